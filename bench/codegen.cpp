@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <malloc.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/stats.hpp>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * codegen throughput and output size over synthetic IR shapes. every
+ * shape is lowered with each backend configuration; the report is one
+ * JSON document so runs can be diffed and tracked over time
+ *
+ *   cdgnx-bench [--scale n] [--rounds n] [--out file] [--trace file]
+ *
+ * --trace writes one more run of every shape and configuration,
+ * instrumented with backend::Stats, as a Chrome trace
+ */
+
+using namespace cdgnx;
+using namespace cdgnx::backend;
+
+namespace
+{
+    /* heap accounting through the replaced operator new/delete below */
+    struct Heap
+    {
+        size_t allocs = 0;
+        size_t live = 0;
+        size_t peak = 0;
+    } heap;
+
+    void *counted(const size_t n)
+    {
+        void *p = std::malloc(n ? n : 1);
+        if (!p)
+            throw std::bad_alloc();
+
+        ++heap.allocs;
+        heap.live += malloc_usable_size(p);
+        heap.peak = std::max(heap.peak, heap.live);
+        return p;
+    }
+
+    void released(void *p)
+    {
+        if (!p)
+            return;
+
+        heap.live -= malloc_usable_size(p);
+        std::free(p);
+    }
+}
+
+void *operator new(const size_t n)
+{
+    return counted(n);
+}
+
+void *operator new[](const size_t n)
+{
+    return counted(n);
+}
+
+void operator delete(void *p) noexcept
+{
+    released(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    released(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    released(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    released(p);
+}
+
+namespace
+{
+    struct Shape
+    {
+        const char *name;
+        std::function<NodeId(IR &, size_t)> build; /* returns a named ROOT */
+    };
+
+    NodeId finish(IR &g, std::vector<NodeId> &body, const char *name)
+    {
+        const NodeId root = g.make(OpType::ROOT, body);
+        g.set_name(root, name);
+        return root;
+    }
+
+    /* balanced integer expression trees, 2^depth leaves each */
+    NodeId deep(IR &g, const size_t scale)
+    {
+        const std::function<NodeId(int, int64_t)> tree = [&](const int depth, const int64_t v) -> NodeId
+        {
+            if (depth == 0)
+                return g.num(v);
+
+            static constexpr OpType ops[] = { OpType::IADD, OpType::ISUB, OpType::IMUL, OpType::BXOR, OpType::BAND };
+            return g.make(ops[(depth + v) % 5], { tree(depth - 1, v * 3 + 1), tree(depth - 1, v * 5 + 2) });
+        };
+
+        std::vector<NodeId> body;
+        for (size_t i = 0; i < scale / 256 + 1; ++i)
+        {
+            body.push_back(tree(8, static_cast<int64_t>(i)));
+            body.push_back(g.make(OpType::POP));
+        }
+        return finish(g, body, "deep");
+    }
+
+    /* a long ROOT of short load/add/store statements */
+    NodeId wide(IR &g, const size_t scale)
+    {
+        std::vector<NodeId> body;
+        for (size_t i = 0; i < scale / 6; ++i)
+        {
+            const Addr slot = Addr::reg("rbp").off(-8 * static_cast<int64_t>(i % 32 + 1));
+            const NodeId src = g.make(OpType::LEA);
+            g.set_addr(src, slot);
+            const NodeId dst = g.make(OpType::LEA);
+            g.set_addr(dst, slot);
+            const NodeId sum = g.make(OpType::IADD, { g.make(OpType::LOAD, { src }), g.num(static_cast<int64_t>(i)) });
+            body.push_back(g.make(OpType::STORE, { dst, sum }));
+        }
+        return finish(g, body, "wide");
+    }
+
+    /* compare and branch between many labels */
+    NodeId branchy(IR &g, const size_t scale)
+    {
+        static constexpr OpType jumps[] = { OpType::JE, OpType::JNE, OpType::JL, OpType::JLE, OpType::JG, OpType::JGE };
+
+        std::vector<NodeId> body;
+        const size_t blocks = scale / 8 + 1;
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            const std::string here = ".Lb" + std::to_string(i);
+            const std::string there = ".Lb" + std::to_string((i * 7 + 3) % blocks);
+            body.push_back(g.label(OpType::LABEL, here));
+            const NodeId lhs = g.make(OpType::IADD, { g.num(static_cast<int64_t>(i)), g.num(1) });
+            body.push_back(g.make(OpType::ICMP, { lhs, g.num(static_cast<int64_t>(blocks / 2)) }));
+            body.push_back(g.label(jumps[i % 6], there));
+        }
+        body.push_back(g.make(OpType::RET, { g.num(0) }));
+        return finish(g, body, "branchy");
+    }
+
+    /* chains of double arithmetic */
+    NodeId floaty(IR &g, const size_t scale)
+    {
+        static constexpr OpType ops[] = { OpType::FADD, OpType::FSUB, OpType::FDIV };
+
+        std::vector<NodeId> body;
+        for (size_t i = 0; i < scale / 16 + 1; ++i)
+        {
+            NodeId acc = g.fnum(1.5 + static_cast<double>(i));
+            for (int k = 0; k < 7; ++k)
+                acc = g.make(ops[(i + k) % 3], { acc, g.fnum(0.25 * (k + 1)) });
+            body.push_back(acc);
+            body.push_back(g.make(OpType::POP));
+        }
+        return finish(g, body, "float");
+    }
+
+    /* nested calls with up to six arguments */
+    NodeId calls(IR &g, const size_t scale)
+    {
+        std::vector<NodeId> body;
+        for (size_t i = 0; i < scale / 12 + 1; ++i)
+        {
+            std::vector<NodeId> args;
+            for (size_t a = 0; a < i % 7; ++a)
+                args.push_back(a % 3 ? g.num(static_cast<int64_t>(a)) : g.make(OpType::IADD, { g.num(1), g.num(2) }));
+
+            const NodeId inner = g.make(OpType::CALL, args);
+            g.set_name(inner, "callee" + std::to_string(i % 16));
+            const NodeId outer = g.make(OpType::CALL, { inner, g.num(static_cast<int64_t>(i)) });
+            g.set_name(outer, "sink");
+            body.push_back(outer);
+            body.push_back(g.make(OpType::POP));
+        }
+        return finish(g, body, "calls");
+    }
+
+    struct Config
+    {
+        const char *name;
+        x86_64::Options opts;
+    };
+
+    std::vector<Config> configs()
+    {
+        x86_64::Options stack;
+        x86_64::Options regs;
+        regs.alloc = x86_64::Alloc::regs;
+        x86_64::Options tidy = regs;
+        tidy.peephole = true;
+        return { { "stack", stack }, { "regs", regs }, { "regs+peephole", tidy } };
+    }
+
+    size_t instructions(const std::string &listing)
+    {
+        size_t n = 0;
+        for (size_t at = listing.find("\n    "); at != std::string::npos; at = listing.find("\n    ", at + 1))
+            ++n;
+        return n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t scale = 200000;
+    int rounds = 5;
+    const char *path = nullptr;
+    const char *trace = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!std::strcmp(argv[i], "--scale"))
+            scale = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--rounds"))
+            rounds = std::max(1, std::atoi(argv[i + 1]));
+        else if (!std::strcmp(argv[i], "--out"))
+            path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--trace"))
+            trace = argv[i + 1];
+    }
+
+    FILE *out = path ? std::fopen(path, "w") : stdout;
+    if (!out)
+        return 1;
+
+    const Shape shapes[] = {
+        { "deep", deep }, { "wide", wide }, { "branchy", branchy }, { "float", floaty }, { "calls", calls }
+    };
+
+    Stats stats;
+    std::fprintf(out, "{\n  \"scale\": %zu,\n  \"rounds\": %d,\n  \"results\": [", scale, rounds);
+    const char *sep = "\n";
+    for (const Shape &shape: shapes)
+    {
+        IR g;
+        const NodeId root = shape.build(g, scale);
+        const auto nodes = static_cast<double>(g.size());
+
+        for (const Config &cfg: configs())
+        {
+            x86_64 backend(cfg.opts);
+
+            /* first run on a fresh backend pays for sizing its reused buffers */
+            heap.allocs = 0;
+            heap.peak = heap.live;
+            const size_t cold_base = heap.live;
+            std::string listing = backend.generate(g, root);
+            const size_t cold_allocs = heap.allocs;
+            const size_t cold_peak = heap.peak - cold_base;
+
+            heap.allocs = 0;
+            heap.peak = heap.live;
+            const size_t base = heap.live;
+            const auto t0 = std::chrono::steady_clock::now();
+            size_t bytes = 0;
+            for (int r = 0; r < rounds; ++r)
+            {
+                listing = backend.generate(g, root);
+                bytes += listing.size();
+            }
+            const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+            const size_t allocs = heap.allocs;
+            const size_t peak = heap.peak - base;
+
+            const size_t text = backend.assemble(g, root).text.size();
+            const double secs = dt.count() / rounds;
+
+            if (trace)
+            {
+                x86_64::Options opts = cfg.opts;
+                opts.stats = &stats;
+                x86_64(opts).generate(g, root);
+            }
+
+            std::fprintf(out,
+                         "%s    {\"shape\": \"%s\", \"config\": \"%s\", \"nodes\": %zu, "
+                         "\"nodes_per_sec\": %.0f, \"bytes_per_sec\": %.0f, \"ms\": %.3f, "
+                         "\"cold_allocs_per_node\": %.6f, \"allocs_per_node\": %.6f, "
+                         "\"cold_peak_heap_bytes\": %zu, \"peak_heap_bytes\": %zu, "
+                         "\"instructions\": %zu, \"text_bytes\": %zu}",
+                         sep, shape.name, cfg.name, g.size(),
+                         nodes / secs, static_cast<double>(bytes) / rounds / secs, secs * 1e3,
+                         static_cast<double>(cold_allocs) / nodes, static_cast<double>(allocs) / rounds / nodes,
+                         cold_peak, peak,
+                         instructions(listing), text);
+            sep = ",\n";
+        }
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (path)
+        std::fclose(out);
+
+    if (trace)
+    {
+        FILE *f = std::fopen(trace, "w");
+        if (!f)
+            return 1;
+
+        Buffer sink;
+        stats.trace(sink);
+        sink.each([f](const std::string_view s) { std::fwrite(s.data(), 1, s.size(), f); });
+        std::fclose(f);
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+#include <cdgnx/buffer.hpp>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * listing throughput: the ostream printer the backend used to have
+ * against mc::print into a reused Buffer, then the whole generate()
+ * path into a string and into a sink that goes straight to /dev/null
+ */
+
+using namespace cdgnx;
+using namespace cdgnx::backend;
+
+namespace
+{
+    constexpr int ROUNDS = 20;
+
+    /* the previous printer, kept here only as the baseline */
+    void legacy_operand(const mc::Code &c, const mc::Inst &i, const mc::Operand &o, std::ostream &os)
+    {
+        const bool shift = i.op == mc::Op::shlq || i.op == mc::Op::shrq || i.op == mc::Op::sarq;
+        switch (o.kind)
+        {
+            case mc::Operand::Kind::reg:
+                os << (shift && &o == &i.a && o.reg == mc::Reg::rcx ? "%cl" : mc::reg_name(o.reg));
+                break;
+
+            case mc::Operand::Kind::imm:
+                os << '$' << o.imm;
+                break;
+
+            case mc::Operand::Kind::sym:
+                os << c.syms[o.sym];
+                break;
+
+            case mc::Operand::Kind::mem:
+                if (o.reg == mc::Reg::rip && o.sym != NONE)
+                {
+                    os << c.syms[o.sym] << "(%rip)";
+                    break;
+                }
+                if (o.imm)
+                    os << o.imm;
+                os << '(' << mc::reg_name(o.reg);
+                if (o.index != mc::Reg::none)
+                    os << ',' << mc::reg_name(o.index) << ',' << static_cast<int>(o.scale);
+                os << ')';
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    std::string legacy_print(const mc::Code &c)
+    {
+        std::stringstream os;
+        for (const mc::Inst &i: c.insts)
+        {
+            if (i.op == mc::Op::label)
+            {
+                os << c.syms[i.a.sym] << ":\n";
+                continue;
+            }
+
+            os << "    " << mc::mnemonic(i.op);
+            if (i.a.kind != mc::Operand::Kind::none)
+            {
+                os << ' ';
+                legacy_operand(c, i, i.a, os);
+            }
+            if (i.b.kind != mc::Operand::Kind::none)
+            {
+                os << ", ";
+                legacy_operand(c, i, i.b, os);
+            }
+            os << '\n';
+        }
+        return os.str();
+    }
+
+    /* a mix shaped like what the stack lowering produces */
+    mc::Code make_code(const size_t n)
+    {
+        using mc::Reg;
+        mc::Code c;
+        const uint32_t str = c.sym(".LC0");
+        for (size_t i = 0; i < n; ++i)
+        {
+            const auto k = static_cast<int64_t>(i);
+            switch (i % 8)
+            {
+                case 0: c.insts.push_back({ mc::Op::label, mc::sym(c.sym(".L" + std::to_string(i))) }); break;
+                case 1: c.insts.push_back({ mc::Op::pushq, mc::imm(k * 7919) }); break;
+                case 2: c.insts.push_back({ mc::Op::movq, mc::mem(Reg::rbp, -8 * (k % 64 + 1)), mc::reg(Reg::rax) }); break;
+                case 3: c.insts.push_back({ mc::Op::addq, mc::reg(Reg::rcx), mc::reg(Reg::rax) }); break;
+                case 4: c.insts.push_back({ mc::Op::leaq, mc::rip(str), mc::reg(Reg::rdi) }); break;
+                case 5: c.insts.push_back({ mc::Op::movq, mc::reg(Reg::rax), mc::mem(Reg::rbx, k % 512, Reg::rsi, 8) }); break;
+                case 6: c.insts.push_back({ mc::Op::popq, mc::reg(Reg::rax) }); break;
+                default: c.insts.push_back({ mc::Op::cqto }); break;
+            }
+        }
+        return c;
+    }
+
+    NodeId make_ir(IR &g, const size_t n)
+    {
+        std::vector<NodeId> body;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const NodeId slot = g.make(OpType::LEA);
+            g.set_addr(slot, Addr::reg("rbp").off(-8 * static_cast<int64_t>(i % 32 + 1)));
+            const NodeId load = g.make(OpType::LOAD, { slot });
+            const NodeId sum = g.make(OpType::IADD, { load, g.num(static_cast<int64_t>(i)) });
+            const NodeId store = g.make(OpType::STORE, { slot, sum });
+            body.push_back(store);
+        }
+        const NodeId root = g.make(OpType::ROOT, body);
+        g.set_name(root, "bench");
+        return root;
+    }
+
+    template<typename F>
+    void measure(const char *what, F &&f)
+    {
+        size_t bytes = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; ++r)
+            bytes += f();
+        const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+        std::printf("%-28s %10.1f MB/s\n", what, static_cast<double>(bytes) / dt.count() / 1e6);
+    }
+}
+
+int main()
+{
+    const int null = open("/dev/null", O_WRONLY);
+    if (null < 0)
+        return 1;
+
+    const mc::Code code = make_code(1 << 18);
+    if (Buffer b; (mc::print(code, b), b.str()) != legacy_print(code))
+    {
+        std::puts("printers disagree");
+        return 1;
+    }
+
+    measure("print: stringstream", [&] { return legacy_print(code).size(); });
+
+    Buffer sink;
+    measure("print: buffer", [&]
+    {
+        sink.clear();
+        mc::print(code, sink);
+        return sink.size();
+    });
+    measure("print: buffer + writev", [&]
+    {
+        sink.clear();
+        mc::print(code, sink);
+        sink.write(null);
+        return sink.size();
+    });
+
+    IR g;
+    const NodeId root = make_ir(g, 1 << 15);
+    x86_64 backend;
+    measure("generate: std::string", [&] { return backend.generate(g, root).size(); });
+    measure("generate: buffer + writev", [&]
+    {
+        sink.clear();
+        backend.generate(g, root, sink);
+        sink.write(null);
+        return sink.size();
+    });
+
+    close(null);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cdgnx
+{
+    /*
+     * append-only text sink made of fixed-size chunks. nothing is moved
+     * once written, so the contents can be handed to writev() or read as
+     * string_views without gathering them into one string first
+     *
+     * the first chunk holds first bytes and every next one twice the
+     * last, up to CHUNK, so a buffer that stays small stays cheap
+     */
+    class Buffer
+    {
+    public:
+        static constexpr size_t CHUNK = 64 * 1024;
+
+        Buffer() = default;
+
+        explicit Buffer(const size_t first) : first(std::max<size_t>(first, 1)) {}
+
+        Buffer(const Buffer &) = delete;
+
+        Buffer &operator=(const Buffer &) = delete;
+
+        /* the source is left empty, its cursor must not point into chunks it gave away */
+        Buffer(Buffer &&o) noexcept
+            : chunks(std::move(o.chunks)), active(std::exchange(o.active, 0)), first(o.first), cur(std::exchange(o.cur, nullptr)),
+              end(std::exchange(o.end, nullptr))
+        {
+            o.chunks.clear();
+        }
+
+        Buffer &operator=(Buffer &&o) noexcept
+        {
+            if (this != &o)
+            {
+                chunks = std::move(o.chunks);
+                o.chunks.clear();
+                active = std::exchange(o.active, 0);
+                first = o.first;
+                cur = std::exchange(o.cur, nullptr);
+                end = std::exchange(o.end, nullptr);
+            }
+            return *this;
+        }
+
+        Buffer &put(const char c)
+        {
+            if (cur == end)
+                grow(1);
+            *cur++ = c;
+            return *this;
+        }
+
+        Buffer &put(std::string_view s)
+        {
+            if (static_cast<size_t>(end - cur) >= s.size())
+            {
+                cur = std::copy(s.begin(), s.end(), cur);
+                return *this;
+            }
+            return put_slow(s);
+        }
+
+        Buffer &put(const int64_t v)
+        {
+            if (end - cur < 20)
+                grow(20);
+            cur = std::to_chars(cur, end, v).ptr;
+            return *this;
+        }
+
+        Buffer &put(const uint64_t v)
+        {
+            if (end - cur < 20)
+                grow(20);
+            cur = std::to_chars(cur, end, v).ptr;
+            return *this;
+        }
+
+        Buffer &put(const int v)
+        {
+            return put(static_cast<int64_t>(v));
+        }
+
+        Buffer &put(const char *s)
+        {
+            return put(std::string_view(s));
+        }
+
+        size_t size() const;
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        /* calls f(std::string_view) for every non-empty chunk, in order */
+        template<typename F>
+        void each(F &&f) const
+        {
+            for (size_t i = 0; i < chunks.size() && i <= active; ++i)
+            {
+                const std::string_view s = span(i);
+                if (!s.empty())
+                    f(s);
+            }
+        }
+
+        /* gathers everything into one string; prefer each() or write() */
+        std::string str() const;
+
+        /* writev()s the whole buffer, retrying short writes; false on error */
+        bool write(int fd) const;
+
+        /* forgets the contents but keeps the chunks for reuse */
+        void clear();
+
+    private:
+        struct Chunk
+        {
+            std::unique_ptr<char[]> data;
+            size_t cap = 0;
+            size_t len = 0;
+        };
+
+        std::vector<Chunk> chunks;
+        size_t active = 0;
+        size_t first = CHUNK;
+        char *cur = nullptr;
+        char *end = nullptr;
+
+        std::string_view span(size_t i) const;
+
+        void grow(size_t n);
+
+        Buffer &put_slow(std::string_view s);
+    };
+}
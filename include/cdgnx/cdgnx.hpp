@@ -62,7 +62,143 @@ namespace cdgnx
         POP,
 
         /* regop */
-        MOV
+        MOV,
+
+        /* vector, shape in the value (VecType::pack) */
+        VLOAD,
+        VSTORE,
+        VADD,
+        VSUB,
+        VMUL,
+        VMIN,
+        VMAX,
+        VAND,
+        VOR,
+        VXOR,
+        VSPLAT,
+        VSUM,
+
+        /* f64 immediate, the value holds its bits */
+        FNUM,
+
+        /* incoming parameter of the function, the value is its position */
+        PARAM,
+
+        /*
+         * compare and branch, the comparison in the value (Compare::pack):
+         * to the name when it holds, else to the strval, or on to the next
+         * statement when that is empty
+         */
+        BR,
+
+        /* 1 when the Compare in the value holds for the operands, 0 otherwise */
+        SET
+    };
+
+    /* lanes of a vector; scalar floating-point values going in or out are doubles */
+    enum class Lane : uint8_t
+    {
+        i32,
+        i64,
+        f32,
+        f64
+    };
+
+    /* shape of a vector value: 16 bytes (xmm) or 32 bytes (ymm, AVX2 only) */
+    struct VecType
+    {
+        Lane lane = Lane::i64;
+        uint8_t bytes = 16;
+
+        /* bytes per lane */
+        constexpr uint32_t size() const
+        {
+            return lane == Lane::i32 || lane == Lane::f32 ? 4 : 8;
+        }
+
+        constexpr uint32_t lanes() const
+        {
+            return bytes / size();
+        }
+
+        constexpr bool fp() const
+        {
+            return lane == Lane::f32 || lane == Lane::f64;
+        }
+
+        constexpr int64_t pack() const
+        {
+            return static_cast<int64_t>(lane) | static_cast<int64_t>(bytes) << 8;
+        }
+
+        static constexpr VecType of(const int64_t v)
+        {
+            return { static_cast<Lane>(v & 0xff), static_cast<uint8_t>(v >> 8 & 0xff) };
+        }
+    };
+
+    /*
+     * SysV signature, packed into the value of a ROOT (the function's own)
+     * or of a CALL (the callee's): how many parameters, which of them are
+     * doubles and whether a double is returned. a CALL takes its count
+     * from its operands
+     */
+    struct Signature
+    {
+        uint8_t params = 0;
+        uint64_t doubles = 0; /* bit i: parameter i is a double, for the first 55 */
+        bool returns_double = false;
+
+        constexpr bool fp(const uint32_t i) const
+        {
+            return i < 55 && (doubles >> i & 1);
+        }
+
+        constexpr int64_t pack() const
+        {
+            return static_cast<int64_t>(params) | int64_t{ returns_double } << 8 | static_cast<int64_t>(doubles << 9);
+        }
+
+        static constexpr Signature of(const int64_t v)
+        {
+            return { static_cast<uint8_t>(v & 0xff), static_cast<uint64_t>(v) >> 9, (v >> 8 & 1) != 0 };
+        }
+    };
+
+    /* condition of a BR or SET on left - right, or on left & right for TEST */
+    enum class Cond : uint8_t
+    {
+        eq,
+        ne,
+        lt,
+        le,
+        gt,
+        ge,
+        ult, /* unsigned; on doubles the same as the signed ones */
+        ule,
+        ugt,
+        uge
+    };
+
+    /*
+     * what a BR or SET compares, packed into its value: the instruction
+     * (ICMP, TEST or FCMP) and the condition. on doubles every condition
+     * but ne is false when an operand is NaN
+     */
+    struct Compare
+    {
+        OpType op = OpType::ICMP;
+        Cond cond = Cond::eq;
+
+        constexpr int64_t pack() const
+        {
+            return static_cast<int64_t>(op) | static_cast<int64_t>(cond) << 8;
+        }
+
+        static constexpr Compare of(const int64_t v)
+        {
+            return { static_cast<OpType>(v & 0xff), static_cast<Cond>(v >> 8 & 0xff) };
+        }
     };
 
     struct Addr
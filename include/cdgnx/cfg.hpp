@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    /*
+     * control-flow graph of the statements of one ROOT. a block starts at
+     * the first statement, at a LABEL and after every JMP, JE..JGE, BR and
+     * RET, and holds a run of statement indices; NONE statements belong to
+     * the block around them. edges follow the jumps and the fall-through
+     *
+     * only top-level statements are looked at. when control flow nodes sit
+     * deeper in a statement, e.g. in a nested ROOT, build() says the graph
+     * is not exact and passes should leave the function alone
+     */
+    class Cfg
+    {
+    public:
+        struct Block
+        {
+            uint32_t first = 0; /* statements [first, last) of the ROOT */
+            uint32_t last = 0;
+            std::vector<uint32_t> preds;
+            std::vector<uint32_t> succs;
+            bool exits = false; /* returns, falls off the end or jumps to a label outside the ROOT */
+        };
+
+        /* rebuilds the graph for root; false when it is not exact, see above */
+        bool build(const IR &g, NodeId root);
+
+        const std::vector<Block> &blocks() const
+        {
+            return bbs;
+        }
+
+        /* block of statement i */
+        uint32_t block_of(const uint32_t i) const
+        {
+            return owner[i];
+        }
+
+        /* block a LABEL called name starts, NONE if the ROOT has none */
+        uint32_t target(StrId name) const;
+
+        /* blocks reachable from the entry, in reverse post-order */
+        const std::vector<uint32_t> &order() const
+        {
+            return rpo;
+        }
+
+        bool reachable(const uint32_t b) const
+        {
+            return seen[b];
+        }
+
+        /* LABEL, the jumps and RET: the statements blocks are cut at */
+        static bool control(OpType t);
+
+        /* ends a block: the jumps and RET */
+        static bool terminator(OpType t);
+
+    private:
+        std::vector<Block> bbs;
+        std::vector<uint32_t> owner;
+        std::unordered_map<StrId, uint32_t> labels;
+        std::vector<uint32_t> rpo;
+        std::vector<uint8_t> seen;
+        std::vector<uint8_t> visited; /* per node, for the exactness scan */
+        std::vector<NodeId> todo;
+
+        void link(uint32_t from, uint32_t to);
+
+        /* true when no control flow node sits below statement n */
+        bool flat(const IR &g, NodeId n);
+
+        void number();
+    };
+}
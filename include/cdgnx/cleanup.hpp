@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <cdgnx/cfg.hpp>
+#include <cdgnx/pass.hpp>
+
+namespace cdgnx
+{
+    /*
+     * control-flow cleanups on the statements of a ROOT, built on Cfg. each
+     * leaves a function whose graph is not exact alone. run them as
+     * Thread, Unreachable, DeadStore: threading leaves labels and blocks
+     * behind that Unreachable then drops
+     *
+     * labels are taken to be local to their ROOT, a LABEL no jump of the
+     * same ROOT refers to is dropped
+     */
+
+    /*
+     * jump threading: a jump to a block that only jumps on is pointed at
+     * the final target, and a JMP or JE..JGE to the statement right after
+     * it is dropped. BR targets are threaded too
+     */
+    class Thread final : public Pass
+    {
+    public:
+        std::string_view name() const override
+        {
+            return "thread";
+        }
+
+        size_t run(IR &g, NodeId root) override;
+
+    private:
+        Cfg cfg;
+
+        /* where a jump to name ends up, following blocks that are a JMP and nothing else */
+        StrId follow(const IR &g, NodeId root, StrId name) const;
+    };
+
+    /* drops the blocks no path from the entry reaches and the labels nothing jumps to */
+    class Unreachable final : public Pass
+    {
+    public:
+        std::string_view name() const override
+        {
+            return "unreachable";
+        }
+
+        size_t run(IR &g, NodeId root) override;
+
+    private:
+        Cfg cfg;
+        std::vector<uint8_t> used; /* per StrId, a jump refers to it */
+    };
+
+    /*
+     * drops a MOV to a frame slot (an rbp-relative LEA) when the same block
+     * writes the slot again before anything could read it, or when a
+     * named ROOT returns first and the slot is below rbp. LOAD, VLOAD,
+     * CALL, PARAM and POP count as reads of any slot. only stores whose
+     * value has no side effects are dropped
+     */
+    class DeadStore final : public Pass
+    {
+    public:
+        std::string_view name() const override
+        {
+            return "dead_store";
+        }
+
+        size_t run(IR &g, NodeId root) override;
+
+    private:
+        Cfg cfg;
+        std::vector<NodeId> todo;
+        std::vector<int64_t> dead; /* offsets written later in the block, before any read */
+    };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cdgnx/const_pool.hpp>
+#include <cdgnx/x86_64_mc.hpp>
+
+namespace cdgnx::backend
+{
+    /*
+     * lowered functions keyed by the structural hash of their ROOT and
+     * the backend options. a hit must also match a second hash and the
+     * node count, so a colliding key is a miss rather than another
+     * function's code. an entry keeps the symbol names it was lowered
+     * with; the backend renames the function's own symbol on a hit and
+     * skips lowering altogether
+     *
+     * the stored bytes stay under a budget, least recently used entries
+     * go first. one cache can be shared by backends on several threads
+     */
+    class CodeCache
+    {
+    public:
+        /* one lowered function, as x86_64 keeps it between lowering and output */
+        struct Entry
+        {
+            mc::Code code;
+            ConstPool pool;
+            std::vector<uint32_t> pool_syms[ConstPool::KINDS];
+            uint32_t fn = NONE;
+
+            /* what the entry holds, an estimate for the budget */
+            size_t bytes() const;
+        };
+
+        /* what an entry is found by: hash picks the slot, all of it has to match */
+        struct Key
+        {
+            uint64_t hash = 0;
+            uint64_t check = 0;
+            uint32_t nodes = 0;
+
+            bool operator==(const Key &) const = default;
+        };
+
+        explicit CodeCache(size_t budget = size_t{ 64 } << 20) : budget(budget) {}
+
+        CodeCache(const CodeCache &) = delete;
+
+        CodeCache &operator=(const CodeCache &) = delete;
+
+        /* copies the entry for key into out and marks it used; false on a miss */
+        bool find(const Key &key, Entry &out);
+
+        /* stores e under key unless it alone is over the budget, evicting as needed */
+        void insert(const Key &key, Entry e);
+
+        uint64_t hits() const;
+
+        uint64_t misses() const;
+
+        uint64_t evictions() const;
+
+        /* entries and the bytes they hold */
+        size_t size() const;
+
+        size_t bytes() const;
+
+        void clear();
+
+    private:
+        struct Slot
+        {
+            Key key;
+            size_t bytes;
+            Entry entry;
+        };
+
+        mutable std::mutex m;
+        std::list<Slot> lru; /* most recently used first */
+        std::unordered_map<uint64_t, std::list<Slot>::iterator> index;
+        size_t budget;
+        size_t used = 0;
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+        uint64_t evicted = 0;
+    };
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <cdgnx/buffer.hpp>
+#include <cdgnx/symtab.hpp>
+
+namespace cdgnx::backend
+{
+    /*
+     * the read-only data of a function or a module: string literals,
+     * 8-byte constants (f64 or i64 bits) and 16- or 32-byte vectors.
+     * entries are interned by their bytes in hashed tables, so an equal
+     * one gets the id the first one got. ids are dense per kind and name
+     * the entry: .LC<id>, .LD<id>, .LV<id>
+     *
+     * the section holds the 32-byte vectors first, then the 16-byte ones,
+     * the quads and the strings, so every entry sits at its alignment
+     * without padding. a string that is the tail of a longer one is not
+     * stored again but points into it, as linkers merge SHF_STRINGS
+     */
+    class ConstPool
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            str,
+            quad,
+            vec
+        };
+
+        static constexpr size_t KINDS = 3;
+
+        struct Layout
+        {
+            std::vector<uint32_t> offsets[KINDS]; /* per kind and id */
+            uint32_t size = 0;
+            uint32_t align = 8;
+        };
+
+        /* s without its NUL */
+        uint32_t str(std::string_view s)
+        {
+            return tabs[0].intern(s);
+        }
+
+        uint32_t quad(int64_t bits);
+
+        /* bytes is 16 or 32 long */
+        uint32_t vec(std::string_view bytes);
+
+        uint32_t intern(Kind k, std::string_view bytes)
+        {
+            return tabs[static_cast<size_t>(k)].intern(bytes);
+        }
+
+        size_t size(const Kind k) const
+        {
+            return tabs[static_cast<size_t>(k)].size();
+        }
+
+        bool empty() const
+        {
+            return !size(Kind::str) && !size(Kind::quad) && !size(Kind::vec);
+        }
+
+        /* the bytes of an entry, a string without its NUL */
+        std::string_view operator()(const Kind k, const uint32_t id) const
+        {
+            return tabs[static_cast<size_t>(k)][id];
+        }
+
+        static std::string_view prefix(Kind k);
+
+        /* where every entry goes; an empty pool has size 0 */
+        void layout(Layout &l) const;
+
+        /* the section contents, as l lays them out */
+        void bytes(const Layout &l, std::vector<uint8_t> &out) const;
+
+        /* the .rodata section as gas source, nothing for an empty pool */
+        void print(Buffer &sink) const;
+
+        size_t footprint() const
+        {
+            return tabs[0].footprint() + tabs[1].footprint() + tabs[2].footprint();
+        }
+
+        void clear();
+
+    private:
+        Symtab tabs[KINDS];
+
+        /* per string id: the id of the string it is the tail of (itself if none) and where in it it starts */
+        void merge(std::vector<uint32_t> &host, std::vector<uint32_t> &at) const;
+    };
+
+    /* s as the inside of a gas string literal: quotes, backslashes and anything unprintable escaped */
+    void escape(std::string_view s, Buffer &out);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <cdgnx/pass.hpp>
+#include <cdgnx/walk.hpp>
+
+namespace cdgnx
+{
+    /*
+     * constant folding and identity simplification for the integer and
+     * bitwise ops: NUM operands are evaluated with the wrap-around and
+     * shift-count semantics of the generated code, and x+0, x*1, x&-1,
+     * x^x and friends collapse to one of their operands or a constant.
+     * operands with side effects are never dropped, and division is left
+     * alone whenever it would trap at run time (x/0, INT64_MIN/-1)
+     *
+     * one post-order walk; a node shared by several parents is visited once
+     */
+    class Fold final : public Pass
+    {
+    public:
+        std::string_view name() const override
+        {
+            return "fold";
+        }
+
+        size_t run(IR &g, NodeId root) override;
+
+    private:
+        struct Info
+        {
+            NodeId repl = NONE; /* what the node was rewritten to, NONE while unvisited */
+            uint32_t size = 0;  /* nodes in the rewritten subtree, counted as a tree */
+            bool pure = false;  /* may be dropped or evaluated fewer times */
+        };
+
+        IR *ir = nullptr;
+        std::vector<Info> info;
+        size_t removed = 0;
+        Walk<uint8_t> walk;
+        std::vector<std::pair<NodeId, NodeId> > pairs; /* same()'s work list */
+
+        void visit(Walk<uint8_t>::Frame &f);
+
+        NodeId simplify(NodeId n);
+
+        NodeId constant(NodeId n, int64_t v);
+
+        NodeId forward(NodeId n, NodeId to);
+
+        bool same(NodeId a, NodeId b);
+    };
+}
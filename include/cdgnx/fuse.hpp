@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cdgnx/pass.hpp>
+#include <cdgnx/walk.hpp>
+
+namespace cdgnx
+{
+    /*
+     * compare-and-branch fusion: an ICMP, TEST or FCMP statement and the
+     * JE..JGE right after it become one BR carrying the condition, and a
+     * JMP right after that becomes the BR's other target. the flags then
+     * no longer have to live from one statement to the next, and FCMP
+     * branches get the NaN-aware conditions of BR
+     *
+     * a compare whose flags a second jump reads as well is left alone.
+     * the jumps that drop out of their ROOT are what run() counts
+     */
+    class Fuse final : public Pass
+    {
+    public:
+        std::string_view name() const override
+        {
+            return "fuse";
+        }
+
+        size_t run(IR &g, NodeId root) override;
+
+    private:
+        Walk<uint8_t> walk;
+    };
+}
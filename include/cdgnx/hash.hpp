@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cdgnx/cdgnx.hpp>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    /*
+     * hash of the tree below n: op, value, address, names, string
+     * contents and operands in order. n's own name is left out and every
+     * other use of it (a recursive call, say) hashes as the same token,
+     * so functions that only differ in their name hash equal. works on
+     * any subtree, not only ROOTs
+     */
+    uint64_t structural_hash(const IR &g, NodeId n);
+
+    uint64_t structural_hash(const Node *n);
+
+    /*
+     * structural_hash, a second hash of the same tree seeded apart from
+     * it, and the number of nodes, from one walk. for telling apart trees
+     * whose structural_hash collides
+     */
+    struct Fingerprint
+    {
+        uint64_t hash = 0;
+        uint64_t check = 0;
+        uint32_t nodes = 0;
+    };
+
+    Fingerprint fingerprint(const IR &g, NodeId n);
+}
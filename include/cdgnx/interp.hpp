@@ -0,0 +1,228 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <cdgnx/jit.hpp>
+#include <cdgnx/module.hpp>
+#include <cdgnx/walk.hpp>
+
+namespace cdgnx
+{
+    /*
+     * reference interpreter: runs the named ROOTs of an IR without
+     * generating code. each function is translated once, up front, into a
+     * flat bytecode, one instruction per node in the order stack mode
+     * evaluates them, operands and results in numbered slots of 8 bytes
+     * (a vector takes VecType::bytes / 8 of them) and jumps resolved to
+     * instruction indexes
+     *
+     * values are what the generated code computes: integers wrap, shifts
+     * count mod 64 and BSHR is logical, doubles and f32 lanes round and
+     * pass NaNs on the way SSE does, and ICMP/TEST/FCMP set the flags of
+     * cmpq/testq/ucomisd for JE..JGE to read. IDIV/IMOD by zero or of
+     * INT64_MIN by -1 trap, where idivq would fault
+     *
+     * memory is one sandbox the interpreter owns. addresses are host
+     * pointers into it, so host functions and native code can use them as
+     * they are, but every LOAD and STORE of interpreted code is checked
+     * against its bounds: below are the strings, read-only, then what
+     * alloc() hands out, and the frames at the top. a frame is laid out
+     * like the native one, rbp-relative LEAs and parameter homes at the
+     * same offsets and PUSHes below the homes, so a MOV to a home changes
+     * the PARAM read from it and a LOAD from an LEA sees what was pushed
+     *
+     * a CALL goes to a function of the IR, or to a host function passed
+     * to define() with the arguments where SysV puts them.
+     * every call that goes through the interpreter is counted, by callee;
+     * with Options::tier_up the function is compiled by a Jit once its
+     * count gets there, and the call that gets there already runs
+     * natively; calls made by native code are not counted. native code
+     * is not sandboxed, so only tier up what may run natively. a function
+     * is compiled after the functions it calls, and stays interpreted
+     * when the backend rejects it, when it calls back into itself through
+     * another function, or when more than 16 of its parameters are passed
+     * on the stack
+     *
+     * traps throw std::runtime_error, IR the interpreter can't run throws
+     * std::invalid_argument. g must outlive the interpreter, and one
+     * interpreter is used by one thread at a time
+     */
+    class Interp
+    {
+    public:
+        struct Options
+        {
+            size_t memory = size_t{ 1 } << 20; /* bytes in the sandbox */
+            size_t stack = size_t{ 1 } << 16;  /* of them, at the top, for frames */
+            uint32_t depth = 1024;             /* calls nested at most */
+            uint64_t tier_up = 0;              /* calls after which a function runs natively, 0: never */
+            backend::x86_64::Options jit;      /* how tiered-up functions are compiled */
+        };
+
+        Interp(const IR &g, std::span<const NodeId> functions) : Interp(g, functions, Options{}) {}
+
+        Interp(const IR &g, std::span<const NodeId> functions, const Options &o);
+
+        explicit Interp(const Module &m) : Interp(m.ir, m.functions()) {}
+
+        Interp(const Module &m, const Options &o) : Interp(m.ir, m.functions(), o) {}
+
+        Interp(const Interp &) = delete;
+
+        Interp &operator=(const Interp &) = delete;
+
+        ~Interp();
+
+        /* a host function CALLs may go to, also for the code tier-up compiles */
+        void define(std::string_view name, void *addr);
+
+        /* calls function name with the bits of its arguments, returns the bits of its result */
+        int64_t call(std::string_view name, std::span<const int64_t> args);
+
+        /* the same with integers, doubles and pointers as they are */
+        template<typename R = int64_t, typename... A>
+        R run(const std::string_view name, const A... args)
+        {
+            const int64_t bits[] = { to_bits(args)..., 0 };
+            const int64_t r = call(name, std::span<const int64_t>(bits, sizeof...(A)));
+            if constexpr (std::is_same_v<R, double>)
+                return std::bit_cast<double>(r);
+            else if constexpr (std::is_pointer_v<R>)
+                return reinterpret_cast<R>(r);
+            else
+                return static_cast<R>(r);
+        }
+
+        /* zeroed bytes in the sandbox, between the strings and the frames */
+        void *alloc(size_t bytes, size_t align = 16);
+
+        std::span<uint8_t> memory() const
+        {
+            return { mem.get(), opts.memory };
+        }
+
+        /* how often the interpreter called function name so far, interpreted or not */
+        uint64_t calls(std::string_view name) const;
+
+        /* function name was tiered up */
+        bool native(std::string_view name) const;
+
+    private:
+        /* one node in evaluation order */
+        struct Insn
+        {
+            OpType op = OpType::NUM;
+            uint16_t shape = 0; /* Compare::pack() of BR and SET, VecType::pack() of vector ops */
+            uint32_t at = 0;    /* slot of the result and of the first operand */
+            uint32_t b = 0;     /* slot of the second operand; CALL: argument count, RET: 1 with a value */
+            int64_t imm = 0;    /* NUM/FNUM: value, STR: address, LEA/PARAM: offset from rbp, jumps: target, CALL: site */
+        };
+
+        static_assert(sizeof(Insn) == 24);
+
+        /* a CALL, its target looked up on first use */
+        struct Site
+        {
+            StrId name = 0;
+            Signature sig;       /* doubles: the arguments passed in xmm registers */
+            uint32_t fn = NONE;  /* a function of the IR */
+            void *host = nullptr;
+        };
+
+        struct Function
+        {
+            NodeId root = NONE;
+            Signature sig;
+            std::vector<Insn> code;
+            std::vector<Site> sites;
+            uint32_t slots = 0;
+            uint32_t frame = 0; /* bytes below rbp */
+            uint32_t homes = 0; /* of them the parameter homes, PUSHes go below */
+            uint64_t calls = 0;
+            void *native = nullptr;
+            bool pinned = false; /* can't be tiered up */
+            bool visiting = false; /* being tiered up, see promote() */
+        };
+
+        /* what post_order() has left in slots while a statement is translated */
+        struct Operand
+        {
+            NodeId node;
+            uint32_t slot;
+            uint32_t width;
+        };
+
+        const IR &ir;
+        Options opts;
+        std::unique_ptr<uint8_t[]> mem;
+        size_t readonly = 0; /* end of the strings */
+        size_t heap = 0;     /* end of what alloc() handed out */
+        size_t sp = 0;       /* lowest frame */
+        uint32_t depth = 0;
+
+        std::vector<Function> fns;
+        std::unordered_map<std::string_view, uint32_t> named; /* views into the IR's strings */
+        std::vector<uint32_t> fn_of; /* by name */
+        std::vector<int64_t> str_at; /* by StrId, 0 until placed */
+        std::unordered_map<std::string, void *> hosts;
+        std::unique_ptr<Jit> jit; /* made on the first tier-up */
+
+        /* kept across calls so running does not allocate */
+        std::vector<int64_t> slots;
+
+        /* translation state */
+        Walk<uint8_t> walk;
+        std::vector<Operand> operands;
+        std::vector<uint32_t> label_at; /* by StrId */
+        std::vector<StrId> labels; /* of the function being translated */
+        std::vector<std::pair<size_t, StrId> > jumps;
+
+        template<typename T>
+        static int64_t to_bits(const T v)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+                return std::bit_cast<int64_t>(static_cast<double>(v));
+            else if constexpr (std::is_pointer_v<T>)
+                return reinterpret_cast<int64_t>(v);
+            else
+                return static_cast<int64_t>(v);
+        }
+
+        uint32_t lookup(std::string_view name) const;
+
+        void translate(Function &f);
+
+        /* one statement of f */
+        void statement(Function &f, NodeId s);
+
+        /* n, once its operands are in slots */
+        void visit(Function &f, NodeId n);
+
+        /* a STR's address, the string placed when first seen */
+        int64_t place(StrId s);
+
+        /* k goes in an xmm register when passed to a CALL of f */
+        bool fp_value(const Function &f, NodeId k) const;
+
+        /* counts the call and runs fn natively or interpreted */
+        int64_t enter(uint32_t fn, const int64_t *args);
+
+        int64_t interpret(uint32_t fn, const int64_t *args);
+
+        /* looks up the target of s once, false if there is none */
+        bool resolve(Site &s) const;
+
+        /* compiles fn and what it calls, false if it has to stay interpreted */
+        bool promote(uint32_t fn);
+
+        /* n bytes at addr, checked against the sandbox */
+        uint8_t *at(int64_t addr, size_t n, bool write);
+    };
+}
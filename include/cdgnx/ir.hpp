@@ -0,0 +1,205 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cdgnx/cdgnx.hpp>
+#include <cdgnx/regs.hpp>
+#include <cdgnx/symtab.hpp>
+
+namespace cdgnx
+{
+    using NodeId = uint32_t;
+    using StrId = SymId;
+
+    /* Addr with its register names resolved once, when it is attached */
+    struct MemRef
+    {
+        int64_t offset = 0;
+        Reg base = Reg::none;
+        Reg index = Reg::none;
+        uint8_t scale = 1;
+    };
+
+    static_assert(sizeof(MemRef) == 16);
+
+    /* one node; operands live in a shared array, payloads in side tables */
+    struct Rec
+    {
+        int64_t value = 0;
+        uint32_t kids = 0;
+        uint32_t nkids = 0;
+        uint32_t extra = NONE;
+        OpType type = OpType::ROOT;
+    };
+
+    static_assert(sizeof(Rec) == 24);
+
+    struct Extra
+    {
+        StrId name = 0;
+        StrId str = 0;
+        uint32_t addr = NONE;
+    };
+
+    /*
+     * arena-style IR: nodes are addressed by 32-bit ids and everything
+     * is stored in a handful of flat arrays, so a whole function is
+     * released (or recycled through clear()) at once
+     *
+     * every node carries a stamp, the generation of the last change to it
+     * or to anything below it. the mutators bump the stamps of n and all
+     * of its ancestors, which is what lets an incremental backend tell
+     * the statements it can keep from the ones it has to lower again
+     */
+    class IR
+    {
+    public:
+        IR();
+
+        NodeId make(OpType t, std::span<const NodeId> kids = {}, int64_t value = 0);
+
+        NodeId make(const OpType t, const std::initializer_list<NodeId> kids, const int64_t value = 0)
+        {
+            return make(t, std::span(kids.begin(), kids.size()), value);
+        }
+
+        NodeId num(const int64_t v)
+        {
+            return make(OpType::NUM, {}, v);
+        }
+
+        NodeId fnum(const double v)
+        {
+            return make(OpType::FNUM, {}, std::bit_cast<int64_t>(v));
+        }
+
+        /* parameter i of the function, see Signature */
+        NodeId param(const uint32_t i)
+        {
+            return make(OpType::PARAM, {}, i);
+        }
+
+        /* a vector op, its shape goes in the value */
+        NodeId vec(const OpType t, const VecType v, const std::initializer_list<NodeId> kids)
+        {
+            return make(t, kids, v.pack());
+        }
+
+        NodeId str(std::string_view s);
+
+        /* BR to taken when c holds for l and r, else to other, or on when other is empty */
+        NodeId branch(Compare c, NodeId l, NodeId r, std::string_view taken, std::string_view other = {});
+
+        NodeId label(OpType t, std::string_view name);
+
+        void set_name(NodeId n, std::string_view s);
+
+        void set_addr(NodeId n, const Addr &a);
+
+        /* the strval, for a BR the label taken when its condition does not hold */
+        void set_str(NodeId n, std::string_view s);
+
+        /* in-place rewriting, for passes */
+        void set_kid(NodeId n, uint32_t i, NodeId k);
+
+        /* turns n into NUM v, dropping its operands */
+        void set_const(NodeId n, int64_t v);
+
+        /* deep-copies a Node tree, returns the id of its root */
+        NodeId import(const Node *n);
+
+        const Rec &operator[](const NodeId n) const
+        {
+            return nodes[n];
+        }
+
+        std::span<const NodeId> kids(const NodeId n) const
+        {
+            const Rec &r = nodes[n];
+            return { ops.data() + r.kids, r.nkids };
+        }
+
+        NodeId kid(const NodeId n, const uint32_t i) const
+        {
+            return ops[nodes[n].kids + i];
+        }
+
+        std::string_view name(NodeId n) const;
+
+        /* interned name: equal names share an id, 0 is the empty name */
+        StrId name_id(NodeId n) const;
+
+        std::string_view strval(NodeId n) const;
+
+        /* interned strval, 0 when there is none */
+        StrId str_id(NodeId n) const;
+
+        const MemRef &addr(NodeId n) const;
+
+        std::string_view string(const StrId s) const
+        {
+            return strs[s];
+        }
+
+        /* number of distinct strings, an upper bound for StrIds */
+        size_t strings() const
+        {
+            return strs.size();
+        }
+
+        size_t size() const
+        {
+            return nodes.size();
+        }
+
+        /*
+         * generation of the last change to n or below it. reading a stamp
+         * closes the current generation, the next change opens a new one;
+         * until then changes share it and stop climbing at ancestors that
+         * are already stamped, so a batch of edits costs one walk up
+         */
+        uint32_t stamp(const NodeId n) const
+        {
+            sealed = true;
+            return stamps[n];
+        }
+
+        /* bytes held by the arrays, including unused capacity */
+        size_t footprint() const;
+
+        void reserve(size_t n, size_t operands);
+
+        void clear();
+
+    private:
+        std::vector<Rec> nodes;
+        std::vector<NodeId> ops;
+        std::vector<Extra> extras;
+        std::vector<MemRef> addrs;
+        Symtab strs;
+
+        /* per node: see stamp(), and the first node that took it as an operand */
+        std::vector<uint32_t> stamps;
+        std::vector<NodeId> parents;
+        std::unordered_multimap<NodeId, NodeId> shared; /* the other parents of a node with several */
+        std::vector<NodeId> climb; /* kept for touch() */
+        uint32_t generation = 0;
+        mutable bool sealed = false;
+
+        StrId store(std::string_view s);
+
+        /* k is an operand of n */
+        void link(NodeId k, NodeId n);
+
+        /* n changed: stamps it and its ancestors with the current generation */
+        void touch(NodeId n);
+
+        Extra &extra(NodeId n);
+    };
+}
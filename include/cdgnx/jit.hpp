@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cdgnx/x86_64.hpp>
+
+namespace cdgnx
+{
+    /*
+     * in-process compiler: encodes a named ROOT, maps it read/write to
+     * patch relocations, then flips it to read/execute before handing out
+     * a pointer. calls are resolved against previously compiled functions
+     * and host symbols registered with define()
+     *
+     * generated code passes call arguments the way the backend does, so
+     * host functions only receive what the lowering puts in registers
+     */
+    class Jit
+    {
+    public:
+        Jit() : Jit(backend::x86_64::Options{}) {}
+
+        /* fmod is predefined, FMOD calls it */
+        explicit Jit(const backend::x86_64::Options &o);
+
+        Jit(const Jit &) = delete;
+
+        Jit &operator=(const Jit &) = delete;
+
+        ~Jit();
+
+        void define(std::string_view name, void *addr);
+
+        /* address of a host symbol or an already compiled function, nullptr if unknown */
+        void *lookup(std::string_view name) const;
+
+        template<typename F>
+        F compile(Node *root)
+        {
+            return reinterpret_cast<F>(compile(root));
+        }
+
+        template<typename F>
+        F compile(const IR &g, const NodeId root)
+        {
+            return reinterpret_cast<F>(compile(g, root));
+        }
+
+        void *compile(Node *root);
+
+        void *compile(const IR &g, NodeId root);
+
+        /* maps an already encoded object and returns the address of its first global symbol */
+        void *load(const backend::mc::Object &o);
+
+    private:
+        struct Region
+        {
+            void *base;
+            size_t size;
+        };
+
+        backend::x86_64 backend;
+        std::unordered_map<std::string, void *> symbols;
+        std::vector<Region> regions;
+    };
+}
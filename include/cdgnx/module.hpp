@@ -0,0 +1,32 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    /* the functions of one translation unit: named ROOTs sharing an IR */
+    class Module
+    {
+    public:
+        IR ir;
+
+        /* registers a ROOT; it needs a name that no other function of the module uses */
+        void add(NodeId root);
+
+        std::span<const NodeId> functions() const
+        {
+            return roots;
+        }
+
+        size_t size() const
+        {
+            return roots.size();
+        }
+
+    private:
+        std::vector<NodeId> roots;
+        std::vector<bool> taken; /* by name */
+    };
+}
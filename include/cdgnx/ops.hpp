@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <cdgnx/cdgnx.hpp>
+
+namespace cdgnx
+{
+    /* what the operands of an op are computed in */
+    enum class OpClass : uint8_t
+    {
+        none,    /* no operands, or bits of either kind */
+        integer,
+        fp,
+        vector
+    };
+
+    /*
+     * backend-independent facts about an OpType. passes and backends read
+     * these instead of keeping their own lists of ops, so describing a new
+     * op starts with one row in OPS
+     */
+    struct OpInfo
+    {
+        static constexpr uint8_t VARIADIC = 0xff; /* any number of operands */
+        static constexpr uint8_t OPTIONAL = 0xfe; /* none or one */
+
+        OpType type;
+        std::string_view name;
+        uint8_t arity;
+        uint8_t first;    /* operands before this one are not evaluated (MOV's destination) */
+        OpClass cls;
+        bool value;       /* leaves a result */
+        bool commutative;
+        bool effects;     /* stores, moves the stack or leaves the function */
+        bool traps;       /* may fault at run time */
+        bool vector;      /* the result is a vector, see VecType */
+
+        /* only computes a value: may be dropped or evaluated fewer times */
+        constexpr bool pure() const
+        {
+            return value && !effects && !traps;
+        }
+
+        /* operands evaluated for a node with nkids kids */
+        constexpr uint32_t operands(const uint32_t nkids) const
+        {
+            if (arity == VARIADIC)
+                return nkids;
+            if (arity == OPTIONAL)
+                return std::min<uint32_t>(nkids, 1);
+            return arity - first;
+        }
+    };
+
+    inline constexpr OpInfo OPS[] = {
+        /* type           name      arity            first class           value  comm   effects traps vector */
+        { OpType::LABEL,  "LABEL",  0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::ROOT,   "ROOT",   OpInfo::VARIADIC, 0, OpClass::none,    false, false, false, false, false },
+        { OpType::NUM,    "NUM",    0,                0, OpClass::none,    true,  false, false, false, false },
+        { OpType::STR,    "STR",    0,                0, OpClass::none,    true,  false, false, false, false },
+        { OpType::IADD,   "IADD",   2,                0, OpClass::integer, true,  true,  false, false, false },
+        { OpType::ISUB,   "ISUB",   2,                0, OpClass::integer, true,  false, false, false, false },
+        { OpType::IMUL,   "IMUL",   2,                0, OpClass::integer, true,  true,  false, false, false },
+        { OpType::IDIV,   "IDIV",   2,                0, OpClass::integer, true,  false, false, true,  false },
+        { OpType::IMOD,   "IMOD",   2,                0, OpClass::integer, true,  false, false, true,  false },
+        { OpType::FADD,   "FADD",   2,                0, OpClass::fp,      true,  true,  false, false, false },
+        { OpType::FSUB,   "FSUB",   2,                0, OpClass::fp,      true,  false, false, false, false },
+        { OpType::FDIV,   "FDIV",   2,                0, OpClass::fp,      true,  false, false, false, false },
+        { OpType::FMOD,   "FMOD",   2,                0, OpClass::fp,      true,  false, false, false, false },
+        { OpType::BAND,   "BAND",   2,                0, OpClass::integer, true,  true,  false, false, false },
+        { OpType::BOR,    "BOR",    2,                0, OpClass::integer, true,  true,  false, false, false },
+        { OpType::BXOR,   "BXOR",   2,                0, OpClass::integer, true,  true,  false, false, false },
+        { OpType::BNOT,   "BNOT",   1,                0, OpClass::integer, true,  false, false, false, false },
+        { OpType::BSHL,   "BSHL",   2,                0, OpClass::integer, true,  false, false, false, false },
+        { OpType::BSHR,   "BSHR",   2,                0, OpClass::integer, true,  false, false, false, false },
+        { OpType::ICMP,   "ICMP",   2,                0, OpClass::integer, false, false, false, false, false },
+        { OpType::FCMP,   "FCMP",   2,                0, OpClass::fp,      false, false, false, false, false },
+        { OpType::TEST,   "TEST",   2,                0, OpClass::integer, false, true,  false, false, false },
+        { OpType::LOAD,   "LOAD",   1,                0, OpClass::integer, true,  false, false, false, false },
+        { OpType::STORE,  "STORE",  2,                0, OpClass::integer, false, false, true,  false, false },
+        { OpType::LEA,    "LEA",    0,                0, OpClass::none,    true,  false, false, false, false },
+        { OpType::CALL,   "CALL",   OpInfo::VARIADIC, 0, OpClass::none,    true,  false, true,  false, false },
+        { OpType::RET,    "RET",    OpInfo::OPTIONAL, 0, OpClass::none,    false, false, true,  false, false },
+        { OpType::JMP,    "JMP",    0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JE,     "JE",     0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JNE,    "JNE",    0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JL,     "JL",     0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JLE,    "JLE",    0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JG,     "JG",     0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::JGE,    "JGE",    0,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::PUSH,   "PUSH",   1,                0, OpClass::none,    false, false, true,  false, false },
+        { OpType::POP,    "POP",    0,                0, OpClass::none,    false, false, true,  false, false },
+        { OpType::MOV,    "MOV",    2,                1, OpClass::integer, false, false, true,  false, false },
+        { OpType::VLOAD,  "VLOAD",  1,                0, OpClass::integer, true,  false, false, false, true },
+        { OpType::VSTORE, "VSTORE", 2,                0, OpClass::vector,  false, false, true,  false, false },
+        { OpType::VADD,   "VADD",   2,                0, OpClass::vector,  true,  true,  false, false, true },
+        { OpType::VSUB,   "VSUB",   2,                0, OpClass::vector,  true,  false, false, false, true },
+        { OpType::VMUL,   "VMUL",   2,                0, OpClass::vector,  true,  true,  false, false, true },
+        { OpType::VMIN,   "VMIN",   2,                0, OpClass::vector,  true,  false, false, false, true },
+        { OpType::VMAX,   "VMAX",   2,                0, OpClass::vector,  true,  false, false, false, true },
+        { OpType::VAND,   "VAND",   2,                0, OpClass::vector,  true,  true,  false, false, true },
+        { OpType::VOR,    "VOR",    2,                0, OpClass::vector,  true,  true,  false, false, true },
+        { OpType::VXOR,   "VXOR",   2,                0, OpClass::vector,  true,  true,  false, false, true },
+        { OpType::VSPLAT, "VSPLAT", 1,                0, OpClass::none,    true,  false, false, false, true },
+        { OpType::VSUM,   "VSUM",   1,                0, OpClass::vector,  true,  false, false, false, false },
+        { OpType::FNUM,   "FNUM",   0,                0, OpClass::none,    true,  false, false, false, false },
+        { OpType::PARAM,  "PARAM",  0,                0, OpClass::none,    true,  false, false, false, false },
+        { OpType::BR,     "BR",     2,                0, OpClass::none,    false, false, false, false, false },
+        { OpType::SET,    "SET",    2,                0, OpClass::none,    true,  false, false, false, false }
+    };
+
+    static_assert(std::size(OPS) == static_cast<size_t>(OpType::SET) + 1, "one row per OpType");
+    static_assert([]
+    {
+        for (size_t i = 0; i < std::size(OPS); ++i)
+            if (OPS[i].type != static_cast<OpType>(i))
+                return false;
+        return true;
+    }(), "OPS rows are in OpType order");
+
+    constexpr const OpInfo &op_info(const OpType t)
+    {
+        return OPS[static_cast<uint8_t>(t)];
+    }
+}
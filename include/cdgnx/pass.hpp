@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    /* a transformation of the IR reachable from one ROOT */
+    class Pass
+    {
+    public:
+        virtual ~Pass() = default;
+
+        virtual std::string_view name() const = 0;
+
+        /* rewrites the tree in place and returns how many nodes dropped out of it */
+        virtual size_t run(IR &g, NodeId root) = 0;
+    };
+
+    struct PassStats
+    {
+        std::string_view name;
+        size_t removed = 0;
+    };
+
+    /* runs its passes in the order they were added */
+    class PassManager
+    {
+    public:
+        PassManager &add(std::unique_ptr<Pass> p);
+
+        template<typename P, typename... Args>
+        PassManager &add(Args &&... args)
+        {
+            return add(std::make_unique<P>(std::forward<Args>(args)...));
+        }
+
+        /* total number of removed nodes; per-pass numbers are in stats() */
+        size_t run(IR &g, NodeId root);
+
+        const std::vector<PassStats> &stats() const
+        {
+            return results;
+        }
+
+    private:
+        std::vector<std::unique_ptr<Pass> > passes;
+        std::vector<PassStats> results;
+    };
+}
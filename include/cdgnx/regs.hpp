@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace cdgnx
+{
+    /* x86_64 registers, numbered the way the encoder wants them */
+    enum class Reg : uint8_t
+    {
+        rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+        r8, r9, r10, r11, r12, r13, r14, r15,
+        xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7,
+        xmm8, xmm9, xmm10, xmm11, xmm12, xmm13, xmm14, xmm15,
+        rip,
+        none
+    };
+
+    /* "rax" or "%rax" to Reg::rax; Reg::none if it is not a 64-bit or xmm register */
+    Reg parse_reg(std::string_view name);
+
+    /* AT&T spelling, "%rax" */
+    const char *reg_name(Reg r);
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cdgnx/buffer.hpp>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/ops.hpp>
+#include <cdgnx/walk.hpp>
+
+/* 0 compiles the backend's recording out, Options::stats is then ignored; set by the CMake option of the same name */
+#ifndef CDGNX_STATS
+#define CDGNX_STATS 1
+#endif
+
+namespace cdgnx::backend
+{
+    /*
+     * what the backend did and where its time went, for one x86_64 at a
+     * time through Options::stats. every function lowered gets a record
+     * of its nodes by OpType and of what came out of them, and every
+     * phase run a timed span on the thread that ran it
+     *
+     * nothing is measured per node or per instruction while lowering:
+     * the tree is counted before and the instructions after, so with
+     * Options::stats unset the backend pays one pointer test per phase,
+     * and built with CDGNX_STATS 0 nothing at all: every test is of a
+     * constant nullptr and Timer is empty. register allocations and
+     * spills are counted whenever recording is built in, and read off
+     * per function
+     */
+    class Stats
+    {
+    public:
+        enum class Phase : uint8_t
+        {
+            import,   /* Node tree into the IR, for the Node entry points */
+            cache,    /* hashing the ROOT and looking it up in Options::cache */
+            lower,    /* instruction selection and allocation, the incremental kind with its peephole runs */
+            peephole, /* mc::Peephole over a function */
+            print,    /* the listing into its sink, .rodata included */
+            copy,     /* the listing out of the backend's Buffer into a std::string */
+            encode,   /* machine code, and for a module the linking of its functions */
+            write     /* the ELF object around it */
+        };
+
+        static constexpr size_t PHASES = 8;
+
+        static constexpr bool ENABLED = CDGNX_STATS != 0;
+
+        static std::string_view name(Phase p);
+
+        struct Function
+        {
+            std::string name; /* of the ROOT, empty for an unnamed one */
+            std::array<uint32_t, std::size(OPS)> nodes{}; /* by OpType, once per path to them like the lowering sees them */
+            uint32_t depth = 0;      /* operands nested at most below the ROOT */
+            bool cached = false;     /* taken from Options::cache instead of lowered */
+            size_t instructions = 0; /* labels not counted */
+            size_t listing = 0;      /* bytes printed */
+            size_t text = 0;         /* bytes of machine code */
+            uint32_t allocs = 0;     /* registers handed out, register mode */
+            uint32_t spills = 0;     /* registers saved on the stack, under pressure or around calls */
+            int64_t stack = 0;       /* most bytes the code keeps below the stack pointer it was entered with */
+        };
+
+        struct Span
+        {
+            Phase phase = Phase::lower;
+            uint32_t function = NONE; /* its record, NONE for a whole module */
+            unsigned thread = 0;
+            uint64_t start = 0; /* ns, steady_clock */
+            uint64_t ns = 0;
+        };
+
+        struct Total
+        {
+            uint64_t calls = 0;
+            uint64_t ns = 0;
+        };
+
+        /* spans are recorded on thread, a worker's index */
+        explicit Stats(const unsigned thread = 0) : thread(thread) {}
+
+        const std::vector<Function> &functions() const
+        {
+            return records;
+        }
+
+        const std::vector<Span> &spans() const
+        {
+            return timeline;
+        }
+
+        Total total(Phase p) const;
+
+        /* the records added up, depth and stack the highest of them */
+        Function sum() const;
+
+        void clear();
+
+        /* records and phase totals as one JSON document */
+        void json(Buffer &sink) const;
+
+        /* the spans in Chrome's trace event format, for chrome://tracing or Perfetto */
+        void trace(Buffer &sink) const;
+
+        /*
+         * the backend's side. enter() starts the record of ROOT n, the
+         * spans that follow are its own until leave(); current() is that
+         * record, nullptr after leave()
+         */
+        uint32_t enter(const IR &g, NodeId n);
+
+        void leave()
+        {
+            open = NONE;
+        }
+
+        Function *current()
+        {
+            return open == NONE ? nullptr : &records[open];
+        }
+
+        Function &function(const uint32_t i)
+        {
+            return records[i];
+        }
+
+        /* the records parts made, in the order of which: part and record index; their spans keep the part's thread */
+        uint32_t merge(std::span<const Stats> parts, std::span<const std::pair<unsigned, uint32_t> > which);
+
+        /* a span of phase p from construction to destruction, when s is set */
+#if CDGNX_STATS
+        class Timer
+        {
+        public:
+            Timer(Stats *s, const Phase p) : s(s), p(p), start(s ? now() : 0) {}
+
+            Timer(const Timer &) = delete;
+
+            Timer &operator=(const Timer &) = delete;
+
+            ~Timer()
+            {
+                if (s)
+                    s->timeline.push_back({ p, s->open, s->thread, start, now() - start });
+            }
+
+        private:
+            Stats *s;
+            Phase p;
+            uint64_t start;
+        };
+#else
+        class Timer
+        {
+        public:
+            Timer(Stats *, Phase) {}
+
+            Timer(const Timer &) = delete;
+
+            Timer &operator=(const Timer &) = delete;
+        };
+#endif
+
+    private:
+        unsigned thread;
+        uint32_t open = NONE;
+        std::vector<Function> records;
+        std::vector<Span> timeline;
+
+        /* counting state, see enter() */
+        Walk<uint8_t> walk;
+        std::vector<uint32_t> depth_of; /* by NodeId, only read after being written */
+
+        static uint64_t now()
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+    };
+}
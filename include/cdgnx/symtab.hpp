@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cdgnx
+{
+    using SymId = uint32_t;
+
+    inline constexpr uint32_t NONE = UINT32_MAX;
+
+    /*
+     * interning table: every distinct string is stored once and named by
+     * a dense 32-bit id, so symbols can be compared, hashed and used as
+     * array indices without touching their characters again
+     */
+    class Symtab
+    {
+    public:
+        /* id of s, adding it if it is new */
+        SymId intern(std::string_view s);
+
+        /* id of s, NONE if it was never interned */
+        SymId find(std::string_view s) const;
+
+        std::string_view operator[](const SymId id) const
+        {
+            const auto &[off, len] = spans[id];
+            return { chars.data() + off, len };
+        }
+
+        size_t size() const
+        {
+            return spans.size();
+        }
+
+        /* bytes held by the arrays, including unused capacity */
+        size_t footprint() const;
+
+        void clear();
+
+    private:
+        std::vector<char> chars;
+        std::vector<std::pair<uint32_t, uint32_t> > spans;
+        std::vector<uint32_t> hashes;
+        std::vector<SymId> slots; /* open addressing, NONE marks a free slot */
+
+        static uint32_t hash(std::string_view s);
+
+        size_t probe(std::string_view s, uint32_t h) const;
+
+        void grow();
+    };
+}
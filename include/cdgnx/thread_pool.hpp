@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cdgnx
+{
+    /*
+     * fixed set of workers for data-parallel loops. every worker starts
+     * on its own contiguous slice of the index space and, once that runs
+     * dry, steals the upper half of whatever another worker has left, so
+     * uneven items still spread out without a shared queue
+     *
+     * the calling thread is worker 0; a pool of one runs everything inline
+     */
+    class ThreadPool
+    {
+    public:
+        /* 0 picks std::thread::hardware_concurrency() */
+        explicit ThreadPool(unsigned threads = 0);
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool();
+
+        unsigned size() const
+        {
+            return static_cast<unsigned>(slices.size());
+        }
+
+        /*
+         * calls f(worker, i) for every i in [0, n) and returns once all
+         * calls are done. worker is below size() and never runs two calls
+         * at once, so it can index per-thread state. the first exception
+         * thrown by f is rethrown here after the loop has drained
+         */
+        void parallel_for(size_t n, const std::function<void(unsigned, size_t)> &f);
+
+    private:
+        struct Slice
+        {
+            std::mutex m;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        std::vector<std::unique_ptr<Slice> > slices;
+        std::vector<std::thread> threads;
+
+        std::mutex m;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        const std::function<void(unsigned, size_t)> *job = nullptr;
+        uint64_t generation = 0;
+        unsigned running = 0;
+        bool stop = false;
+        std::exception_ptr error;
+
+        void loop(unsigned w);
+
+        void work(unsigned w);
+
+        bool take(unsigned w, size_t &i);
+    };
+}
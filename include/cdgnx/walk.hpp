@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    /*
+     * depth-first traversal with an explicit stack, so how deep an
+     * expression may nest is bounded by memory rather than by the stack
+     * of the calling thread. the stack is kept between runs and only
+     * grows, a walker that is reused does not allocate
+     *
+     * a node is handled in steps. step() is called with the node's frame
+     * when it is entered (step 0) and again each time an operand it asked
+     * for with descend() has been finished, with f.step counting up. a
+     * step that does not descend finishes the node; its state is then
+     * what last() returns to the parent
+     */
+    template<typename State>
+    class Walk
+    {
+    public:
+        struct Frame
+        {
+            NodeId node = NONE;
+            uint32_t step = 0;
+            State state{};
+        };
+
+        /* walks from root; a step must not start another run() on the same walker */
+        template<typename Step>
+        void run(const NodeId root, const State &s, Step &&step)
+        {
+            stack.clear(); /* left over if a step threw */
+            stack.push_back({ root, 0, s });
+            while (!stack.empty())
+            {
+                const size_t top = stack.size();
+                step(stack.back());
+                if (stack.size() == top)
+                {
+                    done = stack.back().state;
+                    stack.pop_back();
+                }
+            }
+        }
+
+        /*
+         * from inside a step, at most once and as its last action: enter n
+         * with state s. the frame is pushed right away, so the step's own
+         * frame may have moved once this returns
+         */
+        void descend(const NodeId n, const State &s = {})
+        {
+            ++stack.back().step;
+            stack.push_back({ n, 0, s });
+        }
+
+        /* state of the node finished most recently */
+        State &last()
+        {
+            return done;
+        }
+
+        /*
+         * calls visit(n) for every node below root after all of its
+         * operands, NONE operands are skipped. a node reachable along
+         * several paths is visited once per path
+         */
+        template<typename Visit>
+        void post_order(const IR &g, const NodeId root, Visit &&visit)
+        {
+            if (root == NONE)
+                return;
+
+            /* no steps to resume here, so frames are handled in place */
+            stack.clear();
+            stack.push_back({ root, 0, {} });
+            while (!stack.empty())
+            {
+                Frame &f = stack.back();
+                const Rec &r = g[f.node];
+                if (f.step < r.nkids)
+                {
+                    /* leaves need no frame */
+                    const NodeId k = g.kid(f.node, f.step++);
+                    if (k != NONE && g[k].nkids)
+                        stack.push_back({ k, 0, {} });
+                    else if (k != NONE)
+                        visit(k);
+                    continue;
+                }
+
+                const NodeId n = f.node;
+                stack.pop_back();
+                visit(n);
+            }
+        }
+
+    private:
+        std::vector<Frame> stack;
+        State done{};
+    };
+}
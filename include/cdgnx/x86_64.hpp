@@ -1,29 +1,526 @@
 #pragma once
 
-#include <sstream>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+#include <cdgnx/buffer.hpp>
 #include <cdgnx/cdgnx.hpp>
+#include <cdgnx/code_cache.hpp>
+#include <cdgnx/const_pool.hpp>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/module.hpp>
+#include <cdgnx/ops.hpp>
+#include <cdgnx/stats.hpp>
+#include <cdgnx/walk.hpp>
+#include <cdgnx/x86_64_mc.hpp>
+#include <cdgnx/x86_64_peephole.hpp>
+#include <cdgnx/x86_64_select.hpp>
+
+namespace cdgnx
+{
+    class ThreadPool;
+}
 
 namespace cdgnx::backend
 {
     class x86_64 final : public Backend
     {
     public:
+        /* how intermediate values are kept while lowering expressions */
+        enum class Alloc : uint8_t
+        {
+            stack, /* every value is pushed and popped */
+            regs   /* Sethi-Ullman allocation, spills only under pressure */
+        };
+
+        struct Options
+        {
+            Alloc alloc = Alloc::stack;
+            bool peephole = false; /* clean up every lowered function with mc::Peephole */
+            mc::Peephole::Config peephole_config;
+            bool avx2 = false; /* VEX-encode all SSE code and allow 32-byte vectors; needs an AVX2 CPU */
+            bool reduce = false; /* multiply, divide and modulo by a NUM with shifts, lea and a reciprocal, see x86_64_reduce.cpp */
+            bool select = false; /* register mode: addressing modes, immediates and read-modify-write by tree patterns, see x86_64_select.hpp */
+            CodeCache *cache = nullptr; /* reuse functions lowered before, may be shared; not owned */
+            Stats *stats = nullptr; /* record every function and time every phase, see stats.hpp; not owned, ignored under CDGNX_STATS 0 */
+        };
+
+        /*
+         * what incremental generation keeps of one function between calls:
+         * the instructions of every top-level statement, stamped with the
+         * IR::stamp they were lowered at, and the symbols, strings and
+         * constants they refer to. keep one per function, for as long as
+         * the IR it was built from
+         */
+        struct Unit
+        {
+            struct Piece
+            {
+                NodeId stmt = NONE;
+                uint32_t stamp = 0;
+                bool upper = false; /* writes a ymm register */
+                std::vector<mc::Inst> insts;
+            };
+
+            const IR *ir = nullptr;
+            uint64_t config = 0; /* options it was lowered with, see config() */
+            bool framed = false;
+            int64_t signature = 0; /* of the ROOT, PARAM and RET depend on it */
+            std::vector<Piece> pieces;
+            Symtab syms;
+            ConstPool pool;
+            std::vector<uint32_t> pool_syms[ConstPool::KINDS];
+            uint32_t labels = 0;
+
+            /* statements the last generate() kept and lowered */
+            size_t reused = 0;
+            size_t lowered = 0;
+        };
+
+        x86_64() = default;
+
+        explicit x86_64(const Options &o) : opts(o), peep(o.peephole_config) {}
+
         void gen(Node *n) override;
 
+        void gen(const IR &g, NodeId n);
+
+        /* AT&T listing */
         std::string generate(Node *n) override;
 
+        std::string generate(const IR &g, NodeId n);
+
+        /* appends the listing to sink, no intermediate string is built */
+        void generate(Node *n, Buffer &sink);
+
+        void generate(const IR &g, NodeId n, Buffer &sink);
+
+        /*
+         * the same listing, lowering only the statements of ROOT n whose
+         * stamp moved since the last call with u and splicing them in
+         * between the ones kept. labels, .LC and .LD names stay as they
+         * were; strings of dropped statements stay in .rodata. the
+         * peephole pass runs per statement
+         */
+        std::string generate(const IR &g, NodeId n, Unit &u);
+
+        void generate(const IR &g, NodeId n, Unit &u, Buffer &sink);
+
+        /*
+         * one listing for every function of m, lowered in parallel on
+         * threads workers (0: one per core). labels are made unique per
+         * function and the string literals of all functions share one
+         * .rodata pool; the text is the same for any number of threads
+         */
+        std::string generate_module(const Module &m, unsigned threads = 0);
+
+        void generate_module(const Module &m, Buffer &sink, unsigned threads = 0);
+
+        /* machine code, ready for a linker or the JIT */
+        mc::Object assemble(Node *n);
+
+        mc::Object assemble(const IR &g, NodeId n);
+
+        /*
+         * machine code for every function of m in one object, lowered the
+         * way generate_module does it: .text holds the functions in order,
+         * each 16-byte aligned, and .rodata one pool of constants and
+         * strings. calls between them are left to the linker
+         */
+        mc::Object assemble_module(const Module &m, unsigned threads = 0);
+
+        /* an ELF64 relocatable object of n or of all of m, see mc::write_elf */
+        void write_object(const IR &g, NodeId n, Buffer &sink);
+
+        void write_object(const Module &m, Buffer &sink, unsigned threads = 0);
+
+        /* widest vector the options allow, VecType::bytes */
+        uint8_t vector_bytes() const
+        {
+            return opts.avx2 ? 32 : 16;
+        }
+
+        /* rule hit counters, summed over everything lowered so far */
+        const mc::Peephole &peephole() const
+        {
+            return peep;
+        }
+
     private:
-        std::stringstream out;
-        std::vector<std::string> strs;
-        uint32_t label_counter = 0;
+        using Reg = mc::Reg;
+        using Op = mc::Op;
+        using Operand = mc::Operand;
+        using Inst = mc::Inst;
+
+        /* how a node is lowered: stack mode, or as a statement / value in register mode */
+        enum class Mode : uint8_t
+        {
+            stack,
+            stmt,
+            value
+        };
+
+        /* per-node state of the lowering walk */
+        struct Lowering
+        {
+            Mode mode = Mode::stack;
+            Reg value = Reg::none; /* result of a finished value */
+            Reg first = Reg::none; /* operand evaluated first, see operands() */
+            bool swap = false;
+            bool spilled = false;
+            bool vector = false; /* first was a vector when it was spilled */
+            uint32_t live = 0; /* registers saved around a call */
+            uint32_t live_vecs = 0; /* the ones of them holding vectors */
+            Reg held[select::Matcher::MAX_LEAVES] = { Reg::none, Reg::none, Reg::none }; /* leaves of a matched pattern, see gather() */
+            uint8_t got = 0;
+            uint8_t pushed = 0; /* of them, spilled while a later one was lowered */
+            bool waiting = false; /* descended into the next leaf */
+        };
+
+        using Frame = Walk<Lowering>::Frame;
+
+        /* instruction shape of an op, shared by both allocation modes */
+        enum class Form : uint8_t
+        {
+            special,    /* lowered by hand */
+            operands,   /* nothing left to do once the operands are lowered */
+            binary,     /* op right, left; result in left */
+            shift,      /* binary, with the count in rcx */
+            divide,     /* cqto; op right; result in rax or rdx */
+            unary,      /* op on the only operand */
+            compare,    /* binary that only sets flags */
+            fp,         /* binary on xmm registers */
+            fp_compare, /* fp that only sets flags */
+            jump,       /* op to the node's label */
+            vector      /* see x86_64_vector.cpp */
+        };
+
+        struct Select
+        {
+            Form form;
+            Op op;
+            Reg result; /* register the instruction leaves its result in */
+        };
+
+        /* indexed by OpType like OPS; adding an op of an existing Form is one row here */
+        static constexpr Select SELECT[] = {
+            { Form::special,    Op::nop,     Reg::none }, /* LABEL */
+            { Form::operands,   Op::nop,     Reg::none }, /* ROOT */
+            { Form::special,    Op::nop,     Reg::none }, /* NUM */
+            { Form::special,    Op::nop,     Reg::none }, /* STR */
+            { Form::binary,     Op::addq,    Reg::rax  }, /* IADD */
+            { Form::binary,     Op::subq,    Reg::rax  }, /* ISUB */
+            { Form::binary,     Op::imulq,   Reg::rax  }, /* IMUL */
+            { Form::divide,     Op::idivq,   Reg::rax  }, /* IDIV */
+            { Form::divide,     Op::idivq,   Reg::rdx  }, /* IMOD */
+            { Form::fp,         Op::addsd,   Reg::xmm0 }, /* FADD */
+            { Form::fp,         Op::subsd,   Reg::xmm0 }, /* FSUB */
+            { Form::fp,         Op::divsd,   Reg::xmm0 }, /* FDIV */
+            { Form::special,    Op::nop,     Reg::none }, /* FMOD */
+            { Form::binary,     Op::andq,    Reg::rax  }, /* BAND */
+            { Form::binary,     Op::orq,     Reg::rax  }, /* BOR */
+            { Form::binary,     Op::xorq,    Reg::rax  }, /* BXOR */
+            { Form::unary,      Op::notq,    Reg::rax  }, /* BNOT */
+            { Form::shift,      Op::shlq,    Reg::rax  }, /* BSHL */
+            { Form::shift,      Op::shrq,    Reg::rax  }, /* BSHR */
+            { Form::compare,    Op::cmpq,    Reg::none }, /* ICMP */
+            { Form::fp_compare, Op::ucomisd, Reg::none }, /* FCMP */
+            { Form::compare,    Op::testq,   Reg::none }, /* TEST */
+            { Form::special,    Op::nop,     Reg::none }, /* LOAD */
+            { Form::special,    Op::nop,     Reg::none }, /* STORE */
+            { Form::special,    Op::nop,     Reg::none }, /* LEA */
+            { Form::special,    Op::nop,     Reg::none }, /* CALL */
+            { Form::special,    Op::nop,     Reg::none }, /* RET */
+            { Form::jump,       Op::jmp,     Reg::none }, /* JMP */
+            { Form::jump,       Op::je,      Reg::none }, /* JE */
+            { Form::jump,       Op::jne,     Reg::none }, /* JNE */
+            { Form::jump,       Op::jl,      Reg::none }, /* JL */
+            { Form::jump,       Op::jle,     Reg::none }, /* JLE */
+            { Form::jump,       Op::jg,      Reg::none }, /* JG */
+            { Form::jump,       Op::jge,     Reg::none }, /* JGE */
+            { Form::operands,   Op::nop,     Reg::none }, /* PUSH */
+            { Form::special,    Op::nop,     Reg::none }, /* POP */
+            { Form::special,    Op::nop,     Reg::none }, /* MOV */
+            { Form::vector,     Op::nop,     Reg::none }, /* VLOAD */
+            { Form::vector,     Op::nop,     Reg::none }, /* VSTORE */
+            { Form::vector,     Op::nop,     Reg::none }, /* VADD */
+            { Form::vector,     Op::nop,     Reg::none }, /* VSUB */
+            { Form::vector,     Op::nop,     Reg::none }, /* VMUL */
+            { Form::vector,     Op::nop,     Reg::none }, /* VMIN */
+            { Form::vector,     Op::nop,     Reg::none }, /* VMAX */
+            { Form::vector,     Op::nop,     Reg::none }, /* VAND */
+            { Form::vector,     Op::nop,     Reg::none }, /* VOR */
+            { Form::vector,     Op::nop,     Reg::none }, /* VXOR */
+            { Form::vector,     Op::nop,     Reg::none }, /* VSPLAT */
+            { Form::vector,     Op::nop,     Reg::none }, /* VSUM */
+            { Form::special,    Op::nop,     Reg::none }, /* FNUM */
+            { Form::special,    Op::nop,     Reg::none }, /* PARAM */
+            { Form::special,    Op::nop,     Reg::none }, /* BR */
+            { Form::special,    Op::nop,     Reg::none }  /* SET */
+        };
+
+        static_assert(std::size(SELECT) == std::size(OPS), "one row per OpType");
+
+        /*
+         * packed instruction of VADD..VXOR per Lane; nop where neither SSE2
+         * nor AVX2 has one, those lanes are computed one at a time
+         */
+        static constexpr Op PACKED[][4] = {
+            /* i32         i64         f32         f64 */
+            { Op::paddd,  Op::paddq, Op::addps, Op::addpd }, /* VADD */
+            { Op::psubd,  Op::psubq, Op::subps, Op::subpd }, /* VSUB */
+            { Op::pmulld, Op::nop,   Op::mulps, Op::mulpd }, /* VMUL, pmulld is SSE4.1 */
+            { Op::pminsd, Op::nop,   Op::minps, Op::minpd }, /* VMIN, pminsd is SSE4.1 */
+            { Op::pmaxsd, Op::nop,   Op::maxps, Op::maxpd }, /* VMAX, pmaxsd is SSE4.1 */
+            { Op::pand,   Op::pand,  Op::pand,  Op::pand  }, /* VAND */
+            { Op::por,    Op::por,   Op::por,   Op::por   }, /* VOR */
+            { Op::pxor,   Op::pxor,  Op::pxor,  Op::pxor  }  /* VXOR */
+        };
+
+        static_assert(std::size(PACKED) == static_cast<size_t>(OpType::VXOR) - static_cast<size_t>(OpType::VADD) + 1);
+
+        static constexpr const Select &select(const OpType t)
+        {
+            return SELECT[static_cast<uint8_t>(t)];
+        }
+
+        Options opts;
+        mc::Peephole peep;
+        Buffer out; /* backs the std::string entry points */
+        mc::Code code;
+        ConstPool pool; /* .rodata of the function */
+        std::vector<uint32_t> pool_syms[ConstPool::KINDS]; /* code symbol of every pool entry, by kind and id */
+        uint32_t label_counter = 0; /* .Lu<n> labels of the function, see branch() */
+        const IR *ir = nullptr;
+        IR scratch; /* reused by the Node entry points */
+        bool framed = false;
+        uint32_t fn = NONE; /* symbol of the function being lowered */
+        Signature sig; /* of the function being lowered */
+        std::vector<Reg> places; /* kept for call_sysv() */
+
+        /* IR name -> code symbol, so a name is only hashed once per lowering */
+        std::vector<uint32_t> sym_of;
+        std::vector<StrId> sym_used;
+
+        /* kept across functions so lowering does not allocate per node */
+        Walk<Lowering> walk;
+
+        select::Matcher matcher; /* under Options::select */
+
+        /* register allocator state, see x86_64_regs.cpp */
+        uint32_t free_regs = 0;
+        uint32_t vecs = 0; /* xmm registers holding a vector, they spill at vector_bytes() */
+        std::vector<uint8_t> need;
+        uint64_t allocs = 0; /* registers handed out and spilled so far, for Stats */
+        uint64_t spills = 0;
+
+        bool upper = false; /* a ymm register was written, see lower() */
+
+        /* SSE instructions are VEX encoded under Options::avx2 */
+        void emit(Op op, const Operand &a = {}, const Operand &b = {});
+
+        /* a packed instruction on bytes-wide vectors */
+        void emit_vec(Op op, uint8_t bytes, const Operand &a, const Operand &b = {});
+
+        static Operand format_addr(const MemRef &a);
+
+        uint32_t symbol(StrId s);
+
+        /* the symbol of entry id of the pool, named .LC<id>, .LD<id> or .LV<id> */
+        uint32_t pooled(ConstPool::Kind k, uint32_t id);
+
+        /* the .LC symbol of s in .rodata, one per distinct string */
+        uint32_t literal(std::string_view s);
+
+        /* the .LD symbol of an f64 or i64 in .rodata, one per distinct value */
+        uint32_t constant(int64_t bits);
+
+        /* calls the C function sym with rsp 16-byte aligned; clobbers rax */
+        void call_aligned(uint32_t sym);
+
+        /*
+         * calls CALL n and pops its operands, which were pushed first to
+         * last except the direct() ones; the result is in rax, or xmm0 if
+         * n's Signature returns a double
+         */
+        void call_sysv(NodeId n);
+
+        /* an argument call_sysv() loads into place itself instead of having it pushed */
+        bool direct(NodeId k) const;
+
+        /* loads direct() k into r */
+        void materialize(NodeId k, Reg r);
+
+        /* k is computed as a double: an fp op, FNUM, or a PARAM or CALL typed so */
+        bool fp_value(NodeId k) const;
+
+        /* where PARAM n is kept: its home below rbp, or the caller's frame */
+        Operand param(NodeId n) const;
+
+        /* label, frame and parameter homes of ROOT n, sets framed, fn and sig */
+        void prologue(const IR &g, NodeId n);
+
+        /* closes the frame unless the last statement of n is a RET or JMP, which leaves without it */
+        void epilogue(const IR &g, NodeId n);
+
+        /* n copied into scratch, timed as Stats::Phase::import */
+        NodeId import(Node *n);
+
+        void lower(const IR &g, NodeId n);
+
+        /* lowers only the statements of n that changed since u was last used */
+        void lower(const IR &g, NodeId n, Unit &u);
+
+        struct Fragment; /* one function of a module, see x86_64_module.cpp */
+
+        /* lowers the functions of m into frags on the workers of pool and interns their .rodata into one module-wide pool */
+        void lower_module(const Module &m, ThreadPool &pool, std::vector<Fragment> &frags, ConstPool &rodata);
+
+        /* fills in the Stats record of what was lowered last, given the counters from before */
+        void account(uint64_t allocs_before, uint64_t spills_before);
+
+        /* Options::stats, a constant nullptr when recording is compiled out */
+        Stats *stats() const
+        {
+            if constexpr (Stats::ENABLED)
+                return opts.stats;
+            else
+                return nullptr;
+        }
+
+        /* swaps symbols, strings and constants with the ones kept in u */
+        void trade(Unit &u);
+
+        /* vzeroupper before every call and ret */
+        void clear_upper();
+
+        /* section header, instructions and .rodata of what was lowered last */
+        void print(Buffer &sink) const;
+
+        /* everything in opts that changes the output */
+        uint64_t config() const;
+
+        /* fingerprint of n, both hashes mixed with config() */
+        CodeCache::Key cache_key(const IR &g, NodeId n) const;
+
+        /* takes over a cached lowering of a function called name */
+        void adopt(CodeCache::Entry &e, std::string_view name);
+
+        /* .LD constants, then .LC strings */
+        void gen_rodata(Buffer &sink) const;
+
+        /* points the lowering at g, returns the IR it was on before */
+        const IR *enter(const IR &g);
+
+        /* lowers n and everything below it, after enter() */
+        void gen_tree(NodeId n);
+
+        void step_stack(Frame &f);
+
+        /* dispatches to stack_op<> through a table built from SELECT */
+        void lower_stack(NodeId n);
+
+        /* stack mode for one op once its operands are pushed; Form::special ops are specialized */
+        template<OpType T>
+        void stack_op(NodeId n);
+
+        void step_stmt(Frame &f);
+
+        void step_value(Frame &f);
+
+        void step_call(Frame &f);
+
+        /* IMUL by a NUM, or IDIV/IMOD by a nonzero one, under Options::reduce; c: the NUM's operand index */
+        bool reducible(NodeId n, uint32_t &c) const;
+
+        /* x = x t c with shifts, lea and a high multiply; rax, rcx and rdx are scratch, x may be rax */
+        void reduce(OpType t, int64_t c, Reg x);
+
+        /* the Compare of BR or SET n, checked */
+        Compare comparison(NodeId n) const;
+
+        /* sets the flags c is read from, see x86_64_cond.cpp */
+        void compare(Compare c, Reg l, Reg r);
+
+        /* stack mode: pops both operands and compares them */
+        void stack_compare(Compare c);
+
+        /* the jumps of BR n, after compare() */
+        void branch(NodeId n, Compare c);
+
+        /* 0 or 1 into dst, after compare(); rcx is scratch */
+        void flag(Compare c, Reg dst);
+
+        /* the shape of vector node n, checked against the options */
+        VecType vtype(NodeId n) const;
+
+        /* packed instruction for t on v's lanes, Op::nop if the lanes go one by one */
+        Op packed(OpType t, VecType v) const;
+
+        void stack_vector(NodeId n);
+
+        void step_vector(Frame &f);
+
+        /* dst = dst op src, or lane by lane through the stack */
+        void vector_op(OpType t, VecType v, Reg src, Reg dst);
+
+        /* lane-wise t on the vectors at left(%rsp) and right(%rsp), result at left */
+        void vector_lanes(OpType t, VecType v, int64_t right, int64_t left);
+
+        /* x's low lane, a scalar, into every lane */
+        void splat(VecType v, Reg x);
+
+        /* the .LV symbol of VSPLAT n when it splats a NUM or FNUM, NONE otherwise */
+        uint32_t splat_constant(NodeId n);
+
+        /* sums the low 16 bytes of x into its lowest lane, using xmm1 */
+        void sum(VecType v, Reg x);
+
+        /* lowers a leaf k in place, descends otherwise; true when v already holds k */
+        bool value_of(NodeId k, Reg &v);
+
+        /* the one operand of f.node: true once v holds its value */
+        bool operand(const Frame &f, NodeId k, Reg &v);
+
+        /* both operands of f.node in Sethi-Ullman order, true once l and r hold them */
+        bool operands(Frame &f, const bool fp, Reg &l, Reg &r)
+        {
+            return operands(f, fp, fp, l, r);
+        }
+
+        /* the same, with the register file of each side given separately */
+        bool operands(Frame &f, bool lfp, bool rfp, Reg &l, Reg &r);
+
+        Reg coerce(Reg r, bool fp);
+
+        /* register needs and side effects of everything below n, into need */
+        void measure(NodeId n);
+
+        Reg alloc(bool fp);
+
+        void release(Reg r);
+
+        void spill(Reg r);
+
+        /* vec: r gets back a vector */
+        void restore(Reg r, bool vec = false);
+
+        /* saves the registers in live around a call, lowest first */
+        void spill_all(uint32_t live);
+
+        /* and brings them back, vectors where live_vecs says so */
+        void restore_all(uint32_t live, uint32_t live_vecs);
 
-        std::string new_label();
+        Reg settle(Reg l, Reg r);
 
-        void emit(const std::string &s, bool indent = true);
+        /* lowers f.node by the rule the matcher picked for it as nt; false if it is lowered the plain way */
+        bool step_match(Frame &f, select::Nt nt);
 
-        static std::string format_addr(const Addr &a);
+        /* the count leaves of a pattern into f.state.held, in order, true once all are there */
+        bool gather(Frame &f, const NodeId *leaves, uint8_t count);
 
-        void gen_strings();
+        /* the operand k stands for as nt, taking leaf registers from next */
+        Operand cover(NodeId k, select::Nt nt, const Reg *&next) const;
     };
-}
\ No newline at end of file
+}
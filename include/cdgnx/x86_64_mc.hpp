@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cdgnx/buffer.hpp>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/regs.hpp>
+#include <cdgnx/symtab.hpp>
+
+/*
+ * machine-level view of the x86_64 backend: lowering produces a list of
+ * instructions which is either printed as AT&T text or encoded to bytes
+ */
+namespace cdgnx::backend::mc
+{
+    using cdgnx::Reg;
+    using cdgnx::parse_reg;
+    using cdgnx::reg_name;
+
+    enum class Op : uint8_t
+    {
+        label,
+
+        /* integer */
+        movq,
+        leaq,
+        pushq,
+        popq,
+        addq,
+        subq,
+        imulq,
+        andq,
+        orq,
+        xorq,
+        cmpq,
+        testq,
+        notq,
+        negq,
+        idivq,
+        cqto,
+        shlq,
+        shrq,
+        sarq,
+        movl,
+        movslq,
+        cmovlq,
+        cmovgq,
+        movzbl, /* byte register into the 32-bit one, clearing the upper bits */
+        sete,   /* setcc into a byte register */
+        setne,
+        setl,
+        setle,
+        setg,
+        setge,
+        setb,
+        setbe,
+        seta,
+        setae,
+        setp,
+        setnp,
+
+        /* control */
+        jmp,
+        je,
+        jne,
+        jl,
+        jle,
+        jg,
+        jge,
+        jb,
+        jbe,
+        ja,
+        jae,
+        jp,
+        jnp,
+        call,
+        ret,
+        nop,
+
+        /* sse scalar double */
+        movsd,
+        movapd,
+        addsd,
+        subsd,
+        mulsd,
+        divsd,
+        ucomisd,
+        addss,
+        cvtsd2ss,
+        cvtss2sd,
+
+        /* sse packed, v-prefixed when VEX encoded */
+        movdqu,
+        paddd,
+        paddq,
+        psubd,
+        psubq,
+        pmulld,
+        pminsd,
+        pmaxsd,
+        pand,
+        por,
+        pxor,
+        addps,
+        addpd,
+        subps,
+        subpd,
+        mulps,
+        mulpd,
+        minps,
+        minpd,
+        maxps,
+        maxpd,
+        punpckldq,
+        punpcklqdq,
+        punpckhqdq,
+        psrlq,
+        pbroadcastd, /* VEX only */
+        pbroadcastq, /* VEX only */
+        vzeroupper,
+
+        /* x87 */
+        fldl,
+        fstpl,
+        fprem,
+        fstp
+    };
+
+    struct Operand
+    {
+        enum class Kind : uint8_t
+        {
+            none,
+            reg,
+            imm,
+            mem,
+            sym,
+            st
+        };
+
+        Kind kind = Kind::none;
+        Reg reg = Reg::none; /* register, or the base of a memory operand */
+        Reg index = Reg::none;
+        uint8_t scale = 1;
+        uint32_t sym = NONE; /* label/symbol, or the target of a rip-relative operand */
+        int64_t imm = 0;     /* immediate or displacement */
+    };
+
+    inline Operand reg(const Reg r)
+    {
+        Operand o;
+        o.kind = Operand::Kind::reg;
+        o.reg = r;
+        return o;
+    }
+
+    inline Operand imm(const int64_t v)
+    {
+        Operand o;
+        o.kind = Operand::Kind::imm;
+        o.imm = v;
+        return o;
+    }
+
+    inline Operand mem(const Reg base, const int64_t disp = 0, const Reg index = Reg::none, const uint8_t scale = 1)
+    {
+        Operand o;
+        o.kind = Operand::Kind::mem;
+        o.reg = base;
+        o.index = index;
+        o.scale = scale;
+        o.imm = disp;
+        return o;
+    }
+
+    inline Operand rip(const uint32_t sym)
+    {
+        Operand o = mem(Reg::rip);
+        o.sym = sym;
+        return o;
+    }
+
+    inline Operand sym(const uint32_t id)
+    {
+        Operand o;
+        o.kind = Operand::Kind::sym;
+        o.sym = id;
+        return o;
+    }
+
+    inline Operand st(const uint8_t i)
+    {
+        Operand o;
+        o.kind = Operand::Kind::st;
+        o.imm = i;
+        return o;
+    }
+
+    /*
+     * operands are in AT&T order, a single operand goes in a. a VEX
+     * encoded instruction that takes three operands uses b as both the
+     * destination and the first source
+     */
+    struct Inst
+    {
+        Op op = Op::label;
+        uint8_t vex = 0; /* 16 or 32: VEX encoded on xmm or ymm registers; 0: legacy encoding */
+        Operand a;
+        Operand b;
+
+        Inst() = default;
+
+        Inst(const Op o, const Operand &x = {}, const Operand &y = {}, const uint8_t v = 0) : op(o), vex(v), a(x), b(y) {}
+    };
+
+    /* the instruction list of one lowering run and the symbols it mentions */
+    class Code
+    {
+    public:
+        std::vector<Inst> insts;
+        Symtab syms;
+
+        uint32_t sym(std::string_view name)
+        {
+            return syms.intern(name);
+        }
+
+        void clear();
+    };
+
+    enum class Section : uint8_t
+    {
+        undef,
+        text,
+        rodata
+    };
+
+    struct Symbol
+    {
+        std::string name;
+        Section section = Section::undef;
+        uint32_t offset = 0;
+        uint32_t size = 0; /* of a function, 0 for anything else */
+        bool global = false;
+    };
+
+    struct Reloc
+    {
+        enum class Kind : uint8_t
+        {
+            pc32,
+            plt32
+        };
+
+        uint32_t offset = 0; /* into .text */
+        uint32_t sym = 0;
+        int64_t addend = 0;
+        Kind kind = Kind::pc32;
+    };
+
+    /* encoded function: section contents plus what is left for a linker */
+    struct Object
+    {
+        std::vector<uint8_t> text;
+        std::vector<uint8_t> rodata;
+        uint32_t rodata_align = 8;
+        std::vector<Symbol> syms;
+        std::vector<Reloc> relocs;
+
+        void clear();
+    };
+
+    const char *mnemonic(Op op);
+
+    /* an SSE instruction that has a VEX form; movq only counts when it touches an xmm register */
+    bool has_vex(const Inst &i);
+
+    void print(const Code &c, Buffer &out);
+
+    /* same, but symbol i is spelled names[i] */
+    void print(const Code &c, std::span<const std::string_view> names, Buffer &out);
+
+    /*
+     * encodes c into o.text and fills o.syms with one entry per code
+     * symbol. branches to labels in c get the short form whenever the
+     * displacement fits; references to anything else become relocations
+     */
+    void encode(const Code &c, Object &o);
+
+    /*
+     * o as an ELF64 relocatable object for x86-64, ready for the system
+     * linker: .text, .rodata, .rela.text, the symbol table and an empty
+     * .note.GNU-stack. global symbols become functions and undefined
+     * ones externals; references to local labels point at their
+     * section's symbol plus the label's offset, the way gas emits them
+     */
+    void write_elf(const Object &o, Buffer &out);
+}
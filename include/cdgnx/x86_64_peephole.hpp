@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <cdgnx/x86_64_mc.hpp>
+
+namespace cdgnx::backend::mc
+{
+    /*
+     * sliding-window cleanup of a lowered instruction list. rules only
+     * look at straight-line code: labels, branches, calls and ret end a
+     * window, and a register counts as dead only if it is overwritten
+     * within the window before anything reads it
+     *
+     * flags produced by %rsp adjustments are assumed to be unused
+     */
+    class Peephole
+    {
+    public:
+        enum class Rule : uint8_t
+        {
+            self_move,    /* movq %r, %r */
+            stack_adjust, /* addq $16, %rsp; subq $8, %rsp -> addq $8, %rsp */
+            push_pop,     /* pushq x; ...; popq %r -> movq x, %r */
+            mov_push,     /* movq x, %r; pushq %r -> pushq x, %r dead */
+            forward_mov,  /* movq x, %r; movq %r, y -> movq x, y, %r dead */
+            dead_mov,     /* movq x, %r with %r dead */
+            count
+        };
+
+        static constexpr uint32_t ALL = (1u << static_cast<uint32_t>(Rule::count)) - 1;
+
+        struct Config
+        {
+            uint32_t window = 8; /* instructions a rule may look across */
+            uint32_t rules = ALL; /* bit per Rule */
+            uint32_t rounds = 4; /* passes over the list, later ones catch what earlier rewrites exposed */
+        };
+
+        Peephole() = default;
+
+        explicit Peephole(const Config &c) : cfg(c) {}
+
+        /* rewrites c in place, returns how many instructions went away */
+        size_t run(Code &c);
+
+        /* times a rule fired, summed over every run() */
+        uint64_t hits(const Rule r) const
+        {
+            return counts[static_cast<size_t>(r)];
+        }
+
+        static const char *rule_name(Rule r);
+
+        void reset()
+        {
+            counts.fill(0);
+        }
+
+        /* adds the counters of another instance, e.g. one per thread */
+        void merge(const Peephole &o)
+        {
+            for (size_t r = 0; r < counts.size(); ++r)
+                counts[r] += o.counts[r];
+        }
+
+    private:
+        Config cfg;
+        std::array<uint64_t, static_cast<size_t>(Rule::count)> counts{};
+
+        /* per run() */
+        std::vector<Inst> *insts = nullptr;
+        std::vector<uint8_t> gone;
+
+        bool enabled(Rule r) const;
+
+        size_t next(size_t i) const;
+
+        bool dead(uint64_t regs, size_t from) const;
+
+        bool apply(size_t i);
+
+        bool self_move(size_t i);
+
+        bool stack_adjust(size_t i);
+
+        bool push_pop(size_t i);
+
+        bool mov_push(size_t i);
+
+        bool forward_mov(size_t i);
+
+        bool dead_mov(size_t i);
+    };
+}
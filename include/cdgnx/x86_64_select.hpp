@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/walk.hpp>
+
+/*
+ * tree-pattern instruction selection for register mode, BURS style. a
+ * grammar of rules rewrites IR subtrees into the nonterminals below at
+ * a cost in instructions. label() finds the cheapest cover of every
+ * node bottom-up, for all nonterminals at once, and the backend then
+ * reduces each statement top-down along the rules it picked. a node
+ * that no rule covers more cheaply is lowered the plain way
+ */
+namespace cdgnx::backend::select
+{
+    enum class Nt : uint8_t
+    {
+        reg,   /* a value in a register */
+        imm,   /* a NUM that fits a sign-extended imm32 */
+        shift, /* a NUM 0..63, a shift count */
+        scale, /* a NUM 1, 2, 4 or 8 */
+        log,   /* a NUM 0..3, a shift that is a scale */
+        base,  /* register plus displacement */
+        index, /* register times scale */
+        addr,  /* base + index * scale + displacement */
+        mem,   /* LOAD of an addr, a memory operand */
+        slot,  /* the LEA of a MOV */
+        upd,   /* op of a mem and a reg or imm, the value of a read-modify-write */
+        stmt,
+        none
+    };
+
+    constexpr size_t NTS = static_cast<size_t>(Nt::none);
+
+    /* what a rule does, both when labeling and when the backend reduces it */
+    enum class Act : uint8_t
+    {
+        operand,        /* imm, shift, scale, log, mem or slot, read off the node */
+        based,          /* base <- LEA without an index */
+        fixed,          /* addr <- LEA */
+        disp,           /* base or addr <- IADD(x, imm) */
+        disp_swapped,   /* IADD(imm, x) */
+        disp_neg,       /* ISUB(x, imm) */
+        scaled,         /* index <- IMUL(reg, scale) */
+        scaled_swapped, /* IMUL(scale, reg) */
+        shifted,        /* index <- BSHL(reg, log) */
+        sum,            /* addr <- IADD(base, index) */
+        sum_swapped,    /* IADD(index, base) */
+        alu,            /* reg <- op(reg, imm or mem) */
+        alu_swapped,    /* commutative op(imm or mem, reg) */
+        shift,          /* reg <- BSHL or BSHR(reg, shift) */
+        update,         /* upd <- op(mem, reg or imm) */
+        update_swapped, /* commutative op(reg or imm, mem) */
+        store,          /* STORE(addr, reg or imm) */
+        rmw,            /* STORE(addr, upd) of the same address */
+        mov,            /* MOV(slot, imm) */
+        rmw_slot,       /* MOV(slot, upd) of the same slot */
+        compare,        /* ICMP, TEST, BR or SET of reg or mem and reg, imm or mem */
+        chain_base,     /* base <- reg */
+        chain_index,    /* index <- reg */
+        chain_addr,     /* addr <- base */
+        lea,            /* reg <- addr */
+        load            /* reg <- mem */
+    };
+
+    /* op(kids[0], kids[1]) rewrites to lhs at cost; a chain rule rewrites kids[0] of the same node */
+    struct Rule
+    {
+        Nt lhs;
+        OpType op;
+        Nt kids[2];
+        uint8_t cost;
+        Act act;
+        bool chain = false;
+    };
+
+    /*
+     * a memory operand being built: each register part is either a leaf
+     * the backend lowers into a register or a register a LEA names. only
+     * registers lowering never touches are taken from a LEA: rbp, rbx and
+     * r12..r15
+     */
+    struct Ea
+    {
+        NodeId base = NONE;
+        NodeId index = NONE;
+        Reg fixed = Reg::none;
+        Reg fixed_index = Reg::none;
+        uint8_t scale = 1;
+        bool index_first = false; /* the index leaf comes first in the IR and is lowered first */
+        int32_t disp = 0;
+    };
+
+    class Matcher
+    {
+    public:
+        static constexpr uint8_t MAX_LEAVES = 3;
+
+        /* labels root and everything below it; reduce: IMUL by a NUM is left to strength reduction */
+        void label(const IR &g, NodeId root, bool reduce);
+
+        /* the rule picked for n as nt, nullptr when n is lowered the plain way */
+        const Rule *rule(NodeId n, Nt nt) const;
+
+        /* the operand built for n as base, index or addr */
+        const Ea &ea(NodeId n, Nt nt) const;
+
+        /*
+         * the nodes covering n as nt leaves to be lowered into registers,
+         * in IR order, into out; returns how many, at most MAX_LEAVES
+         */
+        uint8_t leaves(const IR &g, NodeId n, Nt nt, NodeId *out) const;
+
+    private:
+        struct Label
+        {
+            uint16_t cost[NTS];
+            uint8_t rule[NTS];
+            bool effects; /* n or something below it */
+            Ea base;
+            Ea index;
+            Ea addr;
+        };
+
+        std::vector<Label> labels;
+        Walk<uint8_t> walk;
+        std::vector<std::pair<NodeId, NodeId> > pairs; /* scratch of same() */
+
+        void label_node(const IR &g, NodeId n, bool reduce);
+
+        /* checks the rule's conditions on n and builds the operand it yields into e */
+        bool accept(const IR &g, NodeId n, const Rule &r, bool reduce, Ea &e);
+
+        /* a and b compute the same address and nothing below them has effects */
+        bool same(const IR &g, const Ea &a, const Ea &b);
+
+        /* the leaves of e into out at i */
+        static void ea_leaves(const Ea &e, NodeId *out, uint8_t &i);
+
+        void collect(const IR &g, NodeId n, Nt nt, NodeId *out, uint8_t &i) const;
+    };
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <cdgnx/buffer.hpp>
+
+namespace cdgnx
+{
+    size_t Buffer::size() const
+    {
+        size_t n = 0;
+        each([&n](const std::string_view s) { n += s.size(); });
+        return n;
+    }
+
+    std::string Buffer::str() const
+    {
+        std::string s;
+        s.reserve(size());
+        each([&s](const std::string_view part) { s.append(part); });
+        return s;
+    }
+
+    bool Buffer::write(const int fd) const
+    {
+        std::vector<iovec> iov;
+        each([&iov](const std::string_view s)
+        {
+            iov.push_back({ const_cast<char *>(s.data()), s.size() });
+        });
+
+        size_t first = 0;
+        while (first < iov.size())
+        {
+            const int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+            ssize_t n = writev(fd, iov.data() + first, count);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            /* skip what went out, partially written entries are trimmed */
+            while (n > 0 && first < iov.size())
+            {
+                const auto done = std::min<size_t>(static_cast<size_t>(n), iov[first].iov_len);
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + done;
+                iov[first].iov_len -= done;
+                n -= static_cast<ssize_t>(done);
+                if (iov[first].iov_len == 0)
+                    ++first;
+            }
+        }
+        return true;
+    }
+
+    void Buffer::clear()
+    {
+        for (Chunk &c: chunks)
+            c.len = 0;
+
+        active = 0;
+        cur = chunks.empty() ? nullptr : chunks[0].data.get();
+        end = chunks.empty() ? nullptr : cur + chunks[0].cap;
+    }
+
+    std::string_view Buffer::span(const size_t i) const
+    {
+        const Chunk &c = chunks[i];
+        const size_t len = i == active ? static_cast<size_t>(cur - c.data.get()) : c.len;
+        return { c.data.get(), len };
+    }
+
+    void Buffer::grow(const size_t n)
+    {
+        if (!chunks.empty())
+        {
+            chunks[active].len = static_cast<size_t>(cur - chunks[active].data.get());
+            ++active;
+        }
+
+        /* reuse a chunk left over from before clear() if it is big enough */
+        if (active < chunks.size() && chunks[active].cap < n)
+            chunks.erase(chunks.begin() + static_cast<ptrdiff_t>(active), chunks.end());
+        if (active == chunks.size())
+        {
+            Chunk c;
+            c.cap = std::max(chunks.empty() ? first : std::min(CHUNK, 2 * chunks.back().cap), n);
+            c.data = std::make_unique_for_overwrite<char[]>(c.cap);
+            chunks.push_back(std::move(c));
+        }
+
+        cur = chunks[active].data.get();
+        end = cur + chunks[active].cap;
+    }
+
+    Buffer &Buffer::put_slow(std::string_view s)
+    {
+        while (!s.empty())
+        {
+            if (cur == end)
+                grow(1);
+
+            const size_t n = std::min(s.size(), static_cast<size_t>(end - cur));
+            cur = std::copy_n(s.begin(), n, cur);
+            s.remove_prefix(n);
+        }
+        return *this;
+    }
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cdgnx/cfg.hpp>
+
+namespace cdgnx
+{
+    bool Cfg::control(const OpType t)
+    {
+        return t == OpType::LABEL || terminator(t);
+    }
+
+    bool Cfg::terminator(const OpType t)
+    {
+        return t == OpType::JMP || (t >= OpType::JE && t <= OpType::JGE) || t == OpType::BR || t == OpType::RET;
+    }
+
+    bool Cfg::build(const IR &g, const NodeId root)
+    {
+        bbs.clear();
+        labels.clear();
+        const auto kids = g.kids(root);
+        const auto count = static_cast<uint32_t>(kids.size());
+        owner.assign(count, 0);
+        visited.assign(g.size(), 0);
+
+        /* cut the statements into blocks; labels in a row share one */
+        bool exact = true;
+        bool cut = false;
+        bool labels_only = true;
+        bbs.push_back({});
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const NodeId k = kids[i];
+            const OpType t = k == NONE ? OpType::NUM : g[k].type;
+            if (cut || (t == OpType::LABEL && !labels_only))
+            {
+                bbs.back().last = i;
+                bbs.emplace_back().first = i;
+                bbs.back().last = i;
+                cut = false;
+                labels_only = true;
+            }
+
+            owner[i] = static_cast<uint32_t>(bbs.size() - 1);
+            if (k == NONE)
+                continue;
+
+            if (t == OpType::LABEL)
+                labels.try_emplace(g.name_id(k), owner[i]);
+            else
+                labels_only = false;
+            cut = terminator(t);
+            exact = exact && flat(g, k);
+        }
+        bbs.back().last = count;
+
+        for (uint32_t b = 0; b < bbs.size(); ++b)
+        {
+            const auto next = [&]
+            {
+                if (b + 1 < bbs.size())
+                    link(b, b + 1);
+                else
+                    bbs[b].exits = true;
+            };
+            const auto jump = [&](const StrId name)
+            {
+                const uint32_t to = target(name);
+                if (to == NONE)
+                    bbs[b].exits = true;
+                else
+                    link(b, to);
+            };
+
+            /* the last statement decides where control goes */
+            NodeId end = NONE;
+            for (uint32_t i = bbs[b].last; i-- > bbs[b].first && end == NONE;)
+                end = kids[i];
+
+            const OpType t = end == NONE ? OpType::NUM : g[end].type;
+            if (t == OpType::RET)
+                bbs[b].exits = true;
+            else if (t == OpType::JMP)
+                jump(g.name_id(end));
+            else if (t == OpType::BR)
+            {
+                jump(g.name_id(end));
+                if (g.str_id(end) == 0)
+                    next();
+                else
+                    jump(g.str_id(end));
+            }
+            else
+            {
+                if (terminator(t))
+                    jump(g.name_id(end));
+                next();
+            }
+        }
+
+        number();
+        return exact;
+    }
+
+    uint32_t Cfg::target(const StrId name) const
+    {
+        const auto it = labels.find(name);
+        return it == labels.end() ? NONE : it->second;
+    }
+
+    void Cfg::link(const uint32_t from, const uint32_t to)
+    {
+        std::vector<uint32_t> &s = bbs[from].succs;
+        if (std::ranges::find(s, to) != s.end())
+            return;
+        s.push_back(to);
+        bbs[to].preds.push_back(from);
+    }
+
+    bool Cfg::flat(const IR &g, const NodeId n)
+    {
+        todo.assign(g.kids(n).begin(), g.kids(n).end());
+        while (!todo.empty())
+        {
+            const NodeId k = todo.back();
+            todo.pop_back();
+            if (k == NONE || visited[k])
+                continue;
+
+            visited[k] = 1;
+            if (control(g[k].type))
+                return false;
+            todo.insert(todo.end(), g.kids(k).begin(), g.kids(k).end());
+        }
+        return true;
+    }
+
+    void Cfg::number()
+    {
+        /* iterative depth-first search; a block is numbered once all of its successors are */
+        rpo.clear();
+        seen.assign(bbs.size(), 0);
+        std::vector<std::pair<uint32_t, uint32_t> > stack{ { 0, 0 } };
+        seen[0] = 1;
+        while (!stack.empty())
+        {
+            auto &[b, next] = stack.back();
+            if (next < bbs[b].succs.size())
+            {
+                const uint32_t s = bbs[b].succs[next++];
+                if (!seen[s])
+                {
+                    seen[s] = 1;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+        std::ranges::reverse(rpo);
+    }
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cdgnx/cleanup.hpp>
+#include <cdgnx/ops.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        bool is_jump(const OpType t)
+        {
+            return t == OpType::JMP || (t >= OpType::JE && t <= OpType::JGE);
+        }
+
+        /* true if pred holds for a node of the tree at n; todo is scratch */
+        template<typename Pred>
+        bool any(const IR &g, const NodeId n, std::vector<NodeId> &todo, Pred &&pred)
+        {
+            todo.assign(1, n);
+            while (!todo.empty())
+            {
+                const NodeId k = todo.back();
+                todo.pop_back();
+                if (k == NONE)
+                    continue;
+                if (pred(g[k].type))
+                    return true;
+                todo.insert(todo.end(), g.kids(k).begin(), g.kids(k).end());
+            }
+            return false;
+        }
+
+        /* nodes below and including n, counted as a tree */
+        size_t count(const IR &g, const NodeId n, std::vector<NodeId> &todo)
+        {
+            size_t c = 0;
+            any(g, n, todo, [&c](OpType) { ++c; return false; });
+            return c;
+        }
+    }
+
+    size_t Thread::run(IR &g, const NodeId root)
+    {
+        if (root == NONE || !cfg.build(g, root))
+            return 0;
+
+        const uint32_t count = g[root].nkids;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const NodeId k = g.kid(root, i);
+            if (k == NONE || (!is_jump(g[k].type) && g[k].type != OpType::BR))
+                continue;
+
+            const StrId to = follow(g, root, g.name_id(k));
+            if (to != g.name_id(k))
+                g.set_name(k, g.string(to));
+
+            if (g[k].type == OpType::BR && g.str_id(k) != 0)
+            {
+                const StrId other = follow(g, root, g.str_id(k));
+                if (other != g.str_id(k))
+                    g.set_str(k, g.string(other));
+            }
+        }
+
+        /* a jump to the labels right after it goes nowhere */
+        size_t dropped = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const NodeId k = g.kid(root, i);
+            if (k == NONE || !is_jump(g[k].type))
+                continue;
+
+            for (uint32_t j = i + 1; j < count; ++j)
+            {
+                const NodeId l = g.kid(root, j);
+                if (l == NONE)
+                    continue;
+                if (g[l].type != OpType::LABEL)
+                    break;
+                if (g.name_id(l) == g.name_id(k))
+                {
+                    g.set_kid(root, i, NONE);
+                    ++dropped;
+                    break;
+                }
+            }
+        }
+        return dropped;
+    }
+
+    StrId Thread::follow(const IR &g, const NodeId root, const StrId name) const
+    {
+        /* one hop per block at most, more means the chain is a loop */
+        StrId at = name;
+        for (size_t hops = 0; hops <= cfg.blocks().size(); ++hops)
+        {
+            const uint32_t b = cfg.target(at);
+            if (b == NONE)
+                return at;
+
+            NodeId first = NONE;
+            const Cfg::Block &bb = cfg.blocks()[b];
+            for (uint32_t i = bb.first; i < bb.last && first == NONE; ++i)
+            {
+                const NodeId k = g.kid(root, i);
+                if (k != NONE && g[k].type != OpType::LABEL)
+                    first = k;
+            }
+
+            if (first == NONE || g[first].type != OpType::JMP)
+                return at;
+            at = g.name_id(first);
+        }
+        return name;
+    }
+
+    size_t Unreachable::run(IR &g, const NodeId root)
+    {
+        if (root == NONE || !cfg.build(g, root))
+            return 0;
+
+        std::vector<NodeId> todo;
+        size_t dropped = 0;
+        for (uint32_t b = 0; b < cfg.blocks().size(); ++b)
+        {
+            if (cfg.reachable(b))
+                continue;
+
+            for (uint32_t i = cfg.blocks()[b].first; i < cfg.blocks()[b].last; ++i)
+            {
+                const NodeId k = g.kid(root, i);
+                if (k == NONE)
+                    continue;
+                dropped += count(g, k, todo);
+                g.set_kid(root, i, NONE);
+            }
+        }
+
+        /* then the labels the remaining jumps do not name */
+        const uint32_t n = g[root].nkids;
+        used.assign(g.strings(), 0);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const NodeId k = g.kid(root, i);
+            if (k != NONE && (is_jump(g[k].type) || g[k].type == OpType::BR))
+            {
+                used[g.name_id(k)] = 1;
+                used[g.str_id(k)] = 1;
+            }
+        }
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const NodeId k = g.kid(root, i);
+            if (k != NONE && g[k].type == OpType::LABEL && !used[g.name_id(k)])
+            {
+                g.set_kid(root, i, NONE);
+                ++dropped;
+            }
+        }
+        return dropped;
+    }
+
+    size_t DeadStore::run(IR &g, const NodeId root)
+    {
+        if (root == NONE || !cfg.build(g, root))
+            return 0;
+
+        const auto reads = [&](const NodeId n)
+        {
+            return any(g, n, todo, [](const OpType t)
+            {
+                return t == OpType::LOAD || t == OpType::VLOAD || t == OpType::CALL || t == OpType::PARAM || t == OpType::POP;
+            });
+        };
+        const auto removable = [&](const NodeId n)
+        {
+            return n != NONE && !any(g, n, todo, [](const OpType t) { return !op_info(t).pure(); });
+        };
+
+        const bool framed = !g.name(root).empty();
+        size_t dropped = 0;
+        for (const Cfg::Block &b: cfg.blocks())
+        {
+            /* backwards: dead holds the slots written again before the next read */
+            dead.clear();
+            bool frame = false; /* every slot below rbp is dead, the function returns */
+            for (uint32_t i = b.last; i-- > b.first;)
+            {
+                const NodeId k = g.kid(root, i);
+                if (k == NONE)
+                    continue;
+
+                const OpType t = g[k].type;
+                if (t == OpType::RET)
+                {
+                    dead.clear();
+                    frame = framed;
+                }
+                else if (t == OpType::MOV && g[k].nkids == 2)
+                {
+                    const NodeId a = g.kid(k, 0);
+                    const bool slot = a != NONE && g[a].type == OpType::LEA && g.addr(a).base == Reg::rbp && g.addr(a).index == Reg::none;
+                    if (slot)
+                    {
+                        const MemRef &m = g.addr(a);
+                        const bool overwritten = (frame && m.offset < 0) || std::ranges::find(dead, m.offset) != dead.end();
+                        if (overwritten && removable(g.kid(k, 1)))
+                        {
+                            dropped += count(g, k, todo);
+                            g.set_kid(root, i, NONE);
+                            continue;
+                        }
+                        if (!overwritten)
+                            dead.push_back(m.offset);
+                    }
+                }
+
+                if (reads(k))
+                {
+                    dead.clear();
+                    frame = false;
+                }
+            }
+        }
+        return dropped;
+    }
+}
@@ -0,0 +1,94 @@
+#include <utility>
+#include <cdgnx/code_cache.hpp>
+
+namespace cdgnx::backend
+{
+    size_t CodeCache::Entry::bytes() const
+    {
+        size_t n = sizeof(Entry) + code.insts.capacity() * sizeof(mc::Inst) + code.syms.footprint() + pool.footprint();
+        for (const std::vector<uint32_t> &syms: pool_syms)
+            n += syms.capacity() * sizeof(uint32_t);
+        return n;
+    }
+
+    bool CodeCache::find(const Key &key, Entry &out)
+    {
+        std::lock_guard lock(m);
+        const auto it = index.find(key.hash);
+        if (it == index.end() || it->second->key != key)
+        {
+            ++miss_count;
+            return false;
+        }
+
+        ++hit_count;
+        lru.splice(lru.begin(), lru, it->second);
+        out = it->second->entry;
+        return true;
+    }
+
+    void CodeCache::insert(const Key &key, Entry e)
+    {
+        const size_t size = e.bytes();
+        if (size > budget)
+            return;
+
+        std::lock_guard lock(m);
+        if (const auto it = index.find(key.hash); it != index.end())
+        {
+            /* another thread lowered the same function meanwhile, or one that collides keeps its slot */
+            lru.splice(lru.begin(), lru, it->second);
+            return;
+        }
+
+        while (used + size > budget)
+        {
+            used -= lru.back().bytes;
+            index.erase(lru.back().key.hash);
+            lru.pop_back();
+            ++evicted;
+        }
+
+        lru.push_front({ key, size, std::move(e) });
+        index.emplace(key.hash, lru.begin());
+        used += size;
+    }
+
+    uint64_t CodeCache::hits() const
+    {
+        std::lock_guard lock(m);
+        return hit_count;
+    }
+
+    uint64_t CodeCache::misses() const
+    {
+        std::lock_guard lock(m);
+        return miss_count;
+    }
+
+    uint64_t CodeCache::evictions() const
+    {
+        std::lock_guard lock(m);
+        return evicted;
+    }
+
+    size_t CodeCache::size() const
+    {
+        std::lock_guard lock(m);
+        return lru.size();
+    }
+
+    size_t CodeCache::bytes() const
+    {
+        std::lock_guard lock(m);
+        return used;
+    }
+
+    void CodeCache::clear()
+    {
+        std::lock_guard lock(m);
+        lru.clear();
+        index.clear();
+        used = 0;
+    }
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <cdgnx/const_pool.hpp>
+
+namespace cdgnx::backend
+{
+    namespace
+    {
+        constexpr std::string_view PREFIXES[] = { ".LC", ".LD", ".LV" };
+
+        constexpr size_t STR = static_cast<size_t>(ConstPool::Kind::str);
+        constexpr size_t QUAD = static_cast<size_t>(ConstPool::Kind::quad);
+        constexpr size_t VEC = static_cast<size_t>(ConstPool::Kind::vec);
+
+        int64_t quad_at(const std::string_view s, const size_t at)
+        {
+            uint64_t v = 0;
+            for (size_t b = 0; b < 8; ++b)
+                v |= uint64_t{ static_cast<uint8_t>(s[at + b]) } << (8 * b);
+            return static_cast<int64_t>(v);
+        }
+    }
+
+    uint32_t ConstPool::quad(const int64_t bits)
+    {
+        char b[8];
+        for (size_t i = 0; i < 8; ++i)
+            b[i] = static_cast<char>(static_cast<uint64_t>(bits) >> (8 * i));
+        return tabs[QUAD].intern({ b, 8 });
+    }
+
+    uint32_t ConstPool::vec(const std::string_view bytes)
+    {
+        return tabs[VEC].intern(bytes);
+    }
+
+    std::string_view ConstPool::prefix(const Kind k)
+    {
+        return PREFIXES[static_cast<size_t>(k)];
+    }
+
+    void ConstPool::merge(std::vector<uint32_t> &host, std::vector<uint32_t> &at) const
+    {
+        /*
+         * sorted by their reversed bytes, a string is followed by the ones
+         * it is the tail of; walking back, each one is either a tail of the
+         * last string placed or placed itself
+         */
+        const uint32_t n = static_cast<uint32_t>(tabs[STR].size());
+        std::vector<uint32_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::sort(order, [this](const uint32_t a, const uint32_t b)
+        {
+            const std::string_view x = tabs[STR][a];
+            const std::string_view y = tabs[STR][b];
+            return std::lexicographical_compare(x.rbegin(), x.rend(), y.rbegin(), y.rend());
+        });
+
+        host.resize(n);
+        at.assign(n, 0);
+        uint32_t last = NONE;
+        for (uint32_t i = n; i-- > 0;)
+        {
+            const uint32_t id = order[i];
+            const std::string_view s = tabs[STR][id];
+            if (last != NONE && tabs[STR][last].ends_with(s))
+            {
+                host[id] = last;
+                at[id] = static_cast<uint32_t>(tabs[STR][last].size() - s.size());
+                continue;
+            }
+            host[id] = id;
+            last = id;
+        }
+    }
+
+    void ConstPool::layout(Layout &l) const
+    {
+        for (size_t k = 0; k < KINDS; ++k)
+            l.offsets[k].assign(tabs[k].size(), 0);
+        l.align = 8;
+
+        uint32_t at = 0;
+        for (const uint32_t width: { 32u, 16u })
+        {
+            for (uint32_t id = 0; id < tabs[VEC].size(); ++id)
+            {
+                if (tabs[VEC][id].size() != width)
+                    continue;
+                l.offsets[VEC][id] = at;
+                at += width;
+                l.align = std::max(l.align, width);
+            }
+        }
+
+        for (uint32_t id = 0; id < tabs[QUAD].size(); ++id)
+        {
+            l.offsets[QUAD][id] = at;
+            at += 8;
+        }
+
+        std::vector<uint32_t> host, tail;
+        merge(host, tail);
+        for (uint32_t id = 0; id < host.size(); ++id)
+        {
+            if (host[id] != id)
+                continue;
+            l.offsets[STR][id] = at;
+            at += static_cast<uint32_t>(tabs[STR][id].size()) + 1;
+        }
+        for (uint32_t id = 0; id < host.size(); ++id)
+            l.offsets[STR][id] = l.offsets[STR][host[id]] + tail[id];
+        l.size = at;
+    }
+
+    void ConstPool::bytes(const Layout &l, std::vector<uint8_t> &out) const
+    {
+        const size_t base = out.size();
+        out.resize(base + l.size, 0);
+        for (size_t k = 0; k < KINDS; ++k)
+        {
+            /* a merged string copies the tail its host already holds */
+            for (uint32_t id = 0; id < tabs[k].size(); ++id)
+            {
+                const std::string_view s = tabs[k][id];
+                std::memcpy(out.data() + base + l.offsets[k][id], s.data(), s.size());
+            }
+        }
+    }
+
+    void ConstPool::print(Buffer &sink) const
+    {
+        if (empty())
+            return;
+
+        uint64_t align = 8;
+        for (uint32_t id = 0; id < tabs[VEC].size(); ++id)
+            align = std::max<uint64_t>(align, tabs[VEC][id].size());
+
+        const auto label = [&sink](const size_t k, const uint32_t id)
+        {
+            sink.put(PREFIXES[k]).put(static_cast<uint64_t>(id)).put(":\n");
+        };
+
+        sink.put(".section .rodata\n.align ").put(align).put('\n');
+        for (const size_t width: { 32u, 16u })
+        {
+            for (uint32_t id = 0; id < tabs[VEC].size(); ++id)
+            {
+                const std::string_view v = tabs[VEC][id];
+                if (v.size() != width)
+                    continue;
+                label(VEC, id);
+                sink.put(".quad ").put(quad_at(v, 0));
+                for (size_t b = 8; b < width; b += 8)
+                    sink.put(", ").put(quad_at(v, b));
+                sink.put('\n');
+            }
+        }
+
+        for (uint32_t id = 0; id < tabs[QUAD].size(); ++id)
+        {
+            label(QUAD, id);
+            sink.put(".quad ").put(quad_at(tabs[QUAD][id], 0)).put('\n');
+        }
+
+        /* a host string is cut where its tails start, each tail gets its label there */
+        std::vector<uint32_t> host, tail;
+        merge(host, tail);
+        std::vector<std::pair<uint32_t, uint32_t> > tails; /* host, id */
+        for (uint32_t id = 0; id < host.size(); ++id)
+        {
+            if (host[id] != id)
+                tails.emplace_back(host[id], id);
+        }
+        std::ranges::sort(tails, [&tail](const auto &a, const auto &b)
+        {
+            return a.first != b.first ? a.first < b.first : tail[a.second] < tail[b.second];
+        });
+
+        auto next = tails.begin();
+        for (uint32_t id = 0; id < host.size(); ++id)
+        {
+            if (host[id] != id)
+                continue;
+
+            const std::string_view s = tabs[STR][id];
+            size_t done = 0;
+            label(STR, id);
+            for (; next != tails.end() && next->first == id; ++next)
+            {
+                const uint32_t cut = tail[next->second];
+                if (cut > done)
+                {
+                    sink.put(".ascii \"");
+                    escape(s.substr(done, cut - done), sink);
+                    sink.put("\"\n");
+                    done = cut;
+                }
+                label(STR, next->second);
+            }
+            sink.put(".string \"");
+            escape(s.substr(done), sink);
+            sink.put("\"\n");
+        }
+    }
+
+    void ConstPool::clear()
+    {
+        for (Symtab &t: tabs)
+            t.clear();
+    }
+
+    void escape(const std::string_view s, Buffer &out)
+    {
+        size_t plain = 0;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            const auto c = static_cast<uint8_t>(s[i]);
+            if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\')
+                continue;
+
+            out.put(s.substr(plain, i - plain));
+            plain = i + 1;
+            switch (c)
+            {
+                case '"': out.put("\\\""); break;
+                case '\\': out.put("\\\\"); break;
+                case '\n': out.put("\\n"); break;
+                case '\t': out.put("\\t"); break;
+                default:
+                {
+                    /* always three digits, a digit after it is not read as part of the escape */
+                    const char oct[] = { '\\', static_cast<char>('0' + (c >> 6)), static_cast<char>('0' + (c >> 3 & 7)), static_cast<char>('0' + (c & 7)) };
+                    out.put(std::string_view(oct, sizeof(oct)));
+                    break;
+                }
+            }
+        }
+        out.put(s.substr(plain));
+    }
+}
@@ -0,0 +1,243 @@
+#include <cdgnx/fold.hpp>
+#include <cdgnx/ops.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        /* two integer operands and a result */
+        bool binary(const OpType t)
+        {
+            const OpInfo &i = op_info(t);
+            return i.arity == 2 && i.value && i.cls == OpClass::integer;
+        }
+
+        /* idivq faults on both of these, so they must reach run time unchanged */
+        bool traps(const int64_t a, const int64_t b)
+        {
+            return b == 0 || (a == INT64_MIN && b == -1);
+        }
+    }
+
+    size_t Fold::run(IR &g, const NodeId root)
+    {
+        ir = &g;
+        removed = 0;
+        info.assign(g.size(), {});
+        if (root != NONE)
+            walk.run(root, {}, [this](Walk<uint8_t>::Frame &f) { visit(f); });
+        ir = nullptr;
+        return removed;
+    }
+
+    void Fold::visit(Walk<uint8_t>::Frame &f)
+    {
+        const NodeId n = f.node;
+        if (f.step == 0 && info[n].repl != NONE)
+            return;
+
+        /* operands first, a shared one is only folded the first time */
+        const auto kids = ir->kids(n);
+        while (f.step < kids.size() && (kids[f.step] == NONE || info[kids[f.step]].repl != NONE))
+            ++f.step;
+        if (f.step < kids.size())
+        {
+            walk.descend(kids[f.step]);
+            return;
+        }
+
+        uint32_t size = 1;
+        bool pure = op_info((*ir)[n].type).pure();
+        for (uint32_t i = 0; i < kids.size(); ++i)
+        {
+            const NodeId k = kids[i];
+            if (k == NONE)
+                continue;
+
+            const NodeId r = info[k].repl;
+            if (r != k)
+                ir->set_kid(n, i, r);
+            if (r == NONE)
+                continue;
+
+            size += info[r].size;
+            pure = pure && info[r].pure;
+        }
+
+        /* division stays pure only when its divisor is a constant that cannot trap */
+        const Rec &rec = (*ir)[n];
+        if ((rec.type == OpType::IDIV || rec.type == OpType::IMOD) && rec.nkids == 2 && kids[0] != NONE && kids[1] != NONE)
+        {
+            const Rec &d = (*ir)[kids[1]];
+            pure = pure || (info[kids[0]].pure && d.type == OpType::NUM && d.value != 0 && d.value != -1);
+        }
+
+        info[n] = { n, size, pure };
+        info[n].repl = simplify(n);
+    }
+
+    NodeId Fold::simplify(const NodeId n)
+    {
+        const Rec &rec = (*ir)[n];
+        const OpType t = rec.type;
+
+        if (t == OpType::BNOT && rec.nkids == 1 && ir->kid(n, 0) != NONE)
+        {
+            const NodeId x = ir->kid(n, 0);
+            const Rec &k = (*ir)[x];
+            if (k.type == OpType::NUM)
+                return constant(n, ~k.value);
+            if (k.type == OpType::BNOT && k.nkids == 1 && ir->kid(x, 0) != NONE)
+                return forward(n, ir->kid(x, 0));
+            return n;
+        }
+
+        if (!binary(t) || rec.nkids != 2 || ir->kid(n, 0) == NONE || ir->kid(n, 1) == NONE)
+            return n;
+
+        const NodeId a = ir->kid(n, 0);
+        const NodeId b = ir->kid(n, 1);
+        const bool ca = (*ir)[a].type == OpType::NUM;
+        const bool cb = (*ir)[b].type == OpType::NUM;
+        const int64_t va = (*ir)[a].value;
+        const int64_t vb = (*ir)[b].value;
+        const auto ua = static_cast<uint64_t>(va);
+        const auto ub = static_cast<uint64_t>(vb);
+
+        if (ca && cb)
+        {
+            switch (t)
+            {
+                case OpType::IADD: return constant(n, static_cast<int64_t>(ua + ub));
+                case OpType::ISUB: return constant(n, static_cast<int64_t>(ua - ub));
+                case OpType::IMUL: return constant(n, static_cast<int64_t>(ua * ub));
+                case OpType::IDIV: return traps(va, vb) ? n : constant(n, va / vb);
+                case OpType::IMOD: return traps(va, vb) ? n : constant(n, va % vb);
+                case OpType::BAND: return constant(n, va & vb);
+                case OpType::BOR: return constant(n, va | vb);
+                case OpType::BXOR: return constant(n, va ^ vb);
+                case OpType::BSHL: return constant(n, static_cast<int64_t>(ua << (ub & 63)));
+                case OpType::BSHR: return constant(n, static_cast<int64_t>(ua >> (ub & 63)));
+                default: return n;
+            }
+        }
+
+        /* for commutative ops: c is the constant operand, x the other one */
+        const bool one = ca || cb;
+        const int64_t c = cb ? vb : va;
+        const NodeId x = cb ? a : b;
+
+        switch (t)
+        {
+            case OpType::IADD:
+            case OpType::BXOR:
+                if (one && c == 0)
+                    return forward(n, x);
+                if (t == OpType::BXOR && same(a, b))
+                    return constant(n, 0);
+                break;
+
+            case OpType::ISUB:
+                if (cb && vb == 0)
+                    return forward(n, a);
+                if (same(a, b))
+                    return constant(n, 0);
+                break;
+
+            case OpType::IMUL:
+                if (one && c == 1)
+                    return forward(n, x);
+                if (one && c == 0 && info[x].pure)
+                    return constant(n, 0);
+                break;
+
+            case OpType::IDIV:
+                if (cb && vb == 1)
+                    return forward(n, a);
+                break;
+
+            case OpType::IMOD:
+                if (cb && (vb == 1 || vb == -1) && info[a].pure)
+                    return constant(n, 0);
+                break;
+
+            case OpType::BAND:
+                if (one && c == -1)
+                    return forward(n, x);
+                if (one && c == 0 && info[x].pure)
+                    return constant(n, 0);
+                if (same(a, b))
+                    return forward(n, a);
+                break;
+
+            case OpType::BOR:
+                if (one && c == 0)
+                    return forward(n, x);
+                if (one && c == -1 && info[x].pure)
+                    return constant(n, -1);
+                if (same(a, b))
+                    return forward(n, a);
+                break;
+
+            case OpType::BSHL:
+            case OpType::BSHR:
+                if (cb && (vb & 63) == 0)
+                    return forward(n, a);
+                if (ca && va == 0 && info[b].pure)
+                    return constant(n, 0);
+                break;
+
+            default:
+                break;
+        }
+        return n;
+    }
+
+    NodeId Fold::constant(const NodeId n, const int64_t v)
+    {
+        removed += info[n].size - 1;
+        ir->set_const(n, v);
+        info[n].size = 1;
+        info[n].pure = true;
+        return n;
+    }
+
+    NodeId Fold::forward(const NodeId n, const NodeId to)
+    {
+        removed += info[n].size - info[to].size;
+        return to;
+    }
+
+    bool Fold::same(const NodeId a, const NodeId b)
+    {
+        pairs.clear();
+        pairs.emplace_back(a, b);
+        while (!pairs.empty())
+        {
+            const auto [x, y] = pairs.back();
+            pairs.pop_back();
+
+            if (x == NONE || y == NONE || !info[x].pure || !info[y].pure)
+                return false;
+            if (x == y)
+                continue;
+
+            const Rec &p = (*ir)[x];
+            const Rec &q = (*ir)[y];
+            if (p.type != q.type || p.value != q.value || p.nkids != q.nkids)
+                return false;
+            if (ir->name_id(x) != ir->name_id(y) || ir->strval(x) != ir->strval(y))
+                return false;
+
+            const MemRef &mx = ir->addr(x);
+            const MemRef &my = ir->addr(y);
+            if (mx.offset != my.offset || mx.base != my.base || mx.index != my.index || mx.scale != my.scale)
+                return false;
+
+            /* reversed, so operands are compared left to right */
+            for (uint32_t i = p.nkids; i-- > 0;)
+                pairs.emplace_back(ir->kid(x, i), ir->kid(y, i));
+        }
+        return true;
+    }
+}
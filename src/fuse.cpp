@@ -0,0 +1,66 @@
+#include <cdgnx/fuse.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        static_assert(static_cast<int>(OpType::JGE) - static_cast<int>(OpType::JE) == static_cast<int>(Cond::ge),
+                      "JE..JGE are in Cond order");
+
+        bool is_compare(const IR &g, const NodeId k)
+        {
+            if (k == NONE || g[k].nkids != 2)
+                return false;
+            const OpType t = g[k].type;
+            return t == OpType::ICMP || t == OpType::TEST || t == OpType::FCMP;
+        }
+
+        bool is_jcc(const IR &g, const NodeId k)
+        {
+            return k != NONE && g[k].type >= OpType::JE && g[k].type <= OpType::JGE;
+        }
+
+        /* fuses the statements of ROOT n, returns how many of them were dropped */
+        size_t fuse(IR &g, const NodeId n)
+        {
+            size_t dropped = 0;
+            const uint32_t count = g[n].nkids;
+            const auto at = [&](const uint32_t i) { return i < count ? g.kid(n, i) : NONE; };
+
+            for (uint32_t i = 0; i + 1 < count; ++i)
+            {
+                const NodeId cmp = at(i);
+                const NodeId jcc = at(i + 1);
+                if (!is_compare(g, cmp) || !is_jcc(g, jcc) || is_jcc(g, at(i + 2)))
+                    continue;
+
+                const NodeId jmp = at(i + 2);
+                const bool other = jmp != NONE && g[jmp].type == OpType::JMP;
+                const Compare c{ g[cmp].type, static_cast<Cond>(static_cast<int>(g[jcc].type) - static_cast<int>(OpType::JE)) };
+                const NodeId br = g.branch(c, g.kid(cmp, 0), g.kid(cmp, 1), g.name(jcc), other ? g.name(jmp) : std::string_view());
+
+                g.set_kid(n, i, br);
+                g.set_kid(n, i + 1, NONE);
+                ++dropped;
+                if (other)
+                {
+                    g.set_kid(n, i + 2, NONE);
+                    ++dropped;
+                }
+                i += other ? 2 : 1;
+            }
+            return dropped;
+        }
+    }
+
+    size_t Fuse::run(IR &g, const NodeId root)
+    {
+        size_t dropped = 0;
+        walk.post_order(g, root, [&](const NodeId n)
+        {
+            if (g[n].type == OpType::ROOT)
+                dropped += fuse(g, n);
+        });
+        return dropped;
+    }
+}
@@ -0,0 +1,93 @@
+#include <functional>
+#include <string_view>
+#include <cdgnx/hash.hpp>
+#include <cdgnx/walk.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        constexpr uint64_t ABSENT = 0x6e6f6e65; /* a NONE operand */
+        constexpr uint64_t SELF = 0x73656c66;   /* the hashed root's name */
+        constexpr uint64_t CHECK = 0x636865636b; /* seed of Fingerprint::check */
+
+        /* splitmix64 finalizer over a running hash */
+        uint64_t mix(uint64_t h, const uint64_t v)
+        {
+            h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+            return h ^ (h >> 31);
+        }
+
+        uint64_t text(const std::string_view s)
+        {
+            return std::hash<std::string_view>{}(s);
+        }
+
+        uint64_t node(const IR &g, const NodeId n, const StrId self, const uint64_t seed)
+        {
+            const Rec &r = g[n];
+            uint64_t h = mix(static_cast<uint64_t>(r.type) ^ seed, static_cast<uint64_t>(r.value));
+            h = mix(h, r.nkids);
+
+            const StrId name = g.name_id(n);
+            h = mix(h, name != 0 && name == self ? SELF : text(g.name(n)));
+            h = mix(h, text(g.strval(n)));
+
+            const MemRef &a = g.addr(n);
+            h = mix(h, static_cast<uint64_t>(a.offset));
+            return mix(h, static_cast<uint64_t>(a.base) | static_cast<uint64_t>(a.index) << 8 | static_cast<uint64_t>(a.scale) << 16);
+        }
+    }
+
+    Fingerprint fingerprint(const IR &g, const NodeId n)
+    {
+        if (n == NONE)
+            return { ABSENT, ABSENT, 0 };
+
+        /* both hashes side by side, seeded differently at every node */
+        struct Pair
+        {
+            uint64_t hash;
+            uint64_t check;
+        };
+
+        const StrId self = g.name_id(n);
+        uint32_t nodes = 0;
+        Walk<Pair> walk;
+        walk.run(n, {}, [&](Walk<Pair>::Frame &f)
+        {
+            if (f.node == NONE)
+            {
+                f.state = { ABSENT, ABSENT };
+                return;
+            }
+
+            if (f.step == 0)
+            {
+                f.state = { node(g, f.node, self, 0), node(g, f.node, self, CHECK) };
+                ++nodes;
+            }
+            else
+                f.state = { mix(f.state.hash, walk.last().hash), mix(f.state.check, walk.last().check) };
+            if (f.step < g[f.node].nkids)
+                walk.descend(g.kid(f.node, f.step));
+        });
+        return { walk.last().hash, walk.last().check, nodes };
+    }
+
+    uint64_t structural_hash(const IR &g, const NodeId n)
+    {
+        return fingerprint(g, n).hash;
+    }
+
+    uint64_t structural_hash(const Node *n)
+    {
+        if (!n)
+            return ABSENT;
+
+        IR g;
+        return structural_hash(g, g.import(n));
+    }
+}
@@ -0,0 +1,929 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <cdgnx/interp.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        constexpr uint32_t INT_ARGS = 6;
+        constexpr uint32_t FP_ARGS = 8;
+
+        /* the flags JE..JGE read, as cmpq, testq and ucomisd leave them */
+        constexpr uint8_t CF = 1;
+        constexpr uint8_t ZF = 2;
+        constexpr uint8_t SF = 4;
+        constexpr uint8_t OF = 8;
+
+        /* f(i, offset from rbp) for the home of every parameter, counted like x86_64::param() */
+        template<typename F>
+        void each_param(const Signature s, const uint32_t count, F &&f)
+        {
+            uint32_t ints = 0;
+            uint32_t fps = 0;
+            uint32_t stacked = 0;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const bool fp = s.fp(i);
+                if (fp ? fps < FP_ARGS : ints < INT_ARGS)
+                {
+                    f(i, -8 * static_cast<int64_t>(ints + fps + 1));
+                    ++(fp ? fps : ints);
+                }
+                else
+                    f(i, 16 + 8 * static_cast<int64_t>(stacked++));
+            }
+        }
+
+        /* the arguments after the registers a native call passes on the stack */
+        constexpr uint32_t STACK_ARGS = 16;
+
+        /* count arguments of a call typed s fit in the registers and STACK_ARGS slots */
+        bool fits(const Signature s, const uint32_t count)
+        {
+            uint32_t fps = 0;
+            for (uint32_t i = 0; i < count; ++i)
+                fps += s.fp(i);
+            const uint32_t ints = count - fps;
+            return (ints > INT_ARGS ? ints - INT_ARGS : 0) + (fps > FP_ARGS ? fps - FP_ARGS : 0) <= STACK_ARGS;
+        }
+
+        /*
+         * any SysV function: integers and doubles fill their registers
+         * independently, what is left goes on the stack in order. the type
+         * is variadic, so al bounds the xmm registers for variadic callees
+         */
+        template<typename R, size_t... S>
+        R invoke(void *p, const int64_t *i, const double *d, const int64_t *s, std::index_sequence<S...>)
+        {
+            using F = R (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, ...);
+            return reinterpret_cast<F>(p)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], s[S]...);
+        }
+
+        int64_t native_call(void *p, const Signature sig, const int64_t *args, const uint32_t count)
+        {
+            int64_t i[INT_ARGS] = {};
+            double d[FP_ARGS] = {};
+            int64_t s[STACK_ARGS] = {};
+            uint32_t ints = 0;
+            uint32_t fps = 0;
+            uint32_t stacked = 0;
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                if (sig.fp(k) && fps < FP_ARGS)
+                    d[fps++] = std::bit_cast<double>(args[k]);
+                else if (!sig.fp(k) && ints < INT_ARGS)
+                    i[ints++] = args[k];
+                else
+                    s[stacked++] = args[k];
+            }
+
+            const auto slots = std::make_index_sequence<STACK_ARGS>();
+            if (sig.returns_double)
+                return std::bit_cast<int64_t>(invoke<double>(p, i, d, s, slots));
+            return invoke<int64_t>(p, i, d, s, slots);
+        }
+
+        uint8_t compare(const OpType op, const int64_t l, const int64_t r)
+        {
+            if (op == OpType::FCMP)
+            {
+                /* ucomisd: unordered sets ZF, PF and CF, OF and SF are cleared */
+                const double a = std::bit_cast<double>(l);
+                const double b = std::bit_cast<double>(r);
+                if (a < b)
+                    return CF;
+                if (a == b)
+                    return ZF;
+                return a > b ? 0 : ZF | CF;
+            }
+
+            if (op == OpType::TEST)
+            {
+                const int64_t v = l & r;
+                return (v == 0 ? ZF : 0) | (v < 0 ? SF : 0);
+            }
+
+            const auto d = static_cast<int64_t>(static_cast<uint64_t>(l) - static_cast<uint64_t>(r));
+            return (d == 0 ? ZF : 0) | (d < 0 ? SF : 0) | (((l ^ r) & (l ^ d)) < 0 ? OF : 0)
+                   | (static_cast<uint64_t>(l) < static_cast<uint64_t>(r) ? CF : 0);
+        }
+
+        bool taken(const OpType j, const uint8_t flags)
+        {
+            const bool zf = flags & ZF;
+            const bool less = !(flags & SF) != !(flags & OF);
+            switch (j)
+            {
+                case OpType::JE: return zf;
+                case OpType::JNE: return !zf;
+                case OpType::JL: return less;
+                case OpType::JLE: return zf || less;
+                case OpType::JG: return !zf && !less;
+                case OpType::JGE: return !less;
+                default: return true;
+            }
+        }
+
+        /* a BR or SET: TEST compares l & r against 0, FCMP is false on NaN for all but ne */
+        bool holds(const Compare c, int64_t l, int64_t r)
+        {
+            if (c.op == OpType::FCMP)
+            {
+                const double a = std::bit_cast<double>(l);
+                const double b = std::bit_cast<double>(r);
+                switch (c.cond)
+                {
+                    case Cond::eq: return a == b;
+                    case Cond::ne: return a != b;
+                    case Cond::lt: case Cond::ult: return a < b;
+                    case Cond::le: case Cond::ule: return a <= b;
+                    case Cond::gt: case Cond::ugt: return a > b;
+                    default: return a >= b;
+                }
+            }
+
+            if (c.op == OpType::TEST)
+            {
+                l &= r;
+                r = 0;
+            }
+            const auto ul = static_cast<uint64_t>(l);
+            const auto ur = static_cast<uint64_t>(r);
+            switch (c.cond)
+            {
+                case Cond::eq: return l == r;
+                case Cond::ne: return l != r;
+                case Cond::lt: return l < r;
+                case Cond::le: return l <= r;
+                case Cond::gt: return l > r;
+                case Cond::ge: return l >= r;
+                case Cond::ult: return ul < ur;
+                case Cond::ule: return ul <= ur;
+                case Cond::ugt: return ul > ur;
+                default: return ul >= ur;
+            }
+        }
+
+        /* r, unless an operand is NaN: SSE hands back the left one's, quieted, before the right one's, where C++ leaves the order to the compiler */
+        template<typename T>
+        T ordered(const T a, const T b, const T r)
+        {
+            using U = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+            constexpr U QUIET = U{ 1 } << (std::numeric_limits<T>::digits - 2);
+            if (a != a)
+                return std::bit_cast<T>(std::bit_cast<U>(a) | QUIET);
+            if (b != b)
+                return std::bit_cast<T>(std::bit_cast<U>(b) | QUIET);
+            return r;
+        }
+
+        double fp(const OpType t, const int64_t l, const int64_t r)
+        {
+            const double a = std::bit_cast<double>(l);
+            const double b = std::bit_cast<double>(r);
+            switch (t)
+            {
+                case OpType::FADD: return ordered(a, b, a + b);
+                case OpType::FSUB: return ordered(a, b, a - b);
+                case OpType::FDIV: return ordered(a, b, a / b);
+                default: return std::fmod(a, b); /* libm's, like the call the backend makes */
+            }
+        }
+
+        /* min and max keep the right lane unless the left one is strictly on its side, as minps and maxps do */
+        template<typename T>
+        T lane(const OpType t, const T a, const T b)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                using U = std::make_unsigned_t<T>;
+                switch (t)
+                {
+                    case OpType::VADD: return static_cast<T>(static_cast<U>(a) + static_cast<U>(b));
+                    case OpType::VSUB: return static_cast<T>(static_cast<U>(a) - static_cast<U>(b));
+                    case OpType::VMUL: return static_cast<T>(static_cast<U>(a) * static_cast<U>(b));
+                    default: break;
+                }
+            }
+            else
+            {
+                switch (t)
+                {
+                    case OpType::VADD: return ordered(a, b, a + b);
+                    case OpType::VSUB: return ordered(a, b, a - b);
+                    case OpType::VMUL: return ordered(a, b, a * b);
+                    default: break;
+                }
+            }
+            return t == OpType::VMIN ? (a < b ? a : b) : (a > b ? a : b);
+        }
+
+        template<typename T>
+        void lanes(const OpType t, uint8_t *l, const uint8_t *r, const uint32_t bytes)
+        {
+            for (uint32_t at = 0; at < bytes; at += sizeof(T))
+            {
+                T a;
+                T b;
+                std::memcpy(&a, l + at, sizeof(T));
+                std::memcpy(&b, r + at, sizeof(T));
+                a = lane(t, a, b);
+                std::memcpy(l + at, &a, sizeof(T));
+            }
+        }
+
+        /* l = l t r over bytes bytes of lanes */
+        void vector_op(const OpType t, const Lane k, uint8_t *l, const uint8_t *r, const uint32_t bytes)
+        {
+            if (t == OpType::VAND || t == OpType::VOR || t == OpType::VXOR)
+            {
+                for (uint32_t at = 0; at < bytes; ++at)
+                    l[at] = t == OpType::VAND ? l[at] & r[at] : t == OpType::VOR ? l[at] | r[at] : l[at] ^ r[at];
+                return;
+            }
+
+            switch (k)
+            {
+                case Lane::i32: lanes<int32_t>(t, l, r, bytes); break;
+                case Lane::i64: lanes<int64_t>(t, l, r, bytes); break;
+                case Lane::f32: lanes<float>(t, l, r, bytes); break;
+                case Lane::f64: lanes<double>(t, l, r, bytes); break;
+            }
+        }
+
+        /* the scalar's bits in every lane, rounded to a float for f32, as x86_64::splat() */
+        void splat(const VecType v, const int64_t x, uint8_t *out)
+        {
+            auto bits = static_cast<uint64_t>(x);
+            if (v.lane == Lane::f32)
+                bits = std::bit_cast<uint32_t>(static_cast<float>(std::bit_cast<double>(x)));
+            for (uint32_t i = 0; i < v.bytes; ++i)
+                out[i] = static_cast<uint8_t>(bits >> (8 * (i % v.size())));
+        }
+
+        /* in the order x86_64::sum() adds: high half onto the low one, then down to lane 0 */
+        int64_t sum(const VecType v, const uint8_t *x)
+        {
+            uint8_t w[32];
+            std::memcpy(w, x, v.bytes);
+            if (v.bytes == 32)
+                vector_op(OpType::VADD, v.lane, w, w + 16, 16);
+            vector_op(OpType::VADD, v.lane, w, w + 8, 8);
+            if (v.size() == 4)
+                vector_op(OpType::VADD, v.lane, w, w + 4, 4);
+
+            switch (v.lane)
+            {
+                case Lane::i32:
+                {
+                    int32_t s;
+                    std::memcpy(&s, w, 4);
+                    return s;
+                }
+                case Lane::f32:
+                {
+                    float s;
+                    std::memcpy(&s, w, 4);
+                    return std::bit_cast<int64_t>(static_cast<double>(s));
+                }
+                default:
+                {
+                    int64_t s;
+                    std::memcpy(&s, w, 8);
+                    return s;
+                }
+            }
+        }
+    }
+
+    Interp::Interp(const IR &g, const std::span<const NodeId> functions, const Options &o)
+        : ir(g), opts(o), mem(new uint8_t[o.memory]())
+    {
+        if (o.stack > o.memory || o.stack < 64)
+            throw std::invalid_argument("interp: the stack has to fit in the memory");
+
+        sp = opts.memory & ~size_t{ 15 };
+        fn_of.assign(g.strings(), NONE);
+        str_at.assign(g.strings(), 0);
+        label_at.assign(g.strings(), NONE);
+        fns.resize(functions.size());
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            const NodeId root = functions[i];
+            if (g[root].type != OpType::ROOT || g.name(root).empty())
+                throw std::invalid_argument("interp: functions must be named ROOTs");
+
+            const StrId name = g.name_id(root);
+            if (fn_of[name] != NONE)
+                throw std::invalid_argument("interp: duplicate function " + std::string(g.name(root)));
+
+            fn_of[name] = static_cast<uint32_t>(i);
+            named.emplace(g.name(root), static_cast<uint32_t>(i));
+            fns[i].root = root;
+            fns[i].sig = Signature::of(g[root].value);
+        }
+
+        for (Function &f: fns)
+            translate(f);
+        heap = readonly;
+    }
+
+    Interp::~Interp() = default;
+
+    void Interp::define(const std::string_view name, void *addr)
+    {
+        hosts[std::string(name)] = addr;
+        if (jit)
+            jit->define(name, addr);
+    }
+
+    uint32_t Interp::lookup(const std::string_view name) const
+    {
+        const auto it = named.find(name);
+        return it == named.end() ? NONE : it->second;
+    }
+
+    uint64_t Interp::calls(const std::string_view name) const
+    {
+        const uint32_t fn = lookup(name);
+        return fn == NONE ? 0 : fns[fn].calls;
+    }
+
+    bool Interp::native(const std::string_view name) const
+    {
+        const uint32_t fn = lookup(name);
+        return fn != NONE && fns[fn].native;
+    }
+
+    void *Interp::alloc(const size_t bytes, const size_t align)
+    {
+        if (!std::has_single_bit(align))
+            throw std::invalid_argument("interp: alignment has to be a power of two");
+
+        const size_t start = (heap + align - 1) & ~(align - 1);
+        if (start > opts.memory - opts.stack || opts.memory - opts.stack - start < bytes)
+            throw std::runtime_error("interp: out of memory");
+
+        heap = start + bytes;
+        std::memset(mem.get() + start, 0, bytes);
+        return mem.get() + start;
+    }
+
+    int64_t Interp::place(const StrId s)
+    {
+        if (str_at[s])
+            return str_at[s];
+
+        const std::string_view str = ir.string(s);
+        if (opts.memory - opts.stack - readonly <= str.size())
+            throw std::runtime_error("interp: the strings don't fit in the memory");
+
+        std::memcpy(mem.get() + readonly, str.data(), str.size());
+        str_at[s] = reinterpret_cast<int64_t>(mem.get() + readonly);
+        readonly += str.size() + 1;
+        return str_at[s];
+    }
+
+    bool Interp::fp_value(const Function &f, const NodeId k) const
+    {
+        const Rec &r = ir[k];
+        switch (r.type)
+        {
+            case OpType::FNUM: return true;
+            case OpType::VSUM: return VecType::of(r.value).fp();
+            case OpType::PARAM: return f.sig.fp(static_cast<uint32_t>(r.value));
+            case OpType::CALL: return Signature::of(r.value).returns_double;
+            default: return op_info(r.type).cls == OpClass::fp && op_info(r.type).value;
+        }
+    }
+
+    void Interp::translate(Function &f)
+    {
+        jumps.clear();
+        labels.clear();
+
+        /* the frame holds the parameter homes, the PUSHes below them and whatever rbp-relative LEAs reach */
+        each_param(f.sig, f.sig.params, [&f](uint32_t, const int64_t at)
+        {
+            f.homes = std::max(f.homes, static_cast<uint32_t>(std::max<int64_t>(-at, 0)));
+        });
+        f.frame = std::max(f.frame, f.homes);
+
+        for (const NodeId s: ir.kids(f.root))
+        {
+            if (s != NONE)
+                statement(f, s);
+        }
+        f.code.push_back({ OpType::RET }); /* falling off the end returns 0 */
+
+        for (const auto &[at, name]: jumps)
+        {
+            if (label_at[name] == NONE)
+                throw std::invalid_argument("interp: no label " + std::string(ir.string(name)));
+            f.code[at].imm = label_at[name];
+        }
+        for (const StrId l: labels)
+            label_at[l] = NONE;
+
+        /* as deep as the PUSHes go in code order; a loop that pushes more grows the frame at run time */
+        uint32_t pushes = 0;
+        uint32_t most = 0;
+        for (const Insn &in: f.code)
+        {
+            pushes += in.op == OpType::PUSH;
+            pushes -= in.op == OpType::POP && pushes;
+            most = std::max(most, pushes);
+        }
+        f.frame = std::max(f.frame, f.homes + 8 * most);
+
+        f.frame = (f.frame + 15) & ~uint32_t{ 15 };
+        f.slots = std::max<uint32_t>(f.slots, 1);
+    }
+
+    void Interp::statement(Function &f, const NodeId s)
+    {
+        if (ir[s].type == OpType::LABEL)
+        {
+            const StrId name = ir.name_id(s);
+            if (label_at[name] != NONE)
+                throw std::invalid_argument("interp: label " + std::string(ir.name(s)) + " is defined twice");
+            label_at[name] = static_cast<uint32_t>(f.code.size());
+            labels.push_back(name);
+            return;
+        }
+
+        operands.clear();
+        walk.post_order(ir, s, [this, &f](const NodeId n) { visit(f, n); });
+    }
+
+    void Interp::visit(Function &f, const NodeId n)
+    {
+        const Rec &r = ir[n];
+        const OpInfo &info = op_info(r.type);
+        const auto kids = ir.kids(n);
+        const auto count = static_cast<uint32_t>(std::ranges::count_if(kids, [](const NodeId k) { return k != NONE; }));
+        const bool arity = info.arity == OpInfo::VARIADIC ? r.type != OpType::ROOT
+                         : info.arity == OpInfo::OPTIONAL ? count <= 1
+                                                          : count == info.arity;
+        if (!arity || r.type == OpType::LABEL)
+            throw std::invalid_argument("interp: " + std::string(info.name) + " has the wrong operands");
+
+        VecType v;
+        if (info.vector || info.cls == OpClass::vector)
+        {
+            v = VecType::of(r.value);
+            if (v.lane > Lane::f64 || (v.bytes != 16 && v.bytes != 32))
+                throw std::invalid_argument("interp: bad vector shape");
+        }
+
+        /* the operands are the last count values left, one per kid that is not NONE */
+        const size_t first = operands.size() - std::min<size_t>(count, operands.size());
+        for (uint32_t i = 0, k = 0; i < kids.size(); ++i)
+        {
+            if (kids[i] == NONE)
+                continue;
+
+            const uint32_t width = info.cls == OpClass::vector && !(r.type == OpType::VSTORE && k == 0) ? v.bytes / 8u : 1;
+            if (first + k >= operands.size() || operands[first + k].node != kids[i] || operands[first + k].width != width)
+                throw std::invalid_argument("interp: an operand of " + std::string(info.name) + " is not a value of its shape");
+            ++k;
+        }
+
+        Insn in{ r.type };
+        if (count)
+            in.at = operands[first].slot;
+        else if (!operands.empty())
+            in.at = operands.back().slot + operands.back().width;
+        if (count > 1)
+            in.b = operands[first + 1].slot;
+
+        switch (r.type)
+        {
+            case OpType::NUM:
+            case OpType::FNUM:
+                in.imm = r.value;
+                break;
+
+            case OpType::STR:
+                in.imm = place(ir.str_id(n));
+                break;
+
+            case OpType::LEA:
+            {
+                const MemRef &a = ir.addr(n);
+                if (a.index != Reg::none || (a.base != Reg::rbp && a.base != Reg::none))
+                    throw std::invalid_argument("interp: LEA is only rbp-relative");
+                if (a.base == Reg::rbp && a.offset < -static_cast<int64_t>(opts.stack))
+                    throw std::invalid_argument("interp: LEA below the stack");
+
+                /* room for a 32-byte access at the lowest offset */
+                in.imm = a.offset;
+                in.shape = a.base == Reg::rbp;
+                if (a.base == Reg::rbp && a.offset < 0)
+                    f.frame = std::max(f.frame, static_cast<uint32_t>(-a.offset + 32));
+                break;
+            }
+
+            case OpType::PARAM:
+            {
+                if (r.value < 0 || r.value >= f.sig.params)
+                    throw std::invalid_argument("interp: PARAM " + std::to_string(r.value) + " is not a parameter of the function");
+                each_param(f.sig, static_cast<uint32_t>(r.value) + 1, [&in, &r](const uint32_t i, const int64_t at)
+                {
+                    if (i == r.value)
+                        in.imm = at;
+                });
+                break;
+            }
+
+            case OpType::JMP:
+            case OpType::JE:
+            case OpType::JNE:
+            case OpType::JL:
+            case OpType::JLE:
+            case OpType::JG:
+            case OpType::JGE:
+                jumps.emplace_back(f.code.size(), ir.name_id(n));
+                break;
+
+            case OpType::BR:
+            case OpType::SET:
+            {
+                const Compare c = Compare::of(r.value);
+                if ((c.op != OpType::ICMP && c.op != OpType::TEST && c.op != OpType::FCMP) || c.cond > Cond::uge)
+                    throw std::invalid_argument("interp: bad compare");
+                in.shape = static_cast<uint16_t>(c.pack());
+                if (r.type == OpType::SET)
+                    break;
+
+                /* to the strval when it does not hold, like the jmp the backend adds */
+                if (ir.name_id(n) == 0)
+                    throw std::invalid_argument("interp: BR without a target");
+                jumps.emplace_back(f.code.size(), ir.name_id(n));
+                if (ir.str_id(n))
+                {
+                    f.code.push_back(in);
+                    in = { OpType::JMP };
+                    jumps.emplace_back(f.code.size(), ir.str_id(n));
+                }
+                break;
+            }
+
+            case OpType::MOV:
+                if (ir[kids[0]].type != OpType::LEA)
+                    throw std::invalid_argument("interp: MOV needs a LEA to store to");
+                break;
+
+            case OpType::CALL:
+            {
+                if (ir.name_id(n) == 0)
+                    throw std::invalid_argument("interp: CALL without a name");
+
+                /* which arguments a host function gets in xmm registers, as x86_64::call_sysv() decides */
+                Site s{ ir.name_id(n), Signature::of(r.value) };
+                s.sig.params = static_cast<uint8_t>(count);
+                for (uint32_t i = 0; i < count && i < 55; ++i)
+                {
+                    if (fp_value(f, kids[i]))
+                        s.sig.doubles |= uint64_t{ 1 } << i;
+                }
+                in.b = count;
+                in.imm = static_cast<int64_t>(f.sites.size());
+                f.sites.push_back(s);
+                break;
+            }
+
+            case OpType::RET:
+                in.b = count;
+                break;
+
+            default:
+                if (info.vector || info.cls == OpClass::vector)
+                    in.shape = static_cast<uint16_t>(v.pack());
+                break;
+        }
+
+        operands.resize(first);
+        if (info.value)
+        {
+            const uint32_t width = info.vector ? v.bytes / 8u : 1;
+            operands.push_back({ n, in.at, width });
+            f.slots = std::max(f.slots, in.at + width);
+        }
+        f.code.push_back(in);
+    }
+
+    int64_t Interp::call(const std::string_view name, const std::span<const int64_t> args)
+    {
+        const uint32_t fn = lookup(name);
+        if (fn == NONE)
+            throw std::invalid_argument("interp: no function " + std::string(name));
+        if (args.size() != fns[fn].sig.params)
+            throw std::invalid_argument("interp: " + std::string(name) + " takes " + std::to_string(fns[fn].sig.params) + " arguments");
+        return enter(fn, args.data());
+    }
+
+    int64_t Interp::enter(const uint32_t fn, const int64_t *args)
+    {
+        Function &f = fns[fn];
+        ++f.calls;
+        if (!f.native && opts.tier_up && f.calls >= opts.tier_up && !f.pinned)
+            promote(fn);
+        if (f.native)
+            return native_call(f.native, f.sig, args, f.sig.params);
+        return interpret(fn, args);
+    }
+
+    bool Interp::resolve(Site &s) const
+    {
+        if (s.fn != NONE || s.host)
+            return true;
+        if (fn_of[s.name] != NONE)
+        {
+            s.fn = fn_of[s.name];
+            return true;
+        }
+
+        const auto it = hosts.find(std::string(ir.string(s.name)));
+        if (it == hosts.end())
+            return false;
+        s.host = it->second;
+        return true;
+    }
+
+    bool Interp::promote(const uint32_t fn)
+    {
+        Function &f = fns[fn];
+        if (f.native)
+            return true;
+        if (f.pinned || f.visiting)
+            return false;
+
+        /* callees first, so the Jit finds them; one that calls back into f can't be */
+        f.visiting = true;
+        bool ok = fits(f.sig, f.sig.params);
+        for (Site &s: f.sites)
+        {
+            if (!ok)
+                break;
+            ok = resolve(s) && (s.fn == NONE || s.fn == fn || promote(s.fn));
+        }
+        f.visiting = false;
+
+        if (ok)
+        {
+            if (!jit)
+            {
+                jit = std::make_unique<Jit>(opts.jit);
+                for (const auto &[name, addr]: hosts)
+                    jit->define(name, addr);
+            }
+
+            try
+            {
+                f.native = jit->compile(ir, f.root);
+            }
+            catch (const std::invalid_argument &)
+            {
+                ok = false;
+            }
+        }
+        f.pinned = !ok;
+        return ok;
+    }
+
+    uint8_t *Interp::at(const int64_t addr, const size_t n, const bool write)
+    {
+        const uint64_t off = static_cast<uint64_t>(addr) - reinterpret_cast<uint64_t>(mem.get());
+        if (off > opts.memory || opts.memory - off < n)
+            throw std::runtime_error("interp: " + std::string(write ? "store to " : "load from ") + std::to_string(addr) + " is out of bounds");
+        if (write && off < readonly)
+            throw std::runtime_error("interp: store to read-only memory");
+        return mem.get() + off;
+    }
+
+    int64_t Interp::interpret(const uint32_t fn, const int64_t *args)
+    {
+        const Function &f = fns[fn];
+        if (depth == opts.depth)
+            throw std::runtime_error("interp: calls nested too deep");
+
+        /* the arguments that did not fit in registers above the return address and the saved rbp */
+        uint32_t above = 0;
+        each_param(f.sig, f.sig.params, [&above](uint32_t, const int64_t at) { above += at > 0; });
+        const size_t floor = opts.memory - opts.stack;
+        if (sp < floor + 8 * above + 16 + f.frame + 16)
+            throw std::runtime_error("interp: stack overflow");
+
+        const size_t top = sp;
+        const size_t rbp = (top - 8 * above - 16) & ~size_t{ 15 };
+        sp = rbp - f.frame;
+        std::memset(mem.get() + sp, 0, top - sp);
+        uint8_t *const frame = mem.get() + rbp;
+        each_param(f.sig, f.sig.params, [frame, args](const uint32_t i, const int64_t at) { std::memcpy(frame + at, args + i, 8); });
+
+        /* unwound on the way out, also when a trap throws through */
+        struct Leave
+        {
+            Interp &in;
+            size_t sp;
+            size_t slots;
+
+            ~Leave()
+            {
+                in.sp = sp;
+                --in.depth;
+                in.slots.resize(slots);
+            }
+        };
+
+        const size_t base = slots.size();
+        slots.resize(base + f.slots);
+        ++depth;
+        const Leave leave{ *this, top, base };
+
+        /* where native code has rsp: below the homes, lowered by each PUSH */
+        const size_t bottom = rbp - f.homes;
+        size_t rsp = bottom;
+
+        const Insn *const code = f.code.data();
+        int64_t *s = slots.data() + base;
+        uint8_t flags = 0;
+        for (size_t pc = 0;;)
+        {
+            const Insn &in = code[pc++];
+            int64_t &x = s[in.at];
+            switch (in.op)
+            {
+                case OpType::NUM:
+                case OpType::FNUM:
+                case OpType::STR:
+                    x = in.imm;
+                    break;
+
+                case OpType::LEA:
+                    x = in.shape ? reinterpret_cast<int64_t>(frame) + in.imm : in.imm;
+                    break;
+
+                case OpType::PARAM:
+                    std::memcpy(&x, frame + in.imm, 8);
+                    break;
+
+                case OpType::IADD: x = static_cast<int64_t>(static_cast<uint64_t>(x) + static_cast<uint64_t>(s[in.b])); break;
+                case OpType::ISUB: x = static_cast<int64_t>(static_cast<uint64_t>(x) - static_cast<uint64_t>(s[in.b])); break;
+                case OpType::IMUL: x = static_cast<int64_t>(static_cast<uint64_t>(x) * static_cast<uint64_t>(s[in.b])); break;
+
+                case OpType::IDIV:
+                case OpType::IMOD:
+                {
+                    const int64_t y = s[in.b];
+                    if (y == 0)
+                        throw std::runtime_error("interp: division by zero");
+                    if (x == std::numeric_limits<int64_t>::min() && y == -1)
+                        throw std::runtime_error("interp: division overflow");
+                    x = in.op == OpType::IDIV ? x / y : x % y;
+                    break;
+                }
+
+                case OpType::FADD:
+                case OpType::FSUB:
+                case OpType::FDIV:
+                case OpType::FMOD:
+                    x = std::bit_cast<int64_t>(fp(in.op, x, s[in.b]));
+                    break;
+
+                case OpType::BAND: x &= s[in.b]; break;
+                case OpType::BOR: x |= s[in.b]; break;
+                case OpType::BXOR: x ^= s[in.b]; break;
+                case OpType::BNOT: x = ~x; break;
+                case OpType::BSHL: x = static_cast<int64_t>(static_cast<uint64_t>(x) << (s[in.b] & 63)); break;
+                case OpType::BSHR: x = static_cast<int64_t>(static_cast<uint64_t>(x) >> (s[in.b] & 63)); break;
+
+                case OpType::ICMP:
+                case OpType::FCMP:
+                case OpType::TEST:
+                    flags = compare(in.op, x, s[in.b]);
+                    break;
+
+                case OpType::LOAD:
+                    std::memcpy(&x, at(x, 8, false), 8);
+                    break;
+
+                case OpType::STORE:
+                case OpType::MOV:
+                    std::memcpy(at(x, 8, true), &s[in.b], 8);
+                    break;
+
+                case OpType::CALL:
+                {
+                    Site &site = fns[fn].sites[static_cast<size_t>(in.imm)];
+                    if (!resolve(site))
+                        throw std::runtime_error("interp: unresolved symbol " + std::string(ir.string(site.name)));
+
+                    int64_t r;
+                    if (site.fn == NONE)
+                    {
+                        if (!fits(site.sig, in.b))
+                            throw std::invalid_argument("interp: a host call passes at most 16 arguments on the stack");
+                        r = native_call(site.host, site.sig, &x, in.b);
+                    }
+                    else
+                    {
+                        if (in.b != fns[site.fn].sig.params)
+                            throw std::invalid_argument("interp: " + std::string(ir.string(site.name)) + " takes " + std::to_string(fns[site.fn].sig.params) + " arguments");
+                        r = enter(site.fn, &x);
+                    }
+
+                    /* the callee's slots may have moved ours */
+                    s = slots.data() + base;
+                    s[in.at] = r;
+                    break;
+                }
+
+                case OpType::RET:
+                    return in.b ? x : 0;
+
+                case OpType::JMP:
+                    pc = static_cast<size_t>(in.imm);
+                    break;
+
+                case OpType::JE:
+                case OpType::JNE:
+                case OpType::JL:
+                case OpType::JLE:
+                case OpType::JG:
+                case OpType::JGE:
+                    if (taken(in.op, flags))
+                        pc = static_cast<size_t>(in.imm);
+                    break;
+
+                case OpType::BR:
+                    if (holds(Compare::of(in.shape), x, s[in.b]))
+                        pc = static_cast<size_t>(in.imm);
+                    break;
+
+                case OpType::SET:
+                    x = holds(Compare::of(in.shape), x, s[in.b]);
+                    break;
+
+                case OpType::PUSH:
+                    if (rsp < floor + 8)
+                        throw std::runtime_error("interp: stack overflow");
+                    rsp -= 8;
+                    std::memcpy(mem.get() + rsp, &x, 8);
+                    sp = std::min(sp, rsp); /* calls made from here on get their frames below it */
+                    break;
+
+                case OpType::POP:
+                    if (rsp == bottom)
+                        throw std::runtime_error("interp: POP without a PUSH");
+                    rsp += 8;
+                    break;
+
+                case OpType::VLOAD:
+                {
+                    const VecType v = VecType::of(in.shape);
+                    std::memcpy(&x, at(x, v.bytes, false), v.bytes);
+                    break;
+                }
+
+                case OpType::VSTORE:
+                {
+                    const VecType v = VecType::of(in.shape);
+                    std::memcpy(at(x, v.bytes, true), &s[in.b], v.bytes);
+                    break;
+                }
+
+                case OpType::VADD:
+                case OpType::VSUB:
+                case OpType::VMUL:
+                case OpType::VMIN:
+                case OpType::VMAX:
+                case OpType::VAND:
+                case OpType::VOR:
+                case OpType::VXOR:
+                {
+                    const VecType v = VecType::of(in.shape);
+                    vector_op(in.op, v.lane, reinterpret_cast<uint8_t *>(&x), reinterpret_cast<const uint8_t *>(&s[in.b]), v.bytes);
+                    break;
+                }
+
+                case OpType::VSPLAT:
+                    splat(VecType::of(in.shape), x, reinterpret_cast<uint8_t *>(&x));
+                    break;
+
+                case OpType::VSUM:
+                    x = sum(VecType::of(in.shape), reinterpret_cast<const uint8_t *>(&x));
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cdgnx/ir.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        Reg resolve(const std::string &name)
+        {
+            if (name.empty())
+                return Reg::none;
+
+            const Reg r = parse_reg(name);
+            if (r == Reg::none)
+                throw std::invalid_argument("ir: unknown register " + name);
+            return r;
+        }
+    }
+
+    IR::IR()
+    {
+        strs.intern("");
+    }
+
+    NodeId IR::make(const OpType t, std::span<const NodeId> kids, const int64_t value)
+    {
+        const auto first = static_cast<uint32_t>(ops.size());
+
+        /* kids may point into ops itself (e.g. another node's operand list) */
+        if (!kids.empty() && kids.data() >= ops.data() && kids.data() < ops.data() + ops.size())
+        {
+            const size_t src = kids.data() - ops.data();
+            ops.resize(first + kids.size());
+            std::copy_n(ops.begin() + src, kids.size(), ops.begin() + first);
+        }
+        else
+            ops.insert(ops.end(), kids.begin(), kids.end());
+
+        Rec r;
+        r.value = value;
+        r.kids = first;
+        r.nkids = static_cast<uint32_t>(kids.size());
+        r.type = t;
+        nodes.push_back(r);
+        stamps.push_back(generation);
+        parents.push_back(NONE);
+
+        const auto n = static_cast<NodeId>(nodes.size() - 1);
+        for (uint32_t i = first; i < ops.size(); ++i)
+            link(ops[i], n);
+        return n;
+    }
+
+    NodeId IR::str(std::string_view s)
+    {
+        const NodeId n = make(OpType::STR);
+        extra(n).str = store(s);
+        return n;
+    }
+
+    NodeId IR::branch(const Compare c, const NodeId l, const NodeId r, std::string_view taken, std::string_view other)
+    {
+        const NodeId n = make(OpType::BR, { l, r }, c.pack());
+        Extra &e = extra(n);
+        e.name = store(taken);
+        e.str = store(other);
+        return n;
+    }
+
+    NodeId IR::label(const OpType t, std::string_view name)
+    {
+        const NodeId n = make(t);
+        extra(n).name = store(name);
+        return n;
+    }
+
+    void IR::set_name(const NodeId n, std::string_view s)
+    {
+        extra(n).name = store(s);
+        touch(n);
+    }
+
+    void IR::set_str(const NodeId n, std::string_view s)
+    {
+        extra(n).str = store(s);
+        touch(n);
+    }
+
+    void IR::set_addr(const NodeId n, const Addr &a)
+    {
+        MemRef m;
+        m.offset = a.offset;
+        m.base = resolve(a.base);
+        m.index = resolve(a.index);
+        m.scale = a.scale;
+        if (m.offset < INT32_MIN || m.offset > INT32_MAX)
+            throw std::invalid_argument("ir: offset " + std::to_string(m.offset) + " does not fit in 32 bits");
+        if (m.scale != 1 && m.scale != 2 && m.scale != 4 && m.scale != 8)
+            throw std::invalid_argument("ir: scale " + std::to_string(m.scale) + " is not 1, 2, 4 or 8");
+        if (m.index == Reg::rsp)
+            throw std::invalid_argument("ir: %rsp can't be an index");
+
+        Extra &e = extra(n);
+        if (e.addr == NONE)
+        {
+            e.addr = static_cast<uint32_t>(addrs.size());
+            addrs.push_back(m);
+        }
+        else
+            addrs[e.addr] = m;
+        touch(n);
+    }
+
+    void IR::set_kid(const NodeId n, const uint32_t i, const NodeId k)
+    {
+        /* the old operand keeps its link to n, which only costs a spare touch */
+        ops[nodes[n].kids + i] = k;
+        link(k, n);
+        touch(n);
+    }
+
+    void IR::set_const(const NodeId n, const int64_t v)
+    {
+        Rec &r = nodes[n];
+        r.type = OpType::NUM;
+        r.value = v;
+        r.nkids = 0;
+        touch(n);
+    }
+
+    NodeId IR::import(const Node *n)
+    {
+        /* explicit stack, a Node tree can nest deeper than the thread's stack */
+        struct Item
+        {
+            const Node *node;
+            NodeId id;
+            uint32_t next;
+        };
+
+        std::vector<Item> todo;
+        const auto enter = [&](const Node *k)
+        {
+            const NodeId id = make(k->type, {}, k->value);
+
+            /* reserve the operand slots first so they stay contiguous */
+            nodes[id].kids = static_cast<uint32_t>(ops.size());
+            nodes[id].nkids = static_cast<uint32_t>(k->kids.size());
+            ops.resize(ops.size() + k->kids.size(), NONE);
+            todo.push_back({ k, id, 0 });
+            return id;
+        };
+
+        const NodeId root = enter(n);
+        while (!todo.empty())
+        {
+            Item &it = todo.back();
+            if (it.next < it.node->kids.size())
+            {
+                const NodeId parent = it.id;
+                const uint32_t slot = nodes[parent].kids + it.next;
+                const Node *k = it.node->kids[it.next++].get();
+                if (k)
+                {
+                    const NodeId kid = enter(k); /* may grow ops, and todo under it */
+                    ops[slot] = kid;
+                    link(kid, parent);
+                }
+                continue;
+            }
+
+            const Node *k = it.node;
+            const NodeId id = it.id;
+            todo.pop_back();
+
+            if (!k->name.empty())
+                set_name(id, k->name);
+            if (!k->strval.empty())
+                extra(id).str = store(k->strval);
+            if (k->addr.offset || !k->addr.base.empty() || !k->addr.index.empty())
+                set_addr(id, k->addr);
+        }
+        return root;
+    }
+
+    std::string_view IR::name(const NodeId n) const
+    {
+        const uint32_t e = nodes[n].extra;
+        return e == NONE ? std::string_view() : string(extras[e].name);
+    }
+
+    StrId IR::name_id(const NodeId n) const
+    {
+        const uint32_t e = nodes[n].extra;
+        return e == NONE ? 0 : extras[e].name;
+    }
+
+    std::string_view IR::strval(const NodeId n) const
+    {
+        const uint32_t e = nodes[n].extra;
+        return e == NONE ? std::string_view() : string(extras[e].str);
+    }
+
+    StrId IR::str_id(const NodeId n) const
+    {
+        const uint32_t e = nodes[n].extra;
+        return e == NONE ? 0 : extras[e].str;
+    }
+
+    const MemRef &IR::addr(const NodeId n) const
+    {
+        static constexpr MemRef none;
+
+        const uint32_t e = nodes[n].extra;
+        if (e == NONE || extras[e].addr == NONE)
+            return none;
+        return addrs[extras[e].addr];
+    }
+
+    size_t IR::footprint() const
+    {
+        return nodes.capacity() * sizeof(Rec)
+               + ops.capacity() * sizeof(NodeId)
+               + extras.capacity() * sizeof(Extra)
+               + addrs.capacity() * sizeof(MemRef)
+               + stamps.capacity() * sizeof(uint32_t)
+               + parents.capacity() * sizeof(NodeId)
+               + strs.footprint();
+    }
+
+    void IR::reserve(const size_t n, const size_t operands)
+    {
+        nodes.reserve(n);
+        ops.reserve(operands);
+        stamps.reserve(n);
+        parents.reserve(n);
+    }
+
+    void IR::clear()
+    {
+        nodes.clear();
+        ops.clear();
+        extras.clear();
+        addrs.clear();
+        strs.clear();
+        strs.intern("");
+        stamps.clear();
+        parents.clear();
+        shared.clear();
+
+        /* ids are handed out again, the stamps of the new nodes must not match old ones */
+        ++generation;
+        sealed = false;
+    }
+
+    void IR::link(const NodeId k, const NodeId n)
+    {
+        if (k == NONE)
+            return;
+        if (parents[k] == NONE)
+            parents[k] = n;
+        else if (parents[k] != n)
+            shared.emplace(k, n);
+    }
+
+    void IR::touch(const NodeId n)
+    {
+        if (sealed)
+        {
+            ++generation;
+            sealed = false;
+        }
+
+        /* a node already at this generation had its ancestors stamped with it */
+        climb.push_back(n);
+        while (!climb.empty())
+        {
+            const NodeId m = climb.back();
+            climb.pop_back();
+            if (stamps[m] == generation)
+                continue;
+
+            stamps[m] = generation;
+            if (parents[m] != NONE)
+                climb.push_back(parents[m]);
+            if (!shared.empty())
+            {
+                const auto [first, last] = shared.equal_range(m);
+                for (auto it = first; it != last; ++it)
+                    climb.push_back(it->second);
+            }
+        }
+    }
+
+    StrId IR::store(std::string_view s)
+    {
+        return s.empty() ? 0 : strs.intern(s);
+    }
+
+    Extra &IR::extra(const NodeId n)
+    {
+        Rec &r = nodes[n];
+        if (r.extra == NONE)
+        {
+            r.extra = static_cast<uint32_t>(extras.size());
+            extras.emplace_back();
+        }
+        return extras[r.extra];
+    }
+}
@@ -0,0 +1,157 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cdgnx/jit.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        constexpr size_t STUB_SIZE = 16; /* jmp *0(%rip); .quad target; 2 bytes padding */
+
+        size_t align_up(const size_t v, const size_t a)
+        {
+            return (v + a - 1) & ~(a - 1);
+        }
+
+        void put32(uint8_t *p, const int64_t v)
+        {
+            const auto u = static_cast<uint32_t>(v);
+            std::memcpy(p, &u, sizeof(u));
+        }
+    }
+
+    Jit::Jit(const backend::x86_64::Options &o) : backend(o)
+    {
+        /* FMOD lowers to a call */
+        define("fmod", reinterpret_cast<void *>(static_cast<double (*)(double, double)>(::fmod)));
+    }
+
+    Jit::~Jit()
+    {
+        for (const Region &r: regions)
+            munmap(r.base, r.size);
+    }
+
+    void Jit::define(std::string_view name, void *addr)
+    {
+        symbols[std::string(name)] = addr;
+    }
+
+    void *Jit::lookup(std::string_view name) const
+    {
+        const auto it = symbols.find(std::string(name));
+        return it == symbols.end() ? nullptr : it->second;
+    }
+
+    void *Jit::compile(Node *root)
+    {
+        if (!root || root->name.empty())
+            throw std::invalid_argument("jit: root needs a name");
+        return load(backend.assemble(root));
+    }
+
+    void *Jit::compile(const IR &g, const NodeId root)
+    {
+        if (g.name(root).empty())
+            throw std::invalid_argument("jit: root needs a name");
+        return load(backend.assemble(g, root));
+    }
+
+    void *Jit::load(const backend::mc::Object &o)
+    {
+        using backend::mc::Reloc;
+        using backend::mc::Section;
+
+        /* every undefined call target gets one stub, so distance to the host never matters */
+        std::vector<void *> target(o.syms.size(), nullptr);
+        std::vector<uint32_t> stub(o.syms.size(), NONE);
+        uint32_t stubs = 0;
+        for (const Reloc &r: o.relocs)
+        {
+            const auto &s = o.syms[r.sym];
+            if (s.section != Section::undef || target[r.sym])
+                continue;
+
+            target[r.sym] = lookup(s.name);
+            if (!target[r.sym])
+                throw std::runtime_error("jit: unresolved symbol " + s.name);
+            if (r.kind == Reloc::Kind::plt32)
+                stub[r.sym] = stubs++;
+        }
+
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t stub_off = align_up(o.text.size(), 16);
+        const size_t ro_off = align_up(stub_off + stubs * STUB_SIZE, page);
+        const size_t size = align_up(ro_off + o.rodata.size(), page);
+
+        void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("jit: mmap failed");
+
+        auto *base = static_cast<uint8_t *>(mapped);
+        if (!o.text.empty())
+            std::memcpy(base, o.text.data(), o.text.size());
+        if (!o.rodata.empty())
+            std::memcpy(base + ro_off, o.rodata.data(), o.rodata.size());
+
+        for (size_t i = 0; i < o.syms.size(); ++i)
+        {
+            if (stub[i] == NONE)
+                continue;
+
+            uint8_t *p = base + stub_off + stub[i] * STUB_SIZE;
+            const uint8_t jmp[] = { 0xff, 0x25, 0, 0, 0, 0 };
+            std::memcpy(p, jmp, sizeof(jmp));
+            std::memcpy(p + sizeof(jmp), &target[i], sizeof(void *));
+        }
+
+        const auto address = [&](const uint32_t sym) -> const uint8_t *
+        {
+            const auto &s = o.syms[sym];
+            switch (s.section)
+            {
+                case Section::text: return base + s.offset;
+                case Section::rodata: return base + ro_off + s.offset;
+                default: break;
+            }
+            return stub[sym] != NONE ? base + stub_off + stub[sym] * STUB_SIZE
+                                     : static_cast<const uint8_t *>(target[sym]);
+        };
+
+        for (const Reloc &r: o.relocs)
+        {
+            uint8_t *p = base + r.offset;
+            const int64_t v = address(r.sym) + r.addend - p;
+            if (v < INT32_MIN || v > INT32_MAX)
+            {
+                munmap(mapped, size);
+                throw std::runtime_error("jit: " + o.syms[r.sym].name + " is out of rel32 range");
+            }
+            put32(p, v);
+        }
+
+        /* W^X: code becomes executable only once it is no longer writable */
+        if (mprotect(base, ro_off, PROT_READ | PROT_EXEC) != 0
+            || (size > ro_off && mprotect(base + ro_off, size - ro_off, PROT_READ) != 0))
+        {
+            munmap(mapped, size);
+            throw std::runtime_error("jit: mprotect failed");
+        }
+        regions.push_back({ mapped, size });
+
+        void *entry = nullptr;
+        for (const auto &s: o.syms)
+        {
+            if (!s.global || s.section != Section::text)
+                continue;
+
+            symbols[s.name] = base + s.offset;
+            if (!entry)
+                entry = base + s.offset;
+        }
+        return entry;
+    }
+}
@@ -0,0 +1,22 @@
+#include <stdexcept>
+#include <string>
+#include <cdgnx/module.hpp>
+
+namespace cdgnx
+{
+    void Module::add(const NodeId root)
+    {
+        if (ir[root].type != OpType::ROOT || ir.name(root).empty())
+            throw std::invalid_argument("module: functions must be named ROOTs");
+
+        /* names are interned, so equal names have equal ids */
+        const StrId name = ir.name_id(root);
+        if (name >= taken.size())
+            taken.resize(ir.strings(), false);
+        if (taken[name])
+            throw std::invalid_argument("module: duplicate function " + std::string(ir.name(root)));
+
+        taken[name] = true;
+        roots.push_back(root);
+    }
+}
@@ -0,0 +1,24 @@
+#include <cdgnx/pass.hpp>
+
+namespace cdgnx
+{
+    PassManager &PassManager::add(std::unique_ptr<Pass> p)
+    {
+        passes.push_back(std::move(p));
+        return *this;
+    }
+
+    size_t PassManager::run(IR &g, const NodeId root)
+    {
+        results.clear();
+
+        size_t total = 0;
+        for (const auto &p: passes)
+        {
+            const size_t removed = p->run(g, root);
+            results.push_back({ p->name(), removed });
+            total += removed;
+        }
+        return total;
+    }
+}
@@ -0,0 +1,36 @@
+#include <iterator>
+#include <cdgnx/regs.hpp>
+
+namespace cdgnx
+{
+    namespace
+    {
+        constexpr const char *REG_NAMES[] = {
+            "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+            "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15",
+            "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",
+            "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15",
+            "%rip"
+        };
+
+        static_assert(std::size(REG_NAMES) == static_cast<size_t>(Reg::none));
+    }
+
+    Reg parse_reg(std::string_view name)
+    {
+        if (name.starts_with('%'))
+            name.remove_prefix(1);
+
+        for (size_t i = 0; i < std::size(REG_NAMES); ++i)
+        {
+            if (std::string_view(REG_NAMES[i] + 1) == name)
+                return static_cast<Reg>(i);
+        }
+        return Reg::none;
+    }
+
+    const char *reg_name(const Reg r)
+    {
+        return r < Reg::none ? REG_NAMES[static_cast<uint8_t>(r)] : "";
+    }
+}
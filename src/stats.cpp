@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cdgnx/stats.hpp>
+
+namespace cdgnx::backend
+{
+    namespace
+    {
+        constexpr std::string_view PHASE_NAMES[] = { "import", "cache", "lower", "peephole", "print", "copy", "encode", "write" };
+
+        static_assert(std::size(PHASE_NAMES) == Stats::PHASES);
+
+        /* s as a JSON string */
+        void quoted(Buffer &sink, const std::string_view s)
+        {
+            static constexpr char HEX[] = "0123456789abcdef";
+
+            sink.put('"');
+            for (const char c: s)
+            {
+                const auto u = static_cast<unsigned char>(c);
+                if (c == '"' || c == '\\')
+                    sink.put('\\').put(c);
+                else if (u < 0x20)
+                    sink.put("\\u00").put(HEX[u >> 4]).put(HEX[u & 15]);
+                else
+                    sink.put(c);
+            }
+            sink.put('"');
+        }
+
+        /* ns as microseconds with three decimals, the trace format's unit */
+        void micros(Buffer &sink, const uint64_t ns)
+        {
+            const uint64_t frac = ns % 1000;
+            sink.put(ns / 1000).put('.').put(static_cast<char>('0' + frac / 100)).put(static_cast<char>('0' + frac / 10 % 10))
+                .put(static_cast<char>('0' + frac % 10));
+        }
+    }
+
+    std::string_view Stats::name(const Phase p)
+    {
+        return PHASE_NAMES[static_cast<size_t>(p)];
+    }
+
+    Stats::Total Stats::total(const Phase p) const
+    {
+        Total t;
+        for (const Span &s: timeline)
+        {
+            if (s.phase == p)
+            {
+                ++t.calls;
+                t.ns += s.ns;
+            }
+        }
+        return t;
+    }
+
+    Stats::Function Stats::sum() const
+    {
+        Function all;
+        for (const Function &f: records)
+        {
+            for (size_t t = 0; t < f.nodes.size(); ++t)
+                all.nodes[t] += f.nodes[t];
+            all.depth = std::max(all.depth, f.depth);
+            all.instructions += f.instructions;
+            all.listing += f.listing;
+            all.text += f.text;
+            all.allocs += f.allocs;
+            all.spills += f.spills;
+            all.stack = std::max(all.stack, f.stack);
+        }
+        return all;
+    }
+
+    void Stats::clear()
+    {
+        open = NONE;
+        records.clear();
+        timeline.clear();
+    }
+
+    uint32_t Stats::enter(const IR &g, const NodeId n)
+    {
+        open = static_cast<uint32_t>(records.size());
+        Function &f = records.emplace_back();
+        f.name = g.name(n);
+
+        /* a node is visited after its operands, so their depths are written by then */
+        if (depth_of.size() < g.size())
+            depth_of.resize(g.size());
+        walk.post_order(g, n, [&](const NodeId m)
+        {
+            uint32_t d = 0;
+            for (const NodeId k: g.kids(m))
+            {
+                if (k != NONE)
+                    d = std::max(d, depth_of[k] + 1);
+            }
+            depth_of[m] = d;
+            ++f.nodes[static_cast<size_t>(g[m].type)];
+        });
+        f.depth = depth_of[n];
+        return open;
+    }
+
+    uint32_t Stats::merge(const std::span<const Stats> parts, const std::span<const std::pair<unsigned, uint32_t> > which)
+    {
+        const auto first = static_cast<uint32_t>(records.size());
+        std::vector<std::vector<uint32_t> > index(parts.size());
+        for (size_t p = 0; p < parts.size(); ++p)
+            index[p].assign(parts[p].records.size(), NONE);
+
+        for (const auto &[p, r]: which)
+        {
+            index[p][r] = static_cast<uint32_t>(records.size());
+            records.push_back(parts[p].records[r]);
+        }
+
+        for (size_t p = 0; p < parts.size(); ++p)
+        {
+            for (Span s: parts[p].timeline)
+            {
+                s.function = s.function == NONE ? NONE : index[p][s.function];
+                timeline.push_back(s);
+            }
+        }
+        std::ranges::stable_sort(timeline, {}, &Span::start);
+
+        open = NONE;
+        return first;
+    }
+
+    void Stats::json(Buffer &sink) const
+    {
+        sink.put("{\n  \"phases\": {");
+        const char *sep = "\n";
+        for (size_t p = 0; p < PHASES; ++p)
+        {
+            const Total t = total(static_cast<Phase>(p));
+            sink.put(sep).put("    ");
+            quoted(sink, PHASE_NAMES[p]);
+            sink.put(": {\"calls\": ").put(t.calls).put(", \"ns\": ").put(t.ns).put('}');
+            sep = ",\n";
+        }
+
+        sink.put("\n  },\n  \"functions\": [");
+        sep = "\n";
+        for (const Function &f: records)
+        {
+            sink.put(sep).put("    {\"name\": ");
+            quoted(sink, f.name);
+            sink.put(", \"cached\": ").put(f.cached ? "true" : "false").put(", \"nodes\": {");
+            const char *comma = "";
+            for (size_t t = 0; t < f.nodes.size(); ++t)
+            {
+                if (!f.nodes[t])
+                    continue;
+                sink.put(comma);
+                quoted(sink, OPS[t].name);
+                sink.put(": ").put(static_cast<uint64_t>(f.nodes[t]));
+                comma = ", ";
+            }
+            sink.put("}, \"depth\": ").put(static_cast<uint64_t>(f.depth))
+                .put(", \"instructions\": ").put(static_cast<uint64_t>(f.instructions))
+                .put(", \"listing\": ").put(static_cast<uint64_t>(f.listing))
+                .put(", \"text\": ").put(static_cast<uint64_t>(f.text))
+                .put(", \"allocs\": ").put(static_cast<uint64_t>(f.allocs))
+                .put(", \"spills\": ").put(static_cast<uint64_t>(f.spills))
+                .put(", \"stack\": ").put(f.stack).put('}');
+            sep = ",\n";
+        }
+        sink.put(records.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+
+    void Stats::trace(Buffer &sink) const
+    {
+        /* complete events, timed from the first span */
+        uint64_t origin = UINT64_MAX;
+        for (const Span &s: timeline)
+            origin = std::min(origin, s.start);
+
+        sink.put("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+        const char *sep = "\n";
+        for (const Span &s: timeline)
+        {
+            sink.put(sep).put("  {\"name\": ");
+            quoted(sink, name(s.phase));
+            sink.put(", \"cat\": \"cdgnx\", \"ph\": \"X\", \"pid\": 1, \"tid\": ").put(static_cast<uint64_t>(s.thread)).put(", \"ts\": ");
+            micros(sink, s.start - origin);
+            sink.put(", \"dur\": ");
+            micros(sink, s.ns);
+            if (s.function != NONE)
+            {
+                sink.put(", \"args\": {\"function\": ");
+                quoted(sink, records[s.function].name);
+                sink.put('}');
+            }
+            sink.put('}');
+            sep = ",\n";
+        }
+        sink.put("\n]}\n");
+    }
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cdgnx/symtab.hpp>
+
+namespace cdgnx
+{
+    SymId Symtab::intern(std::string_view s)
+    {
+        /* keep the table at most half full */
+        if ((spans.size() + 1) * 2 > slots.size())
+            grow();
+
+        const uint32_t h = hash(s);
+        const size_t slot = probe(s, h);
+        if (slots[slot] != NONE)
+            return slots[slot];
+
+        const auto id = static_cast<SymId>(spans.size());
+        spans.emplace_back(static_cast<uint32_t>(chars.size()), static_cast<uint32_t>(s.size()));
+        chars.insert(chars.end(), s.begin(), s.end());
+        hashes.push_back(h);
+        slots[slot] = id;
+        return id;
+    }
+
+    SymId Symtab::find(std::string_view s) const
+    {
+        return slots.empty() ? NONE : slots[probe(s, hash(s))];
+    }
+
+    size_t Symtab::footprint() const
+    {
+        return chars.capacity()
+               + spans.capacity() * sizeof(spans[0])
+               + hashes.capacity() * sizeof(uint32_t)
+               + slots.capacity() * sizeof(SymId);
+    }
+
+    void Symtab::clear()
+    {
+        chars.clear();
+        spans.clear();
+        hashes.clear();
+        std::fill(slots.begin(), slots.end(), NONE);
+    }
+
+    uint32_t Symtab::hash(std::string_view s)
+    {
+        /* FNV-1a */
+        uint32_t h = 2166136261u;
+        for (const char c: s)
+            h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+        return h;
+    }
+
+    size_t Symtab::probe(std::string_view s, const uint32_t h) const
+    {
+        const size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            const SymId id = slots[i];
+            if (id == NONE || (hashes[id] == h && (*this)[id] == s))
+                return i;
+        }
+    }
+
+    void Symtab::grow()
+    {
+        slots.assign(slots.empty() ? 64 : slots.size() * 2, NONE);
+
+        const size_t mask = slots.size() - 1;
+        for (SymId id = 0; id < spans.size(); ++id)
+        {
+            size_t i = hashes[id] & mask;
+            while (slots[i] != NONE)
+                i = (i + 1) & mask;
+            slots[i] = id;
+        }
+    }
+}
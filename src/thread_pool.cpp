@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <utility>
+#include <cdgnx/thread_pool.hpp>
+
+namespace cdgnx
+{
+    ThreadPool::ThreadPool(unsigned threads)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned w = 0; w < threads; ++w)
+            slices.push_back(std::make_unique<Slice>());
+        for (unsigned w = 1; w < threads; ++w)
+            this->threads.emplace_back(&ThreadPool::loop, this, w);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &t: threads)
+            t.join();
+    }
+
+    void ThreadPool::parallel_for(const size_t n, const std::function<void(unsigned, size_t)> &f)
+    {
+        if (n == 0)
+            return;
+
+        const size_t workers = slices.size();
+        for (size_t w = 0; w < workers; ++w)
+        {
+            std::lock_guard lock(slices[w]->m);
+            slices[w]->begin = n * w / workers;
+            slices[w]->end = n * (w + 1) / workers;
+        }
+
+        {
+            std::lock_guard lock(m);
+            job = &f;
+            error = nullptr;
+            running = static_cast<unsigned>(workers);
+            ++generation;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        std::unique_lock lock(m);
+        idle.wait(lock, [this] { return running == 0; });
+        job = nullptr;
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+
+    void ThreadPool::loop(const unsigned w)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock lock(m);
+                wake.wait(lock, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+            work(w);
+        }
+    }
+
+    void ThreadPool::work(const unsigned w)
+    {
+        size_t i;
+        while (take(w, i))
+        {
+            try
+            {
+                (*job)(w, i);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(m);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+
+        std::lock_guard lock(m);
+        if (--running == 0)
+            idle.notify_one();
+    }
+
+    bool ThreadPool::take(const unsigned w, size_t &i)
+    {
+        Slice &own = *slices[w];
+        {
+            std::lock_guard lock(own.m);
+            if (own.begin < own.end)
+            {
+                i = own.begin++;
+                return true;
+            }
+        }
+
+        /* only one lock is ever held, so thieves cannot deadlock each other */
+        const auto workers = static_cast<unsigned>(slices.size());
+        for (unsigned k = 1; k < workers; ++k)
+        {
+            Slice &victim = *slices[(w + k) % workers];
+            size_t from;
+            size_t to;
+            {
+                std::lock_guard lock(victim.m);
+                if (victim.begin >= victim.end)
+                    continue;
+
+                to = victim.end;
+                from = victim.end - (victim.end - victim.begin + 1) / 2;
+                victim.end = from;
+            }
+
+            i = from;
+            std::lock_guard lock(own.m);
+            own.begin = from + 1;
+            own.end = to;
+            return true;
+        }
+        return false;
+    }
+}
@@ -1,436 +1,944 @@
+#include <cdgnx/hash.hpp>
 #include <cdgnx/x86_64.hpp>
-#include <ranges>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 namespace cdgnx::backend
 {
-    std::string x86_64::new_label()
+    using mc::imm;
+    using mc::mem;
+    using mc::reg;
+
+    namespace
     {
-        return ".L" + std::to_string(label_counter++);
+        /* SysV argument registers, integers in this order and xmm0-xmm7 */
+        constexpr mc::Reg INT_ARGS[] = { mc::Reg::rdi, mc::Reg::rsi, mc::Reg::rdx, mc::Reg::rcx, mc::Reg::r8, mc::Reg::r9 };
+        constexpr uint32_t FP_ARGS = 8;
+
+        mc::Reg fp_arg(const uint32_t i)
+        {
+            return static_cast<mc::Reg>(static_cast<uint8_t>(mc::Reg::xmm0) + i);
+        }
+
+        uint32_t stack_operands(const Rec &rec)
+        {
+            return op_info(rec.type).operands(rec.nkids);
+        }
     }
 
-    void x86_64::emit(const std::string &s, bool indent)
+    void x86_64::emit(const Op op, const Operand &a, const Operand &b)
     {
-        if (indent && s.back() != ':')
-            out << "    ";
-        out << s << '\n';
+        code.insts.push_back({ op, a, b });
+        if (opts.avx2 && mc::has_vex(code.insts.back()))
+            code.insts.back().vex = 16;
     }
 
-    std::string x86_64::format_addr(const Addr &a)
+    void x86_64::emit_vec(const Op op, const uint8_t bytes, const Operand &a, const Operand &b)
     {
-        std::string result;
-        if (a.offset)
-            result += std::to_string(a.offset);
-        if (!a.base.empty())
-            result += "(" + a.base + ")";
-        if (!a.index.empty())
-            result += "," + a.index + "," + std::to_string(a.scale);
-        return result;
+        code.insts.push_back({ op, a, b, opts.avx2 ? bytes : uint8_t{ 0 } });
+        upper = upper || bytes == 32;
     }
 
-    void x86_64::gen_strings()
+    mc::Operand x86_64::format_addr(const MemRef &a)
     {
-        if (strs.empty())
-            return;
+        return mem(a.base, a.offset, a.index, a.scale);
+    }
 
-        emit(".section .rodata", false);
-        emit(".align 8", false);
-        for (size_t i = 0; i < strs.size(); ++i)
+    uint32_t x86_64::symbol(const StrId s)
+    {
+        if (s >= sym_of.size())
+            sym_of.resize(ir->strings(), NONE);
+
+        uint32_t &id = sym_of[s];
+        if (id == NONE)
         {
-            emit(".LC" + std::to_string(i) + ":", false);
-            emit(".string \"" + strs[i] + "\"", false);
+            id = code.sym(ir->string(s));
+            sym_used.push_back(s);
         }
+        return id;
     }
 
-    std::string x86_64::generate(Node *n)
+    uint32_t x86_64::pooled(const ConstPool::Kind k, const uint32_t id)
+    {
+        std::vector<uint32_t> &syms = pool_syms[static_cast<size_t>(k)];
+        if (id < syms.size())
+            return syms[id];
+
+        char name[24];
+        const std::string_view prefix = ConstPool::prefix(k);
+        std::ranges::copy(prefix, name);
+        const char *end = std::to_chars(name + prefix.size(), std::end(name), id).ptr;
+        syms.push_back(code.sym({ name, static_cast<size_t>(end - name) }));
+        return syms.back();
+    }
+
+    uint32_t x86_64::literal(const std::string_view s)
+    {
+        return pooled(ConstPool::Kind::str, pool.str(s));
+    }
+
+    uint32_t x86_64::constant(const int64_t bits)
+    {
+        return pooled(ConstPool::Kind::quad, pool.quad(bits));
+    }
+
+    void x86_64::call_aligned(const uint32_t sym)
+    {
+        /* the old rsp goes onto the aligned stack and comes back after the call */
+        emit(Op::movq, reg(Reg::rsp), reg(Reg::rax));
+        emit(Op::andq, imm(-16), reg(Reg::rsp));
+        emit(Op::subq, imm(8), reg(Reg::rsp));
+        emit(Op::pushq, reg(Reg::rax));
+        emit(Op::call, mc::sym(sym));
+        emit(Op::popq, reg(Reg::rsp));
+    }
+
+    bool x86_64::direct(const NodeId k) const
     {
-        out.str("");
-        strs.clear();
+        if (k == NONE)
+            return false;
 
-        emit(".section .text", false);
-        emit(".align 16", false);
-        if (!n->name.empty())
+        switch ((*ir)[k].type)
         {
-            emit(".global " + n->name, false);
-            emit(".type " + n->name + ", @function", false);
-            emit(n->name + ":", false);
-            emit("pushq %rbp");
-            emit("movq %rsp, %rbp");
+            case OpType::NUM:
+            case OpType::FNUM:
+            case OpType::STR:
+            case OpType::PARAM:
+                return true;
+
+            case OpType::LEA:
+            {
+                /* rax, rsp and the argument registers change while the arguments are placed */
+                const MemRef &a = ir->addr(k);
+                return (a.base == Reg::rbp || a.base == Reg::rip || a.base == Reg::none) && a.index == Reg::none;
+            }
+
+            default:
+                return false;
         }
+    }
 
-        gen(n);
-        if (!n->name.empty())
+    void x86_64::materialize(const NodeId k, const Reg r)
+    {
+        const Rec &rec = (*ir)[k];
+        const bool xmm = r >= Reg::xmm0;
+        switch (rec.type)
         {
-            emit("movq %rbp, %rsp");
-            emit("popq %rbp");
-            emit("ret");
+            case OpType::FNUM: emit(xmm ? Op::movsd : Op::movq, mc::rip(constant(rec.value)), reg(r)); return;
+            case OpType::PARAM: emit(xmm ? Op::movsd : Op::movq, param(k), reg(r)); return;
+            default: break;
         }
-        gen_strings();
-        return out.str();
+
+        /* integers bound for an xmm register pass through rax, which is free by then */
+        const Reg to = xmm ? Reg::rax : r;
+        if (rec.type == OpType::NUM)
+            emit(Op::movq, imm(rec.value), reg(to));
+        else if (rec.type == OpType::STR)
+            emit(Op::leaq, mc::rip(literal(ir->strval(k))), reg(to));
+        else
+            emit(Op::leaq, format_addr(ir->addr(k)), reg(to));
+        if (xmm)
+            emit(Op::movq, reg(to), reg(r));
     }
 
-    void x86_64::gen(Node *n)
+    void x86_64::call_sysv(const NodeId n)
+    {
+        const auto args = ir->kids(n);
+        const auto count = static_cast<uint32_t>(args.size());
+        const Signature s = Signature::of((*ir)[n].value);
+
+        places.clear();
+        uint32_t ints = 0;
+        uint32_t fps = 0;
+        uint32_t stacked = 0;
+        uint32_t pushed = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (args[i] != NONE && op_info((*ir)[args[i]].type).vector)
+                throw std::invalid_argument("x86_64: vectors can't be passed to a CALL");
+
+            const bool fp = s.fp(i) || fp_value(args[i]);
+            Reg r = Reg::none;
+            if (fp && fps < FP_ARGS)
+                r = fp_arg(fps++);
+            else if (!fp && ints < std::size(INT_ARGS))
+                r = INT_ARGS[ints++];
+            else
+                ++stacked;
+            places.push_back(r);
+            pushed += !direct(args[i]);
+        }
+
+        /* the k-th pushed argument is 8 * (pushed - 1 - k) above the rsp that rax saves */
+        const auto at = [pushed](const uint32_t k) { return mem(Reg::rax, 8 * static_cast<int64_t>(pushed - 1 - k)); };
+
+        /* the overflow goes below an aligned rsp in order, the old rsp above it */
+        emit(Op::movq, reg(Reg::rsp), reg(Reg::rax));
+        emit(Op::andq, imm(-16), reg(Reg::rsp));
+        if (stacked % 2 == 0)
+            emit(Op::subq, imm(8), reg(Reg::rsp));
+        emit(Op::pushq, reg(Reg::rax));
+        for (uint32_t i = count, k = pushed; i-- > 0;)
+        {
+            const bool leaf = direct(args[i]);
+            k -= !leaf;
+            if (places[i] != Reg::none)
+                continue;
+
+            if (leaf)
+                materialize(args[i], Reg::rcx);
+            else
+                emit(Op::movq, at(k), reg(Reg::rcx));
+            emit(Op::pushq, reg(Reg::rcx));
+        }
+
+        /* then the registers: what was pushed while rax still points at it, leaves last */
+        for (uint32_t i = 0, k = 0; i < count; ++i)
+        {
+            if (direct(args[i]))
+                continue;
+            if (places[i] != Reg::none)
+                emit(places[i] >= Reg::xmm0 ? Op::movsd : Op::movq, at(k), reg(places[i]));
+            ++k;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (places[i] != Reg::none && direct(args[i]))
+                materialize(args[i], places[i]);
+        }
+
+        /* al bounds the vector registers used, for variadic callees */
+        emit(Op::movq, imm(fps), reg(Reg::rax));
+        emit(Op::call, mc::sym(symbol(ir->name_id(n))));
+        emit(Op::movq, mem(Reg::rsp, 8 * static_cast<int64_t>(stacked)), reg(Reg::rsp));
+        if (pushed)
+            emit(Op::addq, imm(8 * static_cast<int64_t>(pushed)), reg(Reg::rsp));
+    }
+
+    bool x86_64::fp_value(const NodeId k) const
+    {
+        if (k == NONE)
+            return false;
+
+        const Rec &r = (*ir)[k];
+        switch (r.type)
+        {
+            case OpType::FNUM: return true;
+            case OpType::VSUM: return VecType::of(r.value).fp();
+            case OpType::PARAM: return sig.fp(static_cast<uint32_t>(r.value));
+            case OpType::CALL: return Signature::of(r.value).returns_double;
+            default: return op_info(r.type).cls == OpClass::fp && op_info(r.type).value;
+        }
+    }
+
+    mc::Operand x86_64::param(const NodeId n) const
+    {
+        const int64_t i = (*ir)[n].value;
+        if (!framed || i < 0 || i >= sig.params)
+            throw std::invalid_argument("x86_64: PARAM " + std::to_string(i) + " is not a parameter of the function");
+
+        /* the same count as call_sysv(): registers are homed in order, the rest are above the return address */
+        uint32_t ints = 0;
+        uint32_t fps = 0;
+        uint32_t stacked = 0;
+        for (uint32_t j = 0;; ++j)
+        {
+            const bool fp = sig.fp(j);
+            const bool in_reg = fp ? fps < FP_ARGS : ints < std::size(INT_ARGS);
+            if (j == i)
+                return in_reg ? mem(Reg::rbp, -8 * static_cast<int64_t>(ints + fps + 1)) : mem(Reg::rbp, 16 + 8 * static_cast<int64_t>(stacked));
+
+            if (!in_reg)
+                ++stacked;
+            else if (fp)
+                ++fps;
+            else
+                ++ints;
+        }
+    }
+
+    void x86_64::prologue(const IR &g, const NodeId n)
     {
-        if (!n)
+        const std::string_view name = g.name(n);
+        framed = !name.empty();
+        sig = Signature::of(g[n].value);
+        fn = NONE;
+        if (!framed)
             return;
 
-        switch (n->type)
+        fn = code.sym(name);
+        emit(Op::label, mc::sym(fn));
+        emit(Op::pushq, reg(Reg::rbp));
+        emit(Op::movq, reg(Reg::rsp), reg(Reg::rbp));
+
+        /* parameters that came in registers get a home below rbp, see param() */
+        uint32_t ints = 0;
+        uint32_t fps = 0;
+        for (uint32_t i = 0; i < sig.params; ++i)
         {
-            case OpType::NUM:
+            if (!sig.fp(i) && ints < std::size(INT_ARGS))
+                emit(Op::pushq, reg(INT_ARGS[ints++]));
+            else if (sig.fp(i) && fps < FP_ARGS)
             {
-                emit("movq $" + std::to_string(n->value) + ", %rax");
-                break;
+                emit(Op::subq, imm(8), reg(Reg::rsp));
+                emit(Op::movsd, reg(fp_arg(fps++)), mem(Reg::rsp));
             }
+        }
+    }
 
-            case OpType::STR:
-            {
-                strs.push_back(n->strval);
-                emit("leaq .LC" + std::to_string(strs.size() - 1) + "(%rip), %rax");
-                break;
-            }
+    void x86_64::epilogue(const IR &g, const NodeId n)
+    {
+        if (!framed)
+            return;
 
-            case OpType::IADD:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("addq %rcx, %rax");
-                emit("pushq %rax");
-                break;
-            }
+        const auto kids = g.kids(n);
+        const auto last = std::ranges::find_if(kids.rbegin(), kids.rend(), [](const NodeId k) { return k != NONE; });
+        if (last != kids.rend() && (g[*last].type == OpType::RET || g[*last].type == OpType::JMP))
+            return;
 
-            case OpType::ISUB:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("subq %rcx, %rax");
-                emit("pushq %rax");
-                break;
-            }
+        emit(Op::movq, reg(Reg::rbp), reg(Reg::rsp));
+        emit(Op::popq, reg(Reg::rbp));
+        emit(Op::ret);
+    }
 
-            case OpType::IMUL:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("imulq %rcx, %rax");
-                emit("pushq %rax");
-                break;
-            }
+    void x86_64::gen_rodata(Buffer &sink) const
+    {
+        pool.print(sink);
+    }
 
-            case OpType::IDIV:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx"); /* divisor */
-                emit("popq %rax"); /* dividend */
-                emit("xorq %rdx, %rdx");
-                emit("idivq %rcx");
-                emit("pushq %rax");
-                break;
-            }
+    uint64_t x86_64::config() const
+    {
+        const mc::Peephole::Config &p = opts.peephole_config;
+        uint64_t k = static_cast<uint64_t>(opts.alloc) | uint64_t{ opts.avx2 } << 8 | uint64_t{ opts.reduce } << 10 | uint64_t{ opts.select } << 11;
+        if (opts.peephole)
+            k |= uint64_t{ 1 } << 9 | uint64_t{ p.rules } << 16 | uint64_t{ p.window } << 32 | uint64_t{ p.rounds } << 48;
+        return k;
+    }
+
+    CodeCache::Key x86_64::cache_key(const IR &g, const NodeId n) const
+    {
+        const Fingerprint f = fingerprint(g, n);
+        return { f.hash ^ config() * 0x9e3779b97f4a7c15, f.check ^ config() * 0xc2b2ae3d27d4eb4f, f.nodes };
+    }
+
+    void x86_64::adopt(CodeCache::Entry &e, const std::string_view name)
+    {
+        code = std::move(e.code);
+        pool = std::move(e.pool);
+        for (size_t k = 0; k < ConstPool::KINDS; ++k)
+            pool_syms[k] = std::move(e.pool_syms[k]);
+        fn = e.fn;
+        if (fn == NONE)
+            return;
+
+        /* the hash maps every use of the function's name to it, so the new name collides with nothing */
+        Symtab syms;
+        for (SymId s = 0; s < code.syms.size(); ++s)
+            syms.intern(s == fn ? name : code.syms[s]);
+        code.syms = std::move(syms);
+    }
+
+    void x86_64::lower(const IR &g, const NodeId n)
+    {
+        if (stats())
+            stats()->enter(g, n);
+        const uint64_t allocs_before = allocs;
+        const uint64_t spills_before = spills;
 
-            case OpType::IMOD:
+        CodeCache::Key key;
+        if (opts.cache)
+        {
+            Stats::Timer t(stats(), Stats::Phase::cache);
+            CodeCache::Entry hit;
+            key = cache_key(g, n);
+            if (opts.cache->find(key, hit))
             {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-
-                /* similar to IDIV... */
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("xorq %rdx, %rdx");
-                emit("idivq %rcx");
-                emit("pushq %rdx");
-                break;
+                adopt(hit, g.name(n));
+                if (stats())
+                    stats()->current()->cached = true;
+                account(allocs_before, spills_before);
+                return;
             }
+        }
+
+        {
+            Stats::Timer t(stats(), Stats::Phase::lower);
+            code.clear();
+            pool.clear();
+            for (std::vector<uint32_t> &syms: pool_syms)
+                syms.clear();
+            label_counter = 0;
+            upper = false;
+
+            prologue(g, n);
+            gen(g, n);
+            epilogue(g, n);
+
+            /* dirty ymm upper halves slow down SSE code in callers and callees */
+            if (upper)
+                clear_upper();
+        }
 
-            case OpType::LABEL:
+        if (opts.peephole)
+        {
+            Stats::Timer t(stats(), Stats::Phase::peephole);
+            peep.run(code);
+        }
+
+        if (opts.cache)
+            opts.cache->insert(key, { code, pool, { pool_syms[0], pool_syms[1], pool_syms[2] }, fn });
+        account(allocs_before, spills_before);
+    }
+
+    void x86_64::lower(const IR &g, const NodeId n, Unit &u)
+    {
+        if (stats())
+            stats()->enter(g, n);
+        const uint64_t allocs_before = allocs;
+        const uint64_t spills_before = spills;
+        Stats::Timer t(stats(), Stats::Phase::lower);
+
+        /* RET and PARAM lower differently with another frame */
+        const bool frame = !g.name(n).empty();
+        if (u.ir != &g || u.config != config() || u.framed != frame || u.signature != g[n].value)
+        {
+            u = Unit();
+            u.ir = &g;
+            u.config = config();
+            u.framed = frame;
+            u.signature = g[n].value;
+        }
+
+        trade(u);
+        code.insts.clear();
+        prologue(g, n);
+
+        /* a statement keeps its piece while its stamp holds, wherever it moved */
+        std::unordered_map<NodeId, size_t> kept;
+        kept.reserve(u.pieces.size());
+        for (size_t i = 0; i < u.pieces.size(); ++i)
+            kept.emplace(u.pieces[i].stmt, i);
+
+        std::vector<Unit::Piece> pieces;
+        pieces.reserve(g.kids(n).size());
+        std::vector<Inst> spliced = std::move(code.insts);
+        u.reused = 0;
+        u.lowered = 0;
+        bool dirty_upper = false;
+
+        const IR *prev = enter(g);
+        for (const NodeId k: g.kids(n))
+        {
+            if (k == NONE)
+                continue;
+
+            const uint32_t stamp = g.stamp(k);
+            const auto it = kept.find(k);
+            if (it != kept.end() && u.pieces[it->second].stamp == stamp)
             {
-                emit(n->name + ":", false);
-                break;
+                /* the same statement twice in n is lowered again the second time */
+                pieces.push_back(std::move(u.pieces[it->second]));
+                kept.erase(it);
+                ++u.reused;
             }
-
-            case OpType::ROOT:
+            else
             {
-                for (const auto &kid: n->kids)
-                {
-                    gen(kid.get());
-                }
-                break;
+                code.insts.clear();
+                upper = false;
+                gen_tree(k);
+                if (opts.peephole)
+                    peep.run(code);
+
+                pieces.push_back({ k, stamp, upper, std::move(code.insts) });
+                ++u.lowered;
             }
 
-            case OpType::CALL:
-            {
-                for (auto &kid: std::ranges::reverse_view(n->kids))
-                    gen(kid.get());
+            const Unit::Piece &p = pieces.back();
+            spliced.insert(spliced.end(), p.insts.begin(), p.insts.end());
+            dirty_upper = dirty_upper || p.upper;
+        }
+        ir = prev;
 
-                emit("call " + n->name);
-                if (!n->kids.empty())
-                    emit("addq $" + std::to_string(8 * n->kids.size()) + ", %rsp");
+        code.insts = std::move(spliced);
+        epilogue(g, n);
+        if (dirty_upper)
+            clear_upper();
 
-                emit("pushq %rax");
-                break;
-            }
+        u.pieces = std::move(pieces);
+        account(allocs_before, spills_before);
+    }
 
-            case OpType::RET:
-            {
-                if (!n->kids.empty())
+    void x86_64::account(const uint64_t allocs_before, const uint64_t spills_before)
+    {
+        Stats::Function *const f = stats() ? stats()->current() : nullptr;
+        if (!f)
+            return;
+
+        f->allocs = static_cast<uint32_t>(allocs - allocs_before);
+        f->spills = static_cast<uint32_t>(spills - spills_before);
+        f->instructions = code.insts.size() - static_cast<size_t>(std::ranges::count(code.insts, Op::label, &Inst::op));
+
+        /*
+         * how far rsp gets below where it was on entry, following the
+         * instructions in order. statements leave it where they found it,
+         * so after a ret it is back where the epilogue before took it from
+         */
+        const auto is = [](const Operand &o, const Reg r) { return o.kind == Operand::Kind::reg && o.reg == r; };
+        int64_t depth = 0;
+        int64_t saved = 0;  /* when rsp was last copied, call_aligned() loads it back */
+        int64_t resume = 0; /* before the last epilogue */
+        for (const Inst &i: code.insts)
+        {
+            const bool to_rsp = is(i.b, Reg::rsp);
+            const int64_t by = i.a.kind == Operand::Kind::imm ? i.a.imm : 0;
+            switch (i.op)
+            {
+                case Op::pushq: depth += 8; break;
+                case Op::popq: depth = is(i.a, Reg::rsp) ? saved : depth - 8; break;
+                case Op::subq: depth += to_rsp ? by : 0; break;
+                case Op::addq: depth -= to_rsp ? by : 0; break;
+                case Op::andq: depth += to_rsp ? 8 : 0; break; /* rsp is 8-byte aligned */
+                case Op::ret: depth = resume; break;
+                case Op::movq:
                 {
-                    gen(n->kids[0].get());
-                    emit("popq %rax");
+                    if (is(i.a, Reg::rsp))
+                        saved = depth;
+                    else if (is(i.a, Reg::rbp) && to_rsp)
+                    {
+                        resume = depth;
+                        depth = 8; /* rbp was pushed on entry */
+                    }
+                    else if (to_rsp)
+                        depth = saved;
+                    break;
                 }
-                emit("ret");
-                break;
+                default: break;
             }
+            f->stack = std::max(f->stack, depth);
+        }
+    }
 
-            case OpType::PUSH:
-            {
-                gen(n->kids[0].get());
-                break;
-            }
+    void x86_64::trade(Unit &u)
+    {
+        std::swap(code.syms, u.syms);
+        std::swap(pool, u.pool);
+        std::swap(pool_syms, u.pool_syms);
+        std::swap(label_counter, u.labels);
+    }
 
-            case OpType::POP:
-            {
-                emit("popq %rax");
-                break;
-            }
+    void x86_64::clear_upper()
+    {
+        std::vector<Inst> &v = code.insts;
+        const auto leaves = [](const Inst &i) { return i.op == Op::call || i.op == Op::ret; };
+        const size_t n = v.size();
+        v.resize(n + static_cast<size_t>(std::ranges::count_if(v, leaves)));
 
-            case OpType::LEA:
-            {
-                emit("leaq " + format_addr(n->addr) + ", %rax");
-                emit("pushq %rax");
-                break;
-            }
+        /* back to front, every instruction moves once */
+        for (size_t from = n, to = v.size(); from-- > 0;)
+        {
+            v[--to] = v[from];
+            if (leaves(v[to]))
+                v[--to] = Inst(Op::vzeroupper);
+        }
+    }
 
-            case OpType::LOAD:
-            {
-                gen(n->kids[0].get());
-                emit("popq %rax");
-                emit("movq (%rax), %rax");
-                emit("pushq %rax");
-                break;
-            }
+    void x86_64::print(Buffer &sink) const
+    {
+        Stats::Timer t(stats(), Stats::Phase::print);
+        const size_t start = stats() ? sink.size() : 0;
+        sink.put(".section .text\n.align 16\n");
+        if (fn != NONE)
+        {
+            sink.put(".global ").put(code.syms[fn]).put('\n');
+            sink.put(".type ").put(code.syms[fn]).put(", @function\n");
+        }
+        mc::print(code, sink);
+        gen_rodata(sink);
+        if (Stats::Function *const f = stats() ? stats()->current() : nullptr)
+            f->listing += sink.size() - start;
+    }
 
-            case OpType::STORE:
-            {
-                gen(n->kids[0].get()); /* addr */
-                gen(n->kids[1].get()); /* value */
-                emit("popq %rcx");     /* value */
-                emit("popq %rax");     /* addr */
-                emit("movq %rcx, (%rax)");
-                break;
-            }
+    NodeId x86_64::import(Node *n)
+    {
+        if (stats())
+            stats()->leave();
+        Stats::Timer t(stats(), Stats::Phase::import);
+        scratch.clear();
+        return scratch.import(n);
+    }
 
-            case OpType::JMP:
-            {
-                emit("jmp " + n->name);
-                break;
-            }
+    std::string x86_64::generate(Node *n)
+    {
+        const NodeId root = import(n);
+        return generate(scratch, root);
+    }
 
-            case OpType::ICMP:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("cmpq %rcx, %rax");
-                break;
-            }
+    std::string x86_64::generate(const IR &g, const NodeId n)
+    {
+        out.clear();
+        generate(g, n, out);
+        Stats::Timer t(stats(), Stats::Phase::copy);
+        return out.str();
+    }
 
-            case OpType::JE:
-            {
-                emit("je " + n->name);
-                break;
-            }
+    void x86_64::generate(Node *n, Buffer &sink)
+    {
+        const NodeId root = import(n);
+        generate(scratch, root, sink);
+    }
 
-            case OpType::JNE:
-            {
-                emit("jne " + n->name);
-                break;
-            }
+    void x86_64::generate(const IR &g, const NodeId n, Buffer &sink)
+    {
+        lower(g, n);
+        print(sink);
+    }
 
-            case OpType::JL:
-            {
-                emit("jl " + n->name);
-                break;
-            }
+    std::string x86_64::generate(const IR &g, const NodeId n, Unit &u)
+    {
+        out.clear();
+        generate(g, n, u, out);
+        Stats::Timer t(stats(), Stats::Phase::copy);
+        return out.str();
+    }
 
-            case OpType::JLE:
-            {
-                emit("jle " + n->name);
-                break;
-            }
+    void x86_64::generate(const IR &g, const NodeId n, Unit &u, Buffer &sink)
+    {
+        lower(g, n, u);
+        print(sink);
+        trade(u);
+    }
 
-            case OpType::JG:
-            {
-                emit("jg " + n->name);
-                break;
-            }
+    mc::Object x86_64::assemble(Node *n)
+    {
+        const NodeId root = import(n);
+        return assemble(scratch, root);
+    }
 
-            case OpType::JGE:
-            {
-                emit("jge " + n->name);
-                break;
-            }
+    mc::Object x86_64::assemble(const IR &g, const NodeId n)
+    {
+        lower(g, n);
 
-            case OpType::BOR:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("orq %rcx, %rax");
-                emit("pushq %rax");
-                break;
-            }
+        Stats::Timer t(stats(), Stats::Phase::encode);
+        mc::Object o;
+        mc::encode(code, o);
+        if (fn != NONE)
+        {
+            o.syms[fn].global = true;
+            o.syms[fn].size = static_cast<uint32_t>(o.text.size()) - o.syms[fn].offset;
+        }
 
-            case OpType::BAND:
+        ConstPool::Layout l;
+        pool.layout(l);
+        pool.bytes(l, o.rodata);
+        o.rodata_align = l.align;
+        for (size_t k = 0; k < ConstPool::KINDS; ++k)
+        {
+            for (size_t id = 0; id < pool_syms[k].size(); ++id)
             {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("andq %rcx, %rax");
-                emit("pushq %rax");
-                break;
+                mc::Symbol &s = o.syms[pool_syms[k][id]];
+                s.section = mc::Section::rodata;
+                s.offset = l.offsets[k][id];
             }
+        }
+        if (Stats::Function *const f = stats() ? stats()->current() : nullptr)
+            f->text += o.text.size();
+        return o;
+    }
 
-            case OpType::BXOR:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("xorq %rcx, %rax");
-                emit("pushq %rax");
-                break;
-            }
+    void x86_64::write_object(const IR &g, const NodeId n, Buffer &sink)
+    {
+        const mc::Object o = assemble(g, n);
+        Stats::Timer t(stats(), Stats::Phase::write);
+        mc::write_elf(o, sink);
+    }
 
-            case OpType::BNOT:
-            {
-                gen(n->kids[0].get());
-                emit("popq %rax");
-                emit("notq %rax");
-                emit("pushq %rax");
-                break;
-            }
+    void x86_64::gen(Node *n)
+    {
+        const NodeId root = import(n);
+        gen(scratch, root);
+    }
 
-            case OpType::BSHL:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx"); /* shift amount */
-                emit("popq %rax"); /* val to shift */
-                emit("shlq %cl, %rax");
-                emit("pushq %rax");
-                break;
-            }
+    void x86_64::gen(const IR &g, const NodeId n)
+    {
+        const IR *prev = enter(g);
+        gen_tree(n);
+        ir = prev;
+    }
 
-            case OpType::BSHR:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx"); /* shift amount */
-                emit("popq %rax"); /* val to shift */
-                emit("shrq %cl, %rax");
-                emit("pushq %rax");
-                break;
-            }
+    const IR *x86_64::enter(const IR &g)
+    {
+        for (const StrId s: sym_used)
+            sym_of[s] = NONE;
+        sym_used.clear();
+        if (opts.alloc == Alloc::regs)
+            need.assign(g.size(), 0);
+        return std::exchange(ir, &g);
+    }
 
-            case OpType::MOV:
-            {
-                gen(n->kids[1].get());
-                emit("popq %rax");
-                emit("movq %rax, " + format_addr(n->kids[0].get()->addr));
-                break;
-            }
+    void x86_64::gen_tree(const NodeId n)
+    {
+        Mode mode = Mode::stack;
+        if (opts.alloc == Alloc::regs)
+        {
+            measure(n);
+            if (opts.select)
+                matcher.label(*ir, n, opts.reduce);
+            free_regs = ~0u;
+            vecs = 0;
+            mode = Mode::stmt;
+        }
 
-            case OpType::FADD:
+        walk.run(n, { mode }, [this](Frame &f)
+        {
+            switch (f.state.mode)
             {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("movsd (%rsp), %xmm0");
-                emit("movsd 8(%rsp), %xmm1");
-                emit("addsd %xmm1, %xmm0");
-                emit("addq $16, %rsp");
-                emit("sub $8, %rsp");
-                emit("movsd %xmm0, (%rsp)");
-                break;
+                case Mode::stack: step_stack(f); break;
+                case Mode::stmt: step_stmt(f); break;
+                case Mode::value: step_value(f); break;
             }
+        });
+    }
 
-            case OpType::FSUB:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("movsd (%rsp), %xmm0");
-                emit("movsd 8(%rsp), %xmm1");
-                emit("subsd %xmm0, %xmm1");
-                emit("addq $16, %rsp");
-                emit("sub $8, %rsp");
-                emit("movsd %xmm1, (%rsp)");
-                break;
-            }
+    void x86_64::step_stack(Frame &f)
+    {
+        const NodeId n = f.node;
+        if (n == NONE)
+            return;
 
-            case OpType::FDIV:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("movsd (%rsp), %xmm0");
-                emit("movsd 8(%rsp), %xmm1");
-                emit("divsd %xmm0, %xmm1");
-                emit("addq $16, %rsp");
-                emit("sub $8, %rsp");
-                emit("movsd %xmm1, (%rsp)");
-                break;
-            }
+        /* a splat of a constant is one load from .rodata */
+        if (const uint32_t c = splat_constant(n); c != NONE)
+        {
+            const uint8_t b = vtype(n).bytes;
+            emit_vec(Op::movdqu, b, mc::rip(c), reg(Reg::xmm0));
+            emit(Op::subq, imm(b), reg(Reg::rsp));
+            emit_vec(Op::movdqu, b, reg(Reg::xmm0), mem(Reg::rsp));
+            return;
+        }
 
-            case OpType::FMOD:
+        /* operands first, each leaves its value on the stack; leaves are lowered in place */
+        const Rec &rec = (*ir)[n];
+        const uint32_t count = stack_operands(rec);
+        uint32_t c = 0;
+        const bool reduced = reducible(n, c);
+        for (; f.step < count; ++f.step)
+        {
+            const uint32_t i = op_info(rec.type).first + f.step;
+            const NodeId k = ir->kid(n, i);
+            if ((rec.type == OpType::CALL && direct(k)) || (reduced && i == c))
+                continue; /* call_sysv() or reduce() puts it in place */
+            if (k != NONE && stack_operands((*ir)[k]))
             {
-                /*
-                 * x86_64 doesn't have a direct floating-point modulo
-                 * so we'll use FPU for this
-                 */
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("fldl 8(%rsp)"); /* load first value */
-                emit("fldl (%rsp)"); /* load second val */
-                emit("fprem"); /* partial rem */
-                emit("fstp %st(1)"); /* store res, discard extra */
-                emit("addq $16, %rsp");
-                emit("sub $8, %rsp");
-                emit("fstpl (%rsp)"); /* res to stack*/
-                break;
+                walk.descend(k, { Mode::stack });
+                return;
             }
+            lower_stack(k);
+        }
 
-            case OpType::FCMP:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("movsd (%rsp), %xmm0");
-                emit("movsd 8(%rsp), %xmm1");
-                emit("ucomisd %xmm1, %xmm0");
-                emit("addq $16, %rsp");
-                break;
-            }
+        if (reduced)
+        {
+            emit(Op::popq, reg(Reg::rax));
+            reduce(rec.type, (*ir)[ir->kid(n, c)].value, Reg::rax);
+            emit(Op::pushq, reg(Reg::rax));
+        }
+        else
+            lower_stack(n);
+    }
 
-            case OpType::TEST:
-            {
-                gen(n->kids[0].get());
-                gen(n->kids[1].get());
-                emit("popq %rcx");
-                emit("popq %rax");
-                emit("testq %rcx, %rax");
-                break;
-            }
+    template<OpType T>
+    void x86_64::stack_op(const NodeId n)
+    {
+        constexpr Select s = select(T);
+        static_assert(s.form != Form::special, "Form::special ops need a stack_op specialization");
 
-            default:
-            {
-                emit("nop");
-                break;
-            }
+        if constexpr (s.form == Form::binary || s.form == Form::shift || s.form == Form::compare)
+        {
+            emit(Op::popq, reg(Reg::rcx)); /* right, the shift amount for shifts */
+            emit(Op::popq, reg(Reg::rax)); /* left */
+            emit(s.op, reg(Reg::rcx), reg(Reg::rax));
+            if constexpr (s.form != Form::compare)
+                emit(Op::pushq, reg(s.result));
+        }
+        else if constexpr (s.form == Form::divide)
+        {
+            emit(Op::popq, reg(Reg::rcx)); /* divisor */
+            emit(Op::popq, reg(Reg::rax)); /* dividend */
+            emit(Op::cqto);
+            emit(s.op, reg(Reg::rcx));
+            emit(Op::pushq, reg(s.result));
+        }
+        else if constexpr (s.form == Form::unary)
+        {
+            emit(Op::popq, reg(Reg::rax));
+            emit(s.op, reg(Reg::rax));
+            emit(Op::pushq, reg(s.result));
+        }
+        else if constexpr (s.form == Form::fp)
+        {
+            /* left into the result register, right used straight from the stack */
+            emit(Op::movsd, mem(Reg::rsp, 8), reg(s.result));
+            emit(s.op, mem(Reg::rsp), reg(s.result));
+            emit(Op::addq, imm(8), reg(Reg::rsp));
+            emit(Op::movsd, reg(s.result), mem(Reg::rsp));
+        }
+        else if constexpr (s.form == Form::fp_compare)
+        {
+            /* both are loaded before the stack is popped, addq would clobber the flags */
+            emit(Op::movsd, mem(Reg::rsp, 8), reg(Reg::xmm0));
+            emit(Op::movsd, mem(Reg::rsp), reg(Reg::xmm1));
+            emit(Op::addq, imm(16), reg(Reg::rsp));
+            emit(s.op, reg(Reg::xmm1), reg(Reg::xmm0));
         }
+        else if constexpr (s.form == Form::jump)
+            emit(s.op, mc::sym(symbol(ir->name_id(n))));
+        else if constexpr (s.form == Form::vector)
+            stack_vector(n);
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::LABEL>(const NodeId n)
+    {
+        emit(Op::label, mc::sym(symbol(ir->name_id(n))));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::NUM>(const NodeId n)
+    {
+        emit(Op::movq, imm((*ir)[n].value), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::STR>(const NodeId n)
+    {
+        emit(Op::leaq, mc::rip(literal(ir->strval(n))), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::FNUM>(const NodeId n)
+    {
+        emit(Op::pushq, mc::rip(constant((*ir)[n].value)));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::FMOD>(const NodeId)
+    {
+        /*
+         * SSE has no remainder, and x - trunc(x/y)*y is not exact, so
+         * this is libm's fmod. the result replaces the left operand
+         */
+        emit(Op::movsd, mem(Reg::rsp, 8), reg(Reg::xmm0));
+        emit(Op::movsd, mem(Reg::rsp), reg(Reg::xmm1));
+        emit(Op::addq, imm(8), reg(Reg::rsp));
+        call_aligned(code.sym("fmod"));
+        emit(Op::movsd, reg(Reg::xmm0), mem(Reg::rsp));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::LOAD>(const NodeId)
+    {
+        emit(Op::popq, reg(Reg::rax));
+        emit(Op::movq, mem(Reg::rax), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::STORE>(const NodeId)
+    {
+        emit(Op::popq, reg(Reg::rcx));     /* value */
+        emit(Op::popq, reg(Reg::rax));     /* addr */
+        emit(Op::movq, reg(Reg::rcx), mem(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::LEA>(const NodeId n)
+    {
+        emit(Op::leaq, format_addr(ir->addr(n)), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::CALL>(const NodeId n)
+    {
+        call_sysv(n);
+        if (Signature::of((*ir)[n].value).returns_double)
+            emit(Op::movq, reg(Reg::xmm0), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::RET>(const NodeId n)
+    {
+        if (!ir->kids(n).empty())
+        {
+            emit(Op::popq, reg(Reg::rax));
+            if (sig.returns_double)
+                emit(Op::movq, reg(Reg::rax), reg(Reg::xmm0));
+        }
+        if (framed)
+        {
+            emit(Op::movq, reg(Reg::rbp), reg(Reg::rsp));
+            emit(Op::popq, reg(Reg::rbp));
+        }
+        emit(Op::ret);
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::POP>(const NodeId)
+    {
+        emit(Op::popq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::MOV>(const NodeId n)
+    {
+        emit(Op::popq, reg(Reg::rax));
+        emit(Op::movq, reg(Reg::rax), format_addr(ir->addr(ir->kid(n, 0))));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::PARAM>(const NodeId n)
+    {
+        emit(Op::movq, param(n), reg(Reg::rax));
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::BR>(const NodeId n)
+    {
+        const Compare c = comparison(n);
+        stack_compare(c);
+        branch(n, c);
+    }
+
+    template<>
+    void x86_64::stack_op<OpType::SET>(const NodeId n)
+    {
+        const Compare c = comparison(n);
+        stack_compare(c);
+        flag(c, Reg::rax);
+        emit(Op::pushq, reg(Reg::rax));
+    }
+
+    void x86_64::lower_stack(const NodeId n)
+    {
+        if (n == NONE)
+            return;
+
+        static constexpr auto lower = []<size_t... I>(std::index_sequence<I...>)
+        {
+            return std::array{ &x86_64::stack_op<static_cast<OpType>(I)>... };
+        }(std::make_index_sequence<std::size(SELECT)>());
+
+        const auto t = static_cast<size_t>((*ir)[n].type);
+        if (t < lower.size())
+            (this->*lower[t])(n);
+        else
+            emit(Op::nop);
     }
 }
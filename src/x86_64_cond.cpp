@@ -0,0 +1,142 @@
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * BR and SET: one cmpq, testq or ucomisd, then a jcc for BR or a setcc
+ * for SET. the flags are set right before they are read, so nothing in
+ * the IR has to keep them alive between two nodes
+ *
+ * ucomisd sets CF and ZF like an unsigned compare and PF when either side
+ * is NaN. gt and ge are ja and jae, which are false on NaN; lt and le
+ * compare the other way round to use them too. eq also needs PF clear and
+ * ne is taken on PF alone, so those two are a pair of jumps or setccs
+ */
+namespace cdgnx::backend
+{
+    using mc::imm;
+    using mc::mem;
+    using mc::reg;
+
+    namespace
+    {
+        struct Flags
+        {
+            mc::Op jump;
+            mc::Op set;
+            bool swap = false; /* FCMP only: compare right against left */
+        };
+
+        /* indexed by Cond */
+        constexpr Flags INTEGER[] = {
+            { mc::Op::je, mc::Op::sete }, { mc::Op::jne, mc::Op::setne },
+            { mc::Op::jl, mc::Op::setl }, { mc::Op::jle, mc::Op::setle }, { mc::Op::jg, mc::Op::setg }, { mc::Op::jge, mc::Op::setge },
+            { mc::Op::jb, mc::Op::setb }, { mc::Op::jbe, mc::Op::setbe }, { mc::Op::ja, mc::Op::seta }, { mc::Op::jae, mc::Op::setae }
+        };
+
+        constexpr Flags FLOAT[] = {
+            { mc::Op::je, mc::Op::sete }, { mc::Op::jne, mc::Op::setne },
+            { mc::Op::ja, mc::Op::seta, true }, { mc::Op::jae, mc::Op::setae, true }, { mc::Op::ja, mc::Op::seta }, { mc::Op::jae, mc::Op::setae },
+            { mc::Op::ja, mc::Op::seta, true }, { mc::Op::jae, mc::Op::setae, true }, { mc::Op::ja, mc::Op::seta }, { mc::Op::jae, mc::Op::setae }
+        };
+
+        static_assert(std::size(INTEGER) == static_cast<size_t>(Cond::uge) + 1 && std::size(FLOAT) == std::size(INTEGER));
+
+        const Flags &flags(const Compare c)
+        {
+            return (c.op == OpType::FCMP ? FLOAT : INTEGER)[static_cast<size_t>(c.cond)];
+        }
+    }
+
+    Compare x86_64::comparison(const NodeId n) const
+    {
+        const Compare c = Compare::of((*ir)[n].value);
+        if ((c.op != OpType::ICMP && c.op != OpType::TEST && c.op != OpType::FCMP) || c.cond > Cond::uge)
+            throw std::invalid_argument("x86_64: bad compare");
+        return c;
+    }
+
+    void x86_64::compare(const Compare c, const Reg l, const Reg r)
+    {
+        if (c.op == OpType::FCMP)
+        {
+            if (flags(c).swap)
+                emit(Op::ucomisd, reg(l), reg(r));
+            else
+                emit(Op::ucomisd, reg(r), reg(l));
+        }
+        else
+            emit(select(c.op).op, reg(r), reg(l));
+    }
+
+    void x86_64::stack_compare(const Compare c)
+    {
+        if (c.op == OpType::FCMP)
+        {
+            /* loaded before the stack is popped, as for FCMP */
+            emit(Op::movsd, mem(Reg::rsp, 8), reg(Reg::xmm0));
+            emit(Op::movsd, mem(Reg::rsp), reg(Reg::xmm1));
+            emit(Op::addq, imm(16), reg(Reg::rsp));
+            compare(c, Reg::xmm0, Reg::xmm1);
+            return;
+        }
+
+        emit(Op::popq, reg(Reg::rcx));
+        emit(Op::popq, reg(Reg::rax));
+        compare(c, Reg::rax, Reg::rcx);
+    }
+
+    void x86_64::branch(const NodeId n, const Compare c)
+    {
+        if (ir->name_id(n) == 0)
+            throw std::invalid_argument("x86_64: BR without a target");
+
+        const auto taken = mc::sym(symbol(ir->name_id(n)));
+        const std::string_view other = ir->strval(n);
+        const uint32_t to = other.empty() ? NONE : code.sym(other);
+        const bool fp = c.op == OpType::FCMP;
+
+        if (fp && c.cond == Cond::eq)
+        {
+            /* unordered goes to other, or past the je */
+            uint32_t skip = to;
+            if (skip == NONE)
+            {
+                char name[24] = ".Lu";
+                const char *end = std::to_chars(name + 3, std::end(name), label_counter++).ptr;
+                skip = code.sym({ name, static_cast<size_t>(end - name) });
+            }
+
+            emit(Op::jp, mc::sym(skip));
+            emit(Op::je, taken);
+            if (to == NONE)
+                emit(Op::label, mc::sym(skip));
+        }
+        else
+        {
+            emit(flags(c).jump, taken);
+            if (fp && c.cond == Cond::ne)
+                emit(Op::jp, taken);
+        }
+
+        if (to != NONE)
+            emit(Op::jmp, mc::sym(to));
+    }
+
+    void x86_64::flag(const Compare c, const Reg dst)
+    {
+        emit(flags(c).set, reg(dst));
+        if (c.op == OpType::FCMP && (c.cond == Cond::eq || c.cond == Cond::ne))
+        {
+            const bool eq = c.cond == Cond::eq;
+            emit(eq ? Op::setnp : Op::setp, reg(Reg::rcx));
+            emit(Op::movzbl, reg(Reg::rcx), reg(Reg::rcx));
+            emit(Op::movzbl, reg(dst), reg(dst));
+            emit(eq ? Op::andq : Op::orq, reg(Reg::rcx), reg(dst));
+            return;
+        }
+
+        emit(Op::movzbl, reg(dst), reg(dst));
+    }
+}
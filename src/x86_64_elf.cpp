@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cdgnx/x86_64_mc.hpp>
+
+/*
+ * ELF64 relocatable objects after the System V gABI and the x86-64 psABI.
+ * the file is laid out in one pass: header, the section contents in
+ * section order, the section headers last. symbols are the null one,
+ * one per section that relocations can point into, then the globals,
+ * defined ones and externals in the order the object lists them
+ */
+namespace cdgnx::backend::mc
+{
+    namespace
+    {
+        constexpr uint16_t ET_REL = 1;
+        constexpr uint16_t EM_X86_64 = 62;
+
+        constexpr uint32_t SHT_PROGBITS = 1;
+        constexpr uint32_t SHT_SYMTAB = 2;
+        constexpr uint32_t SHT_STRTAB = 3;
+        constexpr uint32_t SHT_RELA = 4;
+
+        constexpr uint64_t SHF_ALLOC = 0x2;
+        constexpr uint64_t SHF_EXECINSTR = 0x4;
+        constexpr uint64_t SHF_INFO_LINK = 0x40;
+
+        constexpr uint8_t STB_LOCAL = 0;
+        constexpr uint8_t STB_GLOBAL = 1;
+        constexpr uint8_t STT_NOTYPE = 0;
+        constexpr uint8_t STT_OBJECT = 1;
+        constexpr uint8_t STT_FUNC = 2;
+        constexpr uint8_t STT_SECTION = 3;
+
+        constexpr uint32_t R_X86_64_PC32 = 2;
+        constexpr uint32_t R_X86_64_PLT32 = 4;
+
+        constexpr size_t EHDR_SIZE = 64;
+        constexpr size_t SHDR_SIZE = 64;
+        constexpr size_t SYM_SIZE = 24;
+        constexpr size_t RELA_SIZE = 24;
+
+        /* section header indices, in file order */
+        enum Index : uint16_t
+        {
+            NUL,
+            TEXT,
+            RODATA,
+            RELA_TEXT,
+            SYMTAB,
+            STRTAB,
+            SHSTRTAB,
+            NOTE_STACK,
+            SECTIONS
+        };
+
+        constexpr const char *SECTION_NAMES[] = {
+            "", ".text", ".rodata", ".rela.text", ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack"
+        };
+
+        static_assert(std::size(SECTION_NAMES) == SECTIONS);
+
+        /* symbol table indices of the section symbols */
+        constexpr uint32_t TEXT_SYM = 1;
+        constexpr uint32_t RODATA_SYM = 2;
+        constexpr uint32_t FIRST_GLOBAL = 3;
+
+        size_t align_up(const size_t v, const size_t a)
+        {
+            return (v + a - 1) & ~(a - 1);
+        }
+
+        /* little-endian fields into a Buffer, counting the offset */
+        class Writer
+        {
+        public:
+            explicit Writer(Buffer &b) : out(b) {}
+
+            template <typename T>
+            void put(const T v)
+            {
+                char b[sizeof(T)];
+                for (size_t i = 0; i < sizeof(T); ++i)
+                    b[i] = static_cast<char>(static_cast<uint64_t>(v) >> (8 * i));
+                bytes({ b, sizeof(T) });
+            }
+
+            void bytes(const std::string_view s)
+            {
+                out.put(s);
+                at += s.size();
+            }
+
+            void bytes(const std::vector<uint8_t> &v)
+            {
+                bytes({ reinterpret_cast<const char *>(v.data()), v.size() });
+            }
+
+            void pad(const size_t to)
+            {
+                static constexpr char ZEROS[16] = {};
+                while (at < to)
+                    bytes({ ZEROS, std::min(to - at, sizeof(ZEROS)) });
+            }
+
+            size_t at = 0;
+
+        private:
+            Buffer &out;
+        };
+
+        struct Sym
+        {
+            uint32_t name;
+            uint8_t info;
+            uint16_t shndx;
+            uint64_t value;
+            uint64_t size;
+        };
+
+        struct Shdr
+        {
+            uint32_t name = 0;
+            uint32_t type = 0;
+            uint64_t flags = 0;
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint32_t link = 0;
+            uint32_t info = 0;
+            uint64_t align = 1;
+            uint64_t entsize = 0;
+        };
+
+        uint16_t index_of(const Section s)
+        {
+            switch (s)
+            {
+                case Section::text: return TEXT;
+                case Section::rodata: return RODATA;
+                default: break;
+            }
+            return NUL;
+        }
+
+        uint32_t add_name(std::string &table, const std::string_view name)
+        {
+            const auto at = static_cast<uint32_t>(table.size());
+            table.append(name);
+            table.push_back('\0');
+            return at;
+        }
+    }
+
+    void write_elf(const Object &o, Buffer &out)
+    {
+        /* externals only count once something refers to them */
+        std::vector<uint8_t> referenced(o.syms.size(), 0);
+        for (const Reloc &r: o.relocs)
+            referenced[r.sym] = 1;
+
+        std::string strtab(1, '\0');
+        std::vector<Sym> syms = {
+            {},
+            { 0, STB_LOCAL << 4 | STT_SECTION, TEXT, 0, 0 },
+            { 0, STB_LOCAL << 4 | STT_SECTION, RODATA, 0, 0 }
+        };
+        std::vector<uint32_t> index(o.syms.size(), 0);
+        for (size_t i = 0; i < o.syms.size(); ++i)
+        {
+            const Symbol &s = o.syms[i];
+            const bool external = s.section == Section::undef;
+            if (external ? !referenced[i] : !s.global)
+                continue;
+
+            const uint8_t type = external ? STT_NOTYPE : s.section == Section::text ? STT_FUNC : STT_OBJECT;
+            index[i] = static_cast<uint32_t>(syms.size());
+            syms.push_back({ add_name(strtab, s.name), static_cast<uint8_t>(STB_GLOBAL << 4 | type), index_of(s.section), s.offset, s.size });
+        }
+
+        std::string shstrtab;
+        Shdr sh[SECTIONS];
+        for (uint16_t i = 0; i < SECTIONS; ++i)
+            sh[i].name = add_name(shstrtab, SECTION_NAMES[i]);
+        sh[NUL].align = 0;
+
+        sh[TEXT].type = SHT_PROGBITS;
+        sh[TEXT].flags = SHF_ALLOC | SHF_EXECINSTR;
+        sh[TEXT].offset = EHDR_SIZE;
+        sh[TEXT].size = o.text.size();
+        sh[TEXT].align = 16;
+
+        sh[RODATA].type = SHT_PROGBITS;
+        sh[RODATA].flags = SHF_ALLOC;
+        sh[RODATA].offset = align_up(sh[TEXT].offset + sh[TEXT].size, o.rodata_align);
+        sh[RODATA].size = o.rodata.size();
+        sh[RODATA].align = o.rodata_align;
+
+        sh[RELA_TEXT].type = SHT_RELA;
+        sh[RELA_TEXT].flags = SHF_INFO_LINK;
+        sh[RELA_TEXT].offset = align_up(sh[RODATA].offset + sh[RODATA].size, 8);
+        sh[RELA_TEXT].size = o.relocs.size() * RELA_SIZE;
+        sh[RELA_TEXT].link = SYMTAB;
+        sh[RELA_TEXT].info = TEXT;
+        sh[RELA_TEXT].align = 8;
+        sh[RELA_TEXT].entsize = RELA_SIZE;
+
+        sh[SYMTAB].type = SHT_SYMTAB;
+        sh[SYMTAB].offset = sh[RELA_TEXT].offset + sh[RELA_TEXT].size;
+        sh[SYMTAB].size = syms.size() * SYM_SIZE;
+        sh[SYMTAB].link = STRTAB;
+        sh[SYMTAB].info = FIRST_GLOBAL;
+        sh[SYMTAB].align = 8;
+        sh[SYMTAB].entsize = SYM_SIZE;
+
+        sh[STRTAB].type = SHT_STRTAB;
+        sh[STRTAB].offset = sh[SYMTAB].offset + sh[SYMTAB].size;
+        sh[STRTAB].size = strtab.size();
+
+        sh[SHSTRTAB].type = SHT_STRTAB;
+        sh[SHSTRTAB].offset = sh[STRTAB].offset + sh[STRTAB].size;
+        sh[SHSTRTAB].size = shstrtab.size();
+
+        /* empty: the code does not need an executable stack */
+        sh[NOTE_STACK].type = SHT_PROGBITS;
+        sh[NOTE_STACK].offset = sh[SHSTRTAB].offset + sh[SHSTRTAB].size;
+
+        const size_t shoff = align_up(sh[NOTE_STACK].offset, 8);
+
+        Writer w(out);
+        w.bytes({ "\x7f" "ELF\x02\x01\x01\0\0\0\0\0\0\0\0\0", 16 }); /* 64-bit, little endian, SysV */
+        w.put(ET_REL);
+        w.put(EM_X86_64);
+        w.put(uint32_t{ 1 });
+        w.put(uint64_t{ 0 }); /* entry */
+        w.put(uint64_t{ 0 }); /* program headers */
+        w.put(uint64_t{ shoff });
+        w.put(uint32_t{ 0 });
+        w.put(static_cast<uint16_t>(EHDR_SIZE));
+        w.put(uint16_t{ 0 });
+        w.put(uint16_t{ 0 });
+        w.put(static_cast<uint16_t>(SHDR_SIZE));
+        w.put(static_cast<uint16_t>(SECTIONS));
+        w.put(static_cast<uint16_t>(SHSTRTAB));
+
+        w.bytes(o.text);
+        w.pad(sh[RODATA].offset);
+        w.bytes(o.rodata);
+        w.pad(sh[RELA_TEXT].offset);
+
+        for (const Reloc &r: o.relocs)
+        {
+            /* a local label is its section's symbol plus the label's offset */
+            const Symbol &s = o.syms[r.sym];
+            uint64_t sym = index[r.sym];
+            int64_t addend = r.addend;
+            if (sym == 0)
+            {
+                sym = s.section == Section::text ? TEXT_SYM : RODATA_SYM;
+                addend += s.offset;
+            }
+            w.put(uint64_t{ r.offset });
+            w.put(sym << 32 | (r.kind == Reloc::Kind::plt32 ? R_X86_64_PLT32 : R_X86_64_PC32));
+            w.put(addend);
+        }
+
+        for (const Sym &s: syms)
+        {
+            w.put(s.name);
+            w.put(s.info);
+            w.put(uint8_t{ 0 }); /* default visibility */
+            w.put(s.shndx);
+            w.put(s.value);
+            w.put(s.size);
+        }
+
+        w.bytes(strtab);
+        w.bytes(shstrtab);
+        w.pad(shoff);
+
+        for (const Shdr &h: sh)
+        {
+            w.put(h.name);
+            w.put(h.type);
+            w.put(h.flags);
+            w.put(uint64_t{ 0 }); /* address */
+            w.put(h.offset);
+            w.put(h.size);
+            w.put(h.link);
+            w.put(h.info);
+            w.put(h.align);
+            w.put(h.entsize);
+        }
+    }
+}
@@ -0,0 +1,1000 @@
+#include <algorithm>
+#include <stdexcept>
+#include <cdgnx/x86_64_mc.hpp>
+
+namespace cdgnx::backend::mc
+{
+    namespace
+    {
+        constexpr const char *MNEMONICS[] = {
+            "",
+            "movq", "leaq", "pushq", "popq", "addq", "subq", "imulq", "andq", "orq", "xorq",
+            "cmpq", "testq", "notq", "negq", "idivq", "cqto", "shlq", "shrq", "sarq",
+            "movl", "movslq", "cmovlq", "cmovgq", "movzbl",
+            "sete", "setne", "setl", "setle", "setg", "setge", "setb", "setbe", "seta", "setae", "setp", "setnp",
+            "jmp", "je", "jne", "jl", "jle", "jg", "jge", "jb", "jbe", "ja", "jae", "jp", "jnp", "call", "ret", "nop",
+            "movsd", "movapd", "addsd", "subsd", "mulsd", "divsd", "ucomisd", "addss", "cvtsd2ss", "cvtss2sd",
+            "movdqu", "paddd", "paddq", "psubd", "psubq", "pmulld", "pminsd", "pmaxsd", "pand", "por", "pxor",
+            "addps", "addpd", "subps", "subpd", "mulps", "mulpd", "minps", "minpd", "maxps", "maxpd",
+            "punpckldq", "punpcklqdq", "punpckhqdq", "psrlq", "pbroadcastd", "pbroadcastq", "vzeroupper",
+            "fldl", "fstpl", "fprem", "fstp"
+        };
+
+        static_assert(std::size(MNEMONICS) == static_cast<size_t>(Op::fstp) + 1);
+
+        constexpr const char *REG32_NAMES[] = {
+            "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+            "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"
+        };
+
+        constexpr const char *REG8_NAMES[] = {
+            "%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil",
+            "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"
+        };
+
+        constexpr const char *YMM_NAMES[] = {
+            "%ymm0", "%ymm1", "%ymm2", "%ymm3", "%ymm4", "%ymm5", "%ymm6", "%ymm7",
+            "%ymm8", "%ymm9", "%ymm10", "%ymm11", "%ymm12", "%ymm13", "%ymm14", "%ymm15"
+        };
+
+        /* {prefix, opcode after 0x0f} of the packed ops, all reg = destination, rm = source */
+        struct Packed
+        {
+            uint8_t prefix;
+            uint8_t map; /* 0x0f, or 0x38 for 0x0f 0x38 */
+            uint8_t opcode;
+        };
+
+        Packed packed(const Op op)
+        {
+            switch (op)
+            {
+                case Op::paddd: return { 0x66, 0x0f, 0xfe };
+                case Op::paddq: return { 0x66, 0x0f, 0xd4 };
+                case Op::psubd: return { 0x66, 0x0f, 0xfa };
+                case Op::psubq: return { 0x66, 0x0f, 0xfb };
+                case Op::pmulld: return { 0x66, 0x38, 0x40 };
+                case Op::pminsd: return { 0x66, 0x38, 0x39 };
+                case Op::pmaxsd: return { 0x66, 0x38, 0x3d };
+                case Op::pand: return { 0x66, 0x0f, 0xdb };
+                case Op::por: return { 0x66, 0x0f, 0xeb };
+                case Op::pxor: return { 0x66, 0x0f, 0xef };
+                case Op::addps: return { 0x00, 0x0f, 0x58 };
+                case Op::addpd: return { 0x66, 0x0f, 0x58 };
+                case Op::subps: return { 0x00, 0x0f, 0x5c };
+                case Op::subpd: return { 0x66, 0x0f, 0x5c };
+                case Op::mulps: return { 0x00, 0x0f, 0x59 };
+                case Op::mulpd: return { 0x66, 0x0f, 0x59 };
+                case Op::minps: return { 0x00, 0x0f, 0x5d };
+                case Op::minpd: return { 0x66, 0x0f, 0x5d };
+                case Op::maxps: return { 0x00, 0x0f, 0x5f };
+                case Op::maxpd: return { 0x66, 0x0f, 0x5f };
+                case Op::punpckldq: return { 0x66, 0x0f, 0x62 };
+                case Op::punpcklqdq: return { 0x66, 0x0f, 0x6c };
+                case Op::punpckhqdq: return { 0x66, 0x0f, 0x6d };
+                case Op::addss: return { 0xf3, 0x0f, 0x58 };
+                case Op::cvtsd2ss: return { 0xf2, 0x0f, 0x5a };
+                case Op::cvtss2sd: return { 0xf3, 0x0f, 0x5a };
+                case Op::pbroadcastd: return { 0x66, 0x38, 0x58 };
+                default: return { 0x66, 0x38, 0x59 }; /* pbroadcastq */
+            }
+        }
+
+        /* VEX form with a separate first source (vvvv), printed as "a, b, b" */
+        bool three_operand(const Inst &i)
+        {
+            if (!i.vex)
+                return false;
+
+            switch (i.op)
+            {
+                case Op::movsd:
+                    return i.a.kind == Operand::Kind::reg && i.b.kind == Operand::Kind::reg;
+
+                case Op::movq:
+                case Op::movapd:
+                case Op::movdqu:
+                case Op::ucomisd:
+                case Op::pbroadcastd:
+                case Op::pbroadcastq:
+                    return false;
+
+                default:
+                    return true;
+            }
+        }
+
+        bool is_shift(const Op op)
+        {
+            return op == Op::shlq || op == Op::shrq || op == Op::sarq;
+        }
+
+        bool is_setcc(const Op op)
+        {
+            return op >= Op::sete && op <= Op::setnp;
+        }
+
+        /* names(sym) gives the spelling of a symbol */
+        template<typename Names>
+        void print_operand(const Names &names, const Inst &i, const Operand &o, Buffer &out)
+        {
+            switch (o.kind)
+            {
+                case Operand::Kind::reg:
+                {
+                    const bool source = &o == &i.a;
+                    if (is_shift(i.op) && source && o.reg == Reg::rcx)
+                        out.put("%cl");
+                    else if ((is_setcc(i.op) || (i.op == Op::movzbl && source)) && o.reg <= Reg::r15)
+                        out.put(REG8_NAMES[static_cast<uint8_t>(o.reg)]);
+                    else if ((i.op == Op::movl || i.op == Op::movzbl || (i.op == Op::movslq && source)) && o.reg <= Reg::r15)
+                        out.put(REG32_NAMES[static_cast<uint8_t>(o.reg)]);
+                    else if (i.vex == 32 && o.reg >= Reg::xmm0 && o.reg <= Reg::xmm15 &&
+                             !(source && (i.op == Op::pbroadcastd || i.op == Op::pbroadcastq)))
+                        out.put(YMM_NAMES[static_cast<uint8_t>(o.reg) - static_cast<uint8_t>(Reg::xmm0)]);
+                    else
+                        out.put(reg_name(o.reg));
+                    break;
+                }
+
+                case Operand::Kind::imm:
+                    out.put('$').put(o.imm);
+                    break;
+
+                case Operand::Kind::sym:
+                    out.put(names(o.sym));
+                    break;
+
+                case Operand::Kind::st:
+                    out.put("%st(").put(o.imm).put(')');
+                    break;
+
+                case Operand::Kind::mem:
+                {
+                    if (o.reg == Reg::rip && o.sym != NONE)
+                    {
+                        out.put(names(o.sym));
+                        if (o.imm > 0)
+                            out.put('+');
+                        if (o.imm)
+                            out.put(o.imm);
+                        out.put("(%rip)");
+                        break;
+                    }
+
+                    if (o.imm)
+                        out.put(o.imm);
+                    if (o.reg != Reg::none || o.index != Reg::none)
+                    {
+                        out.put('(');
+                        if (o.reg != Reg::none)
+                            out.put(reg_name(o.reg));
+                        if (o.index != Reg::none)
+                            out.put(',').put(reg_name(o.index)).put(',').put(static_cast<int>(o.scale));
+                        out.put(')');
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        template<typename Names>
+        void print_code(const Code &c, const Names &names, Buffer &out)
+        {
+            for (const Inst &i: c.insts)
+            {
+                if (i.op == Op::label)
+                {
+                    out.put(names(i.a.sym)).put(":\n");
+                    continue;
+                }
+
+                out.put("    ");
+                if (i.vex)
+                    out.put('v');
+                out.put(mnemonic(i.op));
+                if (i.a.kind != Operand::Kind::none)
+                {
+                    out.put(' ');
+                    print_operand(names, i, i.a, out);
+                }
+                if (i.b.kind != Operand::Kind::none)
+                {
+                    out.put(", ");
+                    print_operand(names, i, i.b, out);
+                    if (three_operand(i))
+                    {
+                        out.put(", ");
+                        print_operand(names, i, i.b, out);
+                    }
+                }
+                out.put('\n');
+            }
+        }
+
+        uint8_t num(const Reg r)
+        {
+            return static_cast<uint8_t>(r) & 15;
+        }
+
+        bool is_xmm(const Operand &o)
+        {
+            return o.kind == Operand::Kind::reg && o.reg >= Reg::xmm0 && o.reg <= Reg::xmm15;
+        }
+
+        bool fits8(const int64_t v)
+        {
+            return v >= -128 && v <= 127;
+        }
+
+        bool fits32(const int64_t v)
+        {
+            return v >= INT32_MIN && v <= INT32_MAX;
+        }
+
+        uint8_t scale_bits(const uint8_t s)
+        {
+            return s == 8 ? 3 : s == 4 ? 2 : s == 2 ? 1 : 0;
+        }
+
+        /* {reg/mem store form, reg load form, /digit of the imm form} */
+        struct Alu
+        {
+            uint8_t store;
+            uint8_t load;
+            uint8_t ext;
+        };
+
+        Alu alu(const Op op)
+        {
+            switch (op)
+            {
+                case Op::addq: return { 0x01, 0x03, 0 };
+                case Op::orq: return { 0x09, 0x0b, 1 };
+                case Op::andq: return { 0x21, 0x23, 4 };
+                case Op::subq: return { 0x29, 0x2b, 5 };
+                case Op::xorq: return { 0x31, 0x33, 6 };
+                default: return { 0x39, 0x3b, 7 }; /* cmpq */
+            }
+        }
+
+        /* condition code of a jcc or setcc */
+        uint8_t cond(const Op op)
+        {
+            switch (op)
+            {
+                case Op::jb: case Op::setb: return 0x2;
+                case Op::jae: case Op::setae: return 0x3;
+                case Op::je: case Op::sete: return 0x4;
+                case Op::jne: case Op::setne: return 0x5;
+                case Op::jbe: case Op::setbe: return 0x6;
+                case Op::ja: case Op::seta: return 0x7;
+                case Op::jp: case Op::setp: return 0xa;
+                case Op::jnp: case Op::setnp: return 0xb;
+                case Op::jl: case Op::setl: return 0xc;
+                case Op::jge: case Op::setge: return 0xd;
+                case Op::jle: case Op::setle: return 0xe;
+                default: return 0xf; /* jg, setg */
+            }
+        }
+
+        struct Branch
+        {
+            uint32_t pos;
+            uint32_t sym;
+            Op op;
+            uint8_t grow; /* extra bytes of the rel32 form */
+        };
+
+        class Encoder
+        {
+        public:
+            Encoder(const Code &c, Object &o) : code(c), obj(o), out(o.text) {}
+
+            void run();
+
+        private:
+            const Code &code;
+            Object &obj;
+            std::vector<uint8_t> &out;
+            std::vector<Branch> branches;
+
+            /* of the instruction being encoded: VEX length (0 for legacy) and vvvv register */
+            uint8_t vex_len = 0;
+            uint8_t vex_reg = 0;
+
+            void u8(const uint8_t v)
+            {
+                out.push_back(v);
+            }
+
+            void u32(const uint32_t v)
+            {
+                for (int i = 0; i < 4; ++i)
+                    out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            }
+
+            void u64(const uint64_t v)
+            {
+                for (int i = 0; i < 8; ++i)
+                    out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            }
+
+            void reloc(const uint32_t sym, const int64_t addend, const Reloc::Kind k = Reloc::Kind::pc32)
+            {
+                obj.relocs.push_back({ static_cast<uint32_t>(out.size()), sym, addend, k });
+                u32(0);
+            }
+
+            /*
+             * [prefix] [rex] opcode modrm [sib] [disp]; trailing immediates are written by the caller.
+             * while vex_len is set, prefix, rex and the 0x0f escape are folded into a VEX prefix
+             */
+            void modrm(uint8_t prefix, bool w, std::initializer_list<uint8_t> opcode, uint8_t reg,
+                       const Operand &rm, uint8_t imm_bytes = 0);
+
+            void alu(const Inst &i);
+
+            void inst(const Inst &i);
+
+            void relax();
+        };
+
+        void Encoder::modrm(const uint8_t prefix, const bool w, const std::initializer_list<uint8_t> opcode,
+                            const uint8_t reg, const Operand &rm, const uint8_t imm_bytes)
+        {
+            uint8_t rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0);
+            if (rm.kind == Operand::Kind::reg)
+                rex |= num(rm.reg) & 8 ? 1 : 0;
+            else
+            {
+                /* what as rejects, rather than encode something else */
+                if (!fits32(rm.imm))
+                    throw std::invalid_argument("x86_64: displacement " + std::to_string(rm.imm) + " does not fit in 32 bits");
+                if (rm.scale != 1 && rm.scale != 2 && rm.scale != 4 && rm.scale != 8)
+                    throw std::invalid_argument("x86_64: scale " + std::to_string(rm.scale) + " is not 1, 2, 4 or 8");
+                if (rm.index == Reg::rsp)
+                    throw std::invalid_argument("x86_64: %rsp can't be an index");
+                if (rm.index != Reg::none && num(rm.index) & 8)
+                    rex |= 2;
+                if (rm.reg != Reg::none && rm.reg != Reg::rip && num(rm.reg) & 8)
+                    rex |= 1;
+            }
+
+            if (vex_len)
+            {
+                /* opcode is 0x0f [0x38] op */
+                const uint8_t *op = opcode.begin() + 1;
+                uint8_t map = 1;
+                if (*op == 0x38)
+                {
+                    map = 2;
+                    ++op;
+                }
+
+                const uint8_t pp = prefix == 0x66 ? 1 : prefix == 0xf3 ? 2 : prefix == 0xf2 ? 3 : 0;
+                const uint8_t tail = static_cast<uint8_t>((~vex_reg & 15) << 3 | (vex_len == 32 ? 4 : 0) | pp);
+                const uint8_t rxb = static_cast<uint8_t>(~rex << 5 & 0xe0);
+                if ((rex & 0xb) == 0 && map == 1)
+                {
+                    u8(0xc5);
+                    u8((rxb & 0x80) | tail);
+                }
+                else
+                {
+                    u8(0xc4);
+                    u8(rxb | map);
+                    u8((rex & 8 ? 0x80 : 0) | tail);
+                }
+                for (; op != opcode.end(); ++op)
+                    u8(*op);
+            }
+            else
+            {
+                if (prefix)
+                    u8(prefix);
+                if (rex != 0x40)
+                    u8(rex);
+                for (const uint8_t b: opcode)
+                    u8(b);
+            }
+
+            const uint8_t r = (reg & 7) << 3;
+            if (rm.kind == Operand::Kind::reg)
+            {
+                u8(0xc0 | r | (num(rm.reg) & 7));
+                return;
+            }
+
+            if (rm.reg == Reg::rip)
+            {
+                u8(0x05 | r);
+                if (rm.sym != NONE)
+                    reloc(rm.sym, rm.imm - 4 - imm_bytes);
+                else
+                    u32(static_cast<uint32_t>(rm.imm));
+                return;
+            }
+
+            const uint8_t index = rm.index == Reg::none ? 4 : num(rm.index) & 7;
+            const uint8_t ss = rm.index == Reg::none ? 0 : scale_bits(rm.scale) << 6;
+            if (rm.reg == Reg::none)
+            {
+                /* no base: [index*scale + disp32] */
+                u8(0x04 | r);
+                u8(ss | (index << 3) | 5);
+                u32(static_cast<uint32_t>(rm.imm));
+                return;
+            }
+
+            const uint8_t base = num(rm.reg) & 7;
+            const uint8_t mod = rm.imm == 0 && base != 5 ? 0x00 : fits8(rm.imm) ? 0x40 : 0x80;
+            if (rm.index != Reg::none || base == 4)
+            {
+                u8(mod | r | 4);
+                u8(ss | (index << 3) | base);
+            }
+            else
+                u8(mod | r | base);
+
+            if (mod == 0x40)
+                u8(static_cast<uint8_t>(rm.imm));
+            else if (mod == 0x80)
+                u32(static_cast<uint32_t>(rm.imm));
+        }
+
+        void Encoder::alu(const Inst &i)
+        {
+            const auto [store, load, ext] = mc::alu(i.op);
+            if (i.a.kind == Operand::Kind::imm)
+            {
+                if (fits8(i.a.imm))
+                {
+                    modrm(0, true, { 0x83 }, ext, i.b, 1);
+                    u8(static_cast<uint8_t>(i.a.imm));
+                }
+                else if (i.b.kind == Operand::Kind::reg && i.b.reg == Reg::rax)
+                {
+                    u8(0x48);
+                    u8(store + 4);
+                    u32(static_cast<uint32_t>(i.a.imm));
+                }
+                else
+                {
+                    modrm(0, true, { 0x81 }, ext, i.b, 4);
+                    u32(static_cast<uint32_t>(i.a.imm));
+                }
+            }
+            else if (i.a.kind == Operand::Kind::mem)
+                modrm(0, true, { load }, num(i.b.reg), i.a);
+            else
+                modrm(0, true, { store }, num(i.a.reg), i.b);
+        }
+
+        void Encoder::inst(const Inst &i)
+        {
+            using K = Operand::Kind;
+            vex_len = i.vex;
+            vex_reg = three_operand(i) ? num(i.b.reg) : 0;
+            switch (i.op)
+            {
+                case Op::label:
+                {
+                    Symbol &s = obj.syms[i.a.sym];
+                    s.section = Section::text;
+                    s.offset = static_cast<uint32_t>(out.size());
+                    break;
+                }
+
+                case Op::movq:
+                {
+                    if (is_xmm(i.a) || is_xmm(i.b))
+                    {
+                        if (is_xmm(i.a) && is_xmm(i.b))
+                            modrm(0xf3, false, { 0x0f, 0x7e }, num(i.b.reg), i.a);
+                        else if (is_xmm(i.b))
+                        {
+                            if (i.a.kind == K::mem)
+                                modrm(0xf3, false, { 0x0f, 0x7e }, num(i.b.reg), i.a);
+                            else
+                                modrm(0x66, true, { 0x0f, 0x6e }, num(i.b.reg), i.a);
+                        }
+                        else if (i.b.kind == K::mem)
+                            modrm(0x66, false, { 0x0f, 0xd6 }, num(i.a.reg), i.b);
+                        else
+                            modrm(0x66, true, { 0x0f, 0x7e }, num(i.a.reg), i.b);
+                    }
+                    else if (i.a.kind == K::imm)
+                    {
+                        if (fits32(i.a.imm))
+                        {
+                            modrm(0, true, { 0xc7 }, 0, i.b, 4);
+                            u32(static_cast<uint32_t>(i.a.imm));
+                        }
+                        else
+                        {
+                            /* movabs */
+                            u8(0x48 | (num(i.b.reg) & 8 ? 1 : 0));
+                            u8(0xb8 | (num(i.b.reg) & 7));
+                            u64(static_cast<uint64_t>(i.a.imm));
+                        }
+                    }
+                    else if (i.a.kind == K::mem)
+                        modrm(0, true, { 0x8b }, num(i.b.reg), i.a);
+                    else
+                        modrm(0, true, { 0x89 }, num(i.a.reg), i.b);
+                    break;
+                }
+
+                case Op::leaq:
+                    modrm(0, true, { 0x8d }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::pushq:
+                case Op::popq:
+                {
+                    const bool push = i.op == Op::pushq;
+                    if (i.a.kind == K::reg)
+                    {
+                        if (num(i.a.reg) & 8)
+                            u8(0x41);
+                        u8((push ? 0x50 : 0x58) | (num(i.a.reg) & 7));
+                    }
+                    else if (i.a.kind == K::imm)
+                    {
+                        if (fits8(i.a.imm))
+                        {
+                            u8(0x6a);
+                            u8(static_cast<uint8_t>(i.a.imm));
+                        }
+                        else
+                        {
+                            u8(0x68);
+                            u32(static_cast<uint32_t>(i.a.imm));
+                        }
+                    }
+                    else if (push)
+                        modrm(0, false, { 0xff }, 6, i.a);
+                    else
+                        modrm(0, false, { 0x8f }, 0, i.a);
+                    break;
+                }
+
+                case Op::addq:
+                case Op::subq:
+                case Op::andq:
+                case Op::orq:
+                case Op::xorq:
+                case Op::cmpq:
+                    alu(i);
+                    break;
+
+                case Op::testq:
+                {
+                    if (i.a.kind == K::imm)
+                    {
+                        if (i.b.kind == K::reg && i.b.reg == Reg::rax)
+                        {
+                            u8(0x48);
+                            u8(0xa9);
+                        }
+                        else
+                            modrm(0, true, { 0xf7 }, 0, i.b, 4);
+                        u32(static_cast<uint32_t>(i.a.imm));
+                    }
+                    else
+                        modrm(0, true, { 0x85 }, num(i.a.reg), i.b);
+                    break;
+                }
+
+                case Op::imulq:
+                {
+                    if (i.a.kind == K::imm)
+                    {
+                        const bool small = fits8(i.a.imm);
+                        modrm(0, true, { static_cast<uint8_t>(small ? 0x6b : 0x69) }, num(i.b.reg), i.b, small ? 1 : 4);
+                        if (small)
+                            u8(static_cast<uint8_t>(i.a.imm));
+                        else
+                            u32(static_cast<uint32_t>(i.a.imm));
+                    }
+                    else if (i.b.kind == K::none)
+                        modrm(0, true, { 0xf7 }, 5, i.a); /* rdx:rax = rax * a */
+                    else
+                        modrm(0, true, { 0x0f, 0xaf }, num(i.b.reg), i.a);
+                    break;
+                }
+
+                case Op::notq:
+                    modrm(0, true, { 0xf7 }, 2, i.a);
+                    break;
+
+                case Op::negq:
+                    modrm(0, true, { 0xf7 }, 3, i.a);
+                    break;
+
+                case Op::idivq:
+                    modrm(0, true, { 0xf7 }, 7, i.a);
+                    break;
+
+                case Op::cqto:
+                    u8(0x48);
+                    u8(0x99);
+                    break;
+
+                case Op::shlq:
+                case Op::shrq:
+                case Op::sarq:
+                {
+                    const uint8_t ext = i.op == Op::shlq ? 4 : i.op == Op::shrq ? 5 : 7;
+                    if (i.a.kind != K::imm)
+                        modrm(0, true, { 0xd3 }, ext, i.b);
+                    else if (i.a.imm == 1)
+                        modrm(0, true, { 0xd1 }, ext, i.b);
+                    else
+                    {
+                        modrm(0, true, { 0xc1 }, ext, i.b, 1);
+                        u8(static_cast<uint8_t>(i.a.imm));
+                    }
+                    break;
+                }
+
+                case Op::movl:
+                    modrm(0, false, { 0x89 }, num(i.a.reg), i.b);
+                    break;
+
+                case Op::movslq:
+                    modrm(0, true, { 0x63 }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::cmovlq:
+                case Op::cmovgq:
+                    modrm(0, true, { 0x0f, static_cast<uint8_t>(i.op == Op::cmovlq ? 0x4c : 0x4f) }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::movzbl:
+                    /* without a REX prefix 4-7 would be ah..bh, not spl..dil */
+                    if (i.a.kind == K::reg && num(i.a.reg) >= 4 && num(i.a.reg) < 8 && num(i.b.reg) < 8)
+                        u8(0x40);
+                    modrm(0, false, { 0x0f, 0xb6 }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::sete:
+                case Op::setne:
+                case Op::setl:
+                case Op::setle:
+                case Op::setg:
+                case Op::setge:
+                case Op::setb:
+                case Op::setbe:
+                case Op::seta:
+                case Op::setae:
+                case Op::setp:
+                case Op::setnp:
+                    if (i.a.kind == K::reg && num(i.a.reg) >= 4 && num(i.a.reg) < 8)
+                        u8(0x40);
+                    modrm(0, false, { 0x0f, static_cast<uint8_t>(0x90 | cond(i.op)) }, 0, i.a);
+                    break;
+
+                case Op::jmp:
+                case Op::je:
+                case Op::jne:
+                case Op::jl:
+                case Op::jle:
+                case Op::jg:
+                case Op::jge:
+                case Op::jb:
+                case Op::jbe:
+                case Op::ja:
+                case Op::jae:
+                case Op::jp:
+                case Op::jnp:
+                {
+                    if (i.a.kind == K::sym)
+                    {
+                        /* short form for now, relax() widens what does not fit */
+                        branches.push_back({ static_cast<uint32_t>(out.size()), i.a.sym, i.op, 0 });
+                        u8(i.op == Op::jmp ? 0xeb : 0x70 | cond(i.op));
+                        u8(0);
+                    }
+                    else
+                        modrm(0, false, { 0xff }, 4, i.a);
+                    break;
+                }
+
+                case Op::call:
+                {
+                    if (i.a.kind == K::sym)
+                    {
+                        u8(0xe8);
+                        reloc(i.a.sym, -4, Reloc::Kind::plt32);
+                    }
+                    else
+                        modrm(0, false, { 0xff }, 2, i.a);
+                    break;
+                }
+
+                case Op::ret:
+                    u8(0xc3);
+                    break;
+
+                case Op::nop:
+                    u8(0x90);
+                    break;
+
+                case Op::movsd:
+                {
+                    if (i.b.kind == K::mem)
+                        modrm(0xf2, false, { 0x0f, 0x11 }, num(i.a.reg), i.b);
+                    else
+                        modrm(0xf2, false, { 0x0f, 0x10 }, num(i.b.reg), i.a);
+                    break;
+                }
+
+                case Op::movapd:
+                    modrm(0x66, false, { 0x0f, 0x28 }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::addsd:
+                    modrm(0xf2, false, { 0x0f, 0x58 }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::subsd:
+                    modrm(0xf2, false, { 0x0f, 0x5c }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::mulsd:
+                    modrm(0xf2, false, { 0x0f, 0x59 }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::divsd:
+                    modrm(0xf2, false, { 0x0f, 0x5e }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::ucomisd:
+                    modrm(0x66, false, { 0x0f, 0x2e }, num(i.b.reg), i.a);
+                    break;
+
+                case Op::movdqu:
+                {
+                    if (i.b.kind == K::mem)
+                        modrm(0xf3, false, { 0x0f, 0x7f }, num(i.a.reg), i.b);
+                    else
+                        modrm(0xf3, false, { 0x0f, 0x6f }, num(i.b.reg), i.a);
+                    break;
+                }
+
+                case Op::psrlq:
+                    modrm(0x66, false, { 0x0f, 0x73 }, 2, i.b, 1);
+                    u8(static_cast<uint8_t>(i.a.imm));
+                    break;
+
+                case Op::vzeroupper:
+                    u8(0xc5);
+                    u8(0xf8);
+                    u8(0x77);
+                    break;
+
+                case Op::addss:
+                case Op::cvtsd2ss:
+                case Op::cvtss2sd:
+                case Op::paddd:
+                case Op::paddq:
+                case Op::psubd:
+                case Op::psubq:
+                case Op::pmulld:
+                case Op::pminsd:
+                case Op::pmaxsd:
+                case Op::pand:
+                case Op::por:
+                case Op::pxor:
+                case Op::addps:
+                case Op::addpd:
+                case Op::subps:
+                case Op::subpd:
+                case Op::mulps:
+                case Op::mulpd:
+                case Op::minps:
+                case Op::minpd:
+                case Op::maxps:
+                case Op::maxpd:
+                case Op::punpckldq:
+                case Op::punpcklqdq:
+                case Op::punpckhqdq:
+                case Op::pbroadcastd:
+                case Op::pbroadcastq:
+                {
+                    const auto [prefix, map, opcode] = packed(i.op);
+                    if (map == 0x38)
+                        modrm(prefix, false, { 0x0f, 0x38, opcode }, num(i.b.reg), i.a);
+                    else
+                        modrm(prefix, false, { 0x0f, opcode }, num(i.b.reg), i.a);
+                    break;
+                }
+
+                case Op::fldl:
+                    modrm(0, false, { 0xdd }, 0, i.a);
+                    break;
+
+                case Op::fstpl:
+                    modrm(0, false, { 0xdd }, 3, i.a);
+                    break;
+
+                case Op::fprem:
+                    u8(0xd9);
+                    u8(0xf8);
+                    break;
+
+                case Op::fstp:
+                    u8(0xdd);
+                    u8(static_cast<uint8_t>(0xd8 + i.a.imm));
+                    break;
+            }
+        }
+
+        void Encoder::relax()
+        {
+            /* a branch needs rel32 if its target is not in this code */
+            for (Branch &b: branches)
+            {
+                if (obj.syms[b.sym].section != Section::text)
+                    b.grow = b.op == Op::jmp ? 3 : 4;
+            }
+
+            /* growth only ever lengthens displacements, so this converges */
+            std::vector<uint32_t> before(branches.size() + 1);
+            const auto shifted = [&](const uint32_t off)
+            {
+                const auto it = std::ranges::lower_bound(branches, off, {}, &Branch::pos);
+                return off + before[it - branches.begin()];
+            };
+
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (size_t i = 0; i < branches.size(); ++i)
+                    before[i + 1] = before[i] + branches[i].grow;
+
+                for (size_t i = 0; i < branches.size(); ++i)
+                {
+                    Branch &b = branches[i];
+                    if (b.grow)
+                        continue;
+
+                    const int64_t end = b.pos + before[i] + 2;
+                    const int64_t target = shifted(obj.syms[b.sym].offset);
+                    if (!fits8(target - end))
+                    {
+                        b.grow = b.op == Op::jmp ? 3 : 4;
+                        changed = true;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < branches.size(); ++i)
+                before[i + 1] = before[i] + branches[i].grow;
+            if (branches.empty())
+                return;
+
+            /* rebuild with the final branch forms */
+            std::vector<uint8_t> old;
+            old.swap(out);
+            out.reserve(old.size() + before.back());
+
+            std::vector<Reloc> pending;
+            pending.swap(obj.relocs);
+            for (Reloc &r: pending)
+                r.offset = shifted(r.offset);
+            for (Symbol &s: obj.syms)
+            {
+                if (s.section == Section::text)
+                    s.offset = shifted(s.offset);
+            }
+
+            uint32_t from = 0;
+            for (const Branch &b: branches)
+            {
+                out.insert(out.end(), old.begin() + from, old.begin() + b.pos);
+                from = b.pos + 2;
+
+                const Symbol &t = obj.syms[b.sym];
+                const bool local = t.section == Section::text;
+                if (!b.grow)
+                {
+                    u8(old[b.pos]);
+                    u8(static_cast<uint8_t>(t.offset - (out.size() + 1)));
+                    continue;
+                }
+
+                if (b.op == Op::jmp)
+                    u8(0xe9);
+                else
+                {
+                    u8(0x0f);
+                    u8(0x80 | cond(b.op));
+                }
+
+                if (!local)
+                    pending.push_back({ static_cast<uint32_t>(out.size()), b.sym, -4, Reloc::Kind::plt32 });
+                u32(local ? static_cast<uint32_t>(t.offset - (out.size() + 4)) : 0);
+            }
+            out.insert(out.end(), old.begin() + from, old.end());
+
+            std::ranges::sort(pending, {}, &Reloc::offset);
+            obj.relocs.swap(pending);
+        }
+
+        void Encoder::run()
+        {
+            obj.syms.resize(code.syms.size());
+            for (size_t i = 0; i < code.syms.size(); ++i)
+                obj.syms[i].name = code.syms[static_cast<SymId>(i)];
+
+            for (const Inst &i: code.insts)
+                inst(i);
+            relax();
+
+            /* pc-relative references to labels in .text need no linker */
+            std::erase_if(obj.relocs, [&](const Reloc &r)
+            {
+                const Symbol &s = obj.syms[r.sym];
+                if (s.section != Section::text)
+                    return false;
+
+                const int64_t v = static_cast<int64_t>(s.offset) + r.addend - r.offset;
+                for (int b = 0; b < 4; ++b)
+                    out[r.offset + b] = static_cast<uint8_t>(v >> (8 * b));
+                return true;
+            });
+        }
+    }
+
+    void Code::clear()
+    {
+        insts.clear();
+        syms.clear();
+    }
+
+    void Object::clear()
+    {
+        text.clear();
+        rodata.clear();
+        rodata_align = 8;
+        syms.clear();
+        relocs.clear();
+    }
+
+    const char *mnemonic(const Op op)
+    {
+        return MNEMONICS[static_cast<uint8_t>(op)];
+    }
+
+    bool has_vex(const Inst &i)
+    {
+        if (i.op == Op::movq)
+            return is_xmm(i.a) || is_xmm(i.b);
+        return i.op >= Op::movsd && i.op <= Op::pbroadcastq;
+    }
+
+    void print(const Code &c, Buffer &out)
+    {
+        print_code(c, [&c](const uint32_t s) { return c.syms[s]; }, out);
+    }
+
+    void print(const Code &c, std::span<const std::string_view> names, Buffer &out)
+    {
+        print_code(c, [names](const uint32_t s) { return names[s]; }, out);
+    }
+
+    void encode(const Code &c, Object &o)
+    {
+        o.text.clear();
+        o.relocs.clear();
+        o.syms.clear();
+        Encoder(c, o).run();
+    }
+}
@@ -0,0 +1,220 @@
+#include <memory>
+#include <unordered_map>
+#include <cdgnx/thread_pool.hpp>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * module codegen runs in four steps: every function is lowered by the
+ * backend owned by whichever worker picked it up, the .rodata entries
+ * (strings, constants, vectors) are numbered in function order, each
+ * function is printed (or encoded) with its symbols renamed, and the
+ * pieces are joined in function order. only the numbering and the join
+ * are sequential, and none of the steps depends on which worker did
+ * what, so the listing and the object are the same for any thread count
+ */
+namespace cdgnx::backend
+{
+    struct x86_64::Fragment
+    {
+        mc::Code code;
+        ConstPool pool;
+        std::vector<uint32_t> pool_syms[ConstPool::KINDS];
+        std::vector<uint32_t> numbers[ConstPool::KINDS]; /* id in the module's pool, per entry of pool */
+        uint32_t fn = NONE;
+        unsigned worker = 0;
+        uint32_t record = NONE; /* in the Stats of worker, then in Options::stats */
+        Buffer text{ 256 }; /* one function's listing, most are short */
+        mc::Object obj;
+    };
+
+    void x86_64::lower_module(const Module &m, ThreadPool &pool, std::vector<Fragment> &frags, ConstPool &rodata)
+    {
+        /* every worker records into Stats of its own, merged in function order afterwards */
+        std::vector<Stats> parts;
+        std::vector<std::unique_ptr<x86_64> > workers;
+        for (unsigned w = 0; w < pool.size(); ++w)
+        {
+            workers.push_back(std::make_unique<x86_64>(opts));
+            if (stats())
+                parts.emplace_back(w);
+        }
+        for (unsigned w = 0; w < parts.size(); ++w)
+            workers[w]->opts.stats = &parts[w];
+
+        const std::span<const NodeId> fns = m.functions();
+        frags.resize(fns.size());
+
+        pool.parallel_for(fns.size(), [&](const unsigned w, const size_t f)
+        {
+            x86_64 &be = *workers[w];
+            be.lower(m.ir, fns[f]);
+
+            Fragment &frag = frags[f];
+            std::swap(frag.code, be.code);
+            std::swap(frag.pool, be.pool);
+            std::swap(frag.pool_syms, be.pool_syms);
+            frag.fn = be.fn;
+            if (be.stats())
+            {
+                frag.worker = w;
+                frag.record = static_cast<uint32_t>(be.stats()->functions().size() - 1);
+            }
+        });
+
+        if (stats())
+        {
+            std::vector<std::pair<unsigned, uint32_t> > which;
+            for (const Fragment &frag: frags)
+                which.emplace_back(frag.worker, frag.record);
+            const uint32_t first = stats()->merge(parts, which);
+            for (size_t f = 0; f < frags.size(); ++f)
+                frags[f].record = first + static_cast<uint32_t>(f);
+        }
+
+        /* equal entries share one symbol, numbered by first use */
+        for (Fragment &frag: frags)
+        {
+            for (size_t k = 0; k < ConstPool::KINDS; ++k)
+            {
+                const auto kind = static_cast<ConstPool::Kind>(k);
+                frag.numbers[k].reserve(frag.pool.size(kind));
+                for (uint32_t id = 0; id < frag.pool.size(kind); ++id)
+                    frag.numbers[k].push_back(rodata.intern(kind, frag.pool(kind, id)));
+            }
+        }
+
+        for (const auto &w: workers)
+            peep.merge(w->peep);
+    }
+
+    std::string x86_64::generate_module(const Module &m, const unsigned threads)
+    {
+        out.clear();
+        generate_module(m, out, threads);
+        Stats::Timer t(stats(), Stats::Phase::copy);
+        return out.str();
+    }
+
+    void x86_64::generate_module(const Module &m, Buffer &sink, const unsigned threads)
+    {
+        ThreadPool pool(threads);
+        std::vector<Fragment> frags;
+        ConstPool rodata;
+        lower_module(m, pool, frags, rodata);
+
+        Stats::Timer t(stats(), Stats::Phase::print);
+        pool.parallel_for(frags.size(), [&](unsigned, const size_t f)
+        {
+            Fragment &frag = frags[f];
+            const mc::Code &c = frag.code;
+
+            /* labels get the function index appended, .rodata entries their pool number */
+            std::vector<std::string> renamed(c.syms.size());
+            for (const mc::Inst &i: c.insts)
+            {
+                if (i.op == Op::label && i.a.sym != frag.fn)
+                    renamed[i.a.sym] = std::string(c.syms[i.a.sym]) + '.' + std::to_string(f);
+            }
+            for (size_t k = 0; k < ConstPool::KINDS; ++k)
+            {
+                const std::string_view prefix = ConstPool::prefix(static_cast<ConstPool::Kind>(k));
+                for (size_t i = 0; i < frag.pool_syms[k].size(); ++i)
+                    renamed[frag.pool_syms[k][i]] = std::string(prefix) + std::to_string(frag.numbers[k][i]);
+            }
+
+            std::vector<std::string_view> names(c.syms.size());
+            for (SymId s = 0; s < names.size(); ++s)
+                names[s] = renamed[s].empty() ? c.syms[s] : std::string_view(renamed[s]);
+
+            frag.text.put(".align 16\n");
+            if (frag.fn != NONE)
+            {
+                frag.text.put(".global ").put(c.syms[frag.fn]).put('\n');
+                frag.text.put(".type ").put(c.syms[frag.fn]).put(", @function\n");
+            }
+            mc::print(c, names, frag.text);
+        });
+
+        sink.put(".section .text\n");
+        for (const Fragment &frag: frags)
+        {
+            frag.text.each([&sink](const std::string_view s) { sink.put(s); });
+            if (stats())
+                stats()->function(frag.record).listing += frag.text.size();
+        }
+
+        rodata.print(sink);
+    }
+
+    mc::Object x86_64::assemble_module(const Module &m, const unsigned threads)
+    {
+        ThreadPool pool(threads);
+        std::vector<Fragment> frags;
+        ConstPool rodata;
+        lower_module(m, pool, frags, rodata);
+
+        Stats::Timer t(stats(), Stats::Phase::encode);
+        pool.parallel_for(frags.size(), [&](unsigned, const size_t f) { mc::encode(frags[f].code, frags[f].obj); });
+
+        /* the pool first, entry id of kind k is symbol first[k] + id */
+        mc::Object o;
+        ConstPool::Layout l;
+        rodata.layout(l);
+        rodata.bytes(l, o.rodata);
+        o.rodata_align = l.align;
+        uint32_t first[ConstPool::KINDS];
+        for (size_t k = 0; k < ConstPool::KINDS; ++k)
+        {
+            const auto kind = static_cast<ConstPool::Kind>(k);
+            first[k] = static_cast<uint32_t>(o.syms.size());
+            for (uint32_t id = 0; id < rodata.size(kind); ++id)
+                o.syms.push_back({ std::string(ConstPool::prefix(kind)) + std::to_string(id), mc::Section::rodata, l.offsets[k][id] });
+        }
+
+        /* functions and externals by name, a call may come before the function it calls */
+        std::unordered_map<std::string, uint32_t> global;
+        std::vector<uint32_t> map;
+        for (const Fragment &frag: frags)
+        {
+            const mc::Object &part = frag.obj;
+            o.text.resize((o.text.size() + 15) & ~size_t{ 15 }, 0xcc);
+            const auto base = static_cast<uint32_t>(o.text.size());
+            o.text.insert(o.text.end(), part.text.begin(), part.text.end());
+            if (stats())
+                stats()->function(frag.record).text += part.text.size();
+
+            /* labels are resolved by now, only pool entries, functions and externals are left */
+            map.assign(part.syms.size(), NONE);
+            for (size_t k = 0; k < ConstPool::KINDS; ++k)
+            {
+                for (size_t i = 0; i < frag.pool_syms[k].size(); ++i)
+                    map[frag.pool_syms[k][i]] = first[k] + frag.numbers[k][i];
+            }
+
+            for (uint32_t i = 0; i < part.syms.size(); ++i)
+            {
+                const mc::Symbol &s = part.syms[i];
+                if (map[i] != NONE || (s.section != mc::Section::undef && i != frag.fn))
+                    continue;
+
+                const auto [it, fresh] = global.try_emplace(s.name, static_cast<uint32_t>(o.syms.size()));
+                if (fresh)
+                    o.syms.push_back({ s.name });
+                map[i] = it->second;
+                if (i == frag.fn)
+                    o.syms[it->second] = { s.name, mc::Section::text, base + s.offset, static_cast<uint32_t>(part.text.size()) - s.offset, true };
+            }
+
+            for (const mc::Reloc &r: part.relocs)
+                o.relocs.push_back({ base + r.offset, map[r.sym], r.addend, r.kind });
+        }
+        return o;
+    }
+
+    void x86_64::write_object(const Module &m, Buffer &sink, const unsigned threads)
+    {
+        const mc::Object o = assemble_module(m, threads);
+        Stats::Timer t(stats(), Stats::Phase::write);
+        mc::write_elf(o, sink);
+    }
+}
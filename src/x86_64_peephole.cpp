@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cdgnx/x86_64_peephole.hpp>
+
+namespace cdgnx::backend::mc
+{
+    namespace
+    {
+        using K = Operand::Kind;
+
+        constexpr const char *RULE_NAMES[] = {
+            "self_move", "stack_adjust", "push_pop", "mov_push", "forward_mov", "dead_mov"
+        };
+
+        static_assert(std::size(RULE_NAMES) == static_cast<size_t>(Peephole::Rule::count));
+
+        /* what an instruction touches, as far as the rules care */
+        struct Effect
+        {
+            uint64_t use = 0;
+            uint64_t def = 0;
+            bool store = false;
+            bool barrier = false;
+        };
+
+        constexpr uint64_t bit(const Reg r)
+        {
+            return r < Reg::none ? uint64_t{ 1 } << static_cast<uint8_t>(r) : 0;
+        }
+
+        const uint64_t RSP = bit(Reg::rsp);
+
+        uint64_t addr_regs(const Operand &o)
+        {
+            return o.kind == K::mem ? bit(o.reg) | bit(o.index) : 0;
+        }
+
+        void read(Effect &e, const Operand &o)
+        {
+            e.use |= o.kind == K::reg ? bit(o.reg) : addr_regs(o);
+        }
+
+        void write(Effect &e, const Operand &o)
+        {
+            if (o.kind == K::reg)
+                e.def |= bit(o.reg);
+            else if (o.kind == K::mem)
+            {
+                e.use |= addr_regs(o);
+                e.store = true;
+            }
+        }
+
+        Effect effect(const Inst &i)
+        {
+            Effect e;
+            switch (i.op)
+            {
+                case Op::nop:
+                case Op::fprem:
+                case Op::fstp:
+                    break;
+
+                case Op::movq:
+                case Op::movapd:
+                    read(e, i.a);
+                    write(e, i.b);
+                    break;
+
+                case Op::movsd:
+                    /* register to register only replaces the low lane */
+                    read(e, i.a);
+                    if (i.a.kind == K::reg)
+                        read(e, i.b);
+                    write(e, i.b);
+                    break;
+
+                case Op::leaq:
+                    e.use |= addr_regs(i.a);
+                    write(e, i.b);
+                    break;
+
+                case Op::pushq:
+                    read(e, i.a);
+                    e.use |= RSP;
+                    e.def |= RSP;
+                    e.store = true;
+                    break;
+
+                case Op::popq:
+                    e.use |= RSP;
+                    e.def |= RSP;
+                    write(e, i.a);
+                    break;
+
+                case Op::imulq:
+                    if (i.b.kind != K::none)
+                    {
+                        read(e, i.a);
+                        read(e, i.b);
+                        write(e, i.b);
+                        break;
+                    }
+
+                    /* one operand: rdx:rax = rax * a */
+                    read(e, i.a);
+                    e.use |= bit(Reg::rax);
+                    e.def |= bit(Reg::rax) | bit(Reg::rdx);
+                    break;
+
+                case Op::addq:
+                case Op::subq:
+                case Op::andq:
+                case Op::orq:
+                case Op::xorq:
+                case Op::shlq:
+                case Op::shrq:
+                case Op::sarq:
+                case Op::addsd:
+                case Op::subsd:
+                case Op::mulsd:
+                case Op::divsd:
+                    read(e, i.a);
+                    read(e, i.b);
+                    write(e, i.b);
+                    break;
+
+                case Op::cmpq:
+                case Op::testq:
+                case Op::ucomisd:
+                    read(e, i.a);
+                    read(e, i.b);
+                    break;
+
+                case Op::notq:
+                case Op::negq:
+                case Op::sete:
+                case Op::setne:
+                case Op::setl:
+                case Op::setle:
+                case Op::setg:
+                case Op::setge:
+                case Op::setb:
+                case Op::setbe:
+                case Op::seta:
+                case Op::setae:
+                case Op::setp:
+                case Op::setnp:
+                    /* setcc only writes the low byte, the rest stays live */
+                    read(e, i.a);
+                    write(e, i.a);
+                    break;
+
+                case Op::movzbl:
+                    read(e, i.a);
+                    write(e, i.b);
+                    break;
+
+                case Op::idivq:
+                    read(e, i.a);
+                    e.use |= bit(Reg::rax) | bit(Reg::rdx);
+                    e.def |= bit(Reg::rax) | bit(Reg::rdx);
+                    break;
+
+                case Op::cqto:
+                    e.use |= bit(Reg::rax);
+                    e.def |= bit(Reg::rdx);
+                    break;
+
+                case Op::fldl:
+                    read(e, i.a);
+                    break;
+
+                case Op::fstpl:
+                    write(e, i.a);
+                    break;
+
+                default:
+                    /* labels, branches, calls, ret and anything newer */
+                    e.barrier = true;
+                    break;
+            }
+            return e;
+        }
+
+        bool gpr(const Operand &o)
+        {
+            return o.kind == K::reg && o.reg <= Reg::r15;
+        }
+
+        bool is(const Operand &o, const Reg r)
+        {
+            return o.kind == K::reg && o.reg == r;
+        }
+
+        /* a source a plain movq/pushq can take directly */
+        bool simple_source(const Operand &o)
+        {
+            return gpr(o) || o.kind == K::mem || (o.kind == K::imm && o.imm >= INT32_MIN && o.imm <= INT32_MAX);
+        }
+
+        /* +n for addq $n, %rsp, -n for subq, 0 for anything else */
+        int64_t rsp_delta(const Inst &i)
+        {
+            if ((i.op != Op::addq && i.op != Op::subq) || i.a.kind != K::imm || !is(i.b, Reg::rsp))
+                return 0;
+            return i.op == Op::addq ? i.a.imm : -i.a.imm;
+        }
+    }
+
+    const char *Peephole::rule_name(const Rule r)
+    {
+        return r < Rule::count ? RULE_NAMES[static_cast<size_t>(r)] : "";
+    }
+
+    size_t Peephole::run(Code &c)
+    {
+        insts = &c.insts;
+        const size_t before = c.insts.size();
+
+        for (uint32_t round = 0; round < cfg.rounds; ++round)
+        {
+            gone.assign(c.insts.size(), 0);
+
+            bool changed = false;
+            for (size_t i = 0; i < c.insts.size(); i = next(i))
+            {
+                while (!gone[i] && apply(i))
+                    changed = true;
+            }
+
+            size_t kept = 0;
+            for (size_t i = 0; i < c.insts.size(); ++i)
+            {
+                if (!gone[i])
+                    c.insts[kept++] = c.insts[i];
+            }
+            c.insts.resize(kept);
+
+            if (!changed)
+                break;
+        }
+
+        insts = nullptr;
+        return before - c.insts.size();
+    }
+
+    bool Peephole::enabled(const Rule r) const
+    {
+        return cfg.rules & (1u << static_cast<uint32_t>(r));
+    }
+
+    size_t Peephole::next(size_t i) const
+    {
+        do
+            ++i;
+        while (i < gone.size() && gone[i]);
+        return i;
+    }
+
+    bool Peephole::dead(uint64_t regs, size_t from) const
+    {
+        const std::vector<Inst> &v = *insts;
+        for (uint32_t seen = 0; from < v.size() && seen < cfg.window; from = next(from), ++seen)
+        {
+            const Effect e = effect(v[from]);
+            if (e.barrier || (e.use & regs))
+                return false;
+
+            regs &= ~e.def;
+            if (!regs)
+                return true;
+        }
+        return false;
+    }
+
+    bool Peephole::apply(const size_t i)
+    {
+        using Fn = bool (Peephole::*)(size_t);
+        static constexpr Fn RULES[] = {
+            &Peephole::self_move, &Peephole::stack_adjust, &Peephole::push_pop,
+            &Peephole::mov_push, &Peephole::forward_mov, &Peephole::dead_mov
+        };
+
+        for (size_t r = 0; r < std::size(RULES); ++r)
+        {
+            if (enabled(static_cast<Rule>(r)) && (this->*RULES[r])(i))
+            {
+                ++counts[r];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Peephole::self_move(const size_t i)
+    {
+        const Inst &in = (*insts)[i];
+        if ((in.op != Op::movq && in.op != Op::movsd && in.op != Op::movapd) || in.a.kind != K::reg ||
+            !is(in.b, in.a.reg))
+            return false;
+
+        gone[i] = 1;
+        return true;
+    }
+
+    bool Peephole::stack_adjust(const size_t i)
+    {
+        std::vector<Inst> &v = *insts;
+        const size_t j = next(i);
+        if (j >= v.size() || cfg.window < 2)
+            return false;
+
+        const int64_t a = rsp_delta(v[i]);
+        const int64_t b = rsp_delta(v[j]);
+        if (!a || !b)
+            return false;
+
+        const int64_t d = a + b;
+        if (d < INT32_MIN || d > INT32_MAX)
+            return false;
+
+        gone[j] = 1;
+        if (d == 0)
+            gone[i] = 1;
+        else
+            v[i] = { d > 0 ? Op::addq : Op::subq, imm(d > 0 ? d : -d), reg(Reg::rsp) };
+        return true;
+    }
+
+    bool Peephole::push_pop(const size_t i)
+    {
+        std::vector<Inst> &v = *insts;
+        const Inst &push = v[i];
+        if (push.op != Op::pushq || !simple_source(push.a) || is(push.a, Reg::rsp))
+            return false;
+
+        /* the popped register is written early, so nothing in between may touch it or the stack */
+        uint64_t touched = 0;
+        uint32_t seen = 1;
+        for (size_t k = next(i); k < v.size() && seen < cfg.window; k = next(k), ++seen)
+        {
+            const Inst &in = v[k];
+            if (in.op == Op::popq)
+            {
+                if (!gpr(in.a) || is(in.a, Reg::rsp) || (touched & bit(in.a.reg)))
+                    return false;
+
+                const Operand to = in.a;
+                gone[k] = 1;
+                if (is(push.a, to.reg))
+                    gone[i] = 1;
+                else
+                    v[i] = { Op::movq, push.a, to };
+                return true;
+            }
+
+            const Effect e = effect(in);
+            if (e.barrier || e.store || ((e.use | e.def) & RSP))
+                return false;
+            touched |= e.use | e.def;
+        }
+        return false;
+    }
+
+    bool Peephole::mov_push(const size_t i)
+    {
+        std::vector<Inst> &v = *insts;
+        const size_t j = next(i);
+        if (j >= v.size() || cfg.window < 2)
+            return false;
+
+        const Inst &mov = v[i];
+        if (mov.op != Op::movq || !gpr(mov.b) || !simple_source(mov.a) || v[j].op != Op::pushq ||
+            !is(v[j].a, mov.b.reg) || !dead(bit(mov.b.reg), next(j)))
+            return false;
+
+        v[j].a = mov.a;
+        gone[i] = 1;
+        return true;
+    }
+
+    bool Peephole::forward_mov(const size_t i)
+    {
+        std::vector<Inst> &v = *insts;
+        const size_t j = next(i);
+        if (j >= v.size() || cfg.window < 2)
+            return false;
+
+        const Inst &first = v[i];
+        const Inst &second = v[j];
+        if (first.op != Op::movq || second.op != Op::movq || !gpr(first.b) || !simple_source(first.a) ||
+            !is(second.a, first.b.reg))
+            return false;
+
+        const Reg r = first.b.reg;
+        const Operand &to = second.b;
+        if (!(gpr(to) || to.kind == K::mem) || (to.kind == K::mem && first.a.kind == K::mem) ||
+            (addr_regs(to) & bit(r)) || is(to, r) || !dead(bit(r), next(j)))
+            return false;
+
+        v[j] = { Op::movq, first.a, to };
+        gone[i] = 1;
+        return true;
+    }
+
+    bool Peephole::dead_mov(const size_t i)
+    {
+        const Inst &in = (*insts)[i];
+        if (in.op != Op::movq && in.op != Op::movsd && in.op != Op::movapd && in.op != Op::leaq)
+            return false;
+        if (in.b.kind != K::reg || in.b.reg == Reg::rsp || in.b.reg == Reg::rbp || !dead(bit(in.b.reg), next(i)))
+            return false;
+
+        gone[i] = 1;
+        return true;
+    }
+}
@@ -0,0 +1,245 @@
+#include <bit>
+#include <cstdint>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * strength reduction for IMUL, IDIV and IMOD by a NUM (Options::reduce)
+ *
+ * a multiply becomes a shift, an lea, an lea and a shift, or a shift and
+ * an add/sub, negated for negative factors; whatever is left is imulq by
+ * an immediate. a division by 2^k adds 2^k - 1 to negative dividends and
+ * shifts arithmetically. any other divisor is a multiply by its magic
+ * number (Hacker's Delight, 10-1): the high half of x * M, corrected by x
+ * when M and d differ in sign, shifted and rounded towards zero. modulo is
+ * x - q * d on top of that
+ *
+ * the results match idivq for every input idivq accepts; INT64_MIN / -1
+ * wraps to INT64_MIN instead of trapping
+ */
+namespace cdgnx::backend
+{
+    using mc::imm;
+    using mc::mem;
+    using mc::reg;
+
+    namespace
+    {
+        struct Magic
+        {
+            int64_t m;
+            uint32_t shift;
+        };
+
+        /* |d| >= 2 and not a power of two */
+        constexpr Magic magic(const int64_t d)
+        {
+            constexpr uint64_t two63 = uint64_t{ 1 } << 63;
+            const uint64_t ad = d < 0 ? 0 - static_cast<uint64_t>(d) : static_cast<uint64_t>(d);
+            const uint64_t t = two63 + (static_cast<uint64_t>(d) >> 63);
+            const uint64_t anc = t - 1 - t % ad;
+            uint32_t p = 63;
+            uint64_t q1 = two63 / anc;
+            uint64_t r1 = two63 - q1 * anc;
+            uint64_t q2 = two63 / ad;
+            uint64_t r2 = two63 - q2 * ad;
+            uint64_t delta = 0;
+            do
+            {
+                ++p;
+                q1 *= 2;
+                r1 *= 2;
+                if (r1 >= anc)
+                {
+                    ++q1;
+                    r1 -= anc;
+                }
+                q2 *= 2;
+                r2 *= 2;
+                if (r2 >= ad)
+                {
+                    ++q2;
+                    r2 -= ad;
+                }
+                delta = ad - r2;
+            }
+            while (q1 < delta || (q1 == delta && r1 == 0));
+
+            const uint64_t m = q2 + 1;
+            return { static_cast<int64_t>(d < 0 ? 0 - m : m), p - 64 };
+        }
+
+        static_assert(magic(7).m == 0x4924924924924925 && magic(7).shift == 1);
+        static_assert(magic(-7).m == -0x4924924924924925 && magic(-7).shift == 1);
+        static_assert(magic(3).m == 0x5555555555555556 && magic(3).shift == 0);
+
+        bool fits32(const int64_t v)
+        {
+            return v >= INT32_MIN && v <= INT32_MAX;
+        }
+    }
+
+    bool x86_64::reducible(const NodeId n, uint32_t &c) const
+    {
+        if (!opts.reduce || n == NONE)
+            return false;
+
+        const Rec &rec = (*ir)[n];
+        if (rec.type != OpType::IMUL && rec.type != OpType::IDIV && rec.type != OpType::IMOD)
+            return false;
+
+        const auto num = [this](const NodeId k) { return k != NONE && (*ir)[k].type == OpType::NUM; };
+        const NodeId l = ir->kid(n, 0);
+        const NodeId r = ir->kid(n, 1);
+        if (num(r) && (rec.type == OpType::IMUL || (*ir)[r].value != 0))
+        {
+            c = 1;
+            return true;
+        }
+        if (rec.type == OpType::IMUL && num(l))
+        {
+            c = 0;
+            return true;
+        }
+        return false;
+    }
+
+    void x86_64::reduce(const OpType t, const int64_t c, const Reg x)
+    {
+        const uint64_t u = c < 0 ? 0 - static_cast<uint64_t>(c) : static_cast<uint64_t>(c);
+        const auto pow2 = [](const uint64_t v) { return v && (v & (v - 1)) == 0; };
+        const auto log2 = [](const uint64_t v) { return static_cast<int64_t>(std::countr_zero(v)); };
+
+        if (t == OpType::IMUL)
+        {
+            const uint64_t odd = u >> std::countr_zero(u | (uint64_t{ 1 } << 63));
+            if (c == 0)
+            {
+                emit(Op::movq, imm(0), reg(x));
+                return;
+            }
+
+            if (pow2(u))
+            {
+                if (u > 1)
+                    emit(Op::shlq, imm(log2(u)), reg(x));
+            }
+            else if (odd == 3 || odd == 5 || odd == 9)
+            {
+                /* lea (x, x, odd - 1), then the power of two */
+                emit(Op::leaq, mem(x, 0, x, static_cast<uint8_t>(odd - 1)), reg(x));
+                if (u != odd)
+                    emit(Op::shlq, imm(log2(u)), reg(x));
+            }
+            else if (pow2(u - 1))
+            {
+                emit(Op::movq, reg(x), reg(Reg::rcx));
+                emit(Op::shlq, imm(log2(u - 1)), reg(Reg::rcx));
+                emit(Op::addq, reg(Reg::rcx), reg(x));
+            }
+            else if (pow2(u + 1))
+            {
+                emit(Op::movq, reg(x), reg(Reg::rcx));
+                emit(Op::shlq, imm(log2(u + 1)), reg(Reg::rcx));
+                emit(Op::subq, reg(x), reg(Reg::rcx));
+                emit(Op::movq, reg(Reg::rcx), reg(x));
+            }
+            else
+            {
+                /* no cheaper form, but the factor still needs no register of its own */
+                if (fits32(c))
+                    emit(Op::imulq, imm(c), reg(x));
+                else
+                {
+                    emit(Op::movq, imm(c), reg(Reg::rcx));
+                    emit(Op::imulq, reg(Reg::rcx), reg(x));
+                }
+                return;
+            }
+
+            if (c < 0)
+                emit(Op::negq, reg(x));
+            return;
+        }
+
+        const bool div = t == OpType::IDIV;
+        if (u == 1)
+        {
+            if (!div)
+                emit(Op::movq, imm(0), reg(x));
+            else if (c < 0)
+                emit(Op::negq, reg(x));
+            return;
+        }
+
+        if (pow2(u))
+        {
+            /* rcx = x + (x < 0 ? 2^k - 1 : 0) */
+            const int64_t k = log2(u);
+            emit(Op::movq, reg(x), reg(Reg::rcx));
+            emit(Op::sarq, imm(63), reg(Reg::rcx));
+            emit(Op::shrq, imm(64 - k), reg(Reg::rcx));
+            emit(Op::addq, reg(x), reg(Reg::rcx));
+            if (div)
+            {
+                emit(Op::sarq, imm(k), reg(Reg::rcx));
+                if (c < 0)
+                    emit(Op::negq, reg(Reg::rcx));
+                emit(Op::movq, reg(Reg::rcx), reg(x));
+                return;
+            }
+
+            /* x - (rcx rounded down to a multiple of 2^k) */
+            const int64_t mask = static_cast<int64_t>(0 - u);
+            if (fits32(mask))
+                emit(Op::andq, imm(mask), reg(Reg::rcx));
+            else
+            {
+                emit(Op::movq, imm(mask), reg(Reg::rdx));
+                emit(Op::andq, reg(Reg::rdx), reg(Reg::rcx));
+            }
+            emit(Op::subq, reg(Reg::rcx), reg(x));
+            return;
+        }
+
+        /* rdx = high half of x * m; the imulq takes rax, so x moves to rcx if it is there */
+        const Magic mg = magic(c);
+        const Reg src = x == Reg::rax ? Reg::rcx : x;
+        if (x == Reg::rax)
+        {
+            emit(Op::movq, reg(Reg::rax), reg(Reg::rcx));
+            emit(Op::movq, imm(mg.m), reg(Reg::rax));
+        }
+        else
+            emit(Op::movq, imm(mg.m), reg(Reg::rax));
+        emit(Op::imulq, reg(src));
+
+        if (c > 0 && mg.m < 0)
+            emit(Op::addq, reg(src), reg(Reg::rdx));
+        else if (c < 0 && mg.m > 0)
+            emit(Op::subq, reg(src), reg(Reg::rdx));
+        if (mg.shift)
+            emit(Op::sarq, imm(mg.shift), reg(Reg::rdx));
+
+        /* round towards zero: add one to a negative quotient */
+        emit(Op::movq, reg(Reg::rdx), reg(Reg::rax));
+        emit(Op::shrq, imm(63), reg(Reg::rax));
+        emit(Op::addq, reg(Reg::rax), reg(Reg::rdx));
+
+        if (div)
+        {
+            emit(Op::movq, reg(Reg::rdx), reg(x));
+            return;
+        }
+
+        if (fits32(c))
+            emit(Op::imulq, imm(c), reg(Reg::rdx));
+        else
+        {
+            emit(Op::movq, imm(c), reg(Reg::rax));
+            emit(Op::imulq, reg(Reg::rax), reg(Reg::rdx));
+        }
+        if (x == Reg::rax)
+            emit(Op::movq, reg(Reg::rcx), reg(Reg::rax));
+        emit(Op::subq, reg(Reg::rdx), reg(x));
+    }
+}
@@ -0,0 +1,810 @@
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * register mode: every statement is an expression tree, so values are
+ * allocated Sethi-Ullman style. the deeper operand is evaluated first
+ * (when neither side has effects) and the first result is only spilled
+ * when the second operand needs more registers than are left
+ *
+ * rax/rcx/rdx and xmm0/xmm1 are never handed out; they are the fixed
+ * operands of idiv and shifts and hold reloaded spills
+ *
+ * lowering runs on the backend's Walk: a step_ function is resumed once
+ * for every operand it descended into and finds that operand's register
+ * in walk.last(). NUM, FNUM, STR, LEA and PARAM operands are lowered in place
+ *
+ * under Options::select a node the matcher covered with a pattern is
+ * lowered by step_match(): the pattern's leaves go into registers in IR
+ * order and one instruction takes the rest as immediates and memory
+ * operands. a leaf that finds too few registers free spills the ones
+ * before it, which come back in rax and rcx
+ */
+namespace cdgnx::backend
+{
+    using mc::imm;
+    using mc::mem;
+    using mc::reg;
+
+    namespace
+    {
+        constexpr uint32_t GPR_POOL = 0x00000fc0; /* rsi, rdi, r8-r11 */
+        constexpr uint32_t XMM_POOL = 0xfffc0000; /* xmm2-xmm15 */
+        constexpr uint8_t EFFECTS = 0x80;
+        constexpr uint8_t NEED = 0x7f;
+
+        bool is_xmm(const mc::Reg r)
+        {
+            return r >= mc::Reg::xmm0 && r <= mc::Reg::xmm15;
+        }
+    }
+
+    x86_64::Reg x86_64::alloc(const bool fp)
+    {
+        const uint32_t avail = free_regs & (fp ? XMM_POOL : GPR_POOL);
+        /* operands() spills by what measure() counted, so this is a bug in the counting */
+        if (!avail)
+            throw std::logic_error("x86_64: out of registers");
+        const auto r = static_cast<Reg>(std::countr_zero(avail));
+        free_regs &= ~(1u << static_cast<uint8_t>(r));
+        vecs &= ~(1u << static_cast<uint8_t>(r));
+        if constexpr (Stats::ENABLED)
+            ++allocs;
+        return r;
+    }
+
+    void x86_64::release(const Reg r)
+    {
+        if (r != Reg::none)
+            free_regs |= (1u << static_cast<uint8_t>(r)) & (GPR_POOL | XMM_POOL);
+    }
+
+    void x86_64::spill(const Reg r)
+    {
+        if constexpr (Stats::ENABLED)
+            ++spills;
+        if (vecs & (1u << static_cast<uint8_t>(r)))
+        {
+            emit(Op::subq, imm(vector_bytes()), reg(Reg::rsp));
+            emit_vec(Op::movdqu, vector_bytes(), reg(r), mem(Reg::rsp));
+        }
+        else if (is_xmm(r))
+        {
+            emit(Op::subq, imm(8), reg(Reg::rsp));
+            emit(Op::movsd, reg(r), mem(Reg::rsp));
+        }
+        else
+            emit(Op::pushq, reg(r));
+    }
+
+    void x86_64::restore(const Reg r, const bool vec)
+    {
+        const uint32_t bit = 1u << static_cast<uint8_t>(r);
+        vecs = vec ? vecs | bit : vecs & ~bit;
+        if (vec)
+        {
+            emit_vec(Op::movdqu, vector_bytes(), mem(Reg::rsp), reg(r));
+            emit(Op::addq, imm(vector_bytes()), reg(Reg::rsp));
+        }
+        else if (is_xmm(r))
+        {
+            emit(Op::movsd, mem(Reg::rsp), reg(r));
+            emit(Op::addq, imm(8), reg(Reg::rsp));
+        }
+        else
+            emit(Op::popq, reg(r));
+    }
+
+    void x86_64::spill_all(const uint32_t live)
+    {
+        for (uint32_t m = live; m; m &= m - 1)
+            spill(static_cast<Reg>(std::countr_zero(m)));
+    }
+
+    void x86_64::restore_all(const uint32_t live, const uint32_t live_vecs)
+    {
+        /* highest first, the reverse of the saves */
+        for (uint32_t m = live; m;)
+        {
+            const int top = 31 - std::countl_zero(m);
+            m &= ~(1u << top);
+            restore(static_cast<Reg>(top), live_vecs >> top & 1);
+        }
+    }
+
+    void x86_64::measure(const NodeId n)
+    {
+        walk.post_order(*ir, n, [this](const NodeId m)
+        {
+            const Rec &r = (*ir)[m];
+            uint8_t fx = op_info(r.type).effects ? EFFECTS : 0;
+
+            /* operands are done, NONE counts as one register */
+            const auto of = [this](const NodeId k) -> uint8_t { return k == NONE ? 1 : need[k]; };
+
+            uint32_t n_need = 1;
+            const auto kids = ir->kids(m);
+            if (kids.size() == 2 && r.type != OpType::CALL)
+            {
+                const uint8_t l = of(kids[0]);
+                const uint8_t rr = of(kids[1]);
+                const uint32_t ln = l & NEED;
+                const uint32_t rn = rr & NEED;
+                n_need = ln == rn ? ln + 1 : std::max(ln, rn);
+                fx |= (l | rr) & EFFECTS;
+            }
+            else
+            {
+                for (const NodeId k: kids)
+                {
+                    const uint8_t v = of(k);
+                    n_need = std::max<uint32_t>(n_need, v & NEED);
+                    fx |= v & EFFECTS;
+                }
+            }
+
+            need[m] = static_cast<uint8_t>(std::min<uint32_t>(n_need, NEED) | fx);
+        });
+    }
+
+    void x86_64::step_stmt(Frame &f)
+    {
+        const NodeId n = f.node;
+        if (n == NONE)
+            return;
+
+        const OpType t = (*ir)[n].type;
+        if (t == OpType::ROOT)
+        {
+            if (f.step < (*ir)[n].nkids)
+                walk.descend(ir->kid(n, f.step), { Mode::stmt });
+            return;
+        }
+
+        Reg l = Reg::none;
+        Reg r = Reg::none;
+        if (op_info(t).value)
+        {
+            /* an expression statement leaves its value on the stack, as in stack mode */
+            if (!operand(f, n, r))
+                return;
+
+            spill(r);
+            release(r);
+            return;
+        }
+
+        if (step_match(f, select::Nt::stmt))
+            return;
+
+        switch (t)
+        {
+            case OpType::RET:
+            {
+                if (!ir->kids(n).empty())
+                {
+                    if (!operand(f, ir->kid(n, 0), r))
+                        return;
+
+                    emit(Op::movq, reg(r), reg(Reg::rax));
+                    if (sig.returns_double)
+                        emit(is_xmm(r) ? Op::movapd : Op::movq, reg(r), reg(Reg::xmm0));
+                    release(r);
+                }
+                if (framed)
+                {
+                    emit(Op::movq, reg(Reg::rbp), reg(Reg::rsp));
+                    emit(Op::popq, reg(Reg::rbp));
+                }
+                emit(Op::ret);
+                break;
+            }
+
+            case OpType::PUSH:
+            {
+                if (!operand(f, ir->kid(n, 0), r))
+                    return;
+
+                spill(r);
+                release(r);
+                break;
+            }
+
+            case OpType::STORE:
+            {
+                if (!operands(f, false, l, r))
+                    return;
+
+                emit(Op::movq, reg(r), mem(l));
+                release(l);
+                release(r);
+                break;
+            }
+
+            case OpType::MOV:
+            {
+                if (!operand(f, ir->kid(n, 1), r))
+                    return;
+
+                r = coerce(r, false);
+                emit(Op::movq, reg(r), format_addr(ir->addr(ir->kid(n, 0))));
+                release(r);
+                break;
+            }
+
+            case OpType::ICMP:
+            case OpType::FCMP:
+            case OpType::TEST:
+            {
+                if (!operands(f, op_info(t).cls == OpClass::fp, l, r))
+                    return;
+
+                emit(select(t).op, reg(r), reg(l));
+                release(l);
+                release(r);
+                break;
+            }
+
+            case OpType::BR:
+            {
+                const Compare c = comparison(n);
+                if (!operands(f, c.op == OpType::FCMP, l, r))
+                    return;
+
+                compare(c, l, r);
+                release(l);
+                release(r);
+                branch(n, c);
+                break;
+            }
+
+            case OpType::VSTORE:
+            {
+                step_vector(f);
+                break;
+            }
+
+            default:
+            {
+                /* labels, jumps and POP lower the same way in both modes */
+                f.state.mode = Mode::stack;
+                step_stack(f);
+                break;
+            }
+        }
+    }
+
+    void x86_64::step_value(Frame &f)
+    {
+        const NodeId n = f.node;
+        if (n == NONE || !op_info((*ir)[n].type).value)
+        {
+            if (f.step == 0)
+            {
+                walk.descend(n, { Mode::stmt });
+                return;
+            }
+
+            const Reg r = alloc(false);
+            emit(Op::xorq, reg(r), reg(r));
+            f.state.value = r;
+            return;
+        }
+
+        const Rec &rec = (*ir)[n];
+        if (select(rec.type).form == Form::vector)
+        {
+            step_vector(f);
+            return;
+        }
+        if (step_match(f, select::Nt::reg))
+            return;
+
+        Reg l = Reg::none;
+        Reg r = Reg::none;
+        switch (rec.type)
+        {
+            case OpType::NUM:
+            case OpType::FNUM:
+            case OpType::STR:
+            case OpType::LEA:
+            case OpType::PARAM:
+            {
+                value_of(n, r);
+                break;
+            }
+
+            case OpType::LOAD:
+            {
+                if (!operand(f, ir->kid(n, 0), r))
+                    return;
+
+                r = coerce(r, false);
+                emit(Op::movq, mem(r), reg(r));
+                break;
+            }
+
+            case OpType::BNOT:
+            {
+                if (!operand(f, ir->kid(n, 0), r))
+                    return;
+
+                r = coerce(r, false);
+                emit(select(rec.type).op, reg(r));
+                break;
+            }
+
+            case OpType::FMOD:
+            {
+                if (!operands(f, true, l, r))
+                    return;
+
+                /* a libm call, see stack_op<FMOD>; the rest of the pool is caller-saved */
+                const uint32_t live = ~free_regs & (GPR_POOL | XMM_POOL) & ~(1u << static_cast<uint8_t>(l) | 1u << static_cast<uint8_t>(r));
+                const uint32_t live_vecs = vecs & live;
+                spill_all(live);
+                if (l != Reg::xmm0)
+                    emit(Op::movapd, reg(l), reg(Reg::xmm0));
+                if (r != Reg::xmm1)
+                    emit(Op::movapd, reg(r), reg(Reg::xmm1));
+                call_aligned(code.sym("fmod"));
+                restore_all(live, live_vecs);
+
+                /* at most one of them is xmm0/xmm1, a reloaded spill */
+                const Reg dst = l == Reg::xmm0 ? r : l;
+                release(dst == l ? r : l);
+                emit(Op::movapd, reg(Reg::xmm0), reg(dst));
+                r = dst;
+                break;
+            }
+
+            case OpType::SET:
+            {
+                const Compare c = comparison(n);
+                if (!operands(f, c.op == OpType::FCMP, l, r))
+                    return;
+
+                compare(c, l, r);
+                release(l);
+                release(r);
+                r = alloc(false);
+                flag(c, r);
+                break;
+            }
+
+            case OpType::CALL:
+            {
+                step_call(f);
+                return;
+            }
+
+            default:
+            {
+                uint32_t c = 0;
+                if (reducible(n, c))
+                {
+                    if (!operand(f, ir->kid(n, 1 - c), r))
+                        return;
+
+                    r = coerce(r, false);
+                    reduce(rec.type, (*ir)[ir->kid(n, c)].value, r);
+                    break;
+                }
+
+                /* binary ops, lowered by their Form */
+                const Select &sel = select(rec.type);
+                if (!operands(f, sel.form == Form::fp, l, r))
+                    return;
+
+                if (sel.form == Form::divide)
+                {
+                    if (l != Reg::rax)
+                        emit(Op::movq, reg(l), reg(Reg::rax));
+                    emit(Op::cqto);
+                    emit(sel.op, reg(r));
+                    if (sel.result != l)
+                        emit(Op::movq, reg(sel.result), reg(l));
+                }
+                else if (sel.form == Form::shift)
+                {
+                    if (r != Reg::rcx)
+                        emit(Op::movq, reg(r), reg(Reg::rcx));
+                    emit(sel.op, reg(Reg::rcx), reg(l));
+                }
+                else
+                    emit(sel.op, reg(r), reg(l));
+                r = settle(l, r);
+                break;
+            }
+        }
+        f.state.value = r;
+    }
+
+    x86_64::Reg x86_64::coerce(const Reg r, const bool fp)
+    {
+        if (is_xmm(r) == fp)
+            return r;
+
+        /* bit-for-bit move between register files, as the stack does */
+        const Reg t = alloc(fp);
+        emit(Op::movq, reg(r), reg(t));
+        release(r);
+        return t;
+    }
+
+    bool x86_64::value_of(const NodeId k, Reg &v)
+    {
+        if (k != NONE)
+        {
+            const Rec &rec = (*ir)[k];
+            switch (rec.type)
+            {
+                case OpType::NUM:
+                {
+                    v = alloc(false);
+                    emit(Op::movq, imm(rec.value), reg(v));
+                    return true;
+                }
+
+                case OpType::FNUM:
+                {
+                    v = alloc(true);
+                    emit(Op::movsd, mc::rip(constant(rec.value)), reg(v));
+                    return true;
+                }
+
+                case OpType::STR:
+                {
+                    v = alloc(false);
+                    emit(Op::leaq, mc::rip(literal(ir->strval(k))), reg(v));
+                    return true;
+                }
+
+                case OpType::LEA:
+                {
+                    v = alloc(false);
+                    emit(Op::leaq, format_addr(ir->addr(k)), reg(v));
+                    return true;
+                }
+
+                case OpType::PARAM:
+                {
+                    const bool fp = fp_value(k);
+                    v = alloc(fp);
+                    emit(fp ? Op::movsd : Op::movq, param(k), reg(v));
+                    return true;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        walk.descend(k, { Mode::value });
+        return false;
+    }
+
+    bool x86_64::operand(const Frame &f, const NodeId k, Reg &v)
+    {
+        if (f.step == 0)
+            return value_of(k, v);
+
+        v = walk.last().value;
+        return true;
+    }
+
+    bool x86_64::operands(Frame &f, const bool lfp, const bool rfp, Reg &l, Reg &r)
+    {
+        const NodeId lhs = ir->kid(f.node, 0);
+        const NodeId rhs = ir->kid(f.node, 1);
+        const uint8_t ln = lhs == NONE ? 1 : need[lhs];
+        const uint8_t rn = rhs == NONE ? 1 : need[rhs];
+        Lowering &s = f.state;
+
+        /* v is the operand finished last, either resumed from a descent or lowered in place */
+        Reg v = Reg::none;
+        if (f.step == 0)
+        {
+            /* reordering is only safe when neither side has effects */
+            s.swap = !((ln | rn) & EFFECTS) && (rn & NEED) > (ln & NEED);
+            if (!value_of(s.swap ? rhs : lhs, v))
+                return false;
+            ++f.step;
+        }
+        else
+            v = walk.last().value;
+
+        if (f.step == 1)
+        {
+            const uint32_t want = (s.swap ? ln : rn) & NEED;
+            s.first = coerce(v, s.swap ? rfp : lfp);
+            s.spilled = static_cast<uint32_t>(std::popcount(free_regs & GPR_POOL)) < want
+                        || static_cast<uint32_t>(std::popcount(free_regs & XMM_POOL)) < want;
+            if (s.spilled)
+            {
+                s.vector = vecs & (1u << static_cast<uint8_t>(s.first));
+                spill(s.first);
+                release(s.first);
+            }
+
+            if (!value_of(s.swap ? lhs : rhs, v))
+                return false;
+            ++f.step;
+        }
+
+        const Reg b = coerce(v, s.swap ? lfp : rfp);
+        Reg a = s.first;
+        if (s.spilled)
+        {
+            /* the left operand comes back in rax/xmm0, the right one in rcx/xmm1 */
+            a = (s.swap ? rfp : lfp) ? (s.swap ? Reg::xmm1 : Reg::xmm0) : (s.swap ? Reg::rcx : Reg::rax);
+            restore(a, s.vector);
+        }
+
+        l = s.swap ? b : a;
+        r = s.swap ? a : b;
+        return true;
+    }
+
+    x86_64::Reg x86_64::settle(const Reg l, const Reg r)
+    {
+        if (l == Reg::rax || l == Reg::xmm0)
+        {
+            if (vecs & (1u << static_cast<uint8_t>(l)))
+            {
+                emit_vec(Op::movapd, vector_bytes(), reg(l), reg(r));
+                vecs |= 1u << static_cast<uint8_t>(r);
+            }
+            else
+                emit(l == Reg::rax ? Op::movq : Op::movapd, reg(l), reg(r));
+            return r;
+        }
+
+        release(r);
+        return l;
+    }
+
+    void x86_64::step_call(Frame &f)
+    {
+        const NodeId n = f.node;
+        const auto args = ir->kids(n);
+        Reg v = Reg::none;
+        if (f.step == 0)
+        {
+            /* everything in the pool is caller-saved */
+            f.state.live = ~free_regs & (GPR_POOL | XMM_POOL);
+            f.state.live_vecs = vecs & f.state.live;
+            spill_all(f.state.live);
+            free_regs |= f.state.live;
+        }
+        else
+        {
+            v = walk.last().value;
+            spill(v);
+            release(v);
+        }
+
+        /* arguments are pushed first to last, as in stack mode, and call_sysv() places them */
+        for (; f.step < args.size(); ++f.step)
+        {
+            if (direct(args[f.step]))
+                continue;
+            if (!value_of(args[f.step], v))
+                return;
+            spill(v);
+            release(v);
+        }
+
+        call_sysv(n);
+
+        const uint32_t live = f.state.live;
+        free_regs &= ~live;
+        const bool fp = fp_value(n);
+        const Reg dst = alloc(fp);
+        emit(fp ? Op::movapd : Op::movq, reg(fp ? Reg::xmm0 : Reg::rax), reg(dst));
+        restore_all(live, f.state.live_vecs);
+        f.state.value = dst;
+    }
+
+    bool x86_64::step_match(Frame &f, const select::Nt nt)
+    {
+        using select::Act;
+        using select::Nt;
+
+        const NodeId n = f.node;
+        const select::Rule *rule = opts.select ? matcher.rule(n, nt) : nullptr;
+        if (!rule)
+            return false;
+
+        NodeId leaves[select::Matcher::MAX_LEAVES];
+        const uint8_t count = matcher.leaves(*ir, n, nt, leaves);
+        if (!gather(f, leaves, count))
+            return true;
+
+        Lowering &s = f.state;
+        const Reg *next = s.held;
+        const OpType t = (*ir)[n].type;
+        const auto kid = [&](const uint32_t i) { return ir->kid(n, i); };
+        const auto release_all = [&](const Reg keep)
+        {
+            for (uint8_t i = 0; i < count; ++i)
+                if (s.held[i] != keep)
+                    release(s.held[i]);
+        };
+
+        Reg dst = Reg::none;
+        switch (rule->act)
+        {
+            case Act::lea:
+            case Act::load:
+            {
+                const Operand a = cover(n, rule->act == Act::lea ? Nt::addr : Nt::mem, next);
+                release_all(Reg::none);
+                dst = alloc(false);
+                emit(rule->act == Act::lea ? Op::leaq : Op::movq, a, reg(dst));
+                break;
+            }
+
+            case Act::alu:
+            case Act::alu_swapped:
+            {
+                /* operands come in IR order, the register one is the destination */
+                const bool swapped = rule->act == Act::alu_swapped;
+                const Operand a = swapped ? cover(kid(0), rule->kids[0], next) : Operand{};
+                dst = *next++;
+                const Operand b = swapped ? a : cover(kid(1), rule->kids[1], next);
+                emit(select(t).op, b, reg(dst));
+                release_all(dst);
+                break;
+            }
+
+            case Act::shift:
+            {
+                dst = *next++;
+                emit(select(t).op, imm((*ir)[kid(1)].value), reg(dst));
+                break;
+            }
+
+            case Act::compare:
+            {
+                const Operand l = cover(kid(0), rule->kids[0], next);
+                const Operand r = cover(kid(1), rule->kids[1], next);
+                const bool flag_op = t == OpType::BR || t == OpType::SET;
+                const Compare c = flag_op ? comparison(n) : Compare{ t };
+                if (c.op == OpType::TEST && r.kind == Operand::Kind::mem)
+                    emit(Op::testq, l, r); /* testq only takes memory on the right */
+                else
+                    emit(select(c.op).op, r, l);
+                release_all(Reg::none);
+
+                if (t == OpType::BR)
+                    branch(n, c);
+                else if (t == OpType::SET)
+                {
+                    dst = alloc(false);
+                    flag(c, dst);
+                }
+                break;
+            }
+
+            case Act::store:
+            case Act::mov:
+            {
+                const Operand a = rule->act == Act::store ? cover(kid(0), Nt::addr, next) : format_addr(ir->addr(kid(0)));
+                emit(Op::movq, cover(kid(1), rule->kids[1], next), a);
+                release_all(Reg::none);
+                break;
+            }
+
+            case Act::rmw:
+            case Act::rmw_slot:
+            {
+                /* op src, address: the LOAD below the op is the address itself */
+                const Operand a = rule->act == Act::rmw ? cover(kid(0), Nt::addr, next) : format_addr(ir->addr(kid(0)));
+                const NodeId u = kid(1);
+                const select::Rule &ur = *matcher.rule(u, Nt::upd);
+                const uint32_t src = ur.act == Act::update ? 1 : 0;
+                emit(select((*ir)[u].type).op, cover(ir->kid(u, src), ur.kids[src], next), a);
+                release_all(Reg::none);
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        /* a result reloaded into rax or rcx moves to a register of the pool */
+        if (dst != Reg::none && !((1u << static_cast<uint8_t>(dst)) & GPR_POOL))
+        {
+            const Reg to = alloc(false);
+            emit(Op::movq, reg(dst), reg(to));
+            dst = to;
+        }
+        s.value = dst;
+        return true;
+    }
+
+    bool x86_64::gather(Frame &f, const NodeId *leaves, const uint8_t count)
+    {
+        Lowering &s = f.state;
+        while (s.got < count)
+        {
+            Reg v = Reg::none;
+            if (s.waiting)
+            {
+                v = walk.last().value;
+                s.waiting = false;
+            }
+            else
+            {
+                /* as in operands(): make room when the leaf needs more than is free */
+                const NodeId k = leaves[s.got];
+                const uint32_t want = (k == NONE ? 1 : need[k]) & NEED;
+                if (s.got > s.pushed
+                    && (static_cast<uint32_t>(std::popcount(free_regs & GPR_POOL)) < want
+                        || static_cast<uint32_t>(std::popcount(free_regs & XMM_POOL)) < want))
+                {
+                    for (; s.pushed < s.got; ++s.pushed)
+                    {
+                        spill(s.held[s.pushed]);
+                        release(s.held[s.pushed]);
+                    }
+                }
+
+                s.waiting = true;
+                if (!value_of(k, v))
+                    return false; /* f may have moved */
+                s.waiting = false;
+            }
+            s.held[s.got++] = coerce(v, false);
+        }
+
+        /* last pushed comes back first */
+        for (uint8_t i = s.pushed; i-- > 0;)
+        {
+            s.held[i] = i == 0 ? Reg::rax : Reg::rcx;
+            restore(s.held[i]);
+        }
+        s.pushed = 0;
+        return true;
+    }
+
+    x86_64::Operand x86_64::cover(const NodeId k, const select::Nt nt, const Reg *&next) const
+    {
+        using select::Nt;
+
+        const auto address = [&next](const select::Ea &e)
+        {
+            Reg base = e.fixed;
+            Reg index = e.fixed_index;
+            if (e.index_first && e.index != NONE)
+                index = *next++;
+            if (e.base != NONE)
+                base = *next++;
+            if (!e.index_first && e.index != NONE)
+                index = *next++;
+            return mem(base, e.disp, index, e.scale);
+        };
+
+        switch (nt)
+        {
+            case Nt::reg:
+                return reg(*next++);
+            case Nt::imm:
+            case Nt::shift:
+                return imm((*ir)[k].value);
+            case Nt::slot:
+                return format_addr(ir->addr(k));
+            case Nt::mem:
+                return address(matcher.ea(ir->kid(k, 0), Nt::addr));
+            case Nt::base:
+            case Nt::index:
+            case Nt::addr:
+                return address(matcher.ea(k, nt));
+            default:
+                return {};
+        }
+    }
+}
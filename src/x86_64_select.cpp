@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <cdgnx/ops.hpp>
+#include <cdgnx/x86_64_select.hpp>
+
+/*
+ * the grammar. costs count instructions; a rule's cost adds to the costs
+ * of its kids as the nonterminals it asks for. the plain lowering of a
+ * node costs one instruction plus its kids as registers, and a rule has
+ * to beat that to be used, so trees no rule helps with come out as
+ * before
+ *
+ * a folded LOAD is read by the instruction that uses it, after every
+ * other leaf of the pattern is lowered; rules that move a LOAD past a
+ * leaf check that the leaf has no side effects. a read-modify-write
+ * needs the LOAD's address to be the STORE's, computed by equal trees
+ * without side effects
+ */
+namespace cdgnx::backend::select
+{
+    namespace
+    {
+        constexpr uint16_t INF = 0xffff;
+        constexpr uint8_t PLAIN = 0xfe;
+        constexpr uint8_t NO_RULE = 0xff;
+
+        constexpr Rule RULES[] = {
+            { Nt::imm,   OpType::NUM,   { Nt::none,  Nt::none  }, 0, Act::operand },
+            { Nt::shift, OpType::NUM,   { Nt::none,  Nt::none  }, 0, Act::operand },
+            { Nt::scale, OpType::NUM,   { Nt::none,  Nt::none  }, 0, Act::operand },
+            { Nt::log,   OpType::NUM,   { Nt::none,  Nt::none  }, 0, Act::operand },
+
+            { Nt::base,  OpType::IADD,  { Nt::base,  Nt::imm   }, 0, Act::disp },
+            { Nt::base,  OpType::IADD,  { Nt::imm,   Nt::base  }, 0, Act::disp_swapped },
+            { Nt::addr,  OpType::IADD,  { Nt::addr,  Nt::imm   }, 0, Act::disp },
+            { Nt::addr,  OpType::IADD,  { Nt::imm,   Nt::addr  }, 0, Act::disp_swapped },
+            { Nt::addr,  OpType::IADD,  { Nt::base,  Nt::index }, 0, Act::sum },
+            { Nt::addr,  OpType::IADD,  { Nt::index, Nt::base  }, 0, Act::sum_swapped },
+            { Nt::reg,   OpType::IADD,  { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::IADD,  { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::reg,   OpType::IADD,  { Nt::imm,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::reg,   OpType::IADD,  { Nt::mem,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::upd,   OpType::IADD,  { Nt::mem,   Nt::reg   }, 0, Act::update },
+            { Nt::upd,   OpType::IADD,  { Nt::mem,   Nt::imm   }, 0, Act::update },
+            { Nt::upd,   OpType::IADD,  { Nt::reg,   Nt::mem   }, 0, Act::update_swapped },
+            { Nt::upd,   OpType::IADD,  { Nt::imm,   Nt::mem   }, 0, Act::update_swapped },
+
+            { Nt::base,  OpType::ISUB,  { Nt::base,  Nt::imm   }, 0, Act::disp_neg },
+            { Nt::addr,  OpType::ISUB,  { Nt::addr,  Nt::imm   }, 0, Act::disp_neg },
+            { Nt::reg,   OpType::ISUB,  { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::ISUB,  { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::upd,   OpType::ISUB,  { Nt::mem,   Nt::reg   }, 0, Act::update },
+            { Nt::upd,   OpType::ISUB,  { Nt::mem,   Nt::imm   }, 0, Act::update },
+
+            { Nt::index, OpType::IMUL,  { Nt::reg,   Nt::scale }, 0, Act::scaled },
+            { Nt::index, OpType::IMUL,  { Nt::scale, Nt::reg   }, 0, Act::scaled_swapped },
+            { Nt::reg,   OpType::IMUL,  { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::IMUL,  { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::reg,   OpType::IMUL,  { Nt::imm,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::reg,   OpType::IMUL,  { Nt::mem,   Nt::reg   }, 1, Act::alu_swapped },
+
+            { Nt::reg,   OpType::BAND,  { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::BAND,  { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::reg,   OpType::BAND,  { Nt::imm,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::reg,   OpType::BAND,  { Nt::mem,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::upd,   OpType::BAND,  { Nt::mem,   Nt::reg   }, 0, Act::update },
+            { Nt::upd,   OpType::BAND,  { Nt::mem,   Nt::imm   }, 0, Act::update },
+            { Nt::upd,   OpType::BAND,  { Nt::reg,   Nt::mem   }, 0, Act::update_swapped },
+            { Nt::upd,   OpType::BAND,  { Nt::imm,   Nt::mem   }, 0, Act::update_swapped },
+
+            { Nt::reg,   OpType::BOR,   { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::BOR,   { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::reg,   OpType::BOR,   { Nt::imm,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::reg,   OpType::BOR,   { Nt::mem,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::upd,   OpType::BOR,   { Nt::mem,   Nt::reg   }, 0, Act::update },
+            { Nt::upd,   OpType::BOR,   { Nt::mem,   Nt::imm   }, 0, Act::update },
+            { Nt::upd,   OpType::BOR,   { Nt::reg,   Nt::mem   }, 0, Act::update_swapped },
+            { Nt::upd,   OpType::BOR,   { Nt::imm,   Nt::mem   }, 0, Act::update_swapped },
+
+            { Nt::reg,   OpType::BXOR,  { Nt::reg,   Nt::imm   }, 1, Act::alu },
+            { Nt::reg,   OpType::BXOR,  { Nt::reg,   Nt::mem   }, 1, Act::alu },
+            { Nt::reg,   OpType::BXOR,  { Nt::imm,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::reg,   OpType::BXOR,  { Nt::mem,   Nt::reg   }, 1, Act::alu_swapped },
+            { Nt::upd,   OpType::BXOR,  { Nt::mem,   Nt::reg   }, 0, Act::update },
+            { Nt::upd,   OpType::BXOR,  { Nt::mem,   Nt::imm   }, 0, Act::update },
+            { Nt::upd,   OpType::BXOR,  { Nt::reg,   Nt::mem   }, 0, Act::update_swapped },
+            { Nt::upd,   OpType::BXOR,  { Nt::imm,   Nt::mem   }, 0, Act::update_swapped },
+
+            { Nt::index, OpType::BSHL,  { Nt::reg,   Nt::log   }, 0, Act::shifted },
+            { Nt::reg,   OpType::BSHL,  { Nt::reg,   Nt::shift }, 1, Act::shift },
+            { Nt::reg,   OpType::BSHR,  { Nt::reg,   Nt::shift }, 1, Act::shift },
+
+            { Nt::stmt,  OpType::ICMP,  { Nt::reg,   Nt::imm   }, 1, Act::compare },
+            { Nt::stmt,  OpType::ICMP,  { Nt::reg,   Nt::mem   }, 1, Act::compare },
+            { Nt::stmt,  OpType::ICMP,  { Nt::mem,   Nt::reg   }, 1, Act::compare },
+            { Nt::stmt,  OpType::ICMP,  { Nt::mem,   Nt::imm   }, 1, Act::compare },
+            { Nt::stmt,  OpType::TEST,  { Nt::reg,   Nt::imm   }, 1, Act::compare },
+            { Nt::stmt,  OpType::TEST,  { Nt::reg,   Nt::mem   }, 1, Act::compare },
+            { Nt::stmt,  OpType::TEST,  { Nt::mem,   Nt::reg   }, 1, Act::compare },
+            { Nt::stmt,  OpType::TEST,  { Nt::mem,   Nt::imm   }, 1, Act::compare },
+
+            { Nt::mem,   OpType::LOAD,  { Nt::addr,  Nt::none  }, 0, Act::operand },
+
+            { Nt::stmt,  OpType::STORE, { Nt::addr,  Nt::reg   }, 1, Act::store },
+            { Nt::stmt,  OpType::STORE, { Nt::addr,  Nt::imm   }, 1, Act::store },
+            { Nt::stmt,  OpType::STORE, { Nt::addr,  Nt::upd   }, 1, Act::rmw },
+
+            { Nt::base,  OpType::LEA,   { Nt::none,  Nt::none  }, 0, Act::based },
+            { Nt::addr,  OpType::LEA,   { Nt::none,  Nt::none  }, 0, Act::fixed },
+            { Nt::slot,  OpType::LEA,   { Nt::none,  Nt::none  }, 0, Act::operand },
+
+            { Nt::stmt,  OpType::MOV,   { Nt::slot,  Nt::imm   }, 1, Act::mov },
+            { Nt::stmt,  OpType::MOV,   { Nt::slot,  Nt::upd   }, 1, Act::rmw_slot },
+
+            { Nt::stmt,  OpType::BR,    { Nt::reg,   Nt::imm   }, 1, Act::compare },
+            { Nt::stmt,  OpType::BR,    { Nt::reg,   Nt::mem   }, 1, Act::compare },
+            { Nt::stmt,  OpType::BR,    { Nt::mem,   Nt::reg   }, 1, Act::compare },
+            { Nt::stmt,  OpType::BR,    { Nt::mem,   Nt::imm   }, 1, Act::compare },
+            { Nt::reg,   OpType::SET,   { Nt::reg,   Nt::imm   }, 1, Act::compare },
+            { Nt::reg,   OpType::SET,   { Nt::reg,   Nt::mem   }, 1, Act::compare },
+            { Nt::reg,   OpType::SET,   { Nt::mem,   Nt::reg   }, 1, Act::compare },
+            { Nt::reg,   OpType::SET,   { Nt::mem,   Nt::imm   }, 1, Act::compare },
+
+            /* chain rules, tried until none improves a node */
+            { Nt::base,  OpType::LABEL, { Nt::reg,   Nt::none  }, 0, Act::chain_base,  true },
+            { Nt::index, OpType::LABEL, { Nt::reg,   Nt::none  }, 0, Act::chain_index, true },
+            { Nt::addr,  OpType::LABEL, { Nt::base,  Nt::none  }, 0, Act::chain_addr,  true },
+            { Nt::reg,   OpType::LABEL, { Nt::addr,  Nt::none  }, 1, Act::lea,         true },
+            { Nt::reg,   OpType::LABEL, { Nt::mem,   Nt::none  }, 1, Act::load,        true }
+        };
+
+        static_assert(std::size(RULES) < PLAIN);
+
+        constexpr uint8_t CHAINS = [] {
+            uint8_t i = 0;
+            while (!RULES[i].chain)
+                ++i;
+            return i;
+        }();
+
+        /* the rules of each op, which sit next to each other in RULES */
+        struct Span
+        {
+            uint8_t first = 0;
+            uint8_t count = 0;
+        };
+
+        constexpr auto BY_OP = [] {
+            std::array<Span, std::size(OPS)> s{};
+            for (uint8_t i = 0; i < CHAINS; ++i)
+            {
+                Span &x = s[static_cast<uint8_t>(RULES[i].op)];
+                if (x.count == 0)
+                    x.first = i;
+                ++x.count;
+            }
+            return s;
+        }();
+
+        static_assert([] {
+            for (uint8_t i = 0; i < CHAINS; ++i)
+            {
+                const Span &x = BY_OP[static_cast<uint8_t>(RULES[i].op)];
+                if (i < x.first || i >= x.first + x.count)
+                    return false;
+            }
+            for (size_t i = CHAINS; i < std::size(RULES); ++i)
+                if (!RULES[i].chain)
+                    return false;
+            return true;
+        }(), "rules are grouped by op, chain rules last");
+
+        constexpr size_t at(const Nt nt)
+        {
+            return static_cast<size_t>(nt);
+        }
+
+        bool fits32(const int64_t v)
+        {
+            return v >= std::numeric_limits<int32_t>::min() && v <= std::numeric_limits<int32_t>::max();
+        }
+
+        /* registers lowering never allocates, clobbers or moves */
+        bool kept(const Reg r)
+        {
+            return r == Reg::rbp || r == Reg::rbx || (r >= Reg::r12 && r <= Reg::r15);
+        }
+
+        bool displace(Ea &e, const int64_t v)
+        {
+            const int64_t d = int64_t{ e.disp } + v;
+            if (v == std::numeric_limits<int64_t>::min() || !fits32(v) || !fits32(d))
+                return false;
+            e.disp = static_cast<int32_t>(d);
+            return true;
+        }
+
+        bool same_ref(const MemRef &a, const MemRef &b)
+        {
+            return a.offset == b.offset && a.base == b.base && a.index == b.index && a.scale == b.scale;
+        }
+    }
+
+    void Matcher::label(const IR &g, const NodeId root, const bool reduce)
+    {
+        if (labels.size() < g.size())
+            labels.resize(g.size());
+
+        walk.post_order(g, root, [&](const NodeId n) { label_node(g, n, reduce); });
+    }
+
+    const Rule *Matcher::rule(const NodeId n, const Nt nt) const
+    {
+        if (n == NONE || n >= labels.size())
+            return nullptr;
+
+        const uint8_t r = labels[n].rule[at(nt)];
+        return r < PLAIN ? &RULES[r] : nullptr;
+    }
+
+    const Ea &Matcher::ea(const NodeId n, const Nt nt) const
+    {
+        const Label &l = labels[n];
+        return nt == Nt::base ? l.base : nt == Nt::index ? l.index : l.addr;
+    }
+
+    uint8_t Matcher::leaves(const IR &g, const NodeId n, const Nt nt, NodeId *out) const
+    {
+        const Rule &r = *rule(n, nt);
+        uint8_t i = 0;
+        if (r.act == Act::lea)
+            ea_leaves(labels[n].addr, out, i);
+        else if (r.act == Act::load)
+            collect(g, n, Nt::mem, out, i);
+        else
+        {
+            for (uint32_t j = 0; j < 2; ++j)
+                if (r.kids[j] != Nt::none)
+                    collect(g, g.kid(n, j), r.kids[j], out, i);
+        }
+        return i;
+    }
+
+    void Matcher::ea_leaves(const Ea &e, NodeId *out, uint8_t &i)
+    {
+        if (e.index_first && e.index != NONE)
+            out[i++] = e.index;
+        if (e.base != NONE)
+            out[i++] = e.base;
+        if (!e.index_first && e.index != NONE)
+            out[i++] = e.index;
+    }
+
+    void Matcher::collect(const IR &g, const NodeId n, const Nt nt, NodeId *out, uint8_t &i) const
+    {
+        switch (nt)
+        {
+            case Nt::reg:
+                out[i++] = n;
+                break;
+
+            case Nt::base:
+            case Nt::index:
+            case Nt::addr:
+                ea_leaves(ea(n, nt), out, i);
+                break;
+
+            case Nt::mem:
+                ea_leaves(labels[g.kid(n, 0)].addr, out, i);
+                break;
+
+            case Nt::upd:
+            {
+                /* only the other operand, the address is the STORE's or MOV's */
+                const Rule &u = *rule(n, Nt::upd);
+                const uint32_t src = u.act == Act::update ? 1 : 0;
+                collect(g, g.kid(n, src), u.kids[src], out, i);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    void Matcher::label_node(const IR &g, const NodeId n, const bool reduce)
+    {
+        Label &l = labels[n];
+        std::ranges::fill(l.cost, INF);
+        std::ranges::fill(l.rule, NO_RULE);
+
+        const Rec &rec = g[n];
+        uint32_t plain = 1;
+        l.effects = op_info(rec.type).effects;
+        for (const NodeId k: g.kids(n))
+        {
+            plain += k == NONE ? 1 : labels[k].cost[at(Nt::reg)];
+            l.effects = l.effects || (k != NONE && labels[k].effects);
+        }
+        l.cost[at(Nt::reg)] = l.cost[at(Nt::stmt)] = static_cast<uint16_t>(std::min<uint32_t>(plain, INF - 1));
+        l.rule[at(Nt::reg)] = l.rule[at(Nt::stmt)] = PLAIN;
+
+        const auto take = [&l](const Rule &r, const uint8_t i, const uint32_t cost, const Ea &e)
+        {
+            l.cost[at(r.lhs)] = static_cast<uint16_t>(cost);
+            l.rule[at(r.lhs)] = i;
+            if (r.lhs == Nt::base)
+                l.base = e;
+            else if (r.lhs == Nt::index)
+                l.index = e;
+            else if (r.lhs == Nt::addr)
+                l.addr = e;
+        };
+
+        const Span s = BY_OP[static_cast<uint8_t>(rec.type)];
+        for (uint8_t i = s.first; i < s.first + s.count; ++i)
+        {
+            const Rule &r = RULES[i];
+            const uint32_t arity = (r.kids[0] != Nt::none) + (r.kids[1] != Nt::none);
+            if (rec.nkids != arity)
+                continue;
+
+            uint32_t cost = r.cost;
+            bool covered = true;
+            for (uint32_t j = 0; j < arity && covered; ++j)
+            {
+                const NodeId k = g.kid(n, j);
+                covered = k != NONE && labels[k].cost[at(r.kids[j])] != INF;
+                cost += covered ? labels[k].cost[at(r.kids[j])] : 0;
+            }
+
+            Ea e;
+            cost = std::min<uint32_t>(cost, INF - 1);
+            if (covered && cost < l.cost[at(r.lhs)] && accept(g, n, r, reduce, e))
+                take(r, i, cost, e);
+        }
+
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (uint8_t i = CHAINS; i < std::size(RULES); ++i)
+            {
+                const Rule &r = RULES[i];
+                const uint32_t from = l.cost[at(r.kids[0])];
+                const uint32_t cost = std::min<uint32_t>(from + r.cost, INF - 1);
+                if (from == INF || cost >= l.cost[at(r.lhs)])
+                    continue;
+
+                Ea e;
+                if (r.act == Act::chain_base)
+                    e.base = n;
+                else if (r.act == Act::chain_index)
+                    e.index = n;
+                else if (r.act == Act::chain_addr)
+                    e = l.base;
+                take(r, i, cost, e);
+                changed = true;
+            }
+        }
+    }
+
+    bool Matcher::accept(const IR &g, const NodeId n, const Rule &r, const bool reduce, Ea &e)
+    {
+        const Rec &rec = g[n];
+        const auto kid = [&](const uint32_t i) { return g.kid(n, i); };
+        const auto value = [&](const uint32_t i) { return g[kid(i)].value; };
+        const auto effects = [&](const uint32_t i) { return labels[kid(i)].effects; };
+
+        switch (r.act)
+        {
+            case Act::operand:
+            {
+                const int64_t v = rec.value;
+                switch (r.lhs)
+                {
+                    case Nt::imm: return fits32(v);
+                    case Nt::shift: return v >= 0 && v < 64;
+                    case Nt::scale: return v == 1 || v == 2 || v == 4 || v == 8;
+                    case Nt::log: return v >= 0 && v < 4;
+                    default: return true;
+                }
+            }
+
+            case Act::based:
+            case Act::fixed:
+            {
+                const MemRef &m = g.addr(n);
+                const bool index = m.index != Reg::none;
+                if (!kept(m.base) || (index && (r.act == Act::based || !kept(m.index))) || !fits32(m.offset))
+                    return false;
+
+                e.fixed = m.base;
+                e.fixed_index = m.index;
+                e.scale = index ? m.scale : 1;
+                e.disp = static_cast<int32_t>(m.offset);
+                return true;
+            }
+
+            case Act::disp:
+                e = ea(kid(0), r.lhs);
+                return displace(e, value(1));
+
+            case Act::disp_swapped:
+                e = ea(kid(1), r.lhs);
+                return displace(e, value(0));
+
+            case Act::disp_neg:
+                e = ea(kid(0), r.lhs);
+                return value(1) != std::numeric_limits<int64_t>::min() && displace(e, -value(1));
+
+            case Act::scaled:
+            case Act::scaled_swapped:
+            case Act::shifted:
+            {
+                const uint32_t c = r.act == Act::scaled_swapped ? 0 : 1;
+                e.index = kid(1 - c);
+                e.scale = static_cast<uint8_t>(r.act == Act::shifted ? 1 << value(c) : value(c));
+                return true;
+            }
+
+            case Act::sum:
+            case Act::sum_swapped:
+            {
+                const bool swapped = r.act == Act::sum_swapped;
+                const Ea &x = labels[kid(swapped ? 0 : 1)].index;
+                e = labels[kid(swapped ? 1 : 0)].base;
+                e.index = x.index;
+                e.scale = x.scale;
+                e.index_first = swapped;
+                return true;
+            }
+
+            case Act::alu:
+                return !(reduce && rec.type == OpType::IMUL && r.kids[1] == Nt::imm);
+
+            case Act::alu_swapped:
+                if (reduce && rec.type == OpType::IMUL && r.kids[0] == Nt::imm)
+                    return false;
+                return r.kids[0] != Nt::mem || !effects(1);
+
+            case Act::update:
+            case Act::update_swapped:
+                return !effects(0) && !effects(1);
+
+            case Act::rmw:
+            case Act::rmw_slot:
+            {
+                const NodeId u = kid(1);
+                const Rule &ur = RULES[labels[u].rule[at(Nt::upd)]];
+                const NodeId load = g.kid(u, ur.act == Act::update ? 0 : 1);
+                const NodeId a = g.kid(load, 0);
+                if (r.act == Act::rmw)
+                    return same(g, labels[kid(0)].addr, labels[a].addr);
+                return g[a].type == OpType::LEA && same_ref(g.addr(a), g.addr(kid(0)));
+            }
+
+            case Act::compare:
+            {
+                if (rec.type == OpType::BR || rec.type == OpType::SET)
+                {
+                    const Compare c = Compare::of(rec.value);
+                    if ((c.op != OpType::ICMP && c.op != OpType::TEST) || c.cond > Cond::uge)
+                        return false;
+                }
+                return r.kids[0] != Nt::mem || !effects(1);
+            }
+
+            default:
+                return true;
+        }
+    }
+
+    bool Matcher::same(const IR &g, const Ea &a, const Ea &b)
+    {
+        if (a.fixed != b.fixed || a.fixed_index != b.fixed_index || a.scale != b.scale || a.disp != b.disp)
+            return false;
+        if ((a.base == NONE) != (b.base == NONE) || (a.index == NONE) != (b.index == NONE))
+            return false;
+
+        pairs.clear();
+        if (a.base != NONE)
+            pairs.emplace_back(a.base, b.base);
+        if (a.index != NONE)
+            pairs.emplace_back(a.index, b.index);
+        for (const auto &[x, y]: pairs)
+            if (labels[x].effects || labels[y].effects)
+                return false;
+
+        while (!pairs.empty())
+        {
+            const auto [x, y] = pairs.back();
+            pairs.pop_back();
+            if (x == y)
+                continue;
+            if (x == NONE || y == NONE)
+                return false;
+
+            const Rec &p = g[x];
+            const Rec &q = g[y];
+            if (p.type != q.type || p.value != q.value || p.nkids != q.nkids)
+                return false;
+            if (g.name_id(x) != g.name_id(y) || g.str_id(x) != g.str_id(y) || !same_ref(g.addr(x), g.addr(y)))
+                return false;
+
+            for (uint32_t i = 0; i < p.nkids; ++i)
+                pairs.emplace_back(g.kid(x, i), g.kid(y, i));
+        }
+        return true;
+    }
+}
@@ -0,0 +1,327 @@
+#include <bit>
+#include <stdexcept>
+#include <cdgnx/x86_64.hpp>
+
+/*
+ * vector ops. a vector is VecType::bytes wide and lives on the machine
+ * stack in stack mode, in an xmm register in register mode. SSE2 is the
+ * baseline; under Options::avx2 everything is VEX encoded, which adds the
+ * SSE4.1 integer ops and 32-byte vectors in ymm registers
+ *
+ * what has no packed instruction (64-bit multiply, min and max, and the
+ * 32-bit ones without AVX2) is computed lane by lane in rax and rcx with
+ * both vectors on the stack. every vector op carries its shape, VSUM and
+ * VSTORE the one of their vector operand
+ */
+namespace cdgnx::backend
+{
+    using mc::imm;
+    using mc::mem;
+    using mc::reg;
+
+    namespace
+    {
+        uint32_t bit(const mc::Reg r)
+        {
+            return 1u << static_cast<uint8_t>(r);
+        }
+    }
+
+    VecType x86_64::vtype(const NodeId n) const
+    {
+        const VecType v = VecType::of((*ir)[n].value);
+        if (v.lane > Lane::f64 || (v.bytes != 16 && v.bytes != 32))
+            throw std::invalid_argument("x86_64: bad vector shape");
+        if (v.bytes > vector_bytes())
+            throw std::invalid_argument("x86_64: 32-byte vectors need Options::avx2");
+        return v;
+    }
+
+    mc::Op x86_64::packed(const OpType t, const VecType v) const
+    {
+        const Op op = PACKED[static_cast<size_t>(t) - static_cast<size_t>(OpType::VADD)][static_cast<size_t>(v.lane)];
+        if (!opts.avx2 && (op == Op::pmulld || op == Op::pminsd || op == Op::pmaxsd))
+            return Op::nop;
+        return op;
+    }
+
+    void x86_64::vector_lanes(const OpType t, const VecType v, const int64_t right, const int64_t left)
+    {
+        const bool narrow = v.size() == 4;
+        const Op load = narrow ? Op::movslq : Op::movq;
+        for (uint32_t k = 0; k < v.lanes(); ++k)
+        {
+            const int64_t at = k * v.size();
+            emit(load, mem(Reg::rsp, left + at), reg(Reg::rax));
+            emit(load, mem(Reg::rsp, right + at), reg(Reg::rcx));
+            if (t == OpType::VMUL)
+                emit(Op::imulq, reg(Reg::rcx), reg(Reg::rax));
+            else
+            {
+                emit(Op::cmpq, reg(Reg::rcx), reg(Reg::rax));
+                emit(t == OpType::VMIN ? Op::cmovgq : Op::cmovlq, reg(Reg::rcx), reg(Reg::rax));
+            }
+            emit(narrow ? Op::movl : Op::movq, reg(Reg::rax), mem(Reg::rsp, left + at));
+        }
+    }
+
+    void x86_64::vector_op(const OpType t, const VecType v, const Reg src, const Reg dst)
+    {
+        const Op op = packed(t, v);
+        if (op != Op::nop)
+        {
+            emit_vec(op, v.bytes, reg(src), reg(dst));
+            return;
+        }
+
+        const int64_t b = v.bytes;
+        emit(Op::subq, imm(2 * b), reg(Reg::rsp));
+        emit_vec(Op::movdqu, v.bytes, reg(dst), mem(Reg::rsp, b));
+        emit_vec(Op::movdqu, v.bytes, reg(src), mem(Reg::rsp));
+        vector_lanes(t, v, 0, b);
+        emit_vec(Op::movdqu, v.bytes, mem(Reg::rsp, b), reg(dst));
+        emit(Op::addq, imm(2 * b), reg(Reg::rsp));
+    }
+
+    void x86_64::splat(const VecType v, const Reg x)
+    {
+        if (v.lane == Lane::f32)
+            emit(Op::cvtsd2ss, reg(x), reg(x));
+
+        if (opts.avx2)
+            emit_vec(v.size() == 4 ? Op::pbroadcastd : Op::pbroadcastq, v.bytes, reg(x), reg(x));
+        else
+        {
+            if (v.size() == 4)
+                emit_vec(Op::punpckldq, 16, reg(x), reg(x));
+            emit_vec(Op::punpcklqdq, 16, reg(x), reg(x));
+        }
+    }
+
+    uint32_t x86_64::splat_constant(const NodeId n)
+    {
+        const NodeId k = (*ir)[n].type == OpType::VSPLAT ? ir->kid(n, 0) : NONE;
+        if (k == NONE || ((*ir)[k].type != OpType::NUM && (*ir)[k].type != OpType::FNUM))
+            return NONE;
+
+        /* the lane the way splat() makes it: the scalar's bits, rounded to a float for f32 */
+        const VecType v = vtype(n);
+        auto bits = static_cast<uint64_t>((*ir)[k].value);
+        if (v.lane == Lane::f32)
+            bits = std::bit_cast<uint32_t>(static_cast<float>(std::bit_cast<double>(bits)));
+
+        char bytes[32];
+        for (uint32_t i = 0; i < v.bytes; ++i)
+            bytes[i] = static_cast<char>(bits >> (8 * (i % v.size())));
+        return pooled(ConstPool::Kind::vec, pool.vec({ bytes, v.bytes }));
+    }
+
+    void x86_64::sum(const VecType v, const Reg x)
+    {
+        /* high 8 bytes onto the low ones, then for 4-byte lanes lane 1 onto lane 0 */
+        const Op add = packed(OpType::VADD, v);
+        emit_vec(Op::movapd, 16, reg(x), reg(Reg::xmm1));
+        emit_vec(Op::punpckhqdq, 16, reg(Reg::xmm1), reg(Reg::xmm1));
+        emit_vec(add, 16, reg(Reg::xmm1), reg(x));
+        if (v.size() == 4)
+        {
+            emit_vec(Op::movapd, 16, reg(x), reg(Reg::xmm1));
+            emit_vec(Op::psrlq, 16, imm(32), reg(Reg::xmm1));
+            emit_vec(add, 16, reg(Reg::xmm1), reg(x));
+        }
+
+        if (v.lane == Lane::f32)
+            emit(Op::cvtss2sd, reg(x), reg(x));
+    }
+
+    void x86_64::stack_vector(const NodeId n)
+    {
+        const OpType t = (*ir)[n].type;
+        const VecType v = vtype(n);
+        const int64_t b = v.bytes;
+        const Operand top = mem(Reg::rsp);
+        switch (t)
+        {
+            case OpType::VLOAD:
+            {
+                emit(Op::popq, reg(Reg::rax));
+                emit_vec(Op::movdqu, v.bytes, mem(Reg::rax), reg(Reg::xmm0));
+                emit(Op::subq, imm(b), reg(Reg::rsp));
+                emit_vec(Op::movdqu, v.bytes, reg(Reg::xmm0), top);
+                break;
+            }
+
+            case OpType::VSTORE:
+            {
+                /* the vector is on top, its address below */
+                emit_vec(Op::movdqu, v.bytes, top, reg(Reg::xmm0));
+                emit(Op::movq, mem(Reg::rsp, b), reg(Reg::rax));
+                emit_vec(Op::movdqu, v.bytes, reg(Reg::xmm0), mem(Reg::rax));
+                emit(Op::addq, imm(b + 8), reg(Reg::rsp));
+                break;
+            }
+
+            case OpType::VSPLAT:
+            {
+                emit(Op::movq, top, reg(Reg::xmm0));
+                splat(v, Reg::xmm0);
+                emit(Op::subq, imm(b - 8), reg(Reg::rsp));
+                emit_vec(Op::movdqu, v.bytes, reg(Reg::xmm0), top);
+                break;
+            }
+
+            case OpType::VSUM:
+            {
+                emit_vec(Op::movdqu, 16, top, reg(Reg::xmm0));
+                if (v.bytes == 32)
+                {
+                    emit_vec(Op::movdqu, 16, mem(Reg::rsp, 16), reg(Reg::xmm1));
+                    emit_vec(packed(OpType::VADD, v), 16, reg(Reg::xmm1), reg(Reg::xmm0));
+                }
+                sum(v, Reg::xmm0);
+                emit(Op::addq, imm(b - 8), reg(Reg::rsp));
+
+                if (v.lane == Lane::i32)
+                {
+                    emit(Op::movq, reg(Reg::xmm0), reg(Reg::rax));
+                    emit(Op::movslq, reg(Reg::rax), reg(Reg::rax));
+                    emit(Op::movq, reg(Reg::rax), top);
+                }
+                else
+                    emit(Op::movq, reg(Reg::xmm0), top);
+                break;
+            }
+
+            default:
+            {
+                /* right on top, left below; the result replaces left */
+                if (packed(t, v) == Op::nop)
+                    vector_lanes(t, v, 0, b);
+                else
+                {
+                    emit_vec(Op::movdqu, v.bytes, top, reg(Reg::xmm0));
+                    emit_vec(Op::movdqu, v.bytes, mem(Reg::rsp, b), reg(Reg::xmm1));
+                    emit_vec(packed(t, v), v.bytes, reg(Reg::xmm0), reg(Reg::xmm1));
+                    emit_vec(Op::movdqu, v.bytes, reg(Reg::xmm1), mem(Reg::rsp, b));
+                }
+                emit(Op::addq, imm(b), reg(Reg::rsp));
+                break;
+            }
+        }
+    }
+
+    void x86_64::step_vector(Frame &f)
+    {
+        const NodeId n = f.node;
+        const OpType t = (*ir)[n].type;
+        const VecType v = vtype(n);
+        Reg l = Reg::none;
+        Reg r = Reg::none;
+        switch (t)
+        {
+            case OpType::VLOAD:
+            {
+                /* a LEA address is used as the memory operand directly */
+                const NodeId a = ir->kid(n, 0);
+                Operand src;
+                if (a != NONE && (*ir)[a].type == OpType::LEA)
+                    src = format_addr(ir->addr(a));
+                else
+                {
+                    if (!operand(f, a, r))
+                        return;
+                    r = coerce(r, false);
+                    src = mem(r);
+                }
+
+                l = alloc(true);
+                emit_vec(Op::movdqu, v.bytes, src, reg(l));
+                release(r);
+                break;
+            }
+
+            case OpType::VSTORE:
+            {
+                const NodeId a = ir->kid(n, 0);
+                Operand dst;
+                if (a != NONE && (*ir)[a].type == OpType::LEA)
+                {
+                    if (!operand(f, ir->kid(n, 1), r))
+                        return;
+                    dst = format_addr(ir->addr(a));
+                }
+                else
+                {
+                    if (!operands(f, false, true, l, r))
+                        return;
+                    dst = mem(l);
+                }
+
+                emit_vec(Op::movdqu, v.bytes, reg(r), dst);
+                release(l);
+                release(r);
+                return;
+            }
+
+            case OpType::VSPLAT:
+            {
+                if (const uint32_t c = splat_constant(n); c != NONE)
+                {
+                    l = alloc(true);
+                    emit_vec(Op::movdqu, v.bytes, mc::rip(c), reg(l));
+                    break;
+                }
+                if (!operand(f, ir->kid(n, 0), r))
+                    return;
+
+                l = coerce(r, true);
+                splat(v, l);
+                break;
+            }
+
+            case OpType::VSUM:
+            {
+                if (!operand(f, ir->kid(n, 0), r))
+                    return;
+
+                if (v.bytes == 32)
+                {
+                    /* the high half comes back through the stack */
+                    emit(Op::subq, imm(32), reg(Reg::rsp));
+                    emit_vec(Op::movdqu, 32, reg(r), mem(Reg::rsp));
+                    emit_vec(Op::movdqu, 16, mem(Reg::rsp, 16), reg(Reg::xmm1));
+                    emit(Op::addq, imm(32), reg(Reg::rsp));
+                    emit_vec(packed(OpType::VADD, v), 16, reg(Reg::xmm1), reg(r));
+                }
+                sum(v, r);
+                vecs &= ~bit(r);
+                if (v.fp())
+                {
+                    f.state.value = r;
+                    return;
+                }
+
+                l = alloc(false);
+                emit(Op::movq, reg(r), reg(l));
+                release(r);
+                if (v.lane == Lane::i32)
+                    emit(Op::movslq, reg(l), reg(l));
+                f.state.value = l;
+                return;
+            }
+
+            default:
+            {
+                if (!operands(f, true, l, r))
+                    return;
+
+                vector_op(t, v, r, l);
+                l = settle(l, r);
+                break;
+            }
+        }
+
+        vecs |= bit(l);
+        f.state.value = l;
+    }
+}
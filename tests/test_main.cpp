@@ -1,12 +1,37 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <exception>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <cdgnx/buffer.hpp>
 #include <cdgnx/cdgnx.hpp>
+#include <cdgnx/cfg.hpp>
+#include <cdgnx/cleanup.hpp>
+#include <cdgnx/code_cache.hpp>
+#include <cdgnx/const_pool.hpp>
+#include <cdgnx/fold.hpp>
+#include <cdgnx/fuse.hpp>
+#include <cdgnx/hash.hpp>
+#include <cdgnx/interp.hpp>
+#include <cdgnx/ir.hpp>
+#include <cdgnx/jit.hpp>
+#include <cdgnx/module.hpp>
+#include <cdgnx/ops.hpp>
+#include <cdgnx/stats.hpp>
+#include <cdgnx/symtab.hpp>
+#include <cdgnx/thread_pool.hpp>
 #include <cdgnx/x86_64.hpp>
 
 class TestSuite
@@ -15,7 +40,13 @@ public:
     void add_test(std::string_view name, std::function<std::unique_ptr<cdgnx::Node>()> build_ir
         , std::function<bool(const std::string&)> validate)
     {
-        test_cases.emplace_back(TestCase{ name, build_ir, validate });
+        test_cases.emplace_back(TestCase{ name, build_ir, validate, {} });
+    }
+
+    /* for tests that drive the library themselves */
+    void add_check(std::string_view name, std::function<bool()> check)
+    {
+        test_cases.emplace_back(TestCase{ name, {}, {}, check });
     }
 
     bool run()
@@ -29,6 +60,18 @@ public:
 
             try
             {
+                if (test.check)
+                {
+                    if (test.check())
+                    {
+                        std::cout << "PASSED\n";
+                        passed++;
+                    }
+                    else
+                        std::cout << "FAILED (check failed)\n";
+                    continue;
+                }
+
                 auto ast = test.ir_graph();
                 if (!ast)
                 {
@@ -75,6 +118,7 @@ private:
         std::string_view name;
         std::function<std::unique_ptr<cdgnx::Node>()> ir_graph;
         std::function<bool(const std::string&)> validate;
+        std::function<bool()> check;
     };
 
     std::vector<TestCase> test_cases;
@@ -85,6 +129,28 @@ std::unique_ptr<cdgnx::Node> make_node(cdgnx::OpType type)
     return std::make_unique<cdgnx::Node>(type);
 }
 
+int64_t host_two()
+{
+    return 2;
+}
+
+/* eight integers, two of them on the stack under SysV */
+int64_t host_digits(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f, int64_t g, int64_t h)
+{
+    return a + 10 * b + 100 * c + 1000 * d + 10000 * e + 100000 * f + 1000000 * g + 10000000 * h;
+}
+
+double host_mix(double a, int64_t b, double c)
+{
+    return a * 4 + static_cast<double>(b) * 2 + c;
+}
+
+/* 0 when called with the stack aligned as SysV requires */
+int64_t host_misaligned()
+{
+    return reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) & 15;
+}
+
 int main()
 {
     TestSuite suite;
@@ -239,6 +305,1826 @@ int main()
         }
     );
     
+    suite.add_check(
+        "compact_ir",
+        []() -> bool
+        {
+            /* same function built through both front doors */
+            cdgnx::IR ir;
+            const cdgnx::NodeId add = ir.make(cdgnx::OpType::IADD, { ir.num(2), ir.num(3) });
+            const cdgnx::NodeId lea = ir.make(cdgnx::OpType::LEA);
+            ir.set_addr(lea, cdgnx::Addr::reg("%rbp").idx("%rcx", 8).off(-16));
+            const cdgnx::NodeId root = ir.make(cdgnx::OpType::ROOT, {
+                add, ir.str("hi"), lea, ir.label(cdgnx::OpType::LABEL, ".Lx"), ir.label(cdgnx::OpType::JMP, ".Lx")
+            });
+            ir.set_name(root, "f");
+
+            auto tree = make_node(cdgnx::OpType::ROOT);
+            tree->name = "f";
+            auto n2 = make_node(cdgnx::OpType::NUM);
+            n2->value = 2;
+            auto n3 = make_node(cdgnx::OpType::NUM);
+            n3->value = 3;
+            auto tadd = make_node(cdgnx::OpType::IADD);
+            tadd->kids.push_back(std::move(n2));
+            tadd->kids.push_back(std::move(n3));
+            auto tstr = make_node(cdgnx::OpType::STR);
+            tstr->strval = "hi";
+            auto tlea = make_node(cdgnx::OpType::LEA);
+            tlea->addr = cdgnx::Addr::reg("%rbp").idx("%rcx", 8).off(-16);
+            auto tlabel = make_node(cdgnx::OpType::LABEL);
+            tlabel->name = ".Lx";
+            auto tjmp = make_node(cdgnx::OpType::JMP);
+            tjmp->name = ".Lx";
+            tree->kids.push_back(std::move(tadd));
+            tree->kids.push_back(std::move(tstr));
+            tree->kids.push_back(std::move(tlea));
+            tree->kids.push_back(std::move(tlabel));
+            tree->kids.push_back(std::move(tjmp));
+
+            cdgnx::backend::x86_64 backend;
+            const std::string a = backend.generate(ir, root);
+            const std::string b = backend.generate(tree.get());
+            return a == b && ir.size() == 8 &&
+                   a.find("leaq -16(%rbp") != std::string::npos &&
+                   a.find(".string \"hi\"") != std::string::npos &&
+                   a.find("jmp .Lx") != std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "register_alloc",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            cdgnx::IR ir;
+
+            /* (42 + 13) - 5 needs two registers and no stack traffic */
+            const cdgnx::NodeId sum = ir.make(OpType::IADD, { ir.num(42), ir.num(13) });
+            const cdgnx::NodeId small = ir.make(OpType::RET, { ir.make(OpType::ISUB, { sum, ir.num(5) }) });
+
+            /* a perfectly balanced tree of depth 8 needs more registers than the pool has */
+            std::vector<cdgnx::NodeId> level;
+            for (int i = 0; i < 256; ++i)
+                level.push_back(ir.num(i));
+            while (level.size() > 1)
+            {
+                std::vector<cdgnx::NodeId> next;
+                for (size_t i = 0; i < level.size(); i += 2)
+                    next.push_back(ir.make(OpType::IADD, { level[i], level[i + 1] }));
+                level = std::move(next);
+            }
+            const cdgnx::NodeId wide = ir.make(OpType::RET, { level[0] });
+
+            cdgnx::backend::x86_64::Options opts;
+            opts.alloc = cdgnx::backend::x86_64::Alloc::regs;
+            cdgnx::backend::x86_64 backend(opts);
+            const std::string a = backend.generate(ir, ir.make(OpType::ROOT, { small }));
+            const std::string b = backend.generate(ir, ir.make(OpType::ROOT, { wide }));
+            return a.find("addq %rdi, %rsi") != std::string::npos &&
+                   a.find("subq %rdi, %rsi") != std::string::npos &&
+                   a.find("push") == std::string::npos &&
+                   a.find("pop") == std::string::npos &&
+                   b.find("pushq %rsi") != std::string::npos &&
+                   b.find("popq %rax") != std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "machine_code",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            cdgnx::IR ir;
+
+            /* loop: jmp loop, then a string and a call that need relocations */
+            const cdgnx::NodeId call = ir.make(OpType::CALL, { ir.str("hi") });
+            ir.set_name(call, "puts");
+            const cdgnx::NodeId root = ir.make(OpType::ROOT, {
+                ir.label(OpType::LABEL, ".Lloop"), call, ir.label(OpType::JMP, ".Lloop")
+            });
+            ir.set_name(root, "f");
+
+            cdgnx::backend::x86_64 backend;
+            const cdgnx::backend::mc::Object o = backend.assemble(ir, root);
+            const std::vector<uint8_t> prologue = { 0x55, 0x48, 0x89, 0xe5 };
+
+            /*
+             * the SysV call: movq %rsp, %rax; andq $-16, %rsp; subq $8, %rsp; pushq %rax;
+             * leaq .LC0(%rip), %rdi; movq $0, %rax; call puts; movq (%rsp), %rsp;
+             * then pushq %rax; jmp .Lloop
+             */
+            const std::vector<uint8_t> body = {
+                0x48, 0x89, 0xe0, 0x48, 0x83, 0xe4, 0xf0, 0x48, 0x83, 0xec, 0x08, 0x50, 0x48, 0x8d, 0x3d, 0, 0, 0, 0,
+                0x48, 0xc7, 0xc0, 0, 0, 0, 0, 0xe8, 0, 0, 0, 0, 0x48, 0x8b, 0x24, 0x24, 0x50, 0xeb, 0xda
+            };
+
+            /* memory operands GNU as rejects: a displacement beyond 32 bits, a scale of 3, %rsp as an index */
+            namespace mc = cdgnx::backend::mc;
+            using mc::Reg;
+            int rejected = 0;
+            for (const mc::Operand &m: { mc::mem(Reg::rdi, int64_t{ 1 } << 33), mc::mem(Reg::rdi, 0, Reg::rcx, 3), mc::mem(Reg::rdi, 0, Reg::rsp) })
+            {
+                mc::Code c;
+                c.insts = { { mc::Op::leaq, m, mc::reg(Reg::rax) } };
+                mc::Object bad;
+                try
+                {
+                    mc::encode(c, bad);
+                }
+                catch (const std::invalid_argument &)
+                {
+                    ++rejected;
+                }
+            }
+
+            bool relocs = rejected == 3 && o.relocs.size() == 2 &&
+                          o.syms[o.relocs[0].sym].name == ".LC0" && o.relocs[0].offset == 19 &&
+                          o.syms[o.relocs[1].sym].name == "puts" && o.relocs[1].offset == 31;
+            return std::equal(prologue.begin(), prologue.end(), o.text.begin()) &&
+                   std::equal(body.begin(), body.end(), o.text.begin() + 4) &&
+                   relocs &&
+                   std::string(o.rodata.begin(), o.rodata.end()) == std::string("hi", 3) &&
+                   backend.generate(ir, root).find("jmp .Lloop") != std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "jit",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                cdgnx::IR ir;
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                cdgnx::Jit jit(opts);
+                jit.define("two", reinterpret_cast<void *>(&host_two));
+
+                /* answer() = 40 + two(), greet() = "hello", twice() = answer() * 2 */
+                const cdgnx::NodeId two = ir.make(OpType::CALL);
+                ir.set_name(two, "two");
+                const cdgnx::NodeId answer = ir.make(OpType::ROOT, {
+                    ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.num(40), two }) })
+                });
+                ir.set_name(answer, "answer");
+
+                const cdgnx::NodeId greet = ir.make(OpType::ROOT, { ir.make(OpType::RET, { ir.str("hello") }) });
+                ir.set_name(greet, "greet");
+
+                const cdgnx::NodeId inner = ir.make(OpType::CALL);
+                ir.set_name(inner, "answer");
+                const cdgnx::NodeId twice = ir.make(OpType::ROOT, {
+                    ir.make(OpType::RET, { ir.make(OpType::IMUL, { inner, ir.num(2) }) })
+                });
+                ir.set_name(twice, "twice");
+
+                const auto f = jit.compile<int64_t (*)()>(ir, answer);
+                const auto g = jit.compile<const char *(*)()>(ir, greet);
+                const auto h = jit.compile<int64_t (*)()>(ir, twice);
+                if (f() != 42 || std::string(g()) != "hello" || h() != 84)
+                    return false;
+            }
+
+            /* unknown call targets are reported instead of jumping to nowhere */
+            cdgnx::IR ir;
+            const cdgnx::NodeId missing = ir.make(OpType::CALL);
+            ir.set_name(missing, "missing");
+            const cdgnx::NodeId bad = ir.make(OpType::ROOT, { ir.make(OpType::RET, { missing }) });
+            ir.set_name(bad, "bad");
+            try
+            {
+                cdgnx::Jit().compile(ir, bad);
+                return false;
+            }
+            catch (const std::runtime_error &)
+            {
+                return true;
+            }
+        }
+    );
+
+    suite.add_check(
+        "emit_buffer",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+
+            /* integers straddle chunk boundaries and the pieces come back in order */
+            cdgnx::Buffer buf;
+            std::string expect;
+            for (int64_t i = -5000; i < 20000; ++i)
+            {
+                buf.put(i * 1000003).put(' ');
+                expect += std::to_string(i * 1000003) + ' ';
+            }
+            size_t chunks = 0;
+            std::string joined;
+            buf.each([&](const std::string_view s) { ++chunks; joined.append(s); });
+            if (chunks < 2 || joined != expect || buf.str() != expect || buf.size() != expect.size())
+                return false;
+
+            /* a small first chunk, doubling from there */
+            cdgnx::Buffer small(16);
+            std::vector<size_t> sizes;
+            small.put(std::string_view(expect));
+            small.each([&](const std::string_view s) { sizes.push_back(s.size()); });
+            if (small.str() != expect || sizes.size() < 3 || sizes[0] != 16 || sizes[1] != 32 || sizes[2] != 64)
+                return false;
+
+            /* a moved-from buffer is empty and writes into chunks of its own */
+            cdgnx::Buffer moved(std::move(small));
+            small.put("after");
+            cdgnx::Buffer assigned;
+            assigned.put("before");
+            assigned = std::move(small);
+            small.put("again");
+            if (moved.str() != expect || assigned.str() != "after" || small.str() != "again")
+                return false;
+
+            /* a listing written through a pipe matches the std::string entry point */
+            cdgnx::IR ir;
+            const cdgnx::NodeId root = ir.make(OpType::ROOT, {
+                ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.num(INT64_MIN), ir.str("x") }) })
+            });
+            ir.set_name(root, "f");
+
+            cdgnx::backend::x86_64 backend;
+            const std::string listing = backend.generate(ir, root);
+            buf.clear();
+            backend.generate(ir, root, buf);
+
+            int fds[2];
+            if (listing != buf.str() || pipe(fds) != 0)
+                return false;
+            const bool written = buf.write(fds[1]);
+            close(fds[1]);
+            std::string piped(listing.size() + 1, '\0');
+            const ssize_t n = read(fds[0], piped.data(), piped.size());
+            close(fds[0]);
+            piped.resize(n < 0 ? 0 : static_cast<size_t>(n));
+
+            return written && piped == listing && listing.find("$-9223372036854775808") != std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "interning",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+
+            /* ids are dense, stable across rehashing and shared by equal strings */
+            cdgnx::Symtab tab;
+            for (int i = 0; i < 1000; ++i)
+                if (tab.intern("sym" + std::to_string(i)) != static_cast<cdgnx::SymId>(i))
+                    return false;
+            if (tab.intern("sym500") != 500 || tab.find("sym999") != 999 || tab.find("nope") != cdgnx::NONE ||
+                tab[123] != "sym123" || tab.size() != 1000)
+                return false;
+
+            /* the same call target and the same label resolve to one id and one symbol */
+            cdgnx::IR ir;
+            std::vector<cdgnx::NodeId> body;
+            for (int i = 0; i < 100; ++i)
+            {
+                const cdgnx::NodeId call = ir.make(OpType::CALL);
+                ir.set_name(call, "callee");
+                body.push_back(call);
+                body.push_back(ir.make(OpType::POP));
+                body.push_back(ir.label(OpType::JMP, "out"));
+            }
+            body.push_back(ir.label(OpType::LABEL, "out"));
+            const cdgnx::NodeId root = ir.make(OpType::ROOT, body);
+            ir.set_name(root, "f");
+            if (ir.name_id(body[0]) != ir.name_id(body[3]) || ir.strings() != 4)
+                return false;
+
+            /* registers are resolved when the address is attached */
+            const cdgnx::NodeId lea = ir.make(OpType::LEA);
+            ir.set_addr(lea, cdgnx::Addr::reg("rbx").idx("%r12", 4).off(8));
+            const cdgnx::MemRef &m = ir.addr(lea);
+            if (m.base != cdgnx::Reg::rbx || m.index != cdgnx::Reg::r12 || m.scale != 4)
+                return false;
+            /* an unknown register, or an address the encoder can't represent, is rejected there and leaves the old one */
+            for (const cdgnx::Addr &bad: { cdgnx::Addr::reg("%bogus"), cdgnx::Addr::reg("rbx").off(int64_t{ 1 } << 33),
+                                           cdgnx::Addr::reg("rbx").idx("rcx", 3), cdgnx::Addr::reg("rbx").idx("%rsp") })
+            {
+                try
+                {
+                    ir.set_addr(lea, bad);
+                    return false;
+                }
+                catch (const std::invalid_argument &)
+                {
+                }
+            }
+            if (ir.addr(lea).base != cdgnx::Reg::rbx || ir.addr(lea).offset != 8)
+                return false;
+
+            const cdgnx::backend::mc::Object o = cdgnx::backend::x86_64().assemble(ir, root);
+            const auto named = [&](const std::string_view s)
+            {
+                return std::count_if(o.syms.begin(), o.syms.end(), [&](const auto &sym) { return sym.name == s; });
+            };
+            return o.syms.size() == 3 && named("callee") == 1 && named("out") == 1 && o.relocs.size() == 100;
+        }
+    );
+
+    suite.add_check(
+        "fold",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+
+            cdgnx::IR ir;
+            const auto fold = [&](const NodeId root)
+            {
+                cdgnx::PassManager pm;
+                pm.add<cdgnx::Fold>();
+                return pm.run(ir, root);
+            };
+            const auto listing = [&](const NodeId root) { return cdgnx::backend::x86_64().generate(ir, root); };
+
+            /* IADD(2, 3) becomes a single NUM */
+            const NodeId sum = ir.make(OpType::ROOT, { ir.make(OpType::IADD, { ir.num(2), ir.num(3) }), ir.make(OpType::POP) });
+            if (fold(sum) != 2 || listing(sum).find("addq") != std::string::npos || ir[ir.kid(sum, 0)].value != 5)
+                return false;
+
+            /* identities keep the other operand, but never drop a call */
+            const NodeId call = ir.make(OpType::CALL);
+            ir.set_name(call, "f");
+            const NodeId load = ir.make(OpType::LOAD, { ir.num(64) });
+            const NodeId ids = ir.make(OpType::ROOT, {
+                ir.make(OpType::IADD, { load, ir.num(0) }),
+                ir.make(OpType::IMUL, { call, ir.num(0) }),
+                ir.make(OpType::BXOR, { load, load })
+            });
+            if (fold(ids) != 6 || ir.kid(ids, 0) != load || ir[ir.kid(ids, 1)].type != OpType::IMUL ||
+                ir[ir.kid(ids, 2)].type != OpType::NUM)
+                return false;
+
+            /* anything idivq would fault on is left for run time */
+            const NodeId div = ir.make(OpType::ROOT, {
+                ir.make(OpType::IDIV, { ir.num(5), ir.num(0) }),
+                ir.make(OpType::IMOD, { ir.num(INT64_MIN), ir.num(-1) })
+            });
+            if (fold(div) != 0)
+                return false;
+
+            /* folded and unfolded random trees compute the same thing */
+            static int64_t cells[4] = { 7, -3, INT64_MIN, 1 << 20 };
+            std::mt19937_64 rng(7);
+            const int64_t picks[] = { 0, 1, -1, 2, 63, 64, INT64_MIN, INT64_MAX };
+            const OpType ops[] = {
+                OpType::IADD, OpType::ISUB, OpType::IMUL, OpType::IDIV, OpType::IMOD, OpType::BAND,
+                OpType::BOR, OpType::BXOR, OpType::BNOT, OpType::BSHL, OpType::BSHR
+            };
+            const int64_t divisors[] = { 1, 2, 3, 7, -5 };
+            std::function<NodeId(cdgnx::IR &, int)> gen = [&](cdgnx::IR &g, const int depth) -> NodeId
+            {
+                if (depth == 0 || rng() % 4 == 0)
+                {
+                    if (rng() % 2)
+                        return g.num(rng() % 3 ? picks[rng() % std::size(picks)] : static_cast<int64_t>(rng()));
+                    return g.make(OpType::LOAD, { g.num(reinterpret_cast<int64_t>(&cells[rng() % 4])) });
+                }
+
+                const OpType t = ops[rng() % std::size(ops)];
+                if (t == OpType::BNOT)
+                    return g.make(t, { gen(g, depth - 1) });
+                if (t == OpType::IDIV || t == OpType::IMOD)
+                    return g.make(t, { gen(g, depth - 1), g.num(divisors[rng() % std::size(divisors)]) });
+
+                const NodeId a = gen(g, depth - 1);
+                return g.make(t, { a, rng() % 5 ? gen(g, depth - 1) : a });
+            };
+
+            cdgnx::Jit jit;
+            size_t removed = 0;
+            for (int i = 0; i < 300; ++i)
+            {
+                cdgnx::IR plain;
+                const NodeId root = plain.make(OpType::ROOT, { plain.make(OpType::RET, { gen(plain, 5) }) });
+                plain.set_name(root, "plain" + std::to_string(i));
+                cdgnx::IR folded = plain;
+                folded.set_name(root, "folded" + std::to_string(i));
+
+                cdgnx::Fold f;
+                removed += f.run(folded, root);
+                if (jit.compile<int64_t (*)()>(plain, root)() != jit.compile<int64_t (*)()>(folded, root)())
+                    return false;
+            }
+            return removed > 1000;
+        }
+    );
+
+    suite.add_check(
+        "peephole",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using Rule = cdgnx::backend::mc::Peephole::Rule;
+            using Options = cdgnx::backend::x86_64::Options;
+
+            const auto lines = [](const std::string &s) { return std::count(s.begin(), s.end(), '\n'); };
+
+            /* add(2, 3) and a double sum, with and without the pass */
+            cdgnx::IR ir;
+            const NodeId add = ir.make(OpType::ROOT, {
+                ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.num(2), ir.num(3) }) })
+            });
+            ir.set_name(add, "add");
+
+            const auto bits = [](const double d) { return std::bit_cast<int64_t>(d); };
+            const NodeId fsum = ir.make(OpType::ROOT, {
+                ir.make(OpType::RET, {
+                    ir.make(OpType::FADD, { ir.make(OpType::FADD, { ir.num(bits(1.5)), ir.num(bits(2.25)) }), ir.num(bits(4.0)) })
+                })
+            });
+            ir.set_name(fsum, "fsum");
+
+            Options on;
+            on.peephole = true;
+            cdgnx::backend::x86_64 plain;
+            cdgnx::backend::x86_64 tidy(on);
+            if (lines(tidy.generate(ir, add)) + 4 > lines(plain.generate(ir, add)) ||
+                tidy.generate(ir, add).find("pushq %rax\n    popq") != std::string::npos)
+                return false;
+
+            const auto &p = tidy.peephole();
+            if (!p.hits(Rule::push_pop) || !p.hits(Rule::mov_push) ||
+                std::string(cdgnx::backend::mc::Peephole::rule_name(Rule::dead_mov)) != "dead_mov")
+                return false;
+
+            /* FP lowering no longer leaves adjacent %rsp adjustments, so build them by hand */
+            namespace mc = cdgnx::backend::mc;
+            mc::Code adjust;
+            adjust.insts = {
+                { mc::Op::addq, mc::imm(16), mc::reg(mc::Reg::rsp) },
+                { mc::Op::subq, mc::imm(8), mc::reg(mc::Reg::rsp) }
+            };
+            mc::Peephole merge;
+            if (merge.run(adjust) != 1 || !merge.hits(Rule::stack_adjust) || adjust.insts[0].a.imm != 8)
+                return false;
+
+            /* a one-instruction window leaves a non-adjacent push/pop alone */
+            Options narrow = on;
+            narrow.peephole_config.window = 1;
+            narrow.peephole_config.rules = 1u << static_cast<uint32_t>(Rule::push_pop);
+            cdgnx::backend::x86_64 small(narrow);
+            small.generate(ir, add);
+            if (small.peephole().hits(Rule::push_pop))
+                return false;
+
+            /* same results in both allocation modes */
+            for (const auto mode: { cdgnx::backend::x86_64::Alloc::stack, cdgnx::backend::x86_64::Alloc::regs })
+            {
+                Options o = on;
+                o.alloc = mode;
+                cdgnx::Jit jit(o);
+                /* RET hands doubles back in %rax, like every other value */
+                if (jit.compile<int64_t (*)()>(ir, add)() != 5 || jit.compile<int64_t (*)()>(ir, fsum)() != bits(7.75))
+                    return false;
+            }
+            return true;
+        }
+    );
+
+    suite.add_check(
+        "module",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+
+            /* every index runs exactly once, and errors reach the caller */
+            cdgnx::ThreadPool pool(4);
+            std::vector<int> hits(10000, 0);
+            pool.parallel_for(hits.size(), [&](unsigned, const size_t i) { ++hits[i]; });
+            if (std::count(hits.begin(), hits.end(), 1) != static_cast<long>(hits.size()))
+                return false;
+            try
+            {
+                pool.parallel_for(100, [](unsigned, const size_t i)
+                {
+                    if (i == 42)
+                        throw std::runtime_error("boom");
+                });
+                return false;
+            }
+            catch (const std::runtime_error &)
+            {
+            }
+
+            /* every function has a "top" label and returns a literal, most of them the same one */
+            cdgnx::Module m;
+            for (int f = 0; f < 64; ++f)
+            {
+                cdgnx::IR &ir = m.ir;
+                const NodeId root = ir.make(OpType::ROOT, {
+                    ir.label(OpType::LABEL, ".Ltop"),
+                    ir.make(OpType::IADD, { ir.num(f), ir.num(f % 5) }),
+                    ir.make(OpType::POP),
+                    ir.make(OpType::RET, { ir.str(f % 4 ? "shared" : "own" + std::to_string(f)) }),
+                    ir.label(OpType::JMP, ".Ltop")
+                });
+                ir.set_name(root, "fn" + std::to_string(f));
+                m.add(root);
+            }
+
+            try
+            {
+                const NodeId dup = m.ir.make(OpType::ROOT);
+                m.ir.set_name(dup, "fn3");
+                m.add(dup);
+                return false;
+            }
+            catch (const std::invalid_argument &)
+            {
+            }
+
+            cdgnx::backend::x86_64::Options o;
+            o.alloc = cdgnx::backend::x86_64::Alloc::regs;
+            const std::string one = cdgnx::backend::x86_64(o).generate_module(m, 1);
+            for (const unsigned threads: { 2u, 3u, 8u })
+            {
+                if (cdgnx::backend::x86_64(o).generate_module(m, threads) != one)
+                    return false;
+            }
+
+            const auto count = [&one](const std::string &needle)
+            {
+                size_t n = 0;
+                for (size_t at = one.find(needle); at != std::string::npos; at = one.find(needle, at + 1))
+                    ++n;
+                return n;
+            };
+            return count(".section .rodata") == 1 && count(".string \"shared\"") == 1 && count(".string") == 17 &&
+                   count(".Ltop.0:") == 1 && count(".Ltop.63:") == 1 && count("jmp .Ltop.17\n") == 1 &&
+                   count(".global fn") == 64;
+        }
+    );
+
+    suite.add_check(
+        "deep_ir",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+
+            /* far deeper than a recursive lowering survives on a 256 KiB thread stack */
+            constexpr int64_t depth = 200000;
+            cdgnx::IR ir;
+            NodeId acc = ir.num(0);
+            for (int64_t i = 0; i < depth; ++i)
+                acc = ir.make(OpType::IADD, { acc, ir.num(1) });
+            const NodeId root = ir.make(OpType::ROOT, { ir.make(OpType::RET, { acc }) });
+            ir.set_name(root, "deep");
+
+            struct Job
+            {
+                cdgnx::IR *ir;
+                NodeId root;
+                bool ok;
+            } job{ &ir, root, false };
+
+            const auto body = [](void *p) -> void *
+            {
+                Job &j = *static_cast<Job *>(p);
+                try
+                {
+                    bool ok = true;
+                    for (const auto mode: { cdgnx::backend::x86_64::Alloc::stack, cdgnx::backend::x86_64::Alloc::regs })
+                    {
+                        cdgnx::backend::x86_64::Options opts;
+                        opts.alloc = mode;
+                        cdgnx::Jit jit(opts);
+                        ok = ok && jit.compile<int64_t (*)()>(*j.ir, j.root)() == depth;
+                    }
+
+                    cdgnx::Fold fold;
+                    ok = ok && fold.run(*j.ir, j.root) == 2 * depth;
+                    j.ok = ok && cdgnx::backend::x86_64().generate(*j.ir, j.root).find("movq $200000, %rax") != std::string::npos;
+                }
+                catch (const std::exception &)
+                {
+                }
+                return nullptr;
+            };
+
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setstacksize(&attr, 256 * 1024);
+            pthread_t t;
+            const bool started = pthread_create(&t, &attr, body, &job) == 0;
+            pthread_attr_destroy(&attr);
+            if (!started)
+                return false;
+
+            pthread_join(t, nullptr);
+            return job.ok;
+        }
+    );
+
+    suite.add_check(
+        "op_table",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::OpInfo;
+
+            /* every described op lowers to real instructions in both modes */
+            for (const auto mode: { cdgnx::backend::x86_64::Alloc::stack, cdgnx::backend::x86_64::Alloc::regs })
+            {
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                cdgnx::backend::x86_64 backend(opts);
+                for (const OpInfo &op: cdgnx::OPS)
+                {
+                    cdgnx::IR ir;
+                    const NodeId slot = ir.make(OpType::LEA);
+                    ir.set_addr(slot, cdgnx::Addr::reg("rbp").off(-8));
+
+                    std::vector<NodeId> kids;
+                    const uint8_t arity = op.arity == OpInfo::VARIADIC ? 2 : op.arity == OpInfo::OPTIONAL ? 1 : op.arity;
+                    for (uint8_t i = 0; i < arity; ++i)
+                        kids.push_back(i < op.first || op.type == OpType::LOAD || op.type == OpType::STORE ? slot : ir.num(i + 1));
+
+                    const bool vector = op.vector || op.cls == cdgnx::OpClass::vector;
+                    const bool compare = op.type == OpType::BR || op.type == OpType::SET;
+                    const NodeId n = ir.make(op.type, kids, vector ? cdgnx::VecType{}.pack() : compare ? cdgnx::Compare{}.pack() : 0);
+                    ir.set_name(n, "x");
+                    if (op.type == OpType::LEA)
+                        ir.set_addr(n, cdgnx::Addr::reg("rbp").off(-8));
+                    /* a function of one parameter, for PARAM */
+                    NodeId root = n;
+                    if (op.type != OpType::ROOT)
+                    {
+                        root = ir.make(OpType::ROOT, { n }, cdgnx::Signature{ 1 }.pack());
+                        ir.set_name(root, "f");
+                    }
+
+                    const std::string code = backend.generate(ir, root);
+                    if (op.name.empty() || code.find("nop") != std::string::npos)
+                        return false;
+                }
+            }
+
+            return cdgnx::op_info(OpType::FADD).commutative && !cdgnx::op_info(OpType::IDIV).pure() &&
+                   cdgnx::op_info(OpType::CALL).effects && cdgnx::op_info(OpType::MOV).operands(2) == 1;
+        }
+    );
+
+    suite.add_check(
+        "vector_ops",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::Lane;
+            using cdgnx::VecType;
+            using Options = cdgnx::backend::x86_64::Options;
+
+            alignas(32) static int32_t a[8] = { 1, -2, 3, -4, 5, -6, 7, -8 };
+            alignas(32) static int32_t b[8] = { 9, 9, -9, -9, 2, 2, -2, -2 };
+            alignas(32) static int64_t out[4];
+
+            /* sum(min(a, b) * a) and out = a + splat(n), i64 min/mul and SSE2 i32 mul take the lane-by-lane path */
+            const auto run = [](const Options &opts, const VecType v) -> int64_t
+            {
+                cdgnx::IR ir;
+                const auto at = [&](const void *p) { return ir.num(reinterpret_cast<int64_t>(p)); };
+                const NodeId x = ir.vec(OpType::VLOAD, v, { at(a) });
+                const NodeId m = ir.vec(OpType::VMIN, v, { x, ir.vec(OpType::VLOAD, v, { at(b) }) });
+                const NodeId p = ir.vec(OpType::VMUL, v, { m, ir.vec(OpType::VLOAD, v, { at(a) }) });
+                const NodeId s = ir.vec(OpType::VSTORE, v, {
+                    at(out), ir.vec(OpType::VADD, v, { ir.vec(OpType::VLOAD, v, { at(a) }), ir.vec(OpType::VSPLAT, v, { ir.num(10) }) })
+                });
+                const NodeId root = ir.make(OpType::ROOT, { s, ir.make(OpType::RET, { ir.vec(OpType::VSUM, v, { p }) }) });
+                ir.set_name(root, "f");
+                return cdgnx::Jit(opts).compile<int64_t (*)()>(ir, root)();
+            };
+
+            for (const bool avx2: { false, true })
+            {
+                if (avx2 && !__builtin_cpu_supports("avx2"))
+                    continue;
+
+                for (const auto mode: { cdgnx::backend::x86_64::Alloc::stack, cdgnx::backend::x86_64::Alloc::regs })
+                {
+                    Options opts;
+                    opts.alloc = mode;
+                    opts.avx2 = avx2;
+                    for (const uint8_t bytes: { 16, 32 })
+                    {
+                        if (bytes == 32 && !avx2)
+                            continue;
+
+                        for (const Lane lane: { Lane::i32, Lane::i64 })
+                        {
+                            /* an i64 lane is two of the i32 elements; products and the sum wrap like the vector code */
+                            const VecType v{ lane, bytes };
+                            const auto element = [lane](const int32_t *p, const uint32_t i)
+                            {
+                                int64_t x = p[i];
+                                if (lane == Lane::i64)
+                                    std::memcpy(&x, p + 2 * i, sizeof x);
+                                return x;
+                            };
+                            uint64_t want = 0;
+                            for (uint32_t i = 0; i < v.lanes(); ++i)
+                            {
+                                const int64_t x = element(a, i);
+                                const uint64_t product = static_cast<uint64_t>(std::min(x, element(b, i))) * static_cast<uint64_t>(x);
+                                want += lane == Lane::i32 ? static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(product))) : product;
+                            }
+                            if (run(opts, v) != static_cast<int64_t>(want))
+                                return false;
+
+                            const int64_t first = element(a, 0) + 10;
+                            if ((lane == Lane::i32 ? static_cast<int32_t>(out[0]) : out[0]) != first)
+                                return false;
+                        }
+                    }
+                }
+            }
+
+            /* a LEA address is the memory operand; ymm code clears the upper halves before leaving */
+            cdgnx::IR ir;
+            const NodeId slot = ir.make(OpType::LEA);
+            ir.set_addr(slot, cdgnx::Addr::reg("rbp").off(-32));
+            const VecType wide{ Lane::f64, 32 };
+            const NodeId root = ir.make(OpType::ROOT, {
+                ir.vec(OpType::VSTORE, wide, { slot, ir.vec(OpType::VSPLAT, wide, { ir.num(std::bit_cast<int64_t>(1.5)) }) }),
+                ir.make(OpType::RET)
+            });
+            ir.set_name(root, "g");
+
+            Options opts;
+            opts.alloc = cdgnx::backend::x86_64::Alloc::regs;
+            opts.avx2 = true;
+            const std::string code = cdgnx::backend::x86_64(opts).generate(ir, root);
+            if (code.find("vmovdqu %ymm") == std::string::npos || code.find("-32(%rbp)") == std::string::npos
+                || code.find("vzeroupper") == std::string::npos)
+                return false;
+
+            try
+            {
+                cdgnx::backend::x86_64().generate(ir, root);
+                return false;
+            }
+            catch (const std::invalid_argument &)
+            {
+                return true;
+            }
+        }
+    );
+
+    suite.add_check(
+        "fp_path",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            /* f() = 0.25 + fmod(-7.5, 2.0 + 0.25) with the left sum live across the fmod call */
+            cdgnx::IR ir;
+            const NodeId rem = ir.make(OpType::FMOD, { ir.fnum(-7.5), ir.make(OpType::FADD, { ir.fnum(2.0), ir.fnum(0.25) }) });
+            const NodeId f = ir.make(OpType::ROOT, {
+                ir.make(OpType::RET, { ir.make(OpType::FADD, { ir.make(OpType::FADD, { ir.fnum(0.25), ir.num(0) }), rem }) })
+            });
+            ir.set_name(f, "f");
+
+            /* g() = 1 if 3.0 - 0.5 == 2.0 + 0.5 */
+            const NodeId g = ir.make(OpType::ROOT, {
+                ir.make(OpType::FCMP, {
+                    ir.make(OpType::FSUB, { ir.fnum(3.0), ir.fnum(0.5) }), ir.make(OpType::FADD, { ir.fnum(2.0), ir.fnum(0.5) })
+                }),
+                ir.label(OpType::JE, ".Lsame"),
+                ir.make(OpType::RET, { ir.num(0) }),
+                ir.label(OpType::LABEL, ".Lsame"),
+                ir.make(OpType::RET, { ir.num(1) })
+            });
+            ir.set_name(g, "g");
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                cdgnx::Jit jit(opts);
+                if (std::bit_cast<double>(jit.compile<int64_t (*)()>(ir, f)()) != 0.25 + std::fmod(-7.5, 2.25) ||
+                    jit.compile<int64_t (*)()>(ir, g)() != 1)
+                    return false;
+
+                /* constants come from .rodata, once per value, loaded straight into xmm registers in register mode */
+                const std::string code = cdgnx::backend::x86_64(opts).generate(ir, g);
+                if (code.find("fprem") != std::string::npos || code.find(".LD2:") == std::string::npos || code.find(".LD3") != std::string::npos ||
+                    code.find(".quad " + std::to_string(std::bit_cast<int64_t>(0.5))) == std::string::npos)
+                    return false;
+                if (mode == Alloc::regs && (code.find("movsd .LD0(%rip), %xmm") == std::string::npos || code.find("movq %rsi, %xmm") != std::string::npos))
+                    return false;
+            }
+
+            /* equal constants share one .LD across a module */
+            cdgnx::Module m;
+            for (const char *name: { "a", "b" })
+            {
+                const NodeId root = m.ir.make(OpType::ROOT, { m.ir.make(OpType::RET, { m.ir.fnum(1.5) }) });
+                m.ir.set_name(root, name);
+                m.add(root);
+            }
+            const std::string text = cdgnx::backend::x86_64().generate_module(m, 2);
+            return text.find(".LD0:") != std::string::npos && text.find(".LD1") == std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "code_cache",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::backend::CodeCache;
+            using Options = cdgnx::backend::x86_64::Options;
+
+            /* the same body under different names, one calling itself, plus variants of value, address and string */
+            cdgnx::Module m;
+            cdgnx::IR &g = m.ir;
+            const auto make = [&](const std::string &name, const std::string &callee, const int64_t v, const int64_t off, const char *str)
+            {
+                const NodeId slot = g.make(OpType::LEA);
+                g.set_addr(slot, cdgnx::Addr::reg("rbp").off(off));
+                const NodeId call = g.make(OpType::CALL, { g.num(v) });
+                g.set_name(call, callee);
+                const NodeId root = g.make(OpType::ROOT, {
+                    g.make(OpType::MOV, { slot, g.str(str) }),
+                    g.make(OpType::RET, { g.make(OpType::IADD, { call, g.num(v) }) })
+                });
+                g.set_name(root, name);
+                m.add(root);
+                return root;
+            };
+            const NodeId a = make("a", "host", 1, -8, "x");
+            const NodeId b = make("b", "host", 1, -8, "x");
+            const NodeId ra = make("ra", "ra", 1, -8, "x");
+            const NodeId rb = make("rb", "rb", 1, -8, "x");
+            const NodeId other[] = { make("c", "host", 2, -8, "x"), make("d", "host", 1, -16, "x"), make("e", "host", 1, -8, "y"), make("f", "a", 1, -8, "x") };
+
+            using cdgnx::structural_hash;
+            if (structural_hash(g, a) != structural_hash(g, b) || structural_hash(g, ra) != structural_hash(g, rb) ||
+                structural_hash(g, a) == structural_hash(g, ra))
+                return false;
+            for (const NodeId o: other)
+            {
+                if (structural_hash(g, o) == structural_hash(g, a))
+                    return false;
+            }
+
+            /* a hit gives the same listing as lowering from scratch, threads or not */
+            CodeCache cache;
+            Options opts;
+            opts.alloc = cdgnx::backend::x86_64::Alloc::regs;
+            const std::string plain = cdgnx::backend::x86_64(opts).generate_module(m, 4);
+            opts.cache = &cache;
+            cdgnx::backend::x86_64 cached(opts);
+            if (cached.generate_module(m, 4) != plain || cached.generate_module(m, 1) != plain || cache.size() != 6 ||
+                cache.hits() + cache.misses() != 16 || cache.hits() < 8)
+                return false;
+
+            /* other options do not hit, and a hit renames the function for the JIT */
+            const uint64_t hits = cache.hits();
+            Options stack = opts;
+            stack.alloc = cdgnx::backend::x86_64::Alloc::stack;
+            cdgnx::Jit jit(stack);
+            jit.define("host", reinterpret_cast<void *>(&host_two));
+            const auto fa = jit.compile<int64_t (*)()>(g, a);
+            const auto fb = jit.compile<int64_t (*)()>(g, b);
+            if (fa() != 3 || fb() != 3 || fa == fb || cache.hits() != hits + 1 || cache.size() != 7)
+                return false;
+
+            /* the budget holds, oldest entries go first */
+            CodeCache small(cache.bytes() / 3);
+            opts.cache = &small;
+            cdgnx::backend::x86_64 tight(opts);
+            tight.generate_module(m, 1);
+            tight.generate(g, a);
+            if (small.evictions() == 0 || small.bytes() > cache.bytes() / 3 || small.size() >= 6)
+                return false;
+
+            /* the second hash and the size tell apart what the first one does not */
+            const cdgnx::Fingerprint fa_print = cdgnx::fingerprint(g, a);
+            const cdgnx::Fingerprint fb_print = cdgnx::fingerprint(g, b);
+            const cdgnx::Fingerprint fc_print = cdgnx::fingerprint(g, other[0]);
+            if (fa_print.hash != structural_hash(g, a) || fa_print.check != fb_print.check || fa_print.nodes != fb_print.nodes ||
+                fa_print.check == fc_print.check || fa_print.check == fa_print.hash || fa_print.nodes != 9)
+                return false;
+
+            /* a key that collides on the hash alone is a miss, and does not take over the slot */
+            CodeCache colliding;
+            CodeCache::Entry e;
+            e.fn = 7;
+            colliding.insert({ 1, 2, 3 }, e);
+            colliding.insert({ 1, 5, 3 }, CodeCache::Entry{});
+            CodeCache::Entry out;
+            return !colliding.find({ 1, 5, 3 }, out) && !colliding.find({ 1, 2, 4 }, out) && colliding.find({ 1, 2, 3 }, out) && out.fn == 7 &&
+                   colliding.misses() == 2 && colliding.size() == 1;
+        }
+    );
+
+    suite.add_check(
+        "incremental",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using X = cdgnx::backend::x86_64;
+
+            for (const X::Alloc alloc: { X::Alloc::stack, X::Alloc::regs })
+            {
+                cdgnx::IR g;
+                const NodeId slot = g.make(OpType::LEA);
+                g.set_addr(slot, cdgnx::Addr::reg("rbp").off(-8));
+                const NodeId sum = g.make(OpType::IADD, { g.num(2), g.num(3) });
+                const NodeId root = g.make(OpType::ROOT, {
+                    g.make(OpType::PUSH, { g.str("a") }),
+                    g.label(OpType::LABEL, "top"),
+                    g.make(OpType::PUSH, { sum }),
+                    g.make(OpType::MOV, { slot, g.str("b") }),
+                    g.make(OpType::RET, { g.fnum(0.5) })
+                });
+                g.set_name(root, "f");
+
+                X::Options opts;
+                opts.alloc = alloc;
+                X backend(opts);
+                X::Unit u;
+                const std::string first = backend.generate(g, root, u);
+                if (u.lowered != 5 || backend.generate(g, root, u) != first || u.reused != 5 || u.lowered != 0)
+                    return false;
+
+                /* an edit deep in one statement lowers that statement only */
+                const uint32_t kept = g.stamp(g.kid(root, 3));
+                const uint32_t before = g.stamp(root);
+                g.set_const(g.kid(sum, 1), 40);
+                if (g.stamp(root) == before || g.stamp(g.kid(root, 3)) != kept)
+                    return false;
+
+                X::Unit scratch;
+                const std::string edited = backend.generate(g, root, u);
+                if (u.lowered != 1 || edited != X(opts).generate(g, root, scratch) || edited.find("$40") == std::string::npos)
+                    return false;
+
+                /* strings and constants keep their names, new ones are added after them */
+                g.set_kid(root, 0, g.make(OpType::PUSH, { g.str("c") }));
+                const std::string swapped = backend.generate(g, root, u);
+                if (u.lowered != 1 || swapped.find(".LC1:\n.string \"b\"") == std::string::npos ||
+                    swapped.find(".LC2:\n.string \"c\"") == std::string::npos || swapped.find(".LD0:") == std::string::npos)
+                    return false;
+            }
+            return true;
+        }
+    );
+
+    suite.add_check(
+        "sysv_calls",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::Signature;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                cdgnx::IR ir;
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                cdgnx::Jit jit(opts);
+                jit.define("digits", reinterpret_cast<void *>(&host_digits));
+                jit.define("mix", reinterpret_cast<void *>(&host_mix));
+                jit.define("misaligned", reinterpret_cast<void *>(&host_misaligned));
+
+                /* rev(a..h) = digits(h, g, .., a) + misaligned() * 1000, with a value pushed before the call */
+                std::vector<NodeId> args;
+                for (uint32_t i = 8; i-- > 0;)
+                    args.push_back(i % 2 ? ir.make(OpType::IADD, { ir.param(i), ir.num(0) }) : ir.param(i));
+                const NodeId digits = ir.make(OpType::CALL, args);
+                ir.set_name(digits, "digits");
+                const NodeId misaligned = ir.make(OpType::CALL);
+                ir.set_name(misaligned, "misaligned");
+                const NodeId rev = ir.make(OpType::ROOT, {
+                    ir.make(OpType::PUSH, { ir.num(1) }),
+                    ir.make(OpType::RET, { ir.make(OpType::IADD, { digits, ir.make(OpType::IMUL, { misaligned, ir.num(1000) }) }) })
+                }, Signature{ 8 }.pack());
+                ir.set_name(rev, "rev");
+
+                /* twice(x, n, y) = mix(x, n, y) * 2, doubles in and out */
+                const NodeId mix = ir.make(OpType::CALL, { ir.param(0), ir.param(1), ir.param(2) }, Signature{ 0, 0, true }.pack());
+                ir.set_name(mix, "mix");
+                const NodeId twice = ir.make(OpType::ROOT, {
+                    ir.make(OpType::RET, { ir.make(OpType::FADD, { mix, mix }) })
+                }, Signature{ 3, 0b101, true }.pack());
+                ir.set_name(twice, "twice");
+
+                const auto f = jit.compile<int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(ir, rev);
+                const auto g = jit.compile<double (*)(double, int64_t, double)>(ir, twice);
+                if (f(1, 2, 3, 4, 5, 6, 7, 8) != 12345678 || g(0.5, 3, 0.25) != 16.5)
+                    return false;
+            }
+
+            /* PARAM only exists in a function that declares it */
+            cdgnx::IR ir;
+            const NodeId bad = ir.make(OpType::ROOT, { ir.make(OpType::RET, { ir.param(1) }) }, Signature{ 1 }.pack());
+            ir.set_name(bad, "bad");
+            try
+            {
+                cdgnx::backend::x86_64().generate(ir, bad);
+            }
+            catch (const std::invalid_argument &)
+            {
+                return true;
+            }
+            return false;
+        }
+    );
+
+    suite.add_check(
+        "strength_reduction",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using X = cdgnx::backend::x86_64;
+
+            const int64_t divisors[] = { 1, -1, 2, -2, 3, 5, -6, 7, -7, 10, 25, 641, -1000, 1 << 20, -(int64_t{ 1 } << 40),
+                                         (int64_t{ 1 } << 40) + 1, INT64_MAX, INT64_MIN };
+            const int64_t xs[] = { 0, 1, -1, 6, -7, 99, -100, 1 << 21, -(1 << 21) - 1, INT64_MAX, INT64_MIN + 1 };
+
+            for (const X::Alloc alloc: { X::Alloc::stack, X::Alloc::regs })
+            {
+                X::Options opts;
+                opts.alloc = alloc;
+                opts.reduce = true;
+                cdgnx::Jit jit(opts);
+                for (const int64_t d: divisors)
+                {
+                    for (const OpType t: { OpType::IMUL, OpType::IDIV, OpType::IMOD })
+                    {
+                        /* f(x) = x op d, with d on the left of the multiply for even d */
+                        cdgnx::IR ir;
+                        const NodeId x = ir.make(OpType::IADD, { ir.param(0), ir.num(0) });
+                        const NodeId e = t == OpType::IMUL && d % 2 == 0 ? ir.make(t, { ir.num(d), x }) : ir.make(t, { x, ir.num(d) });
+                        const NodeId root = ir.make(OpType::ROOT, { ir.make(OpType::RET, { e }) }, cdgnx::Signature{ 1 }.pack());
+                        const std::string name = "f" + std::to_string(static_cast<int>(t)) + "_" + std::to_string(d);
+                        ir.set_name(root, name);
+
+                        if (X(opts).generate(ir, root).find("idivq") != std::string::npos)
+                            return false;
+
+                        const auto f = jit.compile<int64_t (*)(int64_t)>(ir, root);
+                        for (const int64_t v: xs)
+                        {
+                            const uint64_t product = static_cast<uint64_t>(v) * static_cast<uint64_t>(d);
+                            const int64_t want = t == OpType::IMUL ? static_cast<int64_t>(product) : t == OpType::IDIV ? v / d : v % d;
+                            if (f(v) != want)
+                                return false;
+                        }
+                    }
+                }
+            }
+
+            /* every divisor up to 4096 and around the powers of two, against the same IR lowered without reduce */
+            std::vector<int64_t> wide;
+            for (int64_t d = -4096; d <= 4096; ++d)
+            {
+                if (d != 0)
+                    wide.push_back(d);
+            }
+            for (int k = 12; k < 63; ++k)
+            {
+                for (const int64_t d: { (int64_t{ 1 } << k) - 1, int64_t{ 1 } << k, (int64_t{ 1 } << k) + 1 })
+                {
+                    wide.push_back(d);
+                    wide.push_back(-d);
+                }
+            }
+            wide.push_back(INT64_MAX);
+            wide.push_back(INT64_MIN);
+
+            /* f(x, out) stores x * d, x / d and x % d for a chunk of the divisors */
+            constexpr size_t CHUNK = 128;
+            using F = void (*)(int64_t, int64_t *);
+            for (const X::Alloc alloc: { X::Alloc::stack, X::Alloc::regs })
+            {
+                X::Options plain;
+                plain.alloc = alloc;
+                X::Options reduced = plain;
+                reduced.reduce = true;
+                cdgnx::Jit slow(plain);
+                cdgnx::Jit fast(reduced);
+                for (size_t first = 0; first < wide.size(); first += CHUNK)
+                {
+                    const size_t n = std::min(CHUNK, wide.size() - first);
+                    cdgnx::IR ir;
+                    std::vector<NodeId> stores;
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        const int64_t d = wide[first + i];
+                        for (const OpType t: { OpType::IMUL, OpType::IDIV, OpType::IMOD })
+                        {
+                            const NodeId x = ir.make(OpType::IADD, { ir.param(0), ir.num(0) });
+                            const NodeId e = t == OpType::IMUL && d % 2 == 0 ? ir.make(t, { ir.num(d), x }) : ir.make(t, { x, ir.num(d) });
+                            const auto at = static_cast<int64_t>(8 * stores.size());
+                            stores.push_back(ir.make(OpType::STORE, { ir.make(OpType::IADD, { ir.param(1), ir.num(at) }), e }));
+                        }
+                    }
+                    const NodeId root = ir.make(OpType::ROOT, stores, cdgnx::Signature{ 2 }.pack());
+                    ir.set_name(root, "wide" + std::to_string(first));
+
+                    const F want = slow.compile<F>(ir, root);
+                    const F got = fast.compile<F>(ir, root);
+                    std::vector<int64_t> a(stores.size());
+                    std::vector<int64_t> b(stores.size());
+                    for (const int64_t v: xs)
+                    {
+                        want(v, a.data());
+                        got(v, b.data());
+                        if (a != b)
+                            return false;
+                    }
+                }
+            }
+            return true;
+        }
+    );
+
+    suite.add_check(
+        "compare_branch",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::Cond;
+            using cdgnx::Compare;
+            using cdgnx::Signature;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                cdgnx::IR ir;
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                cdgnx::Jit jit(opts);
+
+                /* below(a, b) = a < b unsigned, as BR ... else */
+                const NodeId below = ir.make(OpType::ROOT, {
+                    ir.branch({ OpType::ICMP, Cond::ult }, ir.param(0), ir.param(1), "yes", "no"),
+                    ir.make(OpType::RET, { ir.num(7) }),
+                    ir.label(OpType::LABEL, "yes"),
+                    ir.make(OpType::RET, { ir.num(1) }),
+                    ir.label(OpType::LABEL, "no"),
+                    ir.make(OpType::RET, { ir.num(0) })
+                }, Signature{ 2 }.pack());
+                ir.set_name(below, "below");
+
+                /* le(x, y) = (x <= y) + 2 * (x == y), NaN compares false */
+                const auto set = [&](const Cond c)
+                {
+                    return ir.make(OpType::SET, { ir.param(0), ir.param(1) }, Compare{ OpType::FCMP, c }.pack());
+                };
+                const NodeId le = ir.make(OpType::ROOT, {
+                    ir.make(OpType::RET, { ir.make(OpType::IADD, { set(Cond::le), ir.make(OpType::IMUL, { set(Cond::eq), ir.num(2) }) }) })
+                }, Signature{ 2, 0b11 }.pack());
+                ir.set_name(le, "le");
+
+                /* lt(x, y) written the old way, FCMP then JL */
+                const NodeId lt = ir.make(OpType::ROOT, {
+                    ir.make(OpType::FCMP, { ir.param(0), ir.param(1) }),
+                    ir.label(OpType::JL, "yes"),
+                    ir.label(OpType::JMP, "no"),
+                    ir.label(OpType::LABEL, "yes"),
+                    ir.make(OpType::RET, { ir.num(1) }),
+                    ir.label(OpType::LABEL, "no"),
+                    ir.make(OpType::RET, { ir.num(0) })
+                }, Signature{ 2, 0b11 }.pack());
+                ir.set_name(lt, "lt");
+                if (cdgnx::Fuse().run(ir, lt) != 2 || ir[ir.kid(lt, 0)].type != OpType::BR || ir.kid(lt, 1) != cdgnx::NONE)
+                    return false;
+
+                const auto f = jit.compile<int64_t (*)(int64_t, int64_t)>(ir, below);
+                const auto g = jit.compile<int64_t (*)(double, double)>(ir, le);
+                const auto h = jit.compile<int64_t (*)(double, double)>(ir, lt);
+                const double nan = std::nan("");
+                if (f(1, 2) != 1 || f(-1, 2) != 0 || f(2, 2) != 0)
+                    return false;
+                if (g(1, 2) != 1 || g(2, 2) != 3 || g(3, 2) != 0 || g(nan, nan) != 0 || g(nan, 1) != 0)
+                    return false;
+                if (h(1, 2) != 1 || h(2, 1) != 0 || h(nan, 1) != 0 || h(1, nan) != 0)
+                    return false;
+            }
+
+            /* the compare sits right before its jump */
+            cdgnx::IR ir;
+            const NodeId root = ir.make(OpType::ROOT, {
+                ir.make(OpType::ICMP, { ir.num(1), ir.num(2) }),
+                ir.label(OpType::JGE, "out"),
+                ir.label(OpType::LABEL, "out")
+            });
+            cdgnx::Fuse().run(ir, root);
+            cdgnx::backend::x86_64::Options opts;
+            opts.alloc = Alloc::regs;
+            const std::string code = cdgnx::backend::x86_64(opts).generate(ir, root);
+            return code.find("cmpq %rdi, %rsi\n    jge out\n") != std::string::npos;
+        }
+    );
+
+    suite.add_check(
+        "cfg_cleanup",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::NONE;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                cdgnx::IR ir;
+                const auto slot = [&](const int64_t off)
+                {
+                    const NodeId lea = ir.make(OpType::LEA);
+                    ir.set_addr(lea, cdgnx::Addr::reg("rbp").off(off));
+                    return lea;
+                };
+                const auto store = [&](const int64_t off, const NodeId v) { return ir.make(OpType::MOV, { slot(off), v }); };
+
+                /* f(x) = 42 behind a jump chain, with dead code and dead stores around it */
+                const NodeId f = ir.make(OpType::ROOT, {
+                    ir.label(OpType::JMP, "a"),
+                    ir.label(OpType::LABEL, "dead"),
+                    ir.make(OpType::RET, { ir.num(99) }),
+                    ir.label(OpType::LABEL, "a"),
+                    ir.label(OpType::JMP, "b"),
+                    ir.label(OpType::LABEL, "b"),
+                    store(-8, ir.make(OpType::IMUL, { ir.param(0), ir.num(3) })),
+                    store(-8, ir.num(41)),
+                    ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.make(OpType::LOAD, { slot(-8) }), ir.num(1) }) }),
+                    store(-8, ir.num(1))
+                }, cdgnx::Signature{ 1 }.pack());
+                ir.set_name(f, "f");
+
+                cdgnx::Cfg cfg;
+                if (!cfg.build(ir, f) || cfg.blocks().size() != 5 || cfg.order().size() != 3)
+                    return false;
+                if (cfg.blocks()[0].succs != std::vector<uint32_t>{ 2 } || cfg.blocks()[3].preds != std::vector<uint32_t>{ 2 })
+                    return false;
+                if (cfg.reachable(1) || cfg.reachable(4) || !cfg.blocks()[3].exits || cfg.block_of(4) != 2)
+                    return false;
+
+                /* JMP a goes straight to b, JMP b falls through */
+                if (cdgnx::Thread().run(ir, f) != 1 || ir.name(ir.kid(f, 0)) != "b" || ir.kid(f, 4) != NONE)
+                    return false;
+
+                /* the first block, the store after RET and the label a */
+                if (cdgnx::Unreachable().run(ir, f) != 7 || ir.kid(f, 1) != NONE || ir.kid(f, 3) != NONE || ir.kid(f, 9) != NONE)
+                    return false;
+                if (ir.kid(f, 5) == NONE)
+                    return false;
+
+                /* the IMUL is stored over before the LOAD */
+                if (cdgnx::DeadStore().run(ir, f) != 5 || ir.kid(f, 6) != NONE || ir.kid(f, 7) == NONE)
+                    return false;
+
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                const std::string code = cdgnx::backend::x86_64(opts).generate(ir, f);
+                size_t rets = 0;
+                for (size_t at = code.find("ret\n"); at != std::string::npos; at = code.find("ret\n", at + 1))
+                    ++rets;
+                if (rets != 1)
+                    return false;
+
+                cdgnx::Jit jit(opts);
+                const auto fn = jit.compile<int64_t (*)(int64_t)>(ir, f);
+                if (fn(5) != 42)
+                    return false;
+            }
+
+            /* a store below rbp is dead once the function returns, but not in an unframed ROOT */
+            cdgnx::IR ir;
+            const auto frame = [&](const std::string_view name)
+            {
+                const NodeId lea = ir.make(OpType::LEA);
+                ir.set_addr(lea, cdgnx::Addr::reg("rbp").off(-16));
+                const NodeId n = ir.make(OpType::ROOT, { ir.make(OpType::MOV, { lea, ir.num(3) }), ir.make(OpType::RET, { ir.num(7) }) });
+                ir.set_name(n, name);
+                return cdgnx::DeadStore().run(ir, n);
+            };
+            if (frame("g") != 3 || frame("") != 0)
+                return false;
+
+            /* a JMP inside a nested ROOT makes the graph inexact and the passes stay out */
+            const NodeId root = ir.make(OpType::ROOT, {
+                ir.make(OpType::ROOT, { ir.label(OpType::JMP, "x") }),
+                ir.make(OpType::RET, { ir.num(0) }),
+                ir.label(OpType::LABEL, "x")
+            });
+            cdgnx::Cfg cfg;
+            return !cfg.build(ir, root) && cdgnx::Unreachable().run(ir, root) == 0 && ir.kid(root, 2) != NONE;
+        }
+    );
+
+    suite.add_check(
+        "tree_patterns",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using X = cdgnx::backend::x86_64;
+
+            /* f(p, i): p[2] = 5; p[i] += 1; return p[1] + 5 */
+            cdgnx::IR ir;
+            const auto at = [&ir]() { return ir.make(OpType::IADD, { ir.param(0), ir.make(OpType::IMUL, { ir.param(1), ir.num(8) }) }); };
+            const NodeId root = ir.make(OpType::ROOT, {
+                ir.make(OpType::STORE, { ir.make(OpType::IADD, { ir.param(0), ir.num(16) }), ir.num(5) }),
+                ir.make(OpType::STORE, { at(), ir.make(OpType::IADD, { ir.make(OpType::LOAD, { at() }), ir.num(1) }) }),
+                ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.make(OpType::LOAD, { ir.make(OpType::IADD, { ir.param(0), ir.num(8) }) }), ir.num(5) }) })
+            }, cdgnx::Signature{ 2 }.pack());
+            ir.set_name(root, "f");
+
+            X::Options opts;
+            opts.alloc = X::Alloc::regs;
+            opts.select = true;
+            const std::string code = X(opts).generate(ir, root);
+            for (const char *want: { "movq $5, 16(%", "addq $1, (%rsi,%rdi,8)\n", "movq 8(%", "addq $5, %" })
+            {
+                if (code.find(want) == std::string::npos)
+                    return false;
+            }
+            if (code.find("imulq") != std::string::npos)
+                return false;
+
+            for (const bool select: { false, true })
+            {
+                opts.select = select;
+                cdgnx::Jit jit(opts);
+                int64_t p[4] = { 10, 20, 30, 40 };
+                if (jit.compile<int64_t (*)(int64_t *, int64_t)>(ir, root)(p, 3) != 25 || p[2] != 5 || p[3] != 41)
+                    return false;
+            }
+            return true;
+        }
+    );
+
+    suite.add_check(
+        "elf_object",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+
+            /* twice(x) = 2x, greet() = puts("hi"), twice(21) */
+            cdgnx::Module m;
+            cdgnx::IR &ir = m.ir;
+            const NodeId twice = ir.make(OpType::ROOT, {
+                ir.make(OpType::RET, { ir.make(OpType::IMUL, { ir.param(0), ir.num(2) }) })
+            }, cdgnx::Signature{ 1 }.pack());
+            ir.set_name(twice, "twice");
+            const NodeId puts = ir.make(OpType::CALL, { ir.str("hi") });
+            ir.set_name(puts, "puts");
+            const NodeId call = ir.make(OpType::CALL, { ir.num(21) });
+            ir.set_name(call, "twice");
+            const NodeId greet = ir.make(OpType::ROOT, { puts, ir.make(OpType::POP), ir.make(OpType::RET, { call }) });
+            ir.set_name(greet, "greet");
+            m.add(greet);
+            m.add(twice);
+
+            cdgnx::backend::x86_64 backend;
+            cdgnx::Buffer one, many;
+            backend.write_object(m, one, 1);
+            backend.write_object(m, many, 4);
+            const std::string elf = one.str();
+            if (elf != many.str() || elf.compare(0, 4, "\x7f" "ELF") != 0 || elf[4] != 2 || elf[5] != 1)
+                return false;
+
+            const auto le = [&elf](const size_t at, const size_t bytes)
+            {
+                uint64_t v = 0;
+                for (size_t i = 0; i < bytes; ++i)
+                    v |= uint64_t{ static_cast<uint8_t>(elf[at + i]) } << (8 * i);
+                return v;
+            };
+            if (le(16, 2) != 1 || le(18, 2) != 62)
+                return false;
+
+            /* section headers by name */
+            const uint64_t shoff = le(40, 8);
+            const uint64_t count = le(60, 2);
+            const uint64_t names = le(shoff + le(62, 2) * 64 + 24, 8);
+            const auto section = [&](const std::string_view name) -> uint64_t
+            {
+                for (uint64_t i = 0; i < count; ++i)
+                    if (std::string_view(elf.data() + names + le(shoff + i * 64, 4)) == name)
+                        return shoff + i * 64;
+                return 0;
+            };
+            const uint64_t text = section(".text");
+            const uint64_t rela = section(".rela.text");
+            const uint64_t symtab = section(".symtab");
+            const uint64_t strtab = section(".strtab");
+            if (!text || !rela || !symtab || !strtab || !section(".rodata") || !section(".note.GNU-stack"))
+                return false;
+
+            /* greet, puts and twice are global; twice is a function and puts undefined */
+            std::vector<std::string> globals;
+            const uint64_t syms = le(symtab + 24, 8);
+            for (uint64_t at = syms + le(symtab + 44, 4) * 24; at < syms + le(symtab + 32, 8); at += 24)
+            {
+                const std::string name(elf.data() + le(strtab + 24, 8) + le(at, 4));
+                const uint64_t info = le(at + 4, 1);
+                const uint64_t shndx = le(at + 6, 2);
+                if (name == "twice" && (info != 0x12 || shndx == 0 || le(at + 16, 8) == 0))
+                    return false;
+                if (name == "puts" && (info != 0x10 || shndx != 0))
+                    return false;
+                globals.push_back(name);
+            }
+            if (globals != std::vector<std::string>{ "greet", "puts", "twice" })
+                return false;
+
+            /* the string load is PC32 against .rodata, both calls PLT32 */
+            std::vector<uint64_t> types;
+            const uint64_t relas = le(rela + 24, 8);
+            for (uint64_t at = relas; at < relas + le(rela + 32, 8); at += 24)
+                types.push_back(le(at + 8, 4));
+            return types == std::vector<uint64_t>{ 2, 4, 4 } && le(text + 48, 8) == 16;
+        }
+    );
+
+    suite.add_check(
+        "const_pool",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::backend::ConstPool;
+            using Kind = ConstPool::Kind;
+
+            /* equal entries share an id, a tail shares its host's bytes, vectors come first at their alignment */
+            ConstPool pool;
+            const uint32_t hello = pool.str("hello");
+            const uint32_t llo = pool.str("llo");
+            if (pool.str("hello") != hello || pool.str("o") != 2 || pool.quad(42) != 0 || pool.quad(42) != 0 || pool.quad(-1) != 1)
+                return false;
+            const std::string v16(16, 'a'), v32(32, 'b');
+            pool.vec(v16);
+            pool.vec(v32);
+
+            ConstPool::Layout l;
+            pool.layout(l);
+            std::vector<uint8_t> bytes;
+            pool.bytes(l, bytes);
+            if (l.align != 32 || l.offsets[2] != std::vector<uint32_t>{ 32, 0 } || l.offsets[1] != std::vector<uint32_t>{ 48, 56 } ||
+                l.offsets[0][llo] != l.offsets[0][hello] + 2 || l.offsets[0][2] != l.offsets[0][hello] + 4 || l.size != 64 + 6 ||
+                bytes.size() != l.size || std::string(bytes.begin() + 64, bytes.end()) != std::string("hello", 6))
+                return false;
+
+            cdgnx::Buffer text;
+            pool.print(text);
+            if (text.str().find(".LC0:\n.ascii \"he\"\n.LC1:\n.ascii \"ll\"\n.LC2:\n.string \"o\"\n") == std::string::npos ||
+                pool(Kind::vec, 1) != v32)
+                return false;
+
+            cdgnx::Buffer escaped;
+            cdgnx::backend::escape("a\"b\\\n\001\t7", escaped);
+            if (escaped.str() != "a\\\"b\\\\\\n\\001\\t7")
+                return false;
+
+            /* one literal used twice and a splat of a constant, per function */
+            for (const auto alloc: { cdgnx::backend::x86_64::Alloc::stack, cdgnx::backend::x86_64::Alloc::regs })
+            {
+                cdgnx::IR ir;
+                const cdgnx::VecType v{ cdgnx::Lane::i32, 16 };
+                const NodeId splat = ir.vec(OpType::VSUM, v, { ir.vec(OpType::VSPLAT, v, { ir.num(7) }) });
+                const NodeId first = ir.make(OpType::CALL, { ir.str("say \"hi\"\n") });
+                const NodeId second = ir.make(OpType::CALL, { ir.str("say \"hi\"\n") });
+                ir.set_name(first, "len");
+                ir.set_name(second, "len");
+                const NodeId root = ir.make(OpType::ROOT, {
+                    ir.make(OpType::RET, { ir.make(OpType::IADD, { ir.make(OpType::IADD, { first, second }), splat }) })
+                });
+                ir.set_name(root, "f");
+
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = alloc;
+                const std::string code = cdgnx::backend::x86_64(opts).generate(ir, root);
+                if (code.find(".LC0:\n.string \"say \\\"hi\\\"\\n\"\n") == std::string::npos || code.find(".LC1") != std::string::npos ||
+                    code.find("movdqu .LV0(%rip), %xmm") == std::string::npos || code.find(".section .rodata\n.align 16\n.LV0:\n") == std::string::npos)
+                    return false;
+
+                cdgnx::Jit jit(opts);
+                jit.define("len", reinterpret_cast<void *>(+[](const char *s) -> int64_t { return static_cast<int64_t>(std::strlen(s)); }));
+                if (jit.compile<int64_t (*)()>(ir, root)() != 2 * 9 + 4 * 7)
+                    return false;
+            }
+            return true;
+        }
+    );
+
+    suite.add_check(
+        "interpreter",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::Cond;
+            using cdgnx::Signature;
+
+            cdgnx::Module m;
+            cdgnx::IR &g = m.ir;
+            const auto call = [&](const char *name, const std::initializer_list<NodeId> args)
+            {
+                const NodeId c = g.make(OpType::CALL, args);
+                g.set_name(c, name);
+                return c;
+            };
+            const auto slot = [&](const int64_t off)
+            {
+                const NodeId n = g.make(OpType::LEA);
+                g.set_addr(n, cdgnx::Addr::reg("rbp").off(off));
+                return n;
+            };
+
+            /* fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2) */
+            const NodeId fib = g.make(OpType::ROOT, {
+                g.branch({ OpType::ICMP, Cond::lt }, g.param(0), g.num(2), "small"),
+                g.make(OpType::RET, { g.make(OpType::IADD, {
+                    call("fib", { g.make(OpType::ISUB, { g.param(0), g.num(1) }) }),
+                    call("fib", { g.make(OpType::ISUB, { g.param(0), g.num(2) }) })
+                }) }),
+                g.label(OpType::LABEL, "small"),
+                g.make(OpType::RET, { g.param(0) })
+            }, Signature{ 1 }.pack());
+            g.set_name(fib, "fib");
+            m.add(fib);
+
+            /* sum(p, n, i, t) adds up n integers at p, with the index and the total in the homes of i and t */
+            const NodeId sum = g.make(OpType::ROOT, {
+                g.make(OpType::STORE, { slot(-24), g.num(0) }),
+                g.make(OpType::STORE, { slot(-32), g.num(0) }),
+                g.label(OpType::LABEL, "top"),
+                g.branch({ OpType::ICMP, Cond::ge }, g.param(2), g.param(1), "out"),
+                g.make(OpType::STORE, { slot(-32), g.make(OpType::IADD, {
+                    g.param(3), g.make(OpType::LOAD, { g.make(OpType::IADD, { g.param(0), g.make(OpType::IMUL, { g.param(2), g.num(8) }) }) })
+                }) }),
+                g.make(OpType::STORE, { slot(-24), g.make(OpType::IADD, { g.param(2), g.num(1) }) }),
+                g.label(OpType::JMP, "top"),
+                g.label(OpType::LABEL, "out"),
+                g.make(OpType::RET, { g.param(3) })
+            }, Signature{ 4 }.pack());
+            g.set_name(sum, "sum");
+            m.add(sum);
+
+            /* quot(a, b) = a / b + len("four") */
+            const NodeId quot = g.make(OpType::ROOT, {
+                g.make(OpType::RET, { g.make(OpType::IADD, { g.make(OpType::IDIV, { g.param(0), g.param(1) }), call("len", { g.str("four") }) }) })
+            }, Signature{ 2 }.pack());
+            g.set_name(quot, "quot");
+            m.add(quot);
+
+            /* pushed(a, b) = (a + b) - 7 + fib(b), reading what it pushed back through rbp below the homes */
+            const NodeId pushed = g.make(OpType::ROOT, {
+                g.make(OpType::PUSH, { g.make(OpType::IADD, { g.param(0), g.param(1) }) }),
+                g.make(OpType::PUSH, { g.num(7) }),
+                g.make(OpType::RET, { g.make(OpType::IADD, {
+                    g.make(OpType::ISUB, { g.make(OpType::LOAD, { slot(-24) }), g.make(OpType::LOAD, { slot(-32) }) }),
+                    call("fib", { g.param(1) })
+                }) })
+            }, Signature{ 2 }.pack());
+            g.set_name(pushed, "pushed");
+            m.add(pushed);
+
+            /* wild() reads outside the sandbox, poke() writes to a string */
+            const NodeId wild = g.make(OpType::ROOT, { g.make(OpType::RET, { g.make(OpType::LOAD, { g.num(64) }) }) });
+            g.set_name(wild, "wild");
+            m.add(wild);
+            const NodeId poke = g.make(OpType::ROOT, { g.make(OpType::STORE, { g.str("four"), g.num(1) }) });
+            g.set_name(poke, "poke");
+            m.add(poke);
+
+            void *len = reinterpret_cast<void *>(+[](const char *s) -> int64_t { return static_cast<int64_t>(std::strlen(s)); });
+            cdgnx::Interp in(m);
+            in.define("len", len);
+            auto *cells = static_cast<int64_t *>(in.alloc(10 * sizeof(int64_t)));
+            for (int64_t i = 0; i < 10; ++i)
+                cells[i] = i * i;
+            if (in.run("fib", 10) != 55 || in.calls("fib") != 177 || in.native("fib"))
+                return false;
+            if (in.run("sum", cells, 10, 0, 0) != 285 || in.run("quot", -7, 2) != 1)
+                return false;
+
+            /* the same as the generated code */
+            cdgnx::Jit jit;
+            jit.define("len", len);
+            const auto f = jit.compile<int64_t (*)(int64_t)>(g, fib);
+            const auto s = jit.compile<int64_t (*)(const int64_t *, int64_t, int64_t, int64_t)>(g, sum);
+            if (f(12) != in.run("fib", 12) || s(cells, 7, 0, 0) != in.run("sum", cells, 7, 0, 0))
+                return false;
+            const auto p = jit.compile<int64_t (*)(int64_t, int64_t)>(g, pushed);
+            if (in.run("pushed", 30, 5) != 33 || p(30, 5) != 33 || p(-4, 9) != in.run("pushed", -4, 9))
+                return false;
+
+            /* traps throw, and leave the interpreter usable */
+            int traps = 0;
+            for (const std::function<void()> &trap: std::initializer_list<std::function<void()> >{
+                     [&] { in.run("quot", 1, 0); },
+                     [&] { in.run("quot", INT64_MIN, -1); },
+                     [&] { in.run("wild"); },
+                     [&] { in.run("poke"); },
+                     [&] { in.run("sum", cells, int64_t{ 1 } << 20, 0, 0); }
+                 })
+            {
+                try
+                {
+                    trap();
+                }
+                catch (const std::runtime_error &)
+                {
+                    ++traps;
+                }
+            }
+            return traps == 5 && in.run("fib", 15) == 610;
+        }
+    );
+
+    suite.add_check(
+        "tier_up",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::Cond;
+            using cdgnx::Signature;
+
+            cdgnx::Module m;
+            cdgnx::IR &g = m.ir;
+            const auto call = [&](const char *name, const NodeId arg)
+            {
+                const NodeId c = g.make(OpType::CALL, { arg });
+                g.set_name(c, name);
+                return c;
+            };
+            const auto minus = [&](const int64_t k) { return g.make(OpType::ISUB, { g.param(0), g.num(k) }); };
+
+            const NodeId fib = g.make(OpType::ROOT, {
+                g.branch({ OpType::ICMP, Cond::lt }, g.param(0), g.num(2), "small"),
+                g.make(OpType::RET, { g.make(OpType::IADD, { call("fib", minus(1)), call("fib", minus(2)) }) }),
+                g.label(OpType::LABEL, "small"),
+                g.make(OpType::RET, { g.param(0) })
+            }, Signature{ 1 }.pack());
+            g.set_name(fib, "fib");
+            m.add(fib);
+
+            /* even and odd call each other, so neither is compiled */
+            for (const auto &[name, other, base]: { std::tuple{ "even", "odd", 1 }, std::tuple{ "odd", "even", 0 } })
+            {
+                const NodeId root = g.make(OpType::ROOT, {
+                    g.branch({ OpType::ICMP, Cond::eq }, g.param(0), g.num(0), "zero"),
+                    g.make(OpType::RET, { call(other, minus(1)) }),
+                    g.label(OpType::LABEL, "zero"),
+                    g.make(OpType::RET, { g.num(base) })
+                }, Signature{ 1 }.pack());
+                g.set_name(root, name);
+                m.add(root);
+            }
+
+            cdgnx::Interp::Options opts;
+            opts.tier_up = 3;
+            cdgnx::Interp in(m, opts);
+
+            /* the third call is native, and from then on the calls fib makes are not counted */
+            if (in.run("fib", 1) != 1 || in.run("fib", 1) != 1 || in.native("fib"))
+                return false;
+            if (in.run("fib", 20) != 6765 || !in.native("fib") || in.calls("fib") != 3 || in.run("fib", 30) != 832040 || in.calls("fib") != 4)
+                return false;
+            return in.run("even", 10) == 1 && in.run("odd", 7) == 1 && in.run("even", 7) == 0 && !in.native("even") && !in.native("odd");
+        }
+    );
+
+    suite.add_check(
+        "stats",
+        []() -> bool
+        {
+            using cdgnx::OpType;
+            using cdgnx::NodeId;
+            using cdgnx::backend::Stats;
+            using Alloc = cdgnx::backend::x86_64::Alloc;
+
+            /* f<k>(x) = (0 + (1 + ... (k + 1))) * h(x), nested k + 2 deep */
+            cdgnx::Module m;
+            cdgnx::IR &g = m.ir;
+            for (int k = 0; k < 6; ++k)
+            {
+                NodeId e = g.num(1);
+                for (int d = 0; d <= k; ++d)
+                    e = g.make(OpType::IADD, { g.num(d), e });
+                const NodeId h = g.make(OpType::CALL, { g.param(0) });
+                g.set_name(h, "h");
+                const NodeId root = g.make(OpType::ROOT, {
+                    g.make(OpType::RET, { g.make(OpType::IMUL, { e, h }) })
+                }, cdgnx::Signature{ 1 }.pack());
+                g.set_name(root, "f" + std::to_string(k));
+                m.add(root);
+            }
+            const NodeId f3 = m.functions()[3];
+
+            for (const Alloc mode: { Alloc::stack, Alloc::regs })
+            {
+                Stats stats;
+                cdgnx::backend::x86_64::Options opts;
+                opts.alloc = mode;
+                opts.stats = &stats;
+                cdgnx::backend::x86_64 backend(opts);
+
+                /* built with CDGNX_STATS 0 the backend leaves it alone */
+                if constexpr (!Stats::ENABLED)
+                {
+                    backend.generate(g, f3);
+                    if (!stats.functions().empty() || !stats.spans().empty())
+                        return false;
+                    continue;
+                }
+
+                /* one record per lowering, with what came out of it */
+                const std::string listing = backend.generate(g, f3);
+                const size_t text = backend.assemble(g, f3).text.size();
+                if (stats.functions().size() != 2)
+                    return false;
+                const Stats::Function &f = stats.functions()[0];
+                const auto nodes = [&f](const OpType t) { return f.nodes[static_cast<size_t>(t)]; };
+                if (f.name != "f3" || nodes(OpType::IADD) != 4 || nodes(OpType::NUM) != 5 || nodes(OpType::CALL) != 1 || f.depth != 7 ||
+                    f.listing != listing.size() || f.text != 0 || stats.functions()[1].text != text || f.cached)
+                    return false;
+
+                /* every instruction line of the listing; in stack mode the five leaves of the sum are pushed on top of rbp and x */
+                if (f.instructions != static_cast<size_t>(std::ranges::count(listing, '\n') - 5) ||
+                    (mode == Alloc::stack && f.stack != 56) || (mode == Alloc::regs && (f.allocs < 6 || f.spills != 1)))
+                    return false;
+
+                const std::vector<Stats::Span> &spans = stats.spans();
+                if (spans.size() != 5 || spans[0].phase != Stats::Phase::lower || spans[2].phase != Stats::Phase::copy ||
+                    spans[4].phase != Stats::Phase::encode || spans[4].function != 1 || stats.total(Stats::Phase::lower).calls != 2)
+                    return false;
+
+                /* a module keeps function order whatever the workers did */
+                stats.clear();
+                cdgnx::Buffer sink;
+                backend.write_object(m, sink, 4);
+                if (stats.functions().size() != 6 || stats.total(Stats::Phase::write).calls != 1 || stats.sum().nodes[static_cast<size_t>(OpType::IADD)] != 21)
+                    return false;
+                for (size_t k = 0; k < 6; ++k)
+                {
+                    if (stats.functions()[k].name != "f" + std::to_string(k) || stats.functions()[k].depth != k + 4 || !stats.functions()[k].text)
+                        return false;
+                }
+                for (const Stats::Span &s: stats.spans())
+                {
+                    if (s.thread >= 4 || (s.phase == Stats::Phase::lower) != (s.function != cdgnx::NONE))
+                        return false;
+                }
+
+                cdgnx::Buffer json, trace;
+                stats.json(json);
+                stats.trace(trace);
+                const std::string j = json.str();
+                const std::string t = trace.str();
+                if (j.find("\"write\": {\"calls\": 1,") == std::string::npos || j.find("\"name\": \"f5\", \"cached\": false, \"nodes\": {\"ROOT\": 1, \"NUM\": 7, \"IADD\": 6,") == std::string::npos ||
+                    t.find("{\"name\": \"lower\", \"cat\": \"cdgnx\", \"ph\": \"X\", \"pid\": 1, \"tid\": ") == std::string::npos ||
+                    t.find("\"args\": {\"function\": \"f0\"}") == std::string::npos)
+                    return false;
+            }
+
+            /* without Options::stats nothing is recorded, and the output is the same */
+            Stats idle;
+            cdgnx::backend::x86_64::Options opts;
+            opts.alloc = Alloc::regs;
+            const std::string plain = cdgnx::backend::x86_64(opts).generate_module(m, 2);
+            opts.stats = &idle;
+            if (cdgnx::backend::x86_64(opts).generate_module(m, 2) != plain || idle.functions().size() != (Stats::ENABLED ? 6 : 0))
+                return false;
+            idle.clear();
+            return idle.functions().empty() && idle.spans().empty();
+        }
+    );
+
     // Run all tests
     return suite.run() ? 0 : 1;
 }
\ No newline at end of file